@@ -0,0 +1,268 @@
+// WebConfig - Use a web browser to configure your application
+// Copyright (c) 2009 David McClurg <dpm@efn.org>
+// Under the MIT License, details: License.txt.
+
+// Measures moving the sample's balls, headless, from a thousand balls up
+// to a million. The old layout, a heap-allocated ball of vectors each that
+// looks up the screen size for itself, is run first; then the structure of
+// arrays in Test/Balls.h with each kernel this machine has. Reports the
+// time per frame and per ball and the speedup over the old layout, and
+// checks that every kernel leaves the balls where the scalar one does.
+// Last, the best kernel is split across 1 to N threads by JobSystem in
+// the chunks Simulation::Update uses, reporting the speedup over one
+// thread and the scaling efficiency, the speedup divided by the threads.
+//
+// usage: BallBench [most balls] [seconds per run] [most threads]
+
+#include "../Test/Balls.h"
+#include "Support/Clock.h"
+#include "Support/JobSystem.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <vector>
+
+using namespace std;
+using namespace SampleApp;
+
+static const int Width = 640;
+static const int Height = 480;
+static const int Radius = 10;
+static const float Speed = 1;
+
+// the old layout called into the graphics library for the screen size of
+// every ball; through a pointer the compiler can't see through it either
+static int GetMaxX() { return Width - 1; }
+static int GetMaxY() { return Height - 1; }
+static int (* volatile getmaxx)() = GetMaxX;
+static int (* volatile getmaxy)() = GetMaxY;
+
+/// <summary>
+/// A ball as the sample kept them before, one allocation each
+/// </summary>
+struct OldBall
+{
+	float pos[3];
+	float vel[3];
+
+	void Move()
+	{
+		for (int i = 0; i < 3; i++)
+			pos[i] += vel[i] * Speed;
+
+		int w = getmaxx() + 1;
+		int h = getmaxy() + 1;
+		if (pos[0] <= 0 || pos[0] >= w - Radius)
+			vel[0] = -vel[0];
+		if (pos[1] <= 0 || pos[1] >= h - Radius)
+			vel[1] = -vel[1];
+	}
+};
+
+/// <summary>
+/// Place balls the way Simulation::Reset does, the same for every run
+/// </summary>
+static void Place(Balls& balls, int count)
+{
+	srand(1);
+	balls.Resize(count);
+	for (int i = 0; i < count; i++)
+	{
+		balls.X[i] = (float)Width / 2 + rand() % (Width / 3);
+		balls.Y[i] = (float)Height / 2 + rand() % (Height / 3);
+		float speed = (float)(5 + rand() % 11);
+		float angle = (float)(rand() % 360) * 3.1415926535f / 180;
+		balls.VX[i] = cosf(angle) * speed;
+		balls.VY[i] = sinf(angle) * speed;
+	}
+}
+
+/// <summary>
+/// Move the balls frame after frame for at least the given seconds
+/// </summary>
+/// <returns>seconds per frame</returns>
+static double Run(Balls& balls, Balls::Kernel kernel, double seconds)
+{
+	const float maxX = (float)(Width - Radius);
+	const float maxY = (float)(Height - Radius);
+	int frames = 0;
+	double start = Clock::Seconds();
+	double elapsed;
+	do
+	{
+		balls.Move(0, balls.PaddedCount(), Speed, maxX, maxY, kernel);
+		++frames;
+	} while ((elapsed = Clock::Seconds() - start) < seconds || frames < 3);
+	return elapsed / frames;
+}
+
+static double RunOld(vector<OldBall*>& balls, double seconds)
+{
+	int frames = 0;
+	double start = Clock::Seconds();
+	double elapsed;
+	do
+	{
+		for (unsigned int i = 0; i < balls.size(); i++)
+			balls[i]->Move();
+		++frames;
+	} while ((elapsed = Clock::Seconds() - start) < seconds || frames < 3);
+	return elapsed / frames;
+}
+
+// the chunk Simulation::Update gives each job
+static const int ChunkBalls = 16 * 1024;
+
+struct MoveJob
+{
+	Balls* balls;
+	float maxX;
+	float maxY;
+};
+
+static void MoveChunk(void* arg, int begin, int end)
+{
+	MoveJob* job = (MoveJob*)arg;
+	job->balls->Move(begin, end, Speed, job->maxX, job->maxY);
+}
+
+/// <summary>
+/// Move the balls frame after frame on the job system's threads
+/// </summary>
+/// <returns>seconds per frame</returns>
+static double RunParallel(Balls& balls, JobSystem& jobs, double seconds)
+{
+	MoveJob job;
+	job.balls = &balls;
+	job.maxX = (float)(Width - Radius);
+	job.maxY = (float)(Height - Radius);
+	int frames = 0;
+	double start = Clock::Seconds();
+	double elapsed;
+	do
+	{
+		jobs.ParallelFor(0, balls.PaddedCount(), ChunkBalls, MoveChunk, &job);
+		++frames;
+	} while ((elapsed = Clock::Seconds() - start) < seconds || frames < 3);
+	return elapsed / frames;
+}
+
+static void Report(const char* layout, int count, double frame, double baseline)
+{
+	printf("%10d  %-8s %10.3f ms %8.2f ns %10.0f M/s %8.2fx\n", count, layout, frame * 1e3,
+		frame / count * 1e9, count / frame * 1e-6, baseline / frame);
+}
+
+int main(int argc, char** argv)
+{
+	int most = (argc > 1)? atoi(argv[1]): 1000000;
+	double seconds = (argc > 2)? atof(argv[2]): 0.5;
+	int mostThreads = (argc > 3)? atoi(argv[3]): JobSystem::GetProcessorCount();
+
+	printf("best kernel: %s\n\n", Balls::GetKernelName(Balls::KERNEL_BEST));
+	printf("%10s  %-8s %13s %11s %14s %9s\n", "balls", "layout", "frame", "per ball", "balls", "speedup");
+
+	const Balls::Kernel kernels[] = { Balls::KERNEL_SCALAR, Balls::KERNEL_SSE, Balls::KERNEL_AVX };
+	const int kernelCount = sizeof(kernels) / sizeof(kernels[0]);
+	bool agree = true;
+	for (int count = 1000; count <= most; count *= 10)
+	{
+		Balls balls;
+		Place(balls, count);
+
+		vector<OldBall*> old;
+		for (int i = 0; i < count; i++)
+		{
+			OldBall* ball = new OldBall;
+			ball->pos[0] = balls.X[i];
+			ball->pos[1] = balls.Y[i];
+			ball->pos[2] = 0;
+			ball->vel[0] = balls.VX[i];
+			ball->vel[1] = balls.VY[i];
+			ball->vel[2] = 0;
+			old.push_back(ball);
+		}
+		double baseline = RunOld(old, seconds);
+		Report("old", count, baseline, baseline);
+		for (int i = 0; i < count; i++)
+			delete old[i];
+
+		// each kernel from the same start for the same frames must agree
+		Balls reference;
+		Place(reference, count);
+		for (int frame = 0; frame < 100; frame++)
+			reference.Move(0, reference.PaddedCount(), Speed, (float)(Width - Radius), (float)(Height - Radius), Balls::KERNEL_SCALAR);
+
+		for (int k = 0; k < kernelCount; k++)
+		{
+			if (!Balls::HasKernel(kernels[k]))
+				continue;
+			Report(Balls::GetKernelName(kernels[k]), count, Run(balls, kernels[k], seconds), baseline);
+
+			Place(balls, count);
+			for (int frame = 0; frame < 100; frame++)
+				balls.Move(0, balls.PaddedCount(), Speed, (float)(Width - Radius), (float)(Height - Radius), kernels[k]);
+			for (int i = 0; i < count; i++)
+			{
+				if (fabs(balls.X[i] - reference.X[i]) > 1e-3f || fabs(balls.Y[i] - reference.Y[i]) > 1e-3f)
+				{
+					printf("%s moved ball %d to %g,%g; scalar moved it to %g,%g\n", Balls::GetKernelName(kernels[k]),
+						i, balls.X[i], balls.Y[i], reference.X[i], reference.Y[i]);
+					agree = false;
+					break;
+				}
+			}
+		}
+		printf("\n");
+	}
+
+	printf("%d processors, %s kernel, %d balls per chunk\n\n", JobSystem::GetProcessorCount(),
+		Balls::GetKernelName(Balls::KERNEL_BEST), ChunkBalls);
+	printf("%10s  %7s %13s %9s %10s %7s\n", "balls", "threads", "frame", "speedup", "efficiency", "steals");
+	for (int count = 100000; count <= most; count *= 10)
+	{
+		Balls balls;
+		Place(balls, count);
+
+		// a frame on one thread, for the same kernel
+		double single = 0;
+		for (int threads = 1; threads <= mostThreads; threads++)
+		{
+			JobSystem jobs(threads);
+			double frame = RunParallel(balls, jobs, seconds);
+			if (threads == 1)
+				single = frame;
+			double speedup = single / frame;
+			printf("%10d  %7d %10.3f ms %8.2fx %9.0f%% %7lld\n", count, threads, frame * 1e3,
+				speedup, speedup / threads * 100, jobs.GetSteals());
+		}
+
+		// the threads split the balls without changing where they go
+		Balls reference;
+		Place(reference, count);
+		Place(balls, count);
+		JobSystem jobs(mostThreads);
+		MoveJob job;
+		job.balls = &balls;
+		job.maxX = (float)(Width - Radius);
+		job.maxY = (float)(Height - Radius);
+		for (int frame = 0; frame < 100; frame++)
+		{
+			reference.Move(0, reference.PaddedCount(), Speed, job.maxX, job.maxY);
+			jobs.ParallelFor(0, balls.PaddedCount(), ChunkBalls, MoveChunk, &job);
+		}
+		for (int i = 0; i < count; i++)
+		{
+			if (balls.X[i] != reference.X[i] || balls.Y[i] != reference.Y[i])
+			{
+				printf("%d threads moved ball %d to %g,%g; one moved it to %g,%g\n", mostThreads,
+					i, balls.X[i], balls.Y[i], reference.X[i], reference.Y[i]);
+				agree = false;
+				break;
+			}
+		}
+		printf("\n");
+	}
+	return agree? 0: 1;
+}
@@ -0,0 +1,179 @@
+// WebConfig - Use a web browser to configure your application
+// Copyright (c) 2009 David McClurg <dpm@efn.org>
+// Under the MIT License, details: License.txt.
+
+// Measures how long screen capture stalls the frame thread. Synthetic frames
+// are rendered at a fixed rate and every one is captured, once through
+// ScreenCapture (copy on the frame thread, encode on a worker) and once
+// encoding in place the way a synchronous capture would.
+//
+// usage: CaptureBench [width] [height] [frames] [png|qoi|jpg] [output file]
+
+#include "ScreenCapture.h"
+#include "AssetCache.h"
+#include "Support/Clock.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#ifdef _WIN32
+#	include <windows.h>
+#else
+#	include <time.h>
+#endif
+
+using namespace std;
+using namespace WebConfig;
+
+static double Now()
+{
+	return Clock::Seconds();
+}
+
+static void SleepUntil(double when)
+{
+	double wait = when - Now();
+	if (wait <= 0)
+		return;
+#ifdef _WIN32
+	Sleep((DWORD)(wait * 1000));
+#else
+	struct timespec ts;
+	ts.tv_sec = (time_t)wait;
+	ts.tv_nsec = (long)((wait - ts.tv_sec) * 1e9);
+	nanosleep(&ts, NULL);
+#endif
+}
+
+/// <summary>
+/// Render something like a game screen: a gradient, a grid of balls and
+/// a moving bar, so encoders see both flat areas and detail
+/// </summary>
+static void Render(vector<unsigned char>& fb, int width, int height, int frame)
+{
+	for (int y = 0; y < height; y++)
+	{
+		unsigned char* p = &fb[(size_t)y * width * 4];
+		for (int x = 0; x < width; x++, p += 4)
+		{
+			int cx = (x + frame * 3) % 64 - 32;
+			int cy = y % 64 - 32;
+			bool ball = (cx * cx + cy * cy) < 200;
+			bool bar = ((x + frame * 7) % width) < 40;
+			p[0] = ball? 255: (unsigned char)(x * 255 / width);
+			p[1] = bar? 255: (unsigned char)(y * 255 / height);
+			p[2] = ball? 32: (unsigned char)((x ^ y) & 0x1F);
+			p[3] = 255;
+		}
+	}
+}
+
+struct Stats
+{
+	vector<double> samples;
+
+	void Print(const char* name)
+	{
+		if (samples.empty())
+		{
+			printf("%-12s no samples\n", name);
+			return;
+		}
+		sort(samples.begin(), samples.end());
+		double sum = 0;
+		for (unsigned int i = 0; i < samples.size(); i++)
+			sum += samples[i];
+		printf("%-12s mean %9.1f us   p50 %9.1f us   p99 %9.1f us   max %9.1f us\n", name,
+			sum / samples.size() * 1e6,
+			samples[samples.size() / 2] * 1e6,
+			samples[(samples.size() * 99) / 100] * 1e6,
+			samples.back() * 1e6);
+	}
+};
+
+int main(int argc, char** argv)
+{
+	int width = (argc > 1)? atoi(argv[1]): 1280;
+	int height = (argc > 2)? atoi(argv[2]): 720;
+	int frames = (argc > 3)? atoi(argv[3]): 120;
+	ScreenCapture::Format format = ScreenCapture::FORMAT_PNG;
+	if (argc > 4 && strcmp(argv[4], "qoi") == 0)
+		format = ScreenCapture::FORMAT_QOI;
+	else if (argc > 4 && strcmp(argv[4], "jpg") == 0)
+		format = ScreenCapture::FORMAT_JPEG;
+	const char* output = (argc > 5)? argv[5]: NULL;
+	const double period = 1.0 / 60;
+
+	printf("%dx%d, %d frames at 60 Hz, %s\n", width, height, frames,
+		ScreenCapture::GetContentType(format));
+
+	vector<unsigned char> fb((size_t)width * height * 4);
+	AssetCache assets;
+	ScreenCapture capture;
+
+	// asynchronous: the frame thread only copies
+	Stats async;
+	int dropped = 0, published = 0;
+	double next = Now();
+	for (int i = 0; i < frames; i++)
+	{
+		Render(fb, width, height, i);
+
+		double start = Now();
+		published += capture.Publish(assets);
+		ScreenCapture::Frame* frame = capture.Acquire(width, height);
+		if (frame != NULL)
+		{
+			memcpy(frame->Row(0), &fb[0], fb.size());
+			capture.Submit(frame, "/Screen", format);
+		}
+		else
+		{
+			++dropped;
+		}
+		async.samples.push_back(Now() - start);
+
+		next += period;
+		SleepUntil(next);
+	}
+	capture.Stop();
+	published += capture.Publish(assets);
+
+	// synchronous: encode on the frame thread
+	Stats sync;
+	size_t encodedSize = 0;
+	ScreenCapture::Frame* frame = capture.Acquire(width, height);
+	for (int i = 0; i < frames && i < 30; i++)
+	{
+		Render(fb, width, height, i);
+
+		double start = Now();
+		memcpy(frame->Row(0), &fb[0], fb.size());
+		string encoded;
+		ScreenCapture::Encode(*frame, format, (format == ScreenCapture::FORMAT_JPEG)? 75: 3, encoded);
+		sync.samples.push_back(Now() - start);
+		encodedSize = encoded.length();
+	}
+	capture.Release(frame);
+
+	async.Print("async stall");
+	sync.Print("sync stall");
+	printf("published %d, dropped %d while the pool was busy, %u bytes per image (%.1f%% of raw)\n",
+		published, dropped, (unsigned int)encodedSize, 100.0 * encodedSize / fb.size());
+
+	const AssetCache::Asset* asset = assets.Find("/Screen");
+	if (output != NULL && asset != NULL)
+	{
+		FILE* f = fopen(output, "wb");
+		if (f != NULL)
+		{
+			fwrite(asset->Data.data(), 1, asset->Data.length(), f);
+			fclose(f);
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,592 @@
+// WebConfig - Use a web browser to configure your application
+// Copyright (c) 2009 David McClurg <dpm@efn.org>
+// Under the MIT License, details: License.txt.
+
+// Measures the Manager the way a browser uses it. Synthetic forms of
+// sliders, checkboxes, selects and text inputs are served headless, while
+// an in-process load generator keeps keep-alive connections busy with a
+// mix of requests: the menu, form pages, the posts an auto-submit form
+// sends on every change, and static files from the folder. Reports
+// throughput, p50/p99/p999 latency for each kind of request, and the
+// allocations the server made per request. The results are also written
+// as JSON, for tracking regressions between builds.
+//
+// usage: ManagerBench [port] [seconds] [forms] [inputs per form]
+//                     [connections] [reactors] [folder] [results file]
+//
+// The folder defaults to the current one and should hold scripts/slider.js
+// and styles/slider.css, so run it from WebConfigCPP. The results file
+// defaults to ManagerBench.json; "-" writes the JSON to stdout instead.
+
+#include "WebConfigManager.h"
+#include "WebConfigInput.h"
+#include "Support/Clock.h"
+#include "Support/Convert.h"
+#include "Support/Json.h"
+#include "Support/Thread.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <new>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#ifdef _WIN32
+#	include <winsock2.h>
+#	include <windows.h>
+#	define THREAD_LOCAL __declspec(thread)
+#else
+#	include <sys/socket.h>
+#	include <netinet/in.h>
+#	include <netinet/tcp.h>
+#	include <arpa/inet.h>
+#	include <unistd.h>
+#	include <signal.h>
+#	define closesocket close
+#	define THREAD_LOCAL __thread
+#endif
+
+using namespace std;
+using namespace WebConfig;
+
+// Allocations are counted on every thread but the load generator's, so
+// they are the Manager's and its server's
+static volatile long allocations = 0;
+static THREAD_LOCAL bool loadGenerator = false;
+
+static void CountAllocation()
+{
+	if (loadGenerator)
+		return;
+#ifdef _WIN32
+	InterlockedIncrement(&allocations);
+#else
+	__sync_fetch_and_add(&allocations, 1);
+#endif
+}
+
+// Every replaceable form of new and delete is replaced, so each pair
+// agrees on where memory comes from. Allocate and Free are kept out of
+// line: once the compiler sees malloc and free through new and delete it
+// takes the new of one for the free of another.
+#ifdef _MSC_VER
+#	define NOINLINE __declspec(noinline)
+#else
+#	define NOINLINE __attribute__((noinline))
+#endif
+
+static NOINLINE void* Allocate(size_t size)
+{
+	CountAllocation();
+	return malloc(size? size: 1);
+}
+
+static NOINLINE void Free(void* p)
+{
+	free(p);
+}
+
+void* operator new(size_t size)
+{
+	void* p = Allocate(size);
+	if (p == NULL)
+		throw std::bad_alloc();
+	return p;
+}
+
+void* operator new[](size_t size)
+{
+	void* p = Allocate(size);
+	if (p == NULL)
+		throw std::bad_alloc();
+	return p;
+}
+
+void* operator new(size_t size, const std::nothrow_t&) throw()
+{
+	return Allocate(size);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) throw()
+{
+	return Allocate(size);
+}
+
+void operator delete(void* p) throw()
+{
+	Free(p);
+}
+
+void operator delete[](void* p) throw()
+{
+	Free(p);
+}
+
+void operator delete(void* p, const std::nothrow_t&) throw()
+{
+	Free(p);
+}
+
+void operator delete[](void* p, const std::nothrow_t&) throw()
+{
+	Free(p);
+}
+
+/// <summary>
+/// The kinds of request in the mix
+/// </summary>
+enum RequestKind
+{
+	KIND_MENU,
+	KIND_FORM,
+	KIND_POST,
+	KIND_STATIC,
+	KIND_COUNT
+};
+
+static const char* const KindNames[KIND_COUNT] = { "menu", "form", "post", "static" };
+
+// out of every 20 requests
+static const int KindWeights[KIND_COUNT] = { 2, 8, 4, 6 };
+
+static const char* const StaticFiles[] = { "/scripts/slider.js", "/styles/slider.css" };
+
+/// <summary>
+/// The synthetic forms; values live here for as long as the inputs do
+/// </summary>
+struct Forms
+{
+	int count;
+	int inputsPerForm;
+	vector<float> floats;
+	vector<int> ints;
+	bool* flags;
+	vector<string> texts;
+	vector<string> ids;		// UniqueID of each input, form by form
+
+	/// <summary>
+	/// Add count forms of inputsPerForm inputs each, cycling through the input types
+	/// </summary>
+	void Create()
+	{
+		int total = count * inputsPerForm;
+		floats.resize(total);
+		ints.resize(total);
+		texts.resize(total);
+		flags = new bool[total];
+
+		for (int f = 0; f < count; f++)
+		{
+			string form = "form" + Convert::ToString(f);
+			FormSettings* settings = Manager::Instance().GetFormSettings(form);
+			settings->AutoSubmit = true;
+			settings->AutoSave = false;
+
+			for (int i = 0; i < inputsPerForm; i++)
+			{
+				int n = f * inputsPerForm + i;
+				string path = form + "/Input " + Convert::ToString(i);
+				InputBase* input = NULL;
+				switch (i % 5)
+				{
+				case 0:
+					{
+						InputSlider* slider = new InputSlider(path, floats[n]);
+						slider->SetRange(0, 100, 1);
+						input = slider;
+					}
+					break;
+				case 1:
+					input = new InputSliderInt(path, ints[n]);
+					break;
+				case 2:
+					flags[n] = false;
+					input = new InputBool(path, flags[n]);
+					break;
+				case 3:
+					{
+						InputSelect* select = new InputSelect(path, ints[n]);
+						select->AddOption("Low");
+						select->AddOption("Medium");
+						select->AddOption("High");
+						input = select;
+					}
+					break;
+				default:
+					texts[n] = "text " + Convert::ToString(n);
+					input = new InputText(path, texts[n]);
+					break;
+				}
+				ids.push_back(input->UniqueID);
+			}
+		}
+	}
+
+	/// <summary>
+	/// Form data for an auto-submit of form f; every input gets a new value
+	/// </summary>
+	string PostData(int f, int serial) const
+	{
+		string data;
+		for (int i = 0; i < inputsPerForm; i++)
+		{
+			if (i > 0)
+				data += "&";
+			data += ids[f * inputsPerForm + i] + "=";
+			switch (i % 5)
+			{
+			case 0: data += Convert::ToString(serial % 100) + ".5"; break;
+			case 1: data += Convert::ToString(serial % 100); break;
+			case 2: data += (serial & 1)? "on": "off"; break;
+			case 3: data += Convert::ToString(serial % 3); break;
+			default: data += "text+" + Convert::ToString(serial); break;
+			}
+		}
+		return data;
+	}
+};
+
+/// <summary>
+/// One thread of the load generator, with its own keep-alive connections;
+/// every connection has one request in flight at a time
+/// </summary>
+struct ClientThread
+{
+	int port;
+	int connections;
+	double until;
+	const Forms* forms;
+	unsigned int seed;
+	int errors;
+	vector<double> latencies[KIND_COUNT];
+	long long bytes;
+	volatile bool finished;
+	Thread thread;
+
+	ClientThread() : port(0), connections(0), until(0), forms(NULL), seed(1), errors(0), bytes(0), finished(false) {}
+
+	static void Run(void* arg)
+	{
+		loadGenerator = true;
+		((ClientThread*)arg)->Loop();
+		((ClientThread*)arg)->finished = true;
+	}
+
+	unsigned int Random()
+	{
+		seed = seed * 1103515245 + 12345;
+		return (seed >> 16) & 0x7fff;
+	}
+
+	static int Connect(int port)
+	{
+		int fd = (int)socket(AF_INET, SOCK_STREAM, 0);
+		if (fd < 0)
+			return -1;
+		int on = 1;
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, (const char*)&on, sizeof(on));
+
+		struct sockaddr_in addr;
+		memset(&addr, 0, sizeof(addr));
+		addr.sin_family = AF_INET;
+		addr.sin_port = htons(port);
+		addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+		if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0)
+		{
+			closesocket(fd);
+			return -1;
+		}
+		return fd;
+	}
+
+	/// <summary>
+	/// Read one response with a Content-Length body
+	/// </summary>
+	/// <returns>false if the connection failed or the status wasn't 200</returns>
+	bool ReadResponse(int fd, string& buffer)
+	{
+		size_t end;
+		while ((end = buffer.find("\r\n\r\n")) == string::npos)
+		{
+			char temp[16384];
+			int n = (int)recv(fd, temp, sizeof(temp), 0);
+			if (n <= 0)
+				return false;
+			buffer.append(temp, n);
+		}
+
+		size_t length = 0;
+		size_t header = buffer.find("Content-Length: ");
+		if (header != string::npos && header < end)
+			length = (size_t)atoi(buffer.c_str() + header + 16);
+
+		while (buffer.length() < end + 4 + length)
+		{
+			char temp[16384];
+			int n = (int)recv(fd, temp, sizeof(temp), 0);
+			if (n <= 0)
+				return false;
+			buffer.append(temp, n);
+		}
+		bool ok = (buffer.compare(9, 3, "200") == 0);
+		bytes += end + 4 + length;
+		buffer.erase(0, end + 4 + length);
+		return ok;
+	}
+
+	/// <summary>
+	/// Pick the next request from the mix
+	/// </summary>
+	RequestKind NextRequest(string& request, int serial)
+	{
+		int pick = Random() % 20;
+		int kind = 0;
+		while (pick >= KindWeights[kind])
+			pick -= KindWeights[kind++];
+
+		int form = Random() % forms->count;
+		switch (kind)
+		{
+		case KIND_MENU:
+			request = "GET /menu.cgi HTTP/1.1\r\nHost: localhost\r\n\r\n";
+			break;
+		case KIND_FORM:
+			request = "GET /form" + Convert::ToString(form) + ".cgi HTTP/1.1\r\nHost: localhost\r\n\r\n";
+			break;
+		case KIND_POST:
+			{
+				string body = forms->PostData(form, serial);
+				request = "POST /form" + Convert::ToString(form) + ".cgi HTTP/1.1\r\nHost: localhost\r\n"
+					"Content-Type: application/x-www-form-urlencoded\r\n"
+					"Content-Length: " + Convert::ToString((int)body.length()) + "\r\n\r\n" + body;
+			}
+			break;
+		default:
+			request = string("GET ") + StaticFiles[Random() % 2] + " HTTP/1.1\r\nHost: localhost\r\n\r\n";
+			break;
+		}
+		return (RequestKind)kind;
+	}
+
+	void Loop()
+	{
+		vector<int> fds;
+		for (int i = 0; i < connections; i++)
+		{
+			int fd = Connect(port);
+			if (fd < 0)
+				++errors;
+			else
+				fds.push_back(fd);
+		}
+
+		vector<string> buffers(fds.size());
+		vector<double> sent(fds.size());
+		vector<RequestKind> kinds(fds.size());
+		string request;
+		int serial = 0;
+		while (Clock::Seconds() < until && !fds.empty())
+		{
+			for (unsigned int i = 0; i < fds.size(); i++)
+			{
+				kinds[i] = NextRequest(request, ++serial);
+				sent[i] = Clock::Seconds();
+				::send(fds[i], request.data(), (int)request.length(), 0);
+			}
+			for (unsigned int i = 0; i < fds.size(); i++)
+			{
+				if (!ReadResponse(fds[i], buffers[i]))
+				{
+					++errors;
+					closesocket(fds[i]);
+					fds.erase(fds.begin() + i);
+					buffers.erase(buffers.begin() + i);
+					sent.erase(sent.begin() + i);
+					kinds.erase(kinds.begin() + i);
+					--i;
+					continue;
+				}
+				latencies[kinds[i]].push_back(Clock::Seconds() - sent[i]);
+			}
+		}
+
+		for (unsigned int i = 0; i < fds.size(); i++)
+			closesocket(fds[i]);
+	}
+};
+
+/// <summary>
+/// Latency below which permille of the sorted samples fall
+/// </summary>
+static double Percentile(const vector<double>& samples, int permille)
+{
+	if (samples.empty())
+		return 0;
+	return samples[(samples.size() * permille) / 1000];
+}
+
+/// <summary>
+/// Print a line of results and add them to the open JSON object
+/// </summary>
+static void Report(JsonWriter& json, const char* name, vector<double>& latencies, double elapsed)
+{
+	sort(latencies.begin(), latencies.end());
+	double rate = latencies.size() / elapsed;
+	double p50 = Percentile(latencies, 500) * 1e6;
+	double p99 = Percentile(latencies, 990) * 1e6;
+	double p999 = Percentile(latencies, 999) * 1e6;
+	printf("%8s %10d %12.0f %9.1f %9.1f %9.1f\n", name, (int)latencies.size(), rate, p50, p99, p999);
+
+	json.Property("name", name);
+	json.Property("requests", (long long)latencies.size());
+	json.Property("requests_per_second", rate);
+	json.Property("p50_us", p50);
+	json.Property("p99_us", p99);
+	json.Property("p999_us", p999);
+}
+
+int main(int argc, char** argv)
+{
+	int port = (argc > 1)? atoi(argv[1]): 8092;
+	double seconds = (argc > 2)? atof(argv[2]): 5;
+	Forms forms;
+	forms.count = (argc > 3)? max(atoi(argv[3]), 1): 8;
+	forms.inputsPerForm = (argc > 4)? max(atoi(argv[4]), 1): 20;
+	int connections = (argc > 5)? atoi(argv[5]): 16;
+	int reactors = (argc > 6)? atoi(argv[6]): 0;
+	string folder = (argc > 7)? argv[7]: ".";
+	string resultsFile = (argc > 8)? argv[8]: "ManagerBench.json";
+	int clientThreads = min(connections, 4);
+
+#ifdef _WIN32
+	WSADATA wd;
+	WSAStartup(MAKEWORD(1,1), &wd);
+#else
+	// a client hanging up mustn't kill the server
+	signal(SIGPIPE, SIG_IGN);
+#endif
+
+	Manager& manager = Manager::Instance();
+	manager.SetReactors(reactors);
+	manager.SetLogRequests(false);
+	manager.Startup(port, folder);
+	forms.Create();
+	manager.Update();
+
+	printf("%d forms of %d inputs, %d keep-alive connections, %d reactors, %.0f s\n\n",
+		forms.count, forms.inputsPerForm, connections, reactors, seconds);
+
+	vector<ClientThread*> clients;
+	double start = Clock::Seconds();
+	long allocationsBefore = allocations;
+	for (int i = 0; i < clientThreads; i++)
+	{
+		ClientThread* client = new ClientThread;
+		client->port = port;
+		client->connections = connections / clientThreads + ((i < connections % clientThreads)? 1: 0);
+		client->until = start + seconds;
+		client->forms = &forms;
+		client->seed = i + 1;
+		client->thread.Start(&ClientThread::Run, client);
+		clients.push_back(client);
+	}
+
+	// without reactors the requests are answered here; with them, posts
+	// are applied here
+	long long updates = 0;
+	while (Clock::Seconds() < start + seconds)
+	{
+		manager.Update();
+		++updates;
+		if (reactors > 0)
+		{
+#ifdef _WIN32
+			Sleep(1);
+#else
+			usleep(1000);
+#endif
+		}
+	}
+
+	vector<double> latencies[KIND_COUNT];
+	vector<double> all;
+	int errors = 0;
+	long long bytes = 0;
+	for (unsigned int i = 0; i < clients.size(); i++)
+	{
+		// a reply the client still waits on needs an Update
+		while (!clients[i]->finished)
+			manager.Update();
+		clients[i]->thread.Join();
+		for (int k = 0; k < KIND_COUNT; k++)
+		{
+			latencies[k].insert(latencies[k].end(), clients[i]->latencies[k].begin(), clients[i]->latencies[k].end());
+			all.insert(all.end(), clients[i]->latencies[k].begin(), clients[i]->latencies[k].end());
+		}
+		errors += clients[i]->errors;
+		bytes += clients[i]->bytes;
+		delete clients[i];
+	}
+	double elapsed = Clock::Seconds() - start;
+	long serverAllocations = allocations - allocationsBefore;
+	manager.Shutdown();
+
+	string output;
+	JsonWriter json(output);
+	json.BeginObject();
+	json.Property("benchmark", "ManagerBench");
+	json.Name("config");
+	json.BeginObject();
+	json.Property("seconds", seconds);
+	json.Property("forms", forms.count);
+	json.Property("inputs_per_form", forms.inputsPerForm);
+	json.Property("connections", connections);
+	json.Property("client_threads", clientThreads);
+	json.Property("reactors", reactors);
+	json.EndObject();
+
+	printf("    kind   requests   requests/s    p50 us    p99 us   p999 us\n");
+	json.Name("requests");
+	json.BeginArray();
+	for (int k = 0; k < KIND_COUNT; k++)
+	{
+		json.BeginObject();
+		Report(json, KindNames[k], latencies[k], elapsed);
+		json.EndObject();
+	}
+	json.EndArray();
+	json.Name("total");
+	json.BeginObject();
+	long long requests = (long long)all.size();
+	Report(json, "all", all, elapsed);
+
+	double allocationsPerRequest = requests? (double)serverAllocations / requests: 0;
+	double megabytes = bytes / elapsed / (1024 * 1024);
+	printf("\n%.1f allocations per request, %.1f MB/s, %lld updates, %d errors\n",
+		allocationsPerRequest, megabytes, updates, errors);
+
+	json.Property("allocations_per_request", allocationsPerRequest);
+	json.Property("megabytes_per_second", megabytes);
+	json.Property("errors", errors);
+	json.EndObject();
+	json.EndObject();
+	output += "\n";
+
+	if (resultsFile == "-")
+		fputs(output.c_str(), stdout);
+	else
+	{
+		FILE* file = fopen(resultsFile.c_str(), "w");
+		if (file == NULL)
+		{
+			fprintf(stderr, "can't write %s\n", resultsFile.c_str());
+			return 1;
+		}
+		fputs(output.c_str(), file);
+		fclose(file);
+		printf("results written to %s\n", resultsFile.c_str());
+	}
+	return (errors == 0)? 0: 1;
+}
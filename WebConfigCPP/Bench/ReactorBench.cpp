@@ -0,0 +1,294 @@
+// WebConfig - Use a web browser to configure your application
+// Copyright (c) 2009 David McClurg <dpm@efn.org>
+// Under the MIT License, details: License.txt.
+
+// Measures the server's reactors. A server answers small JSON requests,
+// like /api/inputs, while client threads keep a number of keep-alive
+// connections busy on loopback. One reactor is run with each backend that
+// waits for its sockets (select, epoll and io_uring), then the default
+// backend with 1, 2, 4 and 8 reactor threads. Reports requests per second,
+// the speedup over the first run of each table, and request latency.
+//
+// usage: ReactorBench [port] [seconds] [connections] [client threads]
+
+#include "HTTPServer.h"
+#include "Support/asyncore.h"
+#include "Support/Clock.h"
+#include "Support/Thread.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#ifdef _WIN32
+#	include <winsock2.h>
+#	include <windows.h>
+#else
+#	include <sys/socket.h>
+#	include <netinet/in.h>
+#	include <netinet/tcp.h>
+#	include <arpa/inet.h>
+#	include <unistd.h>
+#	include <signal.h>
+#	define closesocket close
+#endif
+
+using namespace std;
+using namespace WebConfig;
+using async_sockets::reactor;
+
+static const char* const Body = "{\"input1\":\"10\",\"input2\":\"1\",\"input3\":\"0\",\"input4\":\"x\"}";
+
+static void OnResponse(const HTTPRequestParams&, HTTPResponse& rp)
+{
+	rp.Headers["Content-type"] = "application/json";
+	rp.BodyData = Body;
+}
+
+/// <summary>
+/// One thread of clients, each with its own keep-alive connection; every
+/// connection has one request in flight at a time
+/// </summary>
+struct ClientThread
+{
+	int port;
+	int connections;
+	double until;
+	long long requests;
+	int errors;
+	vector<double> latencies;
+	Thread thread;
+
+	ClientThread() : port(0), connections(0), until(0), requests(0), errors(0) {}
+
+	static void Run(void* arg)
+	{
+		((ClientThread*)arg)->Loop();
+	}
+
+	static int Connect(int port)
+	{
+		int fd = (int)socket(AF_INET, SOCK_STREAM, 0);
+		if (fd < 0)
+			return -1;
+		int on = 1;
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, (const char*)&on, sizeof(on));
+
+		struct sockaddr_in addr;
+		memset(&addr, 0, sizeof(addr));
+		addr.sin_family = AF_INET;
+		addr.sin_port = htons(port);
+		addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+		if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0)
+		{
+			closesocket(fd);
+			return -1;
+		}
+		return fd;
+	}
+
+	/// <summary>
+	/// Read one response with a Content-Length body
+	/// </summary>
+	static bool ReadResponse(int fd, string& buffer)
+	{
+		size_t end;
+		while ((end = buffer.find("\r\n\r\n")) == string::npos)
+		{
+			char temp[4096];
+			int n = (int)recv(fd, temp, sizeof(temp), 0);
+			if (n <= 0)
+				return false;
+			buffer.append(temp, n);
+		}
+
+		size_t length = 0;
+		size_t header = buffer.find("Content-Length: ");
+		if (header != string::npos && header < end)
+			length = (size_t)atoi(buffer.c_str() + header + 16);
+
+		while (buffer.length() < end + 4 + length)
+		{
+			char temp[4096];
+			int n = (int)recv(fd, temp, sizeof(temp), 0);
+			if (n <= 0)
+				return false;
+			buffer.append(temp, n);
+		}
+		buffer.erase(0, end + 4 + length);
+		return true;
+	}
+
+	void Loop()
+	{
+		static const string request = "GET /api/inputs HTTP/1.1\r\nHost: localhost\r\n\r\n";
+
+		vector<int> fds;
+		vector<string> buffers(connections);
+		for (int i = 0; i < connections; i++)
+		{
+			int fd = Connect(port);
+			if (fd < 0)
+				++errors;
+			else
+				fds.push_back(fd);
+		}
+
+		vector<double> sent(fds.size());
+		while (Clock::Seconds() < until && !fds.empty())
+		{
+			for (unsigned int i = 0; i < fds.size(); i++)
+			{
+				sent[i] = Clock::Seconds();
+				::send(fds[i], request.data(), (int)request.length(), 0);
+			}
+			for (unsigned int i = 0; i < fds.size(); i++)
+			{
+				if (!ReadResponse(fds[i], buffers[i]))
+				{
+					++errors;
+					closesocket(fds[i]);
+					fds.erase(fds.begin() + i);
+					sent.erase(sent.begin() + i);
+					buffers.erase(buffers.begin() + i);
+					--i;
+					continue;
+				}
+				latencies.push_back(Clock::Seconds() - sent[i]);
+				++requests;
+			}
+		}
+
+		for (unsigned int i = 0; i < fds.size(); i++)
+			closesocket(fds[i]);
+	}
+};
+
+static double Percentile(vector<double>& samples, int percent)
+{
+	if (samples.empty())
+		return 0;
+	return samples[(samples.size() * percent) / 100];
+}
+
+struct Run
+{
+	int port;
+	double seconds;
+	int connections;
+	int clientThreads;
+
+	/// <summary>
+	/// Serve with reactors threads for a while and print a line of results
+	/// </summary>
+	/// <returns>requests per second, or 0 if the server couldn't start</returns>
+	double Measure(const char* label, int reactors, double baseline)
+	{
+		HTTPServer server(&OnResponse);
+		server.LogRequests = false;
+		// the limit is shared out between reactors and the kernel spreads
+		// connections unevenly, so leave room for every one on each
+		server.Limits.MaxConnections = connections * reactors;
+		int serverPort = port++;
+		server.Start(serverPort, reactors);
+		if (server.GetReactorCount() != reactors)
+			return 0;
+
+		vector<ClientThread*> clients;
+		double start = Clock::Seconds();
+		for (int i = 0; i < clientThreads; i++)
+		{
+			ClientThread* client = new ClientThread;
+			client->port = serverPort;
+			client->connections = connections / clientThreads + ((i < connections % clientThreads)? 1: 0);
+			client->until = start + seconds;
+			client->thread.Start(&ClientThread::Run, client);
+			clients.push_back(client);
+		}
+
+		long long requests = 0;
+		int errors = 0;
+		vector<double> latencies;
+		for (unsigned int i = 0; i < clients.size(); i++)
+		{
+			clients[i]->thread.Join();
+			requests += clients[i]->requests;
+			errors += clients[i]->errors;
+			latencies.insert(latencies.end(), clients[i]->latencies.begin(), clients[i]->latencies.end());
+			delete clients[i];
+		}
+		double elapsed = Clock::Seconds() - start;
+		server.Stop();
+
+		sort(latencies.begin(), latencies.end());
+		double rate = requests / elapsed;
+		printf("%8s %12.0f %8.2fx %8.1f %8.1f %8.1f %8d\n", label, rate,
+			(baseline > 0)? rate / baseline: 1,
+			Percentile(latencies, 50) * 1e6, Percentile(latencies, 99) * 1e6,
+			latencies.empty()? 0: latencies.back() * 1e6, errors);
+		return rate;
+	}
+};
+
+int main(int argc, char** argv)
+{
+	Run run;
+	run.port = (argc > 1)? atoi(argv[1]): 8091;
+	run.seconds = (argc > 2)? atof(argv[2]): 3;
+	run.connections = (argc > 3)? atoi(argv[3]): 64;
+	run.clientThreads = (argc > 4)? atoi(argv[4]): 4;
+
+#ifdef _WIN32
+	WSADATA wd;
+	WSAStartup(MAKEWORD(1,1), &wd);
+#else
+	// a client hanging up mustn't kill the server
+	signal(SIGPIPE, SIG_IGN);
+#endif
+
+	printf("%d keep-alive connections over %d client threads, %.0f s per run\n\n",
+		run.connections, run.clientThreads, run.seconds);
+
+	static const reactor::backend_type Backends[] = {
+		reactor::backend_select, reactor::backend_epoll, reactor::backend_uring };
+	static const char* const BackendNames[] = { "select", "epoll", "io_uring" };
+	printf(" backend   requests/s   speedup   p50 us   p99 us   max us   errors\n");
+	double baseline = 0;
+	for (int i = 0; i < 3; i++)
+	{
+		if (!reactor::set_default_backend(Backends[i]))
+		{
+			printf("%8s not available\n", BackendNames[i]);
+			continue;
+		}
+		double rate = run.Measure(BackendNames[i], 1, baseline);
+		if (rate == 0)
+		{
+			printf("reactors are not available on this platform\n");
+			return 1;
+		}
+		if (baseline == 0)
+			baseline = rate;
+	}
+#ifdef __linux__
+	reactor::set_default_backend(reactor::backend_epoll);
+#else
+	reactor::set_default_backend(reactor::backend_select);
+#endif
+
+	static const int ReactorCounts[] = { 1, 2, 4, 8 };
+	printf("\nreactors   requests/s   speedup   p50 us   p99 us   max us   errors\n");
+	baseline = 0;
+	for (int i = 0; i < 4; i++)
+	{
+		char label[16];
+		sprintf(label, "%d", ReactorCounts[i]);
+		double rate = run.Measure(label, ReactorCounts[i], baseline);
+		if (baseline == 0)
+			baseline = rate;
+	}
+	return 0;
+}
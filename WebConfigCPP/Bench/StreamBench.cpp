@@ -0,0 +1,280 @@
+// WebConfig - Use a web browser to configure your application
+// Copyright (c) 2009 David McClurg <dpm@efn.org>
+// Under the MIT License, details: License.txt.
+
+// Measures an MJPEG image stream end to end. A synthetic game screen is
+// rendered at 60 Hz and streamed by ImageStream over a real HTTPServer to
+// viewers on loopback sockets: some read as fast as they can, and one reads
+// only 64KB once a second, like a viewer on a poor link. Reports the frame
+// thread's cost per frame, the frame rate each viewer received, and how many
+// frames were dropped for the slow one.
+//
+// usage: StreamBench [port] [seconds] [fps] [width] [height] [quality]
+
+#include "HTTPServer.h"
+#include "AssetCache.h"
+#include "ImageStream.h"
+#include "Support/Clock.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#ifdef _WIN32
+#	include <winsock2.h>
+#	include <windows.h>
+#else
+#	include <sys/socket.h>
+#	include <netinet/in.h>
+#	include <arpa/inet.h>
+#	include <fcntl.h>
+#	include <unistd.h>
+#	include <signal.h>
+#	include <time.h>
+#	define closesocket close
+#endif
+
+using namespace std;
+using namespace WebConfig;
+
+static const char* const StreamUrl = "/live.mjpg";
+static const int FastViewers = 2;
+
+static void SleepUntil(double when)
+{
+	double wait = when - Clock::Seconds();
+	if (wait <= 0)
+		return;
+#ifdef _WIN32
+	Sleep((DWORD)(wait * 1000));
+#else
+	struct timespec ts;
+	ts.tv_sec = (time_t)wait;
+	ts.tv_nsec = (long)((wait - ts.tv_sec) * 1e9);
+	nanosleep(&ts, NULL);
+#endif
+}
+
+/// <summary>
+/// A moving gradient with balls and a bar, like CaptureBench
+/// </summary>
+class SyntheticSource : public CaptureSource
+{
+public:
+	int Width;
+	int Height;
+	int Frame;
+
+	SyntheticSource(int width, int height) : Width(width), Height(height), Frame(0) {}
+
+	bool GetSize(int& width, int& height)
+	{
+		width = Width;
+		height = Height;
+		return true;
+	}
+
+	bool Capture(ScreenCapture::Frame& frame)
+	{
+		for (int y = 0; y < frame.Height; y++)
+		{
+			unsigned char* p = frame.Row(y);
+			for (int x = 0; x < frame.Width; x++, p += 4)
+			{
+				int cx = (x + Frame * 3) % 64 - 32;
+				int cy = y % 64 - 32;
+				bool ball = (cx * cx + cy * cy) < 200;
+				bool bar = ((x + Frame * 7) % frame.Width) < 40;
+				p[0] = ball? 255: (unsigned char)(x * 255 / frame.Width);
+				p[1] = bar? 255: (unsigned char)(y * 255 / frame.Height);
+				p[2] = ball? 32: (unsigned char)((x ^ y) & 0x1F);
+				p[3] = 255;
+			}
+		}
+		return true;
+	}
+};
+
+static ImageStream* theStream = NULL;
+
+static void OnResponse(const HTTPRequestParams& rq, HTTPResponse& rp)
+{
+	if (AssetCache::NormalizeUrl(rq.URL) == theStream->GetUrl())
+	{
+		rp.Headers["Content-type"] = ImageStream::GetContentType();
+		rp.BodyData = theStream->GetLatestPart();
+		rp.Subscribe = theStream->GetUrl();
+	}
+	else
+	{
+		rp.Status = (int)RESPONSE_NOT_FOUND;
+	}
+}
+
+/// <summary>
+/// One end of a loopback connection that requested the stream
+/// </summary>
+struct Viewer
+{
+	int fd;
+	long long bytes;
+	int frames;
+	string tail;	// end of the last read, in case a boundary straddles reads
+
+	Viewer() : fd(-1), bytes(0), frames(0) {}
+
+	bool Open(int port, int receiveBuffer)
+	{
+		fd = (int)socket(AF_INET, SOCK_STREAM, 0);
+		if (fd < 0)
+			return false;
+		if (receiveBuffer > 0)
+			setsockopt(fd, SOL_SOCKET, SO_RCVBUF, (const char*)&receiveBuffer, sizeof(receiveBuffer));
+
+		struct sockaddr_in addr;
+		memset(&addr, 0, sizeof(addr));
+		addr.sin_family = AF_INET;
+		addr.sin_port = htons(port);
+		addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+		if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0)
+			return false;
+
+		string request = string("GET ") + StreamUrl + " HTTP/1.1\r\nHost: localhost\r\n\r\n";
+		::send(fd, request.data(), (int)request.length(), 0);
+
+#ifdef _WIN32
+		u_long nonblocking = 1;
+		ioctlsocket(fd, FIONBIO, &nonblocking);
+#else
+		fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+#endif
+		return true;
+	}
+
+	/// <summary>
+	/// Read up to limit bytes of whatever has arrived and count the frames in it
+	/// </summary>
+	void Drain(long long limit)
+	{
+		static const string boundary = "\r\n--WebConfigFrame";
+		char buffer[65536];
+		while (limit > 0)
+		{
+			int n = (int)recv(fd, buffer, (limit < (long long)sizeof(buffer))? (int)limit: sizeof(buffer), 0);
+			if (n <= 0)
+				return;
+			bytes += n;
+			limit -= n;
+
+			string text = tail + string(buffer, n);
+			for (size_t i = text.find(boundary); i != string::npos; i = text.find(boundary, i + 1))
+				++frames;
+			size_t keep = boundary.length() - 1;
+			tail = (text.length() > keep)? text.substr(text.length() - keep): text;
+		}
+	}
+};
+
+struct Stats
+{
+	vector<double> samples;
+
+	void Print(const char* name)
+	{
+		if (samples.empty())
+		{
+			printf("%-14s no samples\n", name);
+			return;
+		}
+		sort(samples.begin(), samples.end());
+		double sum = 0;
+		for (unsigned int i = 0; i < samples.size(); i++)
+			sum += samples[i];
+		printf("%-14s mean %9.1f us   p50 %9.1f us   p99 %9.1f us   max %9.1f us\n", name,
+			sum / samples.size() * 1e6,
+			samples[samples.size() / 2] * 1e6,
+			samples[(samples.size() * 99) / 100] * 1e6,
+			samples.back() * 1e6);
+	}
+};
+
+int main(int argc, char** argv)
+{
+	int port = (argc > 1)? atoi(argv[1]): 8090;
+	double seconds = (argc > 2)? atof(argv[2]): 5;
+	double fps = (argc > 3)? atof(argv[3]): 30;
+	int width = (argc > 4)? atoi(argv[4]): 640;
+	int height = (argc > 5)? atoi(argv[5]): 360;
+	int quality = (argc > 6)? atoi(argv[6]): 60;
+	const double period = 1.0 / 60;
+
+#ifndef _WIN32
+	// a viewer hanging up mustn't kill the server
+	signal(SIGPIPE, SIG_IGN);
+#endif
+
+	HTTPServer server(&OnResponse);
+	server.Start(port);
+
+	AssetCache assets;
+	SyntheticSource source(1280, 720);
+	ImageStream stream(StreamUrl, &source);
+	stream.SetFrameRate(fps);
+	stream.SetResolution(width, height);
+	stream.SetQuality(quality);
+	theStream = &stream;
+
+	printf("1280x720 scaled to %dx%d, quality %d, %.0f fps for %.0f s\n", width, height, quality, fps, seconds);
+
+	// the last viewer is the slow one
+	Viewer viewers[FastViewers + 1];
+	for (int i = 0; i <= FastViewers; i++)
+	{
+		if (!viewers[i].Open(port, (i == FastViewers)? 4096: 0))
+		{
+			printf("can't connect to port %d\n", port);
+			return 1;
+		}
+	}
+
+	Stats update;
+	double start = Clock::Seconds();
+	double next = start;
+	while (Clock::Seconds() - start < seconds)
+	{
+		if (++source.Frame % 60 == 0)
+			viewers[FastViewers].Drain(64 * 1024);
+
+		double t = Clock::Seconds();
+		stream.Update(server, assets, t);
+		server.Update();
+		update.samples.push_back(Clock::Seconds() - t);
+
+		for (int i = 0; i < FastViewers; i++)
+			viewers[i].Drain(1LL << 40);
+
+		next += period;
+		SleepUntil(next);
+	}
+	double elapsed = Clock::Seconds() - start;
+	stream.Stop();
+
+	update.Print("frame cost");
+	printf("captured %d, skipped %d while encoding, sent %d, dropped %d for busy viewers, %u bytes per frame\n",
+		stream.FramesCaptured, stream.FramesSkipped, stream.FramesSent, stream.FramesDropped,
+		(unsigned int)stream.GetLatestPart().length());
+	for (int i = 0; i < FastViewers; i++)
+	{
+		printf("viewer %d       %5.1f fps  %8.1f KB/s\n", i, viewers[i].frames / elapsed,
+			viewers[i].bytes / elapsed / 1024);
+	}
+	printf("slow viewer    %5.1f fps  %8.1f KB/s\n", viewers[FastViewers].frames / elapsed,
+		viewers[FastViewers].bytes / elapsed / 1024);
+
+	for (int i = 0; i <= FastViewers; i++)
+		closesocket(viewers[i].fd);
+	return 0;
+}
@@ -0,0 +1,343 @@
+// WebConfig - Use a web browser to configure your application
+// Copyright (c) 2009 David McClurg <dpm@efn.org>
+// Under the MIT License, details: License.txt.
+
+#include "AssetCache.h"
+#include "Support/Path.h"
+#include "Support/StringHelper.h"
+#include "Support/HttpUtility.h"
+#include "Support/Deflate.h"
+
+#include <fstream>
+
+#ifdef _WIN32
+#	include <windows.h>
+#elif defined(__linux__)
+#	include <sys/inotify.h>
+#	include <unistd.h>
+#	include <errno.h>
+#endif
+
+using namespace std;
+
+namespace WebConfig
+{
+	AssetCache::AssetCache()
+	{
+		size = 0;
+		capacity = 16 * 1024 * 1024;
+		compressionLevel = 6;
+		watching = false;
+		notifyHandle = -1;
+#ifdef _WIN32
+		changeHandle = INVALID_HANDLE_VALUE;
+#endif
+	}
+
+	AssetCache::~AssetCache()
+	{
+		Close();
+	}
+
+	/// <summary>
+	/// Start watching the folder files are served from
+	/// </summary>
+	bool AssetCache::Open(const string& folder)
+	{
+		Close();
+		this->folder = folder;
+
+#ifdef _WIN32
+		// one handle covers the whole tree but can't say which file changed
+		changeHandle = FindFirstChangeNotification(folder.c_str(), TRUE,
+			FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_DIR_NAME |
+			FILE_NOTIFY_CHANGE_SIZE | FILE_NOTIFY_CHANGE_LAST_WRITE);
+		watching = (changeHandle != INVALID_HANDLE_VALUE);
+#elif defined(__linux__)
+		notifyHandle = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+		watching = (notifyHandle != -1);
+		if (watching)
+			Watch("/");
+#endif
+		return watching;
+	}
+
+	/// <summary>
+	/// Stop watching and empty the cache
+	/// </summary>
+	void AssetCache::Close()
+	{
+		entries.clear();
+		lru.clear();
+		size = 0;
+		watches.clear();
+		watching = false;
+
+#ifdef _WIN32
+		if (changeHandle != INVALID_HANDLE_VALUE)
+			FindCloseChangeNotification(changeHandle);
+		changeHandle = INVALID_HANDLE_VALUE;
+#elif defined(__linux__)
+		if (notifyHandle != -1)
+			::close(notifyHandle);
+		notifyHandle = -1;
+#endif
+	}
+
+	/// <summary>
+	/// Watch a directory for changes to the files in it
+	/// </summary>
+	/// <param name="directoryUrl">url of the directory ending with '/'</param>
+	void AssetCache::Watch(const string& directoryUrl)
+	{
+#if defined(__linux__)
+		for (map<int, string>::iterator i = watches.begin(); i != watches.end(); ++i)
+		{
+			if ((*i).second == directoryUrl)
+				return;
+		}
+
+		int wd = inotify_add_watch(notifyHandle, (folder + directoryUrl).c_str(),
+			IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE | IN_CREATE | IN_DELETE |
+			IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF);
+		if (wd != -1)
+			watches[wd] = directoryUrl;
+#endif
+	}
+
+	/// <summary>
+	/// Apply pending change notifications; call once per update
+	/// </summary>
+	void AssetCache::Update()
+	{
+		if (!watching)
+			return;
+
+#ifdef _WIN32
+		if (WaitForSingleObject(changeHandle, 0) == WAIT_OBJECT_0)
+		{
+			Clear();
+			FindNextChangeNotification(changeHandle);
+		}
+#elif defined(__linux__)
+		char buffer[4096];
+		while (true)
+		{
+			int n = ::read(notifyHandle, buffer, sizeof(buffer));
+			if (n <= 0)
+				break;
+
+			for (int offset = 0; offset < n; )
+			{
+				const struct inotify_event* e = (const struct inotify_event*)(buffer + offset);
+				offset += sizeof(struct inotify_event) + e->len;
+
+				map<int, string>::iterator w = watches.find(e->wd);
+				if ((e->mask & (IN_Q_OVERFLOW | IN_IGNORED | IN_DELETE_SELF | IN_MOVE_SELF | IN_ISDIR)) ||
+					w == watches.end() || e->len == 0)
+				{
+					// lost track of something; start over
+					if (e->mask & IN_IGNORED)
+						watches.erase(e->wd);
+					Clear();
+					continue;
+				}
+				string url = (*w).second + e->name;
+				Remove(url);
+				if (Path::GetExtension(url) == ".gz")
+					Remove(url.substr(0, url.length() - 3));
+			}
+		}
+#endif
+	}
+
+	/// <summary>
+	/// Find an asset and mark it most recently used
+	/// </summary>
+	const AssetCache::Asset* AssetCache::Find(const string& url)
+	{
+		map<string, Entry>::iterator i = entries.find(url);
+		if (i == entries.end())
+			return NULL;
+
+		lru.splice(lru.begin(), lru, (*i).second.lru);
+		return &(*i).second.asset;
+	}
+
+	/// <summary>
+	/// Read a whole file no bigger than limit
+	/// </summary>
+	static bool ReadFile(const string& path, size_t limit, string& data)
+	{
+		ifstream fs(path.c_str(), ios::in | ios::binary);
+		if (!fs.is_open())
+			return false;
+
+		fs.seekg(0, ios::end);
+		size_t length = (size_t)fs.tellg();
+		if (length > limit)
+			return false;
+		fs.seekg(0, ios::beg);
+
+		data.resize(length);
+		return length == 0 || fs.read(&data[0], length);
+	}
+
+	/// <summary>
+	/// Read a file into the cache
+	/// </summary>
+	const AssetCache::Asset* AssetCache::Load(const string& url, const string& path, const string& etag)
+	{
+		if (!watching)
+			return NULL;
+
+		// watch before reading so a write in between is not missed
+		Watch(url.substr(0, url.rfind('/') + 1));
+
+		Asset asset;
+		if (!ReadFile(path, capacity / 4, asset.Data))
+			return NULL;
+		asset.ContentType = GetContentType(path);
+		asset.ETag = etag;
+
+		if (!ReadFile(path + ".gz", capacity / 4, asset.Gzip) &&
+			compressionLevel > 0 && HttpUtility::IsCompressible(asset.ContentType))
+		{
+			asset.Gzip.clear();
+			Deflate::Compress(asset.Data, asset.Gzip, compressionLevel, Deflate::FORMAT_GZIP);
+		}
+		if (asset.Gzip.length() >= asset.Data.length())
+			asset.Gzip.clear();
+
+		return Add(url, asset);
+	}
+
+	/// <summary>
+	/// Add an asset that has no file
+	/// </summary>
+	const AssetCache::Asset* AssetCache::Add(const string& url, Asset& asset)
+	{
+		Remove(url);
+		size_t cost = Cost(asset);
+		if (!asset.Pinned && cost > capacity / 4)
+			return NULL;
+
+		Evict(cost);
+
+		lru.push_front(url);
+		Entry& entry = entries[url];
+		entry.asset.Swap(asset);
+		entry.lru = lru.begin();
+		size += cost;
+		return &entry.asset;
+	}
+
+	/// <summary>
+	/// Drop one asset
+	/// </summary>
+	void AssetCache::Remove(const string& url)
+	{
+		map<string, Entry>::iterator i = entries.find(url);
+		if (i != entries.end())
+		{
+			size -= Cost((*i).second.asset);
+			lru.erase((*i).second.lru);
+			entries.erase(i);
+		}
+	}
+
+	/// <summary>
+	/// Drop all files; pinned assets stay
+	/// </summary>
+	void AssetCache::Clear()
+	{
+		for (map<string, Entry>::iterator i = entries.begin(); i != entries.end(); )
+		{
+			if ((*i).second.asset.Pinned)
+			{
+				++i;
+				continue;
+			}
+			size -= Cost((*i).second.asset);
+			lru.erase((*i).second.lru);
+			entries.erase(i++);
+		}
+	}
+
+	/// <summary>
+	/// Set the memory cap in bytes
+	/// </summary>
+	void AssetCache::SetCapacity(size_t bytes)
+	{
+		capacity = bytes;
+		Evict(0);
+	}
+
+	/// <summary>
+	/// Drop least recently used assets until there is room
+	/// </summary>
+	void AssetCache::Evict(size_t needed)
+	{
+		list<string>::iterator i = lru.end();
+		while (size + needed > capacity && i != lru.begin())
+		{
+			--i;
+			if (entries[*i].asset.Pinned)
+				continue;
+			string url = *i++;
+			Remove(url);
+		}
+	}
+
+	/// <summary>
+	/// Collapse repeated and backslash separators and "." segments
+	/// </summary>
+	string AssetCache::NormalizeUrl(const string& url)
+	{
+		string result;
+		result.reserve(url.length() + 1);
+
+		size_t i = 0;
+		while (i < url.length())
+		{
+			// skip separators
+			while (i < url.length() && (url[i] == '/' || url[i] == '\\'))
+				++i;
+
+			size_t start = i;
+			while (i < url.length() && url[i] != '/' && url[i] != '\\')
+				++i;
+
+			if (i == start || (i - start == 1 && url[start] == '.'))
+				continue;
+
+			result += '/';
+			result.append(url, start, i - start);
+		}
+
+		if (result.empty())
+			result = "/";
+		return result;
+	}
+
+	/// <summary>
+	/// Get the mime type for a file from its extension
+	/// </summary>
+	string AssetCache::GetContentType(const string& path)
+	{
+		string ext = StringHelper::tolower(Path::GetExtension(path));
+
+		if (ext == ".css") return "text/css";
+		if (ext == ".js") return "text/javascript";
+		if (ext == ".htm" || ext == ".html") return "text/html";
+		if (ext == ".txt" || ext == ".ini") return "text/plain";
+		if (ext == ".json") return "application/json";
+		if (ext == ".png") return "image/png";
+		if (ext == ".jpg" || ext == ".jpeg") return "image/jpeg";
+		if (ext == ".gif") return "image/gif";
+		if (ext == ".bmp") return "image/bmp";
+		if (ext == ".ico") return "image/x-icon";
+		if (ext == ".svg") return "image/svg+xml";
+		return "";
+	}
+}
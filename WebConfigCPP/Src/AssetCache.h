@@ -0,0 +1,157 @@
+// WebConfig - Use a web browser to configure your application
+// Copyright (c) 2009 David McClurg <dpm@efn.org>
+// Under the MIT License, details: License.txt.
+
+#ifndef ASSETCACHE_H
+#define ASSETCACHE_H
+
+#include <string>
+#include <map>
+#include <list>
+#include <algorithm>
+
+namespace WebConfig
+{
+	/// <summary>
+	/// In-memory cache of static files keyed by normalized url. Entries are
+	/// dropped when the file changes on disk, so hits need no file system calls.
+	/// </summary>
+	class AssetCache
+	{
+	public:
+
+		/// <summary>
+		/// A cached file
+		/// </summary>
+		class Asset
+		{
+		public:
+			std::string Data;
+			std::string ContentType;
+			std::string ETag;
+			std::string Gzip;	// gzip encoded data; empty if it doesn't pay
+			bool Pinned;		// not a file; kept until replaced or removed
+
+			Asset() : Pinned(false) {}
+
+			void Swap(Asset& other)
+			{
+				Data.swap(other.Data);
+				ContentType.swap(other.ContentType);
+				ETag.swap(other.ETag);
+				Gzip.swap(other.Gzip);
+				std::swap(Pinned, other.Pinned);
+			}
+		};
+
+		AssetCache();
+		~AssetCache();
+
+		/// <summary>
+		/// Start watching the folder files are served from
+		/// </summary>
+		/// <returns>false if change notification is unavailable; the cache stays empty</returns>
+		bool Open(const std::string& folder);
+
+		/// <summary>
+		/// Stop watching and empty the cache
+		/// </summary>
+		void Close();
+
+		/// <summary>
+		/// Apply pending change notifications; call once per update
+		/// </summary>
+		void Update();
+
+		/// <summary>
+		/// Find an asset and mark it most recently used
+		/// </summary>
+		/// <returns>NULL if not cached</returns>
+		const Asset* Find(const std::string& url);
+
+		/// <summary>
+		/// Read a file into the cache; least recently used assets are
+		/// evicted to stay within the capacity. A sibling file with ".gz"
+		/// added to the name is used as the gzip encoding, otherwise text is
+		/// compressed here.
+		/// </summary>
+		/// <param name="url">normalized url</param>
+		/// <param name="path">file to read</param>
+		/// <param name="etag">entity tag of the file</param>
+		/// <returns>NULL if the file is too big or can't be read</returns>
+		const Asset* Load(const std::string& url, const std::string& path, const std::string& etag);
+
+		/// <summary>
+		/// Add an asset that has no file, eg. one encoded in memory.
+		/// The data is swapped in, leaving asset empty. A pinned asset
+		/// may be bigger than a file and is never evicted.
+		/// </summary>
+		const Asset* Add(const std::string& url, Asset& asset);
+
+		/// <summary>
+		/// Drop one asset
+		/// </summary>
+		void Remove(const std::string& url);
+
+		/// <summary>
+		/// Drop all files; pinned assets stay
+		/// </summary>
+		void Clear();
+
+		/// <summary>
+		/// Set the memory cap in bytes; a single file may use a quarter of it
+		/// </summary>
+		void SetCapacity(size_t bytes);
+
+		/// <summary>
+		/// Set the deflate level used to compress text files; 0 turns it off
+		/// </summary>
+		void SetCompressionLevel(int level) { compressionLevel = level; }
+
+		/// <summary>
+		/// Bytes of file data held
+		/// </summary>
+		size_t GetSize() { return size; }
+
+		/// <summary>
+		/// Collapse repeated and backslash separators and "." segments
+		/// </summary>
+		static std::string NormalizeUrl(const std::string& url);
+
+		/// <summary>
+		/// Get the mime type for a file from its extension
+		/// </summary>
+		/// <returns>empty string if unknown</returns>
+		static std::string GetContentType(const std::string& path);
+
+	private:
+
+		class Entry
+		{
+		public:
+			Asset asset;
+			std::list<std::string>::iterator lru;
+		};
+
+		std::string folder;
+		std::map<std::string, Entry> entries;
+		std::list<std::string> lru;		// most recently used first
+		size_t size;
+		size_t capacity;
+		int compressionLevel;
+		bool watching;
+
+		/// directories being watched, url prefix keyed by watch handle
+		std::map<int, std::string> watches;
+		int notifyHandle;
+#ifdef _WIN32
+		void* changeHandle;
+#endif
+
+		void Watch(const std::string& directoryUrl);
+		void Evict(size_t needed);
+		static size_t Cost(const Asset& asset) { return asset.Data.length() + asset.Gzip.length(); }
+	};
+}
+
+#endif // #ifndef ASSETCACHE_H
@@ -0,0 +1,348 @@
+// WebConfig - Use a web browser to configure your application
+// Copyright (c) 2009 David McClurg <dpm@efn.org>
+// Under the MIT License, details: License.txt.
+
+#include "ChangeLog.h"
+#include "Support/Clock.h"
+
+#include <time.h>
+
+using namespace std;
+
+// The file starts with Magic, then holds records that each start with a tag:
+//   'S' varint(unix time)                     a session begins; ids start over
+//   'I' string(id) string(path)               the next id index is this input
+//   'V' varint(id index) varint(frame delta) varint(microsecond delta) byte(source) string(value)
+// Strings are a varint length and the bytes; deltas are from the session's last 'V'.
+static const char Magic[] = "WCLOG\x01";
+static const int MagicSize = 6;
+
+// milliseconds between batches
+static const int WriteInterval = 100;
+
+static void PutVarint(string& out, unsigned long long value)
+{
+	while (value >= 0x80)
+	{
+		out += (char)(value | 0x80);
+		value >>= 7;
+	}
+	out += (char)value;
+}
+
+static void PutString(string& out, const string& s)
+{
+	PutVarint(out, s.length());
+	out += s;
+}
+
+static bool GetVarint(const string& in, size_t& pos, unsigned long long& value)
+{
+	value = 0;
+	for (int shift = 0; pos < in.length() && shift < 64; shift += 7)
+	{
+		unsigned char c = (unsigned char)in[pos++];
+		value |= (unsigned long long)(c & 0x7F) << shift;
+		if ((c & 0x80) == 0)
+			return true;
+	}
+	return false;
+}
+
+static bool GetString(const string& in, size_t& pos, string& s)
+{
+	unsigned long long length;
+	if (!GetVarint(in, pos, length) || length > in.length() - pos)
+		return false;
+	s = in.substr(pos, (size_t)length);
+	pos += (size_t)length;
+	return true;
+}
+
+static bool ReadFile(const string& path, string& data)
+{
+	FILE* in = fopen(path.c_str(), "rb");
+	if (in == NULL)
+		return false;
+	char buffer[4096];
+	size_t n;
+	while ((n = fread(buffer, 1, sizeof(buffer), in)) > 0)
+		data.append(buffer, n);
+	fclose(in);
+	return true;
+}
+
+static bool HasMagic(const string& data)
+{
+	return data.compare(0, MagicSize, string(Magic, MagicSize)) == 0;
+}
+
+/// <summary>
+/// Decode the records of a log that starts with Magic
+/// </summary>
+/// <param name="changes">receives the changes, or NULL to only check the records</param>
+/// <returns>the length of the log up to the end of its last complete record</returns>
+static size_t Parse(const string& data, vector<WebConfig::ChangeLog::Change>* changes)
+{
+	typedef WebConfig::ChangeLog::Change Change;
+
+	// sessions are replayed one after another
+	vector<string> sessionIds;
+	vector<string> sessionPaths;
+	unsigned int base = 0;
+	unsigned int frame = 0;
+	unsigned int lastFrame = 0;
+	bool any = false;
+	long long microseconds = 0;
+	size_t pos = MagicSize;
+	size_t complete = pos;
+
+	// a record cut short by a crash ends the log
+	while (pos < data.length())
+	{
+		char tag = data[pos++];
+		unsigned long long value;
+		if (tag == 'S')
+		{
+			if (!GetVarint(data, pos, value))
+				break;
+			if (any)
+				base = lastFrame + 1;
+			sessionIds.clear();
+			sessionPaths.clear();
+			frame = 0;
+			microseconds = 0;
+		}
+		else if (tag == 'I')
+		{
+			string id, idPath;
+			if (!GetString(data, pos, id) || !GetString(data, pos, idPath))
+				break;
+			sessionIds.push_back(id);
+			sessionPaths.push_back(idPath);
+		}
+		else if (tag == 'V')
+		{
+			unsigned long long index, frames, micros;
+			Change change;
+			if (!GetVarint(data, pos, index) || index >= sessionIds.size() ||
+				!GetVarint(data, pos, frames) || !GetVarint(data, pos, micros) ||
+				pos >= data.length())
+				break;
+			change.From = (WebConfig::ChangeLog::Source)data[pos++];
+			if (!GetString(data, pos, change.Value))
+				break;
+			frame += (unsigned int)frames;
+			microseconds += (long long)micros;
+			change.Frame = base + frame;
+			change.Time = microseconds * 1e-6;
+			change.Id = sessionIds[(size_t)index];
+			change.Path = sessionPaths[(size_t)index];
+			lastFrame = change.Frame;
+			any = true;
+			if (changes != NULL)
+				changes->push_back(change);
+		}
+		else
+			break;
+		complete = pos;
+	}
+	return complete;
+}
+
+namespace WebConfig
+{
+	ChangeLog::ChangeLog()
+	{
+		file = NULL;
+		openTime = 0;
+		lastFrame = 0;
+		lastMicroseconds = 0;
+	}
+
+	ChangeLog::~ChangeLog()
+	{
+		Close();
+	}
+
+	/// <summary>
+	/// Start a session at the end of a log file
+	/// </summary>
+	bool ChangeLog::Open(const string& path)
+	{
+		Close();
+
+		// a record cut short by a crash would swallow the start of this session,
+		// so the log is cut back to its last complete record first
+		string data;
+		if (ReadFile(path, data) && !data.empty())
+		{
+			size_t complete;
+			if (HasMagic(data))
+				complete = Parse(data, NULL);
+			else if (data.length() < (size_t)MagicSize && data.compare(0, data.length(), Magic, data.length()) == 0)
+				complete = 0;
+			else
+				return false;	// not a change log
+
+			if (complete < data.length())
+			{
+				FILE* out = fopen(path.c_str(), "wb");
+				if (out == NULL)
+					return false;
+				fwrite(data.data(), 1, complete, out);
+				fclose(out);
+			}
+		}
+
+		file = fopen(path.c_str(), "ab");
+		if (file == NULL)
+			return false;
+
+		string header;
+		fseek(file, 0, SEEK_END);
+		if (ftell(file) == 0)
+			header.append(Magic, MagicSize);
+		header += 'S';
+		PutVarint(header, (unsigned long long)time(NULL));
+		fwrite(header.data(), 1, header.length(), file);
+		fflush(file);
+
+		ids.clear();
+		lastFrame = 0;
+		lastMicroseconds = 0;
+		openTime = Clock::Seconds();
+		// without a thread, Record writes each change itself
+		writer.Start(&WriterMain, this);
+		return true;
+	}
+
+	/// <summary>
+	/// Write what is queued and close the file
+	/// </summary>
+	void ChangeLog::Close()
+	{
+		if (writer.IsRunning())
+		{
+			stop.Post();
+			writer.Join();
+		}
+		if (file != NULL)
+		{
+			Write();
+			fclose(file);
+			file = NULL;
+		}
+	}
+
+	/// <summary>
+	/// Queue a change
+	/// </summary>
+	void ChangeLog::Record(unsigned int frame, Source from, const string& id,
+		const string& path, const string& value)
+	{
+		if (file == NULL)
+			return;
+
+		Change change;
+		change.Frame = frame;
+		change.Time = Clock::Seconds() - openTime;
+		change.From = from;
+		change.Id = id;
+		change.Path = path;
+		change.Value = value;
+		{
+			MutexLock hold(lock);
+			queue.push_back(change);
+		}
+		if (!writer.IsRunning())
+			Write();
+	}
+
+	void ChangeLog::WriterMain(void* arg)
+	{
+		((ChangeLog*)arg)->Run();
+	}
+
+	/// <summary>
+	/// Write a batch every WriteInterval until Close
+	/// </summary>
+	void ChangeLog::Run()
+	{
+		while (!stop.Wait(WriteInterval))
+			Write();
+	}
+
+	/// <summary>
+	/// Encode and write the queued changes
+	/// </summary>
+	void ChangeLog::Write()
+	{
+		vector<Change> changes;
+		{
+			MutexLock hold(lock);
+			changes.swap(queue);
+		}
+		if (changes.empty())
+			return;
+
+		string out;
+		for (unsigned int i = 0; i < changes.size(); i++)
+		{
+			const Change& change = changes[i];
+			map<string, unsigned int>::iterator id = ids.find(change.Id);
+			if (id == ids.end())
+			{
+				out += 'I';
+				PutString(out, change.Id);
+				PutString(out, change.Path);
+				id = ids.insert(make_pair(change.Id, (unsigned int)ids.size())).first;
+			}
+
+			// frames and times only go forward within a session
+			long long microseconds = (long long)(change.Time * 1e6);
+			if (microseconds < lastMicroseconds)
+				microseconds = lastMicroseconds;
+			unsigned int frame = (change.Frame < lastFrame)? lastFrame: change.Frame;
+
+			out += 'V';
+			PutVarint(out, (*id).second);
+			PutVarint(out, frame - lastFrame);
+			PutVarint(out, (unsigned long long)(microseconds - lastMicroseconds));
+			out += (char)change.From;
+			PutString(out, change.Value);
+			lastFrame = frame;
+			lastMicroseconds = microseconds;
+		}
+		fwrite(out.data(), 1, out.length(), file);
+		fflush(file);
+	}
+
+	/// <summary>
+	/// Read every change in a log file
+	/// </summary>
+	bool ChangeLog::Read(const string& path, vector<Change>& changes)
+	{
+		string data;
+		if (!ReadFile(path, data) || !HasMagic(data))
+			return false;
+		Parse(data, &changes);
+		return true;
+	}
+
+	/// <summary>
+	/// Get the name of a source
+	/// </summary>
+	const char* ChangeLog::GetSourceName(Source from)
+	{
+		switch (from)
+		{
+		case SOURCE_POST: return "post";
+		case SOURCE_API: return "api";
+		case SOURCE_RESTORE: return "restore";
+		case SOURCE_REPLAY: return "replay";
+		case SOURCE_PRESET: return "preset";
+		default: return "unknown";
+		}
+	}
+}
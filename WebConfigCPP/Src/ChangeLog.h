@@ -0,0 +1,109 @@
+// WebConfig - Use a web browser to configure your application
+// Copyright (c) 2009 David McClurg <dpm@efn.org>
+// Under the MIT License, details: License.txt.
+
+#ifndef CHANGELOG_H
+#define CHANGELOG_H
+
+#include "Support/Thread.h"
+
+#include <string>
+#include <vector>
+#include <map>
+#include <stdio.h>
+
+namespace WebConfig
+{
+	/// <summary>
+	/// Append-only binary log of input value changes, with the frame and
+	/// time each was applied and where it came from. The frame thread only
+	/// queues changes; a writer thread encodes and writes them in batches.
+	/// Each Open starts a session in the file; Read returns the changes of
+	/// every session with frames counted on across them, ready to replay.
+	/// </summary>
+	class ChangeLog
+	{
+	public:
+
+		enum Source
+		{
+			SOURCE_POST,		// form post or WebSocket message
+			SOURCE_API,			// POST /api/inputs
+			SOURCE_RESTORE,		// saved value restored when the input was added
+			SOURCE_REPLAY,		// re-applied from a log
+			SOURCE_PRESET		// a preset was applied
+		};
+
+		/// <summary>
+		/// One value change
+		/// </summary>
+		struct Change
+		{
+			unsigned int Frame;	// Update count since the log was opened
+			double Time;		// seconds since the log was opened
+			Source From;
+			std::string Id;		// UniqueID of the input
+			std::string Path;	// "form-name/label-text", for people reading the log
+			std::string Value;
+		};
+
+		ChangeLog();
+		~ChangeLog();
+
+		/// <summary>
+		/// Start a session at the end of a log file, creating it if need be.
+		/// A record cut short by a crash is cut off the end first.
+		/// </summary>
+		/// <returns>false if the file can't be opened for writing or isn't a change log</returns>
+		bool Open(const std::string& path);
+
+		/// <summary>
+		/// Write what is queued and close the file
+		/// </summary>
+		void Close();
+
+		bool IsOpen() const { return file != NULL; }
+
+		/// <summary>
+		/// Queue a change made on the given frame since Open; cheap enough
+		/// to call on the frame thread for every change
+		/// </summary>
+		void Record(unsigned int frame, Source from, const std::string& id,
+			const std::string& path, const std::string& value);
+
+		/// <summary>
+		/// Read every change in a log file
+		/// </summary>
+		/// <returns>false if the file can't be read or isn't a change log</returns>
+		static bool Read(const std::string& path, std::vector<Change>& changes);
+
+		/// <summary>
+		/// Get the name of a source, eg. "post"
+		/// </summary>
+		static const char* GetSourceName(Source from);
+
+	private:
+
+		FILE* file;
+		double openTime;
+
+		Mutex lock;						// guards queue
+		std::vector<Change> queue;		// recorded, waiting for the writer
+		Semaphore stop;
+		Thread writer;
+
+		// the writer's state for the session; ids are written once and then referred to by index
+		std::map<std::string, unsigned int> ids;
+		unsigned int lastFrame;
+		long long lastMicroseconds;
+
+		static void WriterMain(void* arg);
+		void Run();
+		void Write();
+
+		ChangeLog(const ChangeLog&);
+		ChangeLog& operator=(const ChangeLog&);
+	};
+}
+
+#endif // #ifndef CHANGELOG_H
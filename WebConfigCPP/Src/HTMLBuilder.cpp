@@ -6,6 +6,12 @@
 #include "Support/HttpUtility.h"
 #include <cassert>
 #include <stdarg.h>
+#include <stdio.h>
+
+#ifndef _WIN32
+#	include <strings.h>
+#	define _stricmp strcasecmp
+#endif
 
 using namespace std;
 
@@ -19,7 +25,11 @@ namespace WebConfig
 		char temp[1024];
 		va_list args;
 		va_start (args, format);
+#ifdef _WIN32
 		vsprintf_s (temp, sizeof(temp), format, args);
+#else
+		vsnprintf (temp, sizeof(temp), format, args);
+#endif
 		va_end (args);
 		return string(temp);
 	}
@@ -5,11 +5,22 @@
 #include "Support/asynchat.h"
 #include "Support/Convert.h"
 #include "HTTPServer.h"
-#include "Support/HTTPUtility.h"
+#include "Support/HttpUtility.h"
+#include "Support/StringHelper.h"
+#include "Support/Sha1.h"
+#include "Support/Deflate.h"
+#include "Support/Thread.h"
+#include "Support/Clock.h"
+#include "Support/Trace.h"
 
 #include <string>
 #include <map>
+#include <vector>
+#include <stdio.h>
 #include <stdlib.h>
+#ifndef _WIN32
+#	include <netinet/tcp.h>
+#endif
 
 using namespace std;
 
@@ -28,99 +39,1444 @@ namespace WebConfig
 		STATE_OK
 	};
 
+	enum WebSocketOpcode
+	{
+		WS_CONTINUATION = 0x0,
+		WS_TEXT = 0x1,
+		WS_BINARY = 0x2,
+		WS_CLOSE = 0x8,
+		WS_PING = 0x9,
+		WS_PONG = 0xA
+	};
+
+	// largest WebSocket message accepted from a client
+	static const unsigned int MaxMessageSize = 64 * 1024;
+
+	// more ranges than this in one request are ignored and the whole body is sent
+	static const unsigned int MaxRanges = 16;
+
+	// separates the parts of a multiple range response
+	static const char* const RangeBoundary = "WebConfigByteRange";
+
+	/// <summary>
+	/// Inclusive byte positions of one range
+	/// </summary>
+	struct ByteRange
+	{
+		long long First;
+		long long Last;
+		ByteRange(long long first, long long last) : First(first), Last(last) {}
+	};
+
+	// largest slice of queued data moved into a channel's output buffer at once
+	static const size_t SendSlice = 64 * 1024;
+
+	/// <summary>
+	/// Published data shared by every subscriber it is sent to
+	/// </summary>
+	struct SharedData
+	{
+		string Data;
+		int Refs;
+	};
+
+	/// <summary>
+	/// Produces one subscriber's copy of published data in large slices;
+	/// the last one done with the data frees it
+	/// </summary>
+	class SharedProducer : public async_sockets::producer
+	{
+		SharedData* shared;
+		size_t offset;
+
+		SharedProducer(const SharedProducer&);
+		SharedProducer& operator=(const SharedProducer&);
+
+	public:
+
+		SharedProducer(SharedData* data) : shared(data), offset(0) { ++shared->Refs; }
+
+		~SharedProducer()
+		{
+			if (--shared->Refs == 0)
+				delete shared;
+		}
+
+		string* more (void)
+		{
+			size_t n = shared->Data.length() - offset;
+			if (n > SendSlice)
+				n = SendSlice;
+			string* slice = new string(shared->Data, offset, n);
+			offset += n;
+			return slice;
+		}
+	};
+
+	/// <summary>
+	/// Reads part of a file as the client takes it
+	/// </summary>
+	class FileProducer : public async_sockets::producer
+	{
+		ifstream fs;
+		long long remaining;
+
+	public:
+
+		FileProducer(const string& path, long long first, long long count) : remaining(count)
+		{
+			fs.open(path.c_str(), ios::in|ios::binary);
+			if (fs.is_open())
+				fs.seekg((streamoff)first, ios::beg);
+			else
+				remaining = 0;
+		}
+
+		string* more (void)
+		{
+			string* slice = new string;
+			if (remaining > 0)
+			{
+				size_t n = (remaining < (long long)SendSlice)? (size_t)remaining: SendSlice;
+				slice->resize(n);
+				fs.read(&(*slice)[0], (streamsize)n);
+				slice->resize((size_t)fs.gcount());
+
+				// a file that shrank ends early
+				remaining = slice->empty()? 0: remaining - (long long)slice->length();
+			}
+			return slice;
+		}
+	};
+
 	class Channel : public async_sockets::async_chat
 	{
 		class HTTPServer* parent;
 		string input_buffer;
+		HTTPRequestParams request;
+		bool readingBody;	// headers parsed; collecting request.BodyData
+		bool webSocket;		// upgraded to RFC 6455 framing
+		string message;		// fragments of the current WebSocket message
+		bool fragmented;	// a message has started and its final fragment hasn't arrived
+		string topic;		// subscribed; the response stays open for published data
+		bool closing;		// the last response is going out; the rest of the input is ignored
+		bool keepAlive;		// the current request lets the connection stay open after it
+		bool waiting;		// between requests on a kept alive connection
+		bool suspended;		// too much output queued to read more requests
+		long long parked;	// ticket of the request waiting for Resume, or 0
+		string parkedInput;	// what arrived behind that request
+		unsigned long long bytes_queued;	// total bytes given to send
+		long long parseTime;	// nanoseconds spent parsing the current request
+		long long sendStart;	// when the unsent response was queued, or 0
+		int sendRoute;			// route of that response
+		async_sockets::member_timer<Channel> read_timer;	// request or idle deadline
+		async_sockets::member_timer<Channel> write_timer;	// deadline for queued output to move
 
 	public:
 
-		Channel(HTTPServer* p) : parent(p) {}
-		void collect_incoming_data (const string& data)
-		{
-			input_buffer.append (data);
-		}
+		Channel(HTTPServer* p) : parent(p), readingBody(false), webSocket(false), fragmented(false),
+			closing(false), keepAlive(false), waiting(false), suspended(false), parked(0), bytes_queued(0),
+			parseTime(0), sendStart(0), sendRoute(0),
+			read_timer(this, &Channel::read_timeout, &p->get_reactor()->timers),
+			write_timer(this, &Channel::write_timeout, &p->get_reactor()->timers) {}
+		bool idle() const { return ac_out_buffer.empty() && producer_fifo.empty(); }
+		size_t queued() const { return (size_t)(bytes_queued - bytes_sent); }
+		void start();
+		void read_timeout();
+		void write_timeout();
+		void evict();
+		void reject(int status);
+		void send(const string& data);
+		void send(SharedData* shared);
+		void send(FileProducer* file, long long count);
+		void watch_output();
+		bool readable(void);
+		void handle_read(void);
+		void handle_write(void);
+		void collect_incoming_data (const string& data);
 		void found_terminator (void);
-		void handle_close (void) {}
+		void handle_close (void);
 		void handle_request();
+		void finish_request();
+		void respond(bool ok);
+		void park(long long ticket);
+		void resume();
+		void subscribe(HTTPResponse& response);
+		void encode(HTTPResponse& response);
+		bool select_ranges(HTTPResponse& response, long long length, vector<ByteRange>& ranges);
+		void send_body(HTTPResponse& response, long long first, long long count);
+
+		bool upgrade(const HTTPRequestParams& rq);
+		void handle_frames();
+		void send_frame(int opcode, const string& payload);
+		void close_websocket(const string& reason);
+	};
+
+	// how often a reactor copies its counters for the starting thread, in milliseconds
+	static const unsigned int ShareInterval = 100;
+
+	/// <summary>
+	/// One thread serving the port: a server of its own on a reactor of its
+	/// own, and a queue of messages and published data from the thread that
+	/// started the front server. Counters are copied for that thread
+	/// every ShareInterval.
+	/// </summary>
+	class ServerReactor
+	{
+	public:
+
+		/// <summary>
+		/// What a reactor's server copies from the front server
+		/// </summary>
+		struct Settings
+		{
+			int CompressionLevel;
+			size_t CompressionThreshold;
+			bool LogRequests;
+			HTTPServerLimits Limits;
+		};
+
+	private:
+
+		enum MessageKind { MESSAGE_BROADCAST, MESSAGE_PUBLISH, MESSAGE_RESUME, MESSAGE_SETTINGS };
+
+		struct Message
+		{
+			MessageKind Kind;
+			string Topic;
+			string Data;
+			long long Ticket;
+			Settings Config;
+		};
+
+		async_sockets::reactor reactor;
+		HTTPServer server;
+		Thread thread;
+		async_sockets::member_timer<ServerReactor> shareTimer;
+
+		Mutex lock;		// guards what follows
+		vector<Message> queue;
+		bool stopping;
+		int connections;
+		size_t queuedBytes;
+		HTTPServerStats stats;
+		map<string, int> subscriberCounts;
+
+		ServerReactor(const ServerReactor&);
+		ServerReactor& operator=(const ServerReactor&);
+
+		static void Run(void* arg);
+		void Loop();
+		void Share();
+		void Apply(const Settings& settings);
+
+	public:
+
+		ServerReactor(const HTTPServer& front, int index, int reactorCount);
+
+		bool Start(int portNum);
+		void Stop();
+
+		/// <summary>
+		/// Queue a Broadcast or a Publish for the reactor's thread
+		/// </summary>
+		void Post(bool broadcast, const string& topic, const string& data);
+
+		/// <summary>
+		/// Queue a Resume for the reactor's thread
+		/// </summary>
+		void Resume(long long ticket);
+
+		/// <summary>
+		/// Queue new settings for the reactor's thread
+		/// </summary>
+		void Configure(const Settings& settings);
+
+		/// <summary>
+		/// Get the front server's settings with the share of MaxConnections for reactor index
+		/// </summary>
+		static Settings GetSettings(const HTTPServer& front, int index, int reactorCount);
+
+		int GetConnectionCount();
+		size_t GetQueuedBytes();
+		HTTPServerStats GetStats();
+		int GetSubscriberCount(const string& topic);
 	};
 
+	static string GetStatusString(int status)
+	{
+		switch (status)
+		{
+		case RESPONSE_SWITCHING_PROTOCOLS: return "101 Switching Protocols";
+		case RESPONSE_OK: return "200 Ok";
+		case RESPONSE_ACCEPTED: return "202 Accepted";
+		case RESPONSE_PARTIAL_CONTENT: return "206 Partial Content";
+		case RESPONSE_NOT_MODIFIED: return "304 Not Modified";
+		case RESPONSE_BAD_REQUEST: return "400 Bad Request";
+		case RESPONSE_NOT_FOUND: return "404 Not Found";
+		case RESPONSE_REQUEST_TIMEOUT: return "408 Request Timeout";
+		case RESPONSE_PAYLOAD_TOO_LARGE: return "413 Payload Too Large";
+		case RESPONSE_RANGE_NOT_SATISFIABLE: return "416 Range Not Satisfiable";
+		case RESPONSE_HEADER_FIELDS_TOO_LARGE: return "431 Request Header Fields Too Large";
+		case RESPONSE_SERVICE_UNAVAILABLE: return "503 Service Unavailable";
+		default: return Convert::ToString(status);
+		}
+	}
+
 	static void WriteLog(string msg)
 	{
 		cerr << msg << endl;
 	}
 
-	void HTTPServer::handle_accept (void)
+	// upper bounds of the histogram buckets served, in nanoseconds and as labels
+	static const long long MetricBounds[] =
+	{
+		10000LL, 25000LL, 50000LL, 100000LL, 250000LL, 500000LL,
+		1000000LL, 2500000LL, 5000000LL, 10000000LL, 25000000LL, 50000000LL,
+		100000000LL, 250000000LL, 500000000LL, 1000000000LL, 2500000000LL
+	};
+	static const char* const MetricBoundLabels[] =
+	{
+		"0.00001", "0.000025", "0.00005", "0.0001", "0.00025", "0.0005",
+		"0.001", "0.0025", "0.005", "0.01", "0.025", "0.05",
+		"0.1", "0.25", "0.5", "1", "2.5"
+	};
+	static const char* const PhaseNames[HTTPServerMetrics::PHASE_COUNT] = { "parse", "render", "send" };
+
+	HTTPServerMetrics::HTTPServerMetrics() :
+		BytesReceived(0), BytesSent(0), ConnectionsAccepted(0), ConnectionsRejected(0),
+		ConnectionsClosed(0), Errors(0)
+	{
+		for (int i = 0; i < 5; i++)
+			Responses[i] = 0;
+		AddRoute("other");
+		AddRoute("metrics");
+		AddRoute("trace");
+	}
+
+	HTTPServerMetrics::~HTTPServerMetrics()
+	{
+		for (unsigned int i = 0; i < histograms.size(); i++)
+			delete histograms[i];
+	}
+
+	int HTTPServerMetrics::AddRoute(const string& name)
+	{
+		for (unsigned int i = 0; i < routes.size(); i++)
+		{
+			if (routes[i] == name)
+				return (int)i;
+		}
+
+		routes.push_back(name);
+		for (int i = 0; i < PHASE_COUNT; i++)
+			histograms.push_back(new Histogram);
+		return (int)routes.size() - 1;
+	}
+
+	int HTTPServerMetrics::FindRoute(const string& name) const
+	{
+		for (unsigned int i = 0; i < routes.size(); i++)
+		{
+			if (routes[i] == name)
+				return (int)i;
+		}
+		return 0;
+	}
+
+	void HTTPServerMetrics::CountResponse(int status)
+	{
+		int statusClass = status / 100 - 1;
+		if (statusClass >= 0 && statusClass < 5)
+			Count(Responses[statusClass]);
+		if (status >= 400)
+			Count(Errors);
+	}
+
+	// one sample of a metric
+	static void WriteSample(string& out, const char* name, const string& labels, long long value)
+	{
+		out += name;
+		if (!labels.empty())
+			out += "{" + labels + "}";
+		out += " " + Convert::ToString(value) + "\n";
+	}
+
+	// the help and type lines before a metric
+	static void WriteHeader(string& out, const char* name, const char* type, const char* help)
+	{
+		out += string("# HELP ") + name + " " + help + "\n";
+		out += string("# TYPE ") + name + " " + type + "\n";
+	}
+
+	void HTTPServerMetrics::Write(string& out) const
+	{
+		static const char* const duration = "webconfig_http_request_duration_seconds";
+		WriteHeader(out, duration, "histogram", "Time spent in each phase of a request, by route.");
+		for (unsigned int r = 0; r < routes.size(); r++)
+		{
+			for (int p = 0; p < PHASE_COUNT; p++)
+			{
+				const Histogram& h = GetHistogram(r, (Phase)p);
+				long long count = h.CountAtOrBelow(0x7fffffffffffffffLL);
+				if (count == 0)
+					continue;
+
+				string labels = "route=\"" + routes[r] + "\",phase=\"" + PhaseNames[p] + "\"";
+				for (unsigned int b = 0; b < sizeof(MetricBounds) / sizeof(MetricBounds[0]); b++)
+				{
+					WriteSample(out, "webconfig_http_request_duration_seconds_bucket",
+						labels + ",le=\"" + MetricBoundLabels[b] + "\"", h.CountAtOrBelow(MetricBounds[b]));
+				}
+				WriteSample(out, "webconfig_http_request_duration_seconds_bucket", labels + ",le=\"+Inf\"", count);
+
+				char sum[32];
+				sprintf(sum, "%.9f", h.GetSum() * 1e-9);
+				out += "webconfig_http_request_duration_seconds_sum{" + labels + "} " + sum + "\n";
+				WriteSample(out, "webconfig_http_request_duration_seconds_count", labels, count);
+			}
+		}
+
+		WriteHeader(out, "webconfig_http_received_bytes_total", "counter", "Bytes read from clients.");
+		WriteSample(out, "webconfig_http_received_bytes_total", "", Atomic::Load(BytesReceived));
+		WriteHeader(out, "webconfig_http_sent_bytes_total", "counter", "Bytes written to clients.");
+		WriteSample(out, "webconfig_http_sent_bytes_total", "", Atomic::Load(BytesSent));
+
+		long long accepted = Atomic::Load(ConnectionsAccepted);
+		WriteHeader(out, "webconfig_http_connections_accepted_total", "counter", "Client connections taken.");
+		WriteSample(out, "webconfig_http_connections_accepted_total", "", accepted);
+		WriteHeader(out, "webconfig_http_connections_rejected_total", "counter", "Client connections refused at the connection limit.");
+		WriteSample(out, "webconfig_http_connections_rejected_total", "", Atomic::Load(ConnectionsRejected));
+		WriteHeader(out, "webconfig_http_connections_open", "gauge", "Client connections open now.");
+		WriteSample(out, "webconfig_http_connections_open", "", accepted - Atomic::Load(ConnectionsClosed));
+
+		WriteHeader(out, "webconfig_http_responses_total", "counter", "Responses sent, by status class.");
+		for (int i = 0; i < 5; i++)
+		{
+			string labels = "code=\"" + Convert::ToString(i + 1) + "xx\"";
+			WriteSample(out, "webconfig_http_responses_total", labels, Atomic::Load(Responses[i]));
+		}
+		WriteHeader(out, "webconfig_http_errors_total", "counter", "Responses of 400 and up, and clients dropped for not reading.");
+		WriteSample(out, "webconfig_http_errors_total", "", Atomic::Load(Errors));
+	}
+
+	void HTTPServer::handle_accept (void)
+	{
+		TraceScope trace("accept");
+		struct sockaddr addr;
+		int addr_len = sizeof(sockaddr);
+		int fd = async_sockets::dispatcher::accept (&addr, &addr_len);
+		if (fd < 0)
+			return;
+
+		// full up; say so without spending a channel on it
+		if ((int)clients.size() >= Limits.MaxConnections)
+		{
+			static const char busy[] = "HTTP/1.1 503 Service Unavailable\r\n"
+				"Retry-After: 1\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+			::send(fd, busy, sizeof(busy) - 1, 0);
+#ifdef _WIN32
+			closesocket(fd);
+#else
+			::close(fd);
+#endif
+			Stats.Rejected++;
+			HTTPServerMetrics::Count(metrics->ConnectionsRejected);
+			metrics->CountResponse(RESPONSE_SERVICE_UNAVAILABLE);
+			return;
+		}
+
+		Channel * jc = new Channel(this);
+		jc->set_reactor (get_reactor());
+		jc->set_fileno (fd);
+		jc->set_blocking (0);
+		// a response goes out in pieces; don't let Nagle hold back the last one
+		int noDelay = 1;
+		setsockopt (fd, IPPROTO_TCP, TCP_NODELAY, (const char*)&noDelay, sizeof(noDelay));
+		jc->set_terminator ("\r\n\r\n");
+		jc->start();
+		clients.insert(jc);
+		Stats.Accepted++;
+		HTTPServerMetrics::Count(metrics->ConnectionsAccepted);
+	}
+
+	HTTPServer::~HTTPServer()
+	{
+		Stop();
+		if (ownsMetrics)
+			delete metrics;
+	}
+
+	/// <summary>
+	/// Record into another server's metrics instead of our own
+	/// </summary>
+	void HTTPServer::ShareMetrics(HTTPServerMetrics* shared)
+	{
+		if (ownsMetrics)
+			delete metrics;
+		metrics = shared;
+		ownsMetrics = false;
+	}
+
+	/// <summary>
+	/// Start the listener, or the reactors
+	/// </summary>
+	/// <param name="portNum">Port on which to listen</param>
+	/// <param name="reactorCount">number of threads serving the port, or 0</param>
+	void HTTPServer::Start(int portNum, int reactorCount)
+	{
+#ifdef _WIN32
+		WSADATA wd;
+		WSAStartup (MAKEWORD (1,1), &wd);
+#endif
+
+		if (reactorCount > 0)
+		{
+#ifdef SO_REUSEPORT
+			for (int i = 0; i < reactorCount; i++)
+			{
+				ServerReactor* reactor = new ServerReactor(*this, i, reactorCount);
+				if (!reactor->Start(portNum))
+				{
+					delete reactor;
+					break;
+				}
+				reactors.push_back(reactor);
+			}
+			if (!reactors.empty())
+				return;
+#endif
+			cerr << "reactors: not available, serving from Update" << endl;
+		}
+
+		Listen(portNum, false);
+	}
+
+	/// <summary>
+	/// Open the listening socket
+	/// </summary>
+	/// <param name="portNum">Port on which to listen</param>
+	/// <param name="sharePort">let other sockets listen on the port too</param>
+	void HTTPServer::Listen(int portNum, bool sharePort)
+	{
+		cerr << "create: " << create_socket (AF_INET, SOCK_STREAM) << endl;
+
+#ifdef SO_REUSEPORT
+		if (sharePort)
+		{
+			int on = 1;
+			setsockopt (get_fileno(), SOL_SOCKET, SO_REUSEPORT, (const char*)&on, sizeof(on));
+		}
+#endif
+
+		struct sockaddr_in addr;
+		addr.sin_family = AF_INET;
+		addr.sin_port = htons (portNum);
+		addr.sin_addr.s_addr = htonl (INADDR_ANY);
+
+		cerr << "bind: " << bind ((struct sockaddr *) &addr, sizeof (addr)) << endl;
+		cerr << "listen: " << listen (SOMAXCONN) << endl;
+	}
+
+	/// <summary>
+	/// Stop the listener
+	/// </summary>
+	void HTTPServer::Stop()
+	{
+		for (unsigned int i = 0; i < reactors.size(); i++)
+		{
+			reactors[i]->Stop();
+			delete reactors[i];
+		}
+		reactors.clear();
+
+		for (set<Channel*>::iterator i = clients.begin(); i != clients.end(); ++i)
+		{
+			if (!(*i)->closed)
+			{
+				(*i)->handle_close();
+				(*i)->close();
+			}
+		}
+		if (accepting && !closed)
+			close();
+		Reap();
+	}
+
+	void HTTPServer::Update()
+	{
+		// reactors poll on their own threads
+		if (!reactors.empty())
+			return;
+
+		// the request, idle and slow client deadlines run from here too
+		if (get_reactor()->channels.size())
+		{
+			/* Return immediately */
+			struct timeval timeout;
+			timeout.tv_sec = 0;
+			timeout.tv_usec = 0;
+
+			get_reactor()->poll (&timeout);
+		}
+
+		Reap();
+	}
+
+	/// <summary>
+	/// Delete closed client connections
+	/// </summary>
+	void HTTPServer::Reap()
+	{
+		// out of the socket map first so nothing polls them after they are gone
+		get_reactor()->delete_closed_channels();
+
+		for (set<Channel*>::iterator i = clients.begin(); i != clients.end(); )
+		{
+			Channel* channel = *i;
+			if (channel->closed)
+			{
+				clients.erase(i++);
+				delete channel;
+				HTTPServerMetrics::Count(metrics->ConnectionsClosed);
+			}
+			else
+			{
+				++i;
+			}
+		}
+	}
+
+	/// <summary>
+	/// Hand the compression settings, limits and LogRequests to the reactors
+	/// </summary>
+	void HTTPServer::ShareSettings()
+	{
+		for (unsigned int i = 0; i < reactors.size(); i++)
+			reactors[i]->Configure(ServerReactor::GetSettings(*this, (int)i, (int)reactors.size()));
+	}
+
+	/// <summary>
+	/// Get the output bytes waiting to be sent, over every connection
+	/// </summary>
+	size_t HTTPServer::GetQueuedBytes() const
+	{
+		size_t total = 0;
+		for (unsigned int i = 0; i < reactors.size(); i++)
+			total += reactors[i]->GetQueuedBytes();
+		for (set<Channel*>::const_iterator i = clients.begin(); i != clients.end(); ++i)
+			total += (*i)->queued();
+		return total;
+	}
+
+	/// <summary>
+	/// Get the number of open client connections
+	/// </summary>
+	int HTTPServer::GetConnectionCount() const
+	{
+		int total = (int)clients.size();
+		for (unsigned int i = 0; i < reactors.size(); i++)
+			total += reactors[i]->GetConnectionCount();
+		return total;
+	}
+
+	/// <summary>
+	/// Get the counters, summed over the reactors if there are any
+	/// </summary>
+	HTTPServerStats HTTPServer::GetStats() const
+	{
+		HTTPServerStats total = Stats;
+		for (unsigned int i = 0; i < reactors.size(); i++)
+		{
+			HTTPServerStats stats = reactors[i]->GetStats();
+			total.Accepted += stats.Accepted;
+			total.Rejected += stats.Rejected;
+			total.Evicted += stats.Evicted;
+			total.ReadsSuspended += stats.ReadsSuspended;
+			total.HeadersTooLarge += stats.HeadersTooLarge;
+			total.BodiesTooLarge += stats.BodiesTooLarge;
+			total.RequestsTimedOut += stats.RequestsTimedOut;
+			total.IdleClosed += stats.IdleClosed;
+		}
+		return total;
+	}
+
+	ServerReactor::ServerReactor(const HTTPServer& front, int index, int reactorCount) :
+		server(front.OnResponse),
+		shareTimer(this, &ServerReactor::Share, &reactor.timers),
+		stopping(false),
+		connections(0),
+		queuedBytes(0)
+	{
+		server.OnMessage = front.OnMessage;
+		server.MetricsUrl = front.MetricsUrl;
+		server.TraceUrl = front.TraceUrl;
+		server.ShareMetrics(front.metrics);
+		server.set_reactor(&reactor);
+		Apply(GetSettings(front, index, reactorCount));
+	}
+
+	ServerReactor::Settings ServerReactor::GetSettings(const HTTPServer& front, int index, int reactorCount)
+	{
+		Settings settings;
+		settings.CompressionLevel = front.CompressionLevel;
+		settings.CompressionThreshold = front.CompressionThreshold;
+		settings.LogRequests = front.LogRequests;
+		settings.Limits = front.Limits;
+		settings.Limits.MaxConnections = front.Limits.MaxConnections / reactorCount +
+			((index < front.Limits.MaxConnections % reactorCount)? 1: 0);
+		return settings;
+	}
+
+	/// <summary>
+	/// Take settings for the server; connections already open keep the
+	/// deadlines they were given, and go by the new limits from then on
+	/// </summary>
+	void ServerReactor::Apply(const Settings& settings)
+	{
+		server.CompressionLevel = settings.CompressionLevel;
+		server.CompressionThreshold = settings.CompressionThreshold;
+		server.LogRequests = settings.LogRequests;
+		server.Limits = settings.Limits;
+	}
+
+	/// <summary>
+	/// Open a listening socket on the port and start the thread
+	/// </summary>
+	/// <returns>false if the thread could not be started</returns>
+	bool ServerReactor::Start(int portNum)
+	{
+		server.Listen(portNum, true);
+		return thread.Start(&ServerReactor::Run, this);
+	}
+
+	/// <summary>
+	/// Close every connection and wait for the thread to finish
+	/// </summary>
+	void ServerReactor::Stop()
+	{
+		{
+			MutexLock hold(lock);
+			stopping = true;
+		}
+		reactor.wake();
+		thread.Join();
+	}
+
+	void ServerReactor::Run(void* arg)
+	{
+		((ServerReactor*)arg)->Loop();
+	}
+
+	void ServerReactor::Loop()
+	{
+		Trace::SetThreadName("webconfig reactor");
+		Share();
+		for (;;)
+		{
+			vector<Message> messages;
+			{
+				MutexLock hold(lock);
+				if (stopping)
+					break;
+				messages.swap(queue);
+			}
+
+			for (unsigned int i = 0; i < messages.size(); i++)
+			{
+				switch (messages[i].Kind)
+				{
+				case MESSAGE_BROADCAST: server.Broadcast(messages[i].Data); break;
+				case MESSAGE_PUBLISH: server.Publish(messages[i].Topic, messages[i].Data); break;
+				case MESSAGE_RESUME: server.Resume(messages[i].Ticket); break;
+				case MESSAGE_SETTINGS: Apply(messages[i].Config); break;
+				}
+			}
+
+			// until a socket is ready, a timer is due or Post wakes it
+			reactor.poll();
+			server.Reap();
+		}
+
+		shareTimer.cancel();
+		server.Stop();
+		Share();
+	}
+
+	/// <summary>
+	/// Copy the counters for the starting thread
+	/// </summary>
+	void ServerReactor::Share()
+	{
+		map<string, int> counts;
+		for (map<string, set<Channel*> >::iterator i = server.subscribers.begin(); i != server.subscribers.end(); ++i)
+			counts[(*i).first] = (int)(*i).second.size();
+
+		MutexLock hold(lock);
+		connections = server.GetConnectionCount();
+		queuedBytes = server.GetQueuedBytes();
+		stats = server.Stats;
+		subscriberCounts.swap(counts);
+		if (!stopping)
+			shareTimer.arm(ShareInterval);
+	}
+
+	void ServerReactor::Post(bool broadcast, const string& topic, const string& data)
+	{
+		{
+			MutexLock hold(lock);
+			queue.push_back(Message());
+			queue.back().Kind = broadcast? MESSAGE_BROADCAST: MESSAGE_PUBLISH;
+			queue.back().Topic = topic;
+			queue.back().Data = data;
+			queue.back().Ticket = 0;
+		}
+		reactor.wake();
+	}
+
+	void ServerReactor::Resume(long long ticket)
+	{
+		{
+			MutexLock hold(lock);
+			queue.push_back(Message());
+			queue.back().Kind = MESSAGE_RESUME;
+			queue.back().Ticket = ticket;
+		}
+		reactor.wake();
+	}
+
+	void ServerReactor::Configure(const Settings& settings)
+	{
+		{
+			MutexLock hold(lock);
+			queue.push_back(Message());
+			queue.back().Kind = MESSAGE_SETTINGS;
+			queue.back().Ticket = 0;
+			queue.back().Config = settings;
+		}
+		reactor.wake();
+	}
+
+	int ServerReactor::GetConnectionCount()
+	{
+		MutexLock hold(lock);
+		return connections;
+	}
+
+	size_t ServerReactor::GetQueuedBytes()
+	{
+		MutexLock hold(lock);
+		return queuedBytes;
+	}
+
+	HTTPServerStats ServerReactor::GetStats()
+	{
+		MutexLock hold(lock);
+		return stats;
+	}
+
+	int ServerReactor::GetSubscriberCount(const string& topic)
+	{
+		MutexLock hold(lock);
+		map<string, int>::iterator i = subscriberCounts.find(topic);
+		return (i != subscriberCounts.end())? (*i).second: 0;
+	}
+
+	/// <summary>
+	/// Choose a content coding the client accepts
+	/// </summary>
+	/// <returns>"gzip", "deflate" or "" for none</returns>
+	string HTTPServer::GetAcceptedEncoding(const HTTPRequestParams& rq)
+	{
+		HeaderTable::const_iterator i = rq.Headers.find("Accept-Encoding");
+		if (i == rq.Headers.end())
+			return "";
+
+		bool gzip = false, deflate = false;
+		vector<string> codings;
+		StringHelper::Split((*i).second, ",", codings);
+		for (vector<string>::iterator c = codings.begin(); c != codings.end(); ++c)
+		{
+			string coding = StringHelper::tolower(StringHelper::trim(*c));
+			bool accepted = true;
+			size_t semi = coding.find(';');
+			if (semi != string::npos)
+			{
+				size_t q = coding.find("q=", semi);
+				if (q != string::npos)
+					accepted = atof(coding.c_str() + q + 2) > 0;
+				coding = StringHelper::trim(coding.substr(0, semi));
+			}
+			if (coding == "gzip" || coding == "x-gzip" || coding == "*")
+				gzip = accepted;
+			if (coding == "deflate" || coding == "*")
+				deflate = accepted;
+		}
+		return gzip? "gzip": deflate? "deflate": "";
+	}
+
+	/// <summary>
+	/// Send data to every channel subscribed to topic that has caught up
+	/// </summary>
+	/// <returns>number of channels the data was sent to</returns>
+	int HTTPServer::Publish(const string& topic, const string& data)
+	{
+		if (!reactors.empty())
+		{
+			int sent = 0;
+			for (unsigned int i = 0; i < reactors.size(); i++)
+			{
+				int count = reactors[i]->GetSubscriberCount(topic);
+				if (count > 0 && !data.empty())
+				{
+					reactors[i]->Post(false, topic, data);
+					sent += count;
+				}
+			}
+			return sent;
+		}
+
+		map<string, set<Channel*> >::iterator t = subscribers.find(topic);
+		if (t == subscribers.end() || data.empty())
+			return 0;
+
+		SharedData* shared = new SharedData;
+		shared->Data = data;
+		shared->Refs = 1;
+
+		int sent = 0;
+		for (set<Channel*>::iterator i = (*t).second.begin(); i != (*t).second.end(); ++i)
+		{
+			// still writing the last one; drop this rather than fall further behind
+			if (!(*i)->idle())
+				continue;
+			(*i)->send(shared);
+			++sent;
+		}
+
+		if (--shared->Refs == 0)
+			delete shared;
+		return sent;
+	}
+
+	/// <summary>
+	/// Get the number of channels subscribed to topic
+	/// </summary>
+	int HTTPServer::GetSubscriberCount(const string& topic) const
+	{
+		int count = 0;
+		for (unsigned int i = 0; i < reactors.size(); i++)
+			count += reactors[i]->GetSubscriberCount(topic);
+
+		map<string, set<Channel*> >::const_iterator t = subscribers.find(topic);
+		return count + ((t != subscribers.end())? (int)(*t).second.size(): 0);
+	}
+
+	/// <summary>
+	/// Answer the request parked with ticket, if its connection is still open
+	/// </summary>
+	void HTTPServer::Resume(long long ticket)
+	{
+		// the ticket is on one of them; the rest ignore it
+		for (unsigned int i = 0; i < reactors.size(); i++)
+			reactors[i]->Resume(ticket);
+
+		map<long long, Channel*>::iterator p = parked.find(ticket);
+		if (p == parked.end())
+			return;
+		Channel* channel = (*p).second;
+		parked.erase(p);
+		channel->resume();
+	}
+
+	void HTTPServer::RemoveSubscriber(const string& topic, Channel* channel)
+	{
+		map<string, set<Channel*> >::iterator t = subscribers.find(topic);
+		if (t != subscribers.end())
+		{
+			(*t).second.erase(channel);
+			if ((*t).second.empty())
+				subscribers.erase(t);
+		}
+	}
+
+	/// <summary>
+	/// Send a text message to every connected WebSocket
+	/// </summary>
+	/// <param name="message">message text</param>
+	void HTTPServer::Broadcast(const string& message)
+	{
+		for (unsigned int i = 0; i < reactors.size(); i++)
+			reactors[i]->Post(true, "", message);
+
+		// messages can't be skipped like stream frames, so a client too far behind is dropped
+		vector<Channel*> behind;
+		for (set<Channel*>::iterator i = webSockets.begin(); i != webSockets.end(); ++i)
+		{
+			if ((*i)->queued() > Limits.MaxQueuedBytes)
+				behind.push_back(*i);
+			else
+				(*i)->send_frame(WS_TEXT, message);
+		}
+		for (unsigned int i = 0; i < behind.size(); i++)
+			behind[i]->evict();
+	}
+
+	/// <summary>
+	/// Start the slow client deadline for newly queued output
+	/// </summary>
+	void Channel::watch_output()
+	{
+		if (!write_timer.armed())
+			write_timer.arm((unsigned int)(parent->Limits.SlowClientTimeout * 1000));
+	}
+
+	void Channel::send(const string& data)
+	{
+		bytes_queued += data.length();
+		async_chat::send(data);
+		watch_output();
+	}
+
+	void Channel::send(SharedData* shared)
+	{
+		bytes_queued += shared->Data.length();
+		async_chat::send(new SharedProducer(shared));
+		watch_output();
+	}
+
+	void Channel::send(FileProducer* file, long long count)
+	{
+		bytes_queued += count;
+		async_chat::send(file);
+		watch_output();
+	}
+
+	/// <summary>
+	/// Stop reading requests while the responses to earlier ones pile up
+	/// </summary>
+	bool Channel::readable(void)
+	{
+		// the next request waits for the parked one to be answered
+		if (parked != 0)
+			return false;
+		if (queued() > parent->Limits.MaxQueuedBytes)
+		{
+			if (!suspended)
+			{
+				suspended = true;
+				parent->Stats.ReadsSuspended++;
+			}
+			return false;
+		}
+		suspended = false;
+		return async_chat::readable();
+	}
+
+	void Channel::handle_read(void)
+	{
+		TraceScope trace("read");
+		unsigned long long before = bytes_received;
+		async_chat::handle_read();
+		if (bytes_received != before)
+			HTTPServerMetrics::Count(parent->GetMetrics().BytesReceived, (long long)(bytes_received - before));
+	}
+
+	/// <summary>
+	/// Keep output moving: the deadline restarts whenever some is written
+	/// </summary>
+	void Channel::handle_write(void)
+	{
+		TraceScope trace("send");
+		unsigned long long before = bytes_sent;
+		async_chat::handle_write();
+		if (bytes_sent != before)
+			HTTPServerMetrics::Count(parent->GetMetrics().BytesSent, (long long)(bytes_sent - before));
+		if (queued() == 0)
+		{
+			write_timer.cancel();
+			if (sendStart != 0)
+			{
+				parent->GetMetrics().Record(sendRoute, HTTPServerMetrics::PHASE_SEND, Clock::Nanoseconds() - sendStart);
+				sendStart = 0;
+			}
+		}
+		else if (bytes_sent != before)
+			write_timer.arm((unsigned int)(parent->Limits.SlowClientTimeout * 1000));
+	}
+
+	/// <summary>
+	/// Give a new connection RequestTimeout to send its first request
+	/// </summary>
+	void Channel::start()
+	{
+		read_timer.arm((unsigned int)(parent->Limits.RequestTimeout * 1000));
+	}
+
+	/// <summary>
+	/// A request took too long to arrive, or a kept alive connection sat idle
+	/// </summary>
+	void Channel::read_timeout()
+	{
+		if (closed || closing)
+			return;
+
+		// the client may be waiting on output we haven't sent yet
+		if ((waiting && !idle()) || queued() > parent->Limits.MaxQueuedBytes)
+		{
+			read_timer.arm((unsigned int)((waiting? parent->Limits.IdleTimeout: parent->Limits.RequestTimeout) * 1000));
+			return;
+		}
+
+		if (waiting)
+		{
+			parent->Stats.IdleClosed++;
+			handle_close();
+			close();
+			return;
+		}
+
+		parent->Stats.RequestsTimedOut++;
+		reject(RESPONSE_REQUEST_TIMEOUT);
+	}
+
+	/// <summary>
+	/// None of the queued output was taken for SlowClientTimeout
+	/// </summary>
+	void Channel::write_timeout()
+	{
+		if (!closed)
+			evict();
+	}
+
+	/// <summary>
+	/// Hang up on a client that isn't keeping up
+	/// </summary>
+	void Channel::evict()
+	{
+		parent->Stats.Evicted++;
+		HTTPServerMetrics::Count(parent->GetMetrics().Errors);
+		handle_close();
+		close();
+	}
+
+	/// <summary>
+	/// Answer with an error and hang up once it has been sent
+	/// </summary>
+	void Channel::reject(int status)
+	{
+		if (status == RESPONSE_PAYLOAD_TOO_LARGE)
+			parent->Stats.BodiesTooLarge++;
+		else if (status == RESPONSE_HEADER_FIELDS_TOO_LARGE)
+			parent->Stats.HeadersTooLarge++;
+		parent->GetMetrics().CountResponse(status);
+
+		string HeadersString = "HTTP/1.1 " + GetStatusString(status) + "\r\n";
+		HeadersString += "Content-Length: 0\r\n";
+		HeadersString += "Connection: close\r\n";
+		HeadersString += "\r\n";
+		send(HeadersString);
+
+		closing = true;
+		keepAlive = false;
+		readingBody = false;
+		read_timer.cancel();
+		input_buffer.clear();
+		set_terminator(null_terminator);
+		close_when_done();
+	}
+
+	void Channel::collect_incoming_data (const string& data)
+	{
+		// kept for when the parked request has been answered
+		if (parked != 0)
+		{
+			parkedInput.append(data);
+			return;
+		}
+
+		if (readingBody)
+		{
+			request.BodyData.append (data);
+			if (request.BodyData.length() >= (unsigned int)request.BodySize)
+			{
+				// anything past the body is the next request; give it back to be split
+				ac_in_buffer.insert(0, request.BodyData, request.BodySize, string::npos);
+				request.BodyData.resize(request.BodySize);
+				readingBody = false;
+				set_terminator("\r\n\r\n");
+				respond(true);
+				finish_request();
+			}
+			return;
+		}
+
+		// a subscriber only listens
+		if (!topic.empty() || closing)
+			return;
+
+		// the next request has started; it has RequestTimeout to arrive
+		if (waiting && !data.empty())
+		{
+			waiting = false;
+			read_timer.arm((unsigned int)(parent->Limits.RequestTimeout * 1000));
+		}
+
+		input_buffer.append (data);
+		if (!webSocket && input_buffer.length() > parent->Limits.MaxHeaderBytes)
+		{
+			reject(RESPONSE_HEADER_FIELDS_TOO_LARGE);
+			return;
+		}
+		if (webSocket)
+			handle_frames();
+	}
+
+	void Channel::found_terminator (void)
+	{
+		// blank lines between requests
+		if (input_buffer.empty())
+			return;
+
+		input_buffer += get_terminator();
+		handle_request();
+		input_buffer.clear();
+		if (!webSocket && !readingBody)
+			finish_request();
+	}
+
+	/// <summary>
+	/// After a response, wait for the next request or hang up once it is sent
+	/// </summary>
+	void Channel::finish_request()
+	{
+		if (webSocket || !topic.empty() || closing || parked != 0)
+			return;
+
+		if (keepAlive)
+		{
+			waiting = true;
+			read_timer.arm((unsigned int)(parent->Limits.IdleTimeout * 1000));
+		}
+		else
+		{
+			closing = true;
+			read_timer.cancel();
+			set_terminator(null_terminator);
+			close_when_done();
+		}
+	}
+
+	void Channel::handle_close (void)
 	{
-		struct sockaddr addr;
-		int addr_len = sizeof(sockaddr);
-		int fd = async_sockets::dispatcher::accept (&addr, &addr_len);
-		Channel * jc = new Channel(this);
-		jc->set_fileno (fd);
-		jc->set_terminator ("\r\n\r\n");
+		if (parked != 0)
+		{
+			parent->RemoveParked(parked);
+			parked = 0;
+		}
+		if (webSocket)
+		{
+			webSocket = false;
+			parent->RemoveWebSocket(this);
+		}
+		if (!topic.empty())
+		{
+			parent->RemoveSubscriber(topic, this);
+			topic.clear();
+		}
 	}
 
 	/// <summary>
-	/// Start the listener
+	/// Switch to the WebSocket protocol if the request asks for it
 	/// </summary>
-	/// <param name="portNum">Port on which to listen</param>
-	void HTTPServer::Start(int portNum)
+	/// <returns>true if the channel was upgraded</returns>
+	bool Channel::upgrade(const HTTPRequestParams& rq)
 	{
-#ifdef _WIN32
-		WSADATA wd;
-		WSAStartup (MAKEWORD (1,1), &wd);
-#endif
+		if (parent->OnMessage == NULL || rq.Method != "GET")
+			return false;
 
-		cerr << "create: " << create_socket (AF_INET, SOCK_STREAM) << endl;
+		HeaderTable::const_iterator upgrade = rq.Headers.find("Upgrade");
+		HeaderTable::const_iterator connection = rq.Headers.find("Connection");
+		HeaderTable::const_iterator key = rq.Headers.find("Sec-WebSocket-Key");
+		if (upgrade == rq.Headers.end() || connection == rq.Headers.end() || key == rq.Headers.end())
+			return false;
+		if (StringHelper::tolower((*upgrade).second) != "websocket" ||
+			StringHelper::tolower((*connection).second).find("upgrade") == string::npos)
+			return false;
 
-		struct sockaddr_in addr;
-		addr.sin_family = AF_INET;
-		addr.sin_port = htons (portNum);
-		addr.sin_addr.s_addr = htonl (INADDR_ANY);
+		// RFC 6455 section 4.2.2
+		string accept = Convert::ToBase64String(Sha1::ComputeHash(
+			StringHelper::trim((*key).second) + "258EAFA5-E914-47DA-95CA-C5AB0DC85B11"));
 
-		cerr << "bind: " << bind ((struct sockaddr *) &addr, sizeof (addr)) << endl;
-		cerr << "listen: " << listen (5) << endl;
+		string HeadersString = "HTTP/1.1 " + GetStatusString(RESPONSE_SWITCHING_PROTOCOLS) + "\r\n";
+		HeadersString += "Upgrade: websocket\r\n";
+		HeadersString += "Connection: Upgrade\r\n";
+		HeadersString += "Sec-WebSocket-Accept: " + accept + "\r\n";
+		HeadersString += "\r\n";
+		send(HeadersString);
+		parent->GetMetrics().CountResponse(RESPONSE_SWITCHING_PROTOCOLS);
+
+		// from now on data arrives as frames, not terminated requests
+		webSocket = true;
+		read_timer.cancel();
+		set_terminator(null_terminator);
+		parent->AddWebSocket(this);
+		return true;
 	}
 
 	/// <summary>
-	/// Stop the listener
+	/// Decode complete frames from the input buffer
 	/// </summary>
-	void HTTPServer::Stop()
+	void Channel::handle_frames()
 	{
-		//
-	}
-
-	void HTTPServer::Update()
-	{
-		if (channels.size())
+		while (webSocket && input_buffer.length() >= 2)
 		{
-			/* Return immediately */
-			struct timeval timeout;
-			timeout.tv_sec = 0;
-			timeout.tv_usec = 0;
+			const unsigned char* p = (const unsigned char*)input_buffer.data();
+			size_t available = input_buffer.length();
+
+			bool fin = (p[0] & 0x80) != 0;
+			int opcode = p[0] & 0x0f;
+			bool masked = (p[1] & 0x80) != 0;
+			unsigned long long length = p[1] & 0x7f;
+			size_t header = 2;
+
+			if (length == 126)
+			{
+				if (available < 4)
+					return;
+				length = (p[2] << 8) | p[3];
+				header = 4;
+			}
+			else if (length == 127)
+			{
+				if (available < 10)
+					return;
+				length = 0;
+				for (int i = 0; i < 8; i++)
+					length = (length << 8) | p[2 + i];
+				header = 10;
+
+				// the most significant bit must be 0
+				if (length >> 63)
+				{
+					close_websocket("\x03\xea");	// 1002 protocol error
+					return;
+				}
+			}
+
+			// clients must mask their frames
+			if (!masked)
+			{
+				close_websocket("\x03\xea");	// 1002 protocol error
+				return;
+			}
+			// control frames fit in a frame and are never fragmented
+			if ((opcode & 0x08) != 0 && (!fin || length > 125))
+			{
+				close_websocket("\x03\xea");
+				return;
+			}
+			// a continuation needs a message to continue; a new message needs the last one finished
+			if ((opcode == WS_CONTINUATION && !fragmented) ||
+				((opcode == WS_TEXT || opcode == WS_BINARY) && fragmented))
+			{
+				close_websocket("\x03\xea");
+				return;
+			}
+			if (length > MaxMessageSize - message.length())
+			{
+				close_websocket("\x03\xf1");	// 1009 message too big
+				return;
+			}
+
+			header += 4;
+			if (available < header + length)
+				return;
+
+			const unsigned char* mask = p + header - 4;
+			string payload = input_buffer.substr(header, (size_t)length);
+			for (size_t i = 0; i < payload.length(); i++)
+				payload[i] ^= mask[i & 3];
+			input_buffer.erase(0, header + (size_t)length);
 
-			poll (&timeout);
+			switch (opcode)
+			{
+			case WS_CONTINUATION:
+			case WS_TEXT:
+			case WS_BINARY:
+				message += payload;
+				fragmented = !fin;
+				if (fin)
+				{
+					string text;
+					text.swap(message);
+					parent->OnMessage(text);
+				}
+				break;
+			case WS_CLOSE:
+				close_websocket(payload.substr(0, 2));
+				return;
+			case WS_PING:
+				send_frame(WS_PONG, payload);
+				break;
+			case WS_PONG:
+				break;
+			default:
+				close_websocket("\x03\xea");
+				return;
+			}
 		}
 	}
 
-	void Channel::found_terminator (void)
+	/// <summary>
+	/// Queue one unmasked frame for sending
+	/// </summary>
+	void Channel::send_frame(int opcode, const string& payload)
 	{
-		if (input_buffer.length())
+		string frame;
+		frame += (char)(0x80 | opcode);
+
+		size_t length = payload.length();
+		if (length < 126)
+		{
+			frame += (char)length;
+		}
+		else if (length < 65536)
+		{
+			frame += (char)126;
+			frame += (char)(length >> 8);
+			frame += (char)(length & 0xff);
+		}
+		else
 		{
-			input_buffer += get_terminator();
-			handle_request();
+			frame += (char)127;
+			for (int i = 7; i >= 0; i--)
+				frame += (char)(((unsigned long long)length >> (i * 8)) & 0xff);
 		}
+
+		frame += payload;
+		send(frame);
+	}
+
+	/// <summary>
+	/// Send a close frame and hang up once it has been written
+	/// </summary>
+	void Channel::close_websocket(const string& reason)
+	{
+		send_frame(WS_CLOSE, reason);
+		handle_close();
+		input_buffer.clear();
 		close_when_done();
 	}
 
 	void Channel::handle_request()
 	{
-		HTTPRequestParams requestParams;
-		HTTPResponse response;
-
-		WriteLog("You received the following message : \n" + input_buffer);
+		long long parseStart = Clock::Nanoseconds();
+		Trace::Begin("parse");
+		request = HTTPRequestParams();
 
-		response.BodySize = 0;
+		if (parent->LogRequests)
+			WriteLog("You received the following message : \n" + input_buffer);
 
 		string hValue = "";
 		string hKey = "";
@@ -140,7 +1496,7 @@ namespace WebConfig
 			{
 			case STATE_METHOD:
 				if (myReadBuffer[ndx] != ' ')
-					requestParams.Method += (char)myReadBuffer[ndx++];
+					request.Method += (char)myReadBuffer[ndx++];
 				else 
 				{
 					ndx++;
@@ -152,16 +1508,16 @@ namespace WebConfig
 				{
 					ndx++;
 					hKey = "";
-					requestParams.Execute = true;
-					requestParams.Args.clear();
+					request.Execute = true;
+					request.Args.clear();
 					parserState = STATE_URLPARM;
 				}
 				else if (myReadBuffer[ndx] != ' ')
-					requestParams.URL += (char)myReadBuffer[ndx++];
+					request.URL += (char)myReadBuffer[ndx++];
 				else
 				{
 					ndx++;
-					requestParams.URL = HttpUtility::UrlDecode(requestParams.URL);
+					request.URL = HttpUtility::UrlDecode(request.URL);
 					parserState = STATE_VERSION;
 				}
 				break;
@@ -176,7 +1532,7 @@ namespace WebConfig
 				{
 					ndx++;
 
-					requestParams.URL = HttpUtility::UrlDecode(requestParams.URL);
+					request.URL = HttpUtility::UrlDecode(request.URL);
 					parserState = STATE_VERSION;
 				}
 				else
@@ -190,10 +1546,10 @@ namespace WebConfig
 					ndx++;
 					hKey=HttpUtility::UrlDecode(hKey);
 					hValue=HttpUtility::UrlDecode(hValue);
-					if (requestParams.Args.find(hKey) != requestParams.Args.end())
-						requestParams.Args[hKey] = requestParams.Args[hKey] + ", " + hValue;
+					if (request.Args.find(hKey) != request.Args.end())
+						request.Args[hKey] = request.Args[hKey] + ", " + hValue;
 					else
-						requestParams.Args[hKey] = hValue;
+						request.Args[hKey] = hValue;
 					hKey="";
 					parserState = STATE_URLPARM;
 				}
@@ -202,12 +1558,12 @@ namespace WebConfig
 					ndx++;
 					hKey=HttpUtility::UrlDecode(hKey);
 					hValue=HttpUtility::UrlDecode(hValue);
-					if (requestParams.Args.find(hKey) != requestParams.Args.end())
-						requestParams.Args[hKey] = requestParams.Args[hKey] + ", " + hValue;
+					if (request.Args.find(hKey) != request.Args.end())
+						request.Args[hKey] = request.Args[hKey] + ", " + hValue;
 					else
-						requestParams.Args[hKey] = hValue;
+						request.Args[hKey] = hValue;
 
-					requestParams.URL = HttpUtility::UrlDecode(requestParams.URL);
+					request.URL = HttpUtility::UrlDecode(request.URL);
 					parserState = STATE_VERSION;
 				}
 				else
@@ -219,12 +1575,12 @@ namespace WebConfig
 				if (myReadBuffer[ndx] == '\r') 
 					ndx++;
 				else if (myReadBuffer[ndx] != '\n') 
-					requestParams.Version += (char)myReadBuffer[ndx++];
+					request.Version += (char)myReadBuffer[ndx++];
 				else 
 				{
 					ndx++;
 					hKey = "";
-					requestParams.Headers.clear();
+					request.Headers.clear();
 					parserState = STATE_HEADERKEY;
 				}
 				break;
@@ -234,11 +1590,11 @@ namespace WebConfig
 				else if (myReadBuffer[ndx] == '\n')
 				{
 					ndx++;
-					if (requestParams.Headers.find("Content-Length") != requestParams.Headers.end())
+					if (request.Headers.find("Content-Length") != request.Headers.end())
 					{
-						requestParams.BodySize = Convert::ToInt(requestParams.Headers["Content-Length"]);
-						requestParams.BodyData = "";
-						//requestParams.BodyData = new byte[requestParams.BodySize];
+						request.BodySize = Convert::ToInt(request.Headers["Content-Length"]);
+						request.BodyData = "";
+						//request.BodyData = new byte[request.BodySize];
 						parserState = STATE_BODY;
 					}
 					else
@@ -264,16 +1620,16 @@ namespace WebConfig
 				else 
 				{
 					ndx++;
-					requestParams.Headers[hKey] = hValue;
+					request.Headers[hKey] = hValue;
 					hKey = "";
 					parserState = STATE_HEADERKEY;
 				}
 				break;
 			case STATE_BODY:
 				// Append to request BodyData
-				requestParams.BodyData = myReadBuffer.substr(ndx);
+				request.BodyData = myReadBuffer.substr(ndx);
 				ndx = numberOfBytesRead;
-				if (requestParams.BodyData.length() >= (unsigned int)requestParams.BodySize)
+				if (request.BodyData.length() >= (unsigned int)request.BodySize)
 				{
 					parserState = STATE_OK;
 				}
@@ -286,86 +1642,482 @@ namespace WebConfig
 		}
 		while(ndx < numberOfBytesRead);
 
-		// Read body?
-		if (parserState == STATE_BODY)
-		{
-			int needed = requestParams.BodySize - requestParams.BodyData.length();
+		parseTime = Clock::Nanoseconds() - parseStart;
+		Trace::End("parse");
 
-			char buffer[512];
-			while (needed > 0)
-			{
-				int requested = (needed > 512)? 512: needed;
-				int result = read_after_terminator (buffer, requested);
-				if (result > 0)
-				{
-					requestParams.BodyData.append(buffer, result);
-					needed -= result;
-				}
-				else
-					break;
-			}
+		// refuse a body too big to hold before reading any more of it
+		if (request.Headers.find("Content-Length") != request.Headers.end() &&
+			(request.BodySize < 0 || (size_t)request.BodySize > parent->Limits.MaxBodyBytes))
+		{
+			reject(RESPONSE_PAYLOAD_TOO_LARGE);
+			return;
+		}
 
-			if (requestParams.BodyData.length() >= (unsigned int)requestParams.BodySize)
+		// Wait for the rest of the body?
+		if (parserState == STATE_BODY)
+		{
+			if (request.BodyData.length() < (unsigned int)request.BodySize)
 			{
-				parserState = STATE_OK;
+				// the body arrives through collect_incoming_data
+				readingBody = true;
+				set_terminator(null_terminator);
+				return;
 			}
+			parserState = STATE_OK;
 		}
 
+		if (parserState == STATE_OK && upgrade(request))
+			return;
+
+		respond(parserState == STATE_OK);
+	}
+
+	/// <summary>
+	/// Send the response to the current request
+	/// </summary>
+	/// <param name="ok">false if the request could not be parsed</param>
+	void Channel::respond(bool ok)
+	{
+		HTTPResponse response;
+
+		response.BodySize = 0;
+
 		response.Version = "HTTP/1.1";
 
-		string StatusString;
-		if (parserState != STATE_OK)
+		// HTTP/1.1 connections persist unless the client says otherwise; HTTP/1.0 ones only if it asks
+		string connection;
+		if (request.Headers.find("Connection") != request.Headers.end())
+			connection = StringHelper::tolower(request.Headers["Connection"]);
+		if (request.Version == "HTTP/1.1")
+			keepAlive = ok && connection.find("close") == string::npos;
+		else
+			keepAlive = ok && connection.find("keep-alive") != string::npos;
+
+		if (!ok)
 		{
 			response.Status = (int)RESPONSE_BAD_REQUEST;
-			StatusString = "400 Bad Request";
 		}
 		else
 		{
 			response.Status = (int)RESPONSE_OK;
-			StatusString = "200 Ok";
 		}
 
 		response.Headers.clear();
 		response.Headers["Server"] = "HTTPServer/1.0.*";
 
 		//response.Headers["Date"] = DateTime.Now.ToString("r");
-		if (requestParams.Headers.find("Date") != requestParams.Headers.end())
+		if (request.Headers.find("Date") != request.Headers.end())
+		{
+			response.Headers["Date"] = request.Headers["Date"];
+		}
+
+		HTTPServerMetrics& metrics = parent->GetMetrics();
+		int route = 0;
+		if (response.Status == (int)RESPONSE_OK)
+		{
+			long long renderStart = Clock::Nanoseconds();
+			if (!parent->MetricsUrl.empty() && request.URL == parent->MetricsUrl)
+			{
+				response.Headers["Content-type"] = "text/plain; version=0.0.4";
+				response.Headers["Cache-Control"] = "no-cache";
+				response.Route = "metrics";
+				metrics.Write(response.BodyData);
+			}
+			else if (!parent->TraceUrl.empty() && request.URL == parent->TraceUrl)
+			{
+				response.Headers["Content-type"] = "application/json";
+				response.Headers["Cache-Control"] = "no-cache";
+				response.Route = "trace";
+				Trace::Write(response.BodyData);
+			}
+			else
+			{
+				TraceScope trace("OnResponse", request.URL.c_str());
+				parent->OnResponse(request, response);
+			}
+
+			// answered when the server is given the ticket back
+			if (response.Park != 0 && response.Status == (int)RESPONSE_OK)
+			{
+				park(response.Park);
+				return;
+			}
+
+			bool subscribing = !response.Subscribe.empty() && response.Status == (int)RESPONSE_OK && request.Method != "HEAD";
+			if (!subscribing)
+				encode(response);
+
+			long long renderTime = Clock::Nanoseconds() - renderStart;
+			route = metrics.FindRoute(response.Route);
+			metrics.Record(route, HTTPServerMetrics::PHASE_PARSE, parseTime);
+			metrics.Record(route, HTTPServerMetrics::PHASE_RENDER, renderTime);
+			if (parent->UpdateStats != NULL)
+			{
+				parent->UpdateStats->Add(FrameStats::SECTION_PARSE, parseTime);
+				parent->UpdateStats->Add(FrameStats::SECTION_RENDER, renderTime);
+			}
+
+			if (subscribing)
+			{
+				metrics.CountResponse(response.Status);
+				subscribe(response);
+				return;
+			}
+		}
+		metrics.CountResponse(response.Status);
+
+		// the body is BodyData followed by the file, if any
+		long long length = (long long)response.BodyData.length();
+		if (!response.FilePath.empty())
 		{
-			response.Headers["Date"] = requestParams.Headers["Date"];
+			ifstream file(response.FilePath.c_str(), ios::in|ios::binary);
+			file.seekg(0, ios::end);
+			length += file.is_open()? (long long)file.tellg(): 0;
+		}
+		else if (response.fs.is_open())
+		{
+			response.fs.seekg(0, ios::end);
+			length += (long long)response.fs.tellg();
+			response.fs.seekg(0, ios::beg);
 		}
 
+		vector<ByteRange> ranges;
 		if (response.Status == (int)RESPONSE_OK)
 		{
-			parent->OnResponse(requestParams, response);
+			response.Headers["Accept-Ranges"] = "bytes";
+			select_ranges(response, length, ranges);
+		}
+
+		long long contentLength = length;
+		vector<string> parts;	// headers of each part of a multiple range response
+		string closing = string("\r\n--") + RangeBoundary + "--\r\n";
+		if (response.Status == (int)RESPONSE_RANGE_NOT_SATISFIABLE)
+		{
+			contentLength = 0;
+		}
+		else if (ranges.size() == 1)
+		{
+			response.Headers["Content-Range"] = "bytes " + Convert::ToString(ranges[0].First) + "-" +
+				Convert::ToString(ranges[0].Last) + "/" + Convert::ToString(length);
+			contentLength = ranges[0].Last - ranges[0].First + 1;
+		}
+		else if (ranges.size() > 1)
+		{
+			string contentType = response.Headers["Content-type"];
+			response.Headers["Content-type"] = string("multipart/byteranges; boundary=") + RangeBoundary;
+
+			contentLength = closing.length();
+			for (vector<ByteRange>::iterator r = ranges.begin(); r != ranges.end(); ++r)
+			{
+				string part = string("\r\n--") + RangeBoundary + "\r\n";
+				if (!contentType.empty())
+					part += "Content-type: " + contentType + "\r\n";
+				part += "Content-Range: bytes " + Convert::ToString((*r).First) + "-" +
+					Convert::ToString((*r).Last) + "/" + Convert::ToString(length) + "\r\n\r\n";
+				parts.push_back(part);
+				contentLength += part.length() + (*r).Last - (*r).First + 1;
+			}
+		}
+
+		if (response.Status != (int)RESPONSE_NOT_MODIFIED)
+			response.Headers["Content-Length"] = Convert::ToString(contentLength);
+
+		if (keepAlive)
+		{
+			response.Headers["Connection"] = "keep-alive";
+			response.Headers["Keep-Alive"] = "timeout=" + Convert::ToString((int)parent->Limits.IdleTimeout);
+		}
+		else
+		{
+			response.Headers["Connection"] = "close";
 		}
 
-		string HeadersString = response.Version + " " + StatusString + "\n";
+		string HeadersString = response.Version + " " + GetStatusString(response.Status) + "\r\n";
 
-		for (map<string,string>::iterator i = response.Headers.begin(); i != response.Headers.end(); ++i) 
+		for (HeaderTable::iterator i = response.Headers.begin(); i != response.Headers.end(); ++i) 
 		{
-			HeadersString += (*i).first + ": " + (*i).second + "\n";
+			HeadersString += (*i).first + ": " + (*i).second + "\r\n";
 		}
 
-		HeadersString += "\n";
+		HeadersString += "\r\n";
 		//HeadersString = Encoding.ASCII.GetBytes(HeadersString);
 
 		// Send headers	
 		send(HeadersString);
 
 		// Send body
-		if (response.BodyData.length() > 0)
-			send(response.BodyData);
+		if (request.Method == "HEAD" || response.Status == (int)RESPONSE_RANGE_NOT_SATISFIABLE)
+		{
+			// headers only
+		}
+		else if (ranges.empty())
+		{
+			send_body(response, 0, length);
+		}
+		else if (ranges.size() == 1)
+		{
+			send_body(response, ranges[0].First, ranges[0].Last - ranges[0].First + 1);
+		}
+		else
+		{
+			for (unsigned int i = 0; i < ranges.size(); i++)
+			{
+				send(parts[i]);
+				send_body(response, ranges[i].First, ranges[i].Last - ranges[i].First + 1);
+			}
+			send(closing);
+		}
+
+		if (response.fs.is_open())
+			response.fs.close();
+
+		// timed until the output is written; behind an earlier response, until both are
+		if (sendStart == 0)
+		{
+			sendStart = Clock::Nanoseconds();
+			sendRoute = route;
+		}
+	}
+
+	/// <summary>
+	/// Hold the response until the server is given the ticket back; input
+	/// that arrives meanwhile is kept, not parsed
+	/// </summary>
+	void Channel::park(long long ticket)
+	{
+		parked = ticket;
+		read_timer.cancel();
+		set_terminator(null_terminator);
+		parent->AddParked(ticket, this);
+	}
+
+	/// <summary>
+	/// Answer the parked request, then go on to whatever arrived behind it
+	/// </summary>
+	void Channel::resume()
+	{
+		parked = 0;
+		request.Resumed = true;
+		set_terminator("\r\n\r\n");
+		respond(true);
+		finish_request();
+
+		if (parked == 0 && !parkedInput.empty())
+		{
+			ac_in_buffer.insert(0, parkedInput);
+			parkedInput.clear();
+			handle_input();
+		}
+	}
+
+	/// <summary>
+	/// Send the headers and any initial body, then hold the connection open
+	/// for data published to the response's topic; there is no length, so
+	/// the stream ends when the connection does
+	/// </summary>
+	void Channel::subscribe(HTTPResponse& response)
+	{
+		response.Headers.erase("Content-Length");
+		response.Headers["Connection"] = "close";
+
+		string HeadersString = response.Version + " " + GetStatusString(response.Status) + "\r\n";
+		for (HeaderTable::iterator i = response.Headers.begin(); i != response.Headers.end(); ++i)
+		{
+			HeadersString += (*i).first + ": " + (*i).second + "\r\n";
+		}
+		HeadersString += "\r\n";
+		send(HeadersString + response.BodyData);
 
 		if (response.fs.is_open())
+			response.fs.close();
+
+		topic = response.Subscribe;
+		read_timer.cancel();
+		input_buffer.clear();
+		set_terminator(null_terminator);
+		parent->AddSubscriber(topic, this);
+	}
+
+	/// <summary>
+	/// Send part of the body, which is BodyData followed by the file
+	/// </summary>
+	/// <param name="first">offset of the first byte</param>
+	/// <param name="count">number of bytes</param>
+	void Channel::send_body(HTTPResponse& response, long long first, long long count)
+	{
+		long long bodyLength = (long long)response.BodyData.length();
+		if (first < bodyLength)
+		{
+			long long n = (count < bodyLength - first)? count: bodyLength - first;
+			if (n == bodyLength)
+				send(response.BodyData);
+			else
+				send(response.BodyData.substr((size_t)first, (size_t)n));
+			first += n;
+			count -= n;
+		}
+
+		if (count > 0 && !response.FilePath.empty())
+		{
+			send(new FileProducer(response.FilePath, first - bodyLength, count), count);
+		}
+		else if (count > 0 && response.fs.is_open())
 		{
-			char buffer[512];
-			while (!response.fs.eof())
+			response.fs.clear();
+			response.fs.seekg((streamoff)(first - bodyLength), ios::beg);
+
+			char buffer[4096];
+			while (count > 0 && !response.fs.eof())
 			{
-				response.fs.read(buffer, sizeof(buffer));
-				int bytesRead = response.fs.gcount();
+				response.fs.read(buffer, (count < (long long)sizeof(buffer))? (streamsize)count: sizeof(buffer));
+				int bytesRead = (int)response.fs.gcount();
+				if (bytesRead <= 0)
+					break;
 				send(string(buffer, bytesRead));
+				count -= bytesRead;
+			}
+		}
+	}
+
+	/// <summary>
+	/// Parse a byte position; digits only
+	/// </summary>
+	static bool ParsePosition(const string& s, long long& value)
+	{
+		if (s.empty() || s.length() > 18)
+			return false;
+		value = 0;
+		for (unsigned int i = 0; i < s.length(); i++)
+		{
+			if (s[i] < '0' || s[i] > '9')
+				return false;
+			value = value * 10 + (s[i] - '0');
+		}
+		return true;
+	}
+
+	/// <summary>
+	/// Pick the byte ranges to send from the Range and If-Range headers;
+	/// sets the status to 206, or 416 when no range overlaps the body
+	/// </summary>
+	/// <param name="length">length of the whole body</param>
+	/// <returns>false if the whole body should be sent</returns>
+	bool Channel::select_ranges(HTTPResponse& response, long long length, vector<ByteRange>& ranges)
+	{
+		HeaderTable::iterator range = request.Headers.find("Range");
+		if (range == request.Headers.end() || request.Method != "GET")
+			return false;
+
+		// only a strong validator says the parts fit the copy the client has
+		HeaderTable::iterator ifRange = request.Headers.find("If-Range");
+		if (ifRange != request.Headers.end())
+		{
+			HeaderTable::iterator etag = response.Headers.find("ETag");
+			if (etag == response.Headers.end() || (*etag).second.compare(0, 2, "W/") == 0 ||
+				(*etag).second != StringHelper::trim((*ifRange).second))
+				return false;
+		}
+
+		string spec = StringHelper::trim((*range).second);
+		if (StringHelper::tolower(spec.substr(0, 6)) != "bytes=")
+			return false;
+
+		vector<string> specs;
+		StringHelper::Split(spec.substr(6), ",", specs);
+		if (specs.empty() || specs.size() > MaxRanges)
+			return false;
+
+		for (vector<string>::iterator i = specs.begin(); i != specs.end(); ++i)
+		{
+			string s = StringHelper::trim(*i);
+			size_t dash = s.find('-');
+			if (dash == string::npos)
+			{
+				ranges.clear();
+				return false;
+			}
+
+			string first = StringHelper::trim(s.substr(0, dash));
+			string last = StringHelper::trim(s.substr(dash + 1));
+			long long a = 0, b = 0;
+			if (first.empty())
+			{
+				// suffix: the final b bytes
+				if (!ParsePosition(last, b))
+				{
+					ranges.clear();
+					return false;
+				}
+				if (b == 0 || length == 0)
+					continue;
+				a = (b < length)? length - b: 0;
+				b = length - 1;
+			}
+			else
+			{
+				if (!ParsePosition(first, a) ||
+					(!last.empty() && (!ParsePosition(last, b) || b < a)))
+				{
+					ranges.clear();
+					return false;
+				}
+				if (last.empty() || b >= length)
+					b = length - 1;
+				if (a >= length)
+					continue;
+			}
+			ranges.push_back(ByteRange(a, b));
+		}
+
+		if (ranges.empty())
+		{
+			response.Status = (int)RESPONSE_RANGE_NOT_SATISFIABLE;
+			response.Headers["Content-Range"] = "bytes */" + Convert::ToString(length);
+			response.Headers.erase("Content-type");
+		}
+		else
+		{
+			response.Status = (int)RESPONSE_PARTIAL_CONTENT;
+		}
+		return true;
+	}
+
+	/// <summary>
+	/// Compress the body when the client accepts it and it's worth doing
+	/// </summary>
+	void Channel::encode(HTTPResponse& response)
+	{
+		HeaderTable::iterator type = response.Headers.find("Content-type");
+		string contentType = (type != response.Headers.end())? (*type).second: "";
+		bool encoded = (response.Headers.find("Content-Encoding") != response.Headers.end());
+
+		// ranges refer to the identity, so leave it be
+		bool ranged = (request.Headers.find("Range") != request.Headers.end());
+
+		if (!encoded && !ranged && response.Status == (int)RESPONSE_OK && parent->CompressionLevel > 0 &&
+			response.BodyData.length() >= parent->CompressionThreshold &&
+			HttpUtility::IsCompressible(contentType))
+		{
+			response.Headers["Vary"] = "Accept-Encoding";
+
+			string encoding = HTTPServer::GetAcceptedEncoding(request);
+			if (!encoding.empty())
+			{
+				string body;
+				Deflate::Compress(response.BodyData, body, parent->CompressionLevel,
+					(encoding == "gzip")? Deflate::FORMAT_GZIP: Deflate::FORMAT_ZLIB);
+				if (body.length() < response.BodyData.length())
+				{
+					response.BodyData.swap(body);
+					response.Headers["Content-Encoding"] = encoding;
+					encoded = true;
+				}
 			}
-			response.fs.close();
 		}
+
+		// encoded bytes differ from the identity, so only a weak validator still holds
+		HeaderTable::iterator etag = response.Headers.find("ETag");
+		if (encoded && etag != response.Headers.end() && (*etag).second.compare(0, 2, "W/") != 0)
+			(*etag).second = "W/" + (*etag).second;
 	}
 }
\ No newline at end of file
@@ -6,33 +6,95 @@
 #define HTTPSERVER_H
 
 #include "Support/asynchat.h"
+#include "Support/Atomic.h"
+#include "Support/Histogram.h"
+#include "Support/FrameStats.h"
 #include <iostream>
 #include <fstream>
 #include <string>
 #include <map>
+#include <set>
+#include <vector>
+#include <ctype.h>
 
 namespace WebConfig
 {
 	enum HTTPResponseStatus
 	{
+		RESPONSE_SWITCHING_PROTOCOLS = 101,
 		RESPONSE_OK = 200, 
+		RESPONSE_ACCEPTED = 202,
+		RESPONSE_PARTIAL_CONTENT = 206,
+		RESPONSE_NOT_MODIFIED = 304,
 		RESPONSE_BAD_REQUEST = 400,
-		RESPONSE_NOT_FOUND = 404
+		RESPONSE_NOT_FOUND = 404,
+		RESPONSE_REQUEST_TIMEOUT = 408,
+		RESPONSE_PAYLOAD_TOO_LARGE = 413,
+		RESPONSE_RANGE_NOT_SATISFIABLE = 416,
+		RESPONSE_HEADER_FIELDS_TOO_LARGE = 431,
+		RESPONSE_SERVICE_UNAVAILABLE = 503
 	};
 
 	typedef std::map<std::string,std::string> Hashtable;
 
+	/// <summary>
+	/// Orders header names without regard to case
+	/// </summary>
+	struct NoCaseLess
+	{
+		bool operator()(const std::string& a, const std::string& b) const
+		{
+			size_t n = (a.length() < b.length())? a.length(): b.length();
+			for (size_t i = 0; i < n; i++)
+			{
+				int ca = tolower((unsigned char)a[i]);
+				int cb = tolower((unsigned char)b[i]);
+				if (ca != cb)
+					return ca < cb;
+			}
+			return a.length() < b.length();
+		}
+	};
+
+	typedef std::map<std::string,std::string,NoCaseLess> HeaderTable;
+
 	class HTTPResponse
 	{
 	public:
 		int Status;
 		std::string Version;
-		Hashtable Headers;
+		HeaderTable Headers;
 		int BodySize;
 		std::string BodyData;
 		std::ifstream fs;
 
-		HTTPResponse() {}
+		/// <summary>
+		/// A file to send after BodyData. Unlike fs it is read as the client
+		/// takes it, so large files don't sit in memory.
+		/// </summary>
+		std::string FilePath;
+
+		/// <summary>
+		/// When set on a 200 response the connection stays open after the body
+		/// and receives whatever is published to this topic
+		/// </summary>
+		std::string Subscribe;
+
+		/// <summary>
+		/// Name of the route the response is timed under in the metrics; see
+		/// HTTPServerMetrics::AddRoute. Responses without one count as "other".
+		/// </summary>
+		std::string Route;
+
+		/// <summary>
+		/// When set on a 200 response nothing is sent yet: the connection
+		/// waits, reading no more requests, until HTTPServer::Resume is called
+		/// with this ticket, and then OnResponse is called again for the same
+		/// request with Resumed set. 0 to answer at once.
+		/// </summary>
+		long long Park;
+
+		HTTPResponse() : Park(0) {}
 	};
 
 	class HTTPRequestParams
@@ -43,11 +105,134 @@ namespace WebConfig
 		std::string Version;
 		Hashtable Args;
 		bool Execute;
-		Hashtable Headers;
+		HeaderTable Headers;
 		int BodySize;
 		std::string BodyData;
 
-		HTTPRequestParams() {}
+		/// <summary>
+		/// Set when OnResponse is called again for a request it parked
+		/// </summary>
+		bool Resumed;
+
+		HTTPRequestParams() : Resumed(false) {}
+	};
+
+	class Channel;
+	class ServerReactor;
+
+	/// <summary>
+	/// Bounds on what clients may cost the server
+	/// </summary>
+	struct HTTPServerLimits
+	{
+		int MaxConnections;			// more are answered 503 and closed
+		size_t MaxQueuedBytes;		// output waiting for one client before its requests stop being read
+		double SlowClientTimeout;	// seconds a client may leave output waiting without reading any
+		size_t MaxHeaderBytes;		// longer request headers are answered 431
+		size_t MaxBodyBytes;		// longer request bodies are answered 413
+		double RequestTimeout;		// seconds to receive a whole request once it starts; then 408
+		double IdleTimeout;			// seconds a kept alive connection may wait for its next request
+
+		HTTPServerLimits() :
+			MaxConnections(64),
+			MaxQueuedBytes(1024 * 1024),
+			SlowClientTimeout(30),
+			MaxHeaderBytes(8 * 1024),
+			MaxBodyBytes(1024 * 1024),
+			RequestTimeout(10),
+			IdleTimeout(5)
+		{
+		}
+	};
+
+	/// <summary>
+	/// Running totals of connections and of clients turned away
+	/// </summary>
+	struct HTTPServerStats
+	{
+		unsigned int Accepted;			// connections taken
+		unsigned int Rejected;			// refused at MaxConnections
+		unsigned int Evicted;			// dropped for not reading their output
+		unsigned int ReadsSuspended;	// times a client went over MaxQueuedBytes
+		unsigned int HeadersTooLarge;
+		unsigned int BodiesTooLarge;
+		unsigned int RequestsTimedOut;	// answered 408 for sending a request too slowly
+		unsigned int IdleClosed;		// kept alive connections closed at IdleTimeout
+
+		HTTPServerStats() :
+			Accepted(0), Rejected(0), Evicted(0), ReadsSuspended(0), HeadersTooLarge(0), BodiesTooLarge(0),
+			RequestsTimedOut(0), IdleClosed(0)
+		{
+		}
+	};
+
+	/// <summary>
+	/// Latency histograms and counters for a server and its reactors. They
+	/// are shared between the reactor threads and updated without locks.
+	/// </summary>
+	class HTTPServerMetrics
+	{
+		std::vector<std::string> routes;
+		std::vector<Histogram*> histograms;	// PHASE_COUNT for each route
+
+		HTTPServerMetrics(const HTTPServerMetrics&);
+		HTTPServerMetrics& operator=(const HTTPServerMetrics&);
+
+	public:
+
+		enum Phase
+		{
+			PHASE_PARSE,	// the request line and headers
+			PHASE_RENDER,	// OnResponse and compressing the body
+			PHASE_SEND,		// from the response being queued to the last of it written to the socket
+			PHASE_COUNT
+		};
+
+		volatile long long BytesReceived;
+		volatile long long BytesSent;
+		volatile long long ConnectionsAccepted;
+		volatile long long ConnectionsRejected;	// answered 503 at MaxConnections
+		volatile long long ConnectionsClosed;
+		volatile long long Responses[5];		// by status class, 1xx to 5xx
+		volatile long long Errors;				// responses of 400 and up, and clients evicted
+
+		HTTPServerMetrics();
+		~HTTPServerMetrics();
+
+		/// <summary>
+		/// Add a route for responses to be timed under; call before the server starts
+		/// </summary>
+		/// <returns>index of the route</returns>
+		int AddRoute(const std::string& name);
+
+		/// <summary>
+		/// Get the index of a route; 0, "other", if there is none by that name
+		/// </summary>
+		int FindRoute(const std::string& name) const;
+
+		int GetRouteCount() const { return (int)routes.size(); }
+		const std::string& GetRouteName(int route) const { return routes[route]; }
+		const Histogram& GetHistogram(int route, Phase phase) const { return *histograms[route * PHASE_COUNT + phase]; }
+
+		/// <summary>
+		/// Add the duration of a phase of a request on a route
+		/// </summary>
+		void Record(int route, Phase phase, long long nanoseconds)
+		{
+			histograms[route * PHASE_COUNT + phase]->Record(nanoseconds);
+		}
+
+		/// <summary>
+		/// Count a response by its status
+		/// </summary>
+		void CountResponse(int status);
+
+		static void Count(volatile long long& counter, long long n = 1) { Atomic::Add(counter, n); }
+
+		/// <summary>
+		/// Write the histograms and counters in the Prometheus text format
+		/// </summary>
+		void Write(std::string& out) const;
 	};
 
 	/// <summary>
@@ -55,11 +240,87 @@ namespace WebConfig
 	/// </summary>
 	class HTTPServer : public async_sockets::dispatcher
 	{
+		/// <summary>channels upgraded to the WebSocket protocol</summary>
+		std::set<Channel*> webSockets;
+
+		/// <summary>channels holding a response open, by topic</summary>
+		std::map<std::string, std::set<Channel*> > subscribers;
+
+		/// <summary>every open client connection; owned</summary>
+		std::set<Channel*> clients;
+
+		/// <summary>channels waiting for Resume, by ticket</summary>
+		std::map<long long, Channel*> parked;
+
+		/// <summary>reactors serving the port on their own threads; owned</summary>
+		std::vector<ServerReactor*> reactors;
+
+		/// <summary>timings and counters; shared with the reactors, owned by the front server</summary>
+		HTTPServerMetrics* metrics;
+		bool ownsMetrics;
+
+		friend class ServerReactor;
+		void Listen(int portNum, bool sharePort);
+		void Reap();
+		void ShareMetrics(HTTPServerMetrics* shared);
+
 	public:
 
 		typedef void (*Callback)(const HTTPRequestParams& rq, HTTPResponse& rp);
 		Callback OnResponse;
 
+		/// <summary>
+		/// Called with each text message received on a WebSocket;
+		/// WebSocket upgrades are refused while this is NULL
+		/// </summary>
+		typedef void (*MessageCallback)(const std::string& message);
+		MessageCallback OnMessage;
+
+		/// <summary>
+		/// Deflate level for response bodies; 0 turns compression off
+		/// </summary>
+		int CompressionLevel;
+
+		/// <summary>
+		/// Bodies smaller than this many bytes are sent uncompressed
+		/// </summary>
+		size_t CompressionThreshold;
+
+		/// <summary>
+		/// Bounds on connections, queued output and request size
+		/// </summary>
+		HTTPServerLimits Limits;
+
+		/// <summary>
+		/// Counters for the limits; see GetStats when reactors are running
+		/// </summary>
+		HTTPServerStats Stats;
+
+		/// <summary>
+		/// Write each request to cerr
+		/// </summary>
+		bool LogRequests;
+
+		/// <summary>
+		/// Url the metrics are served at in the Prometheus text format, ahead
+		/// of OnResponse; empty to not serve them. The default is "/metrics".
+		/// </summary>
+		std::string MetricsUrl;
+
+		/// <summary>
+		/// Url the trace events recorded so far are served at as Chrome
+		/// trace-event JSON, ahead of OnResponse; empty to not serve them.
+		/// The default is "/trace".
+		/// </summary>
+		std::string TraceUrl;
+
+		/// <summary>
+		/// Frame sections that Update adds the time parsing and rendering
+		/// requests to; NULL for none. Reactors don't add to it, as their
+		/// work isn't part of the caller's frame.
+		/// </summary>
+		FrameStats* UpdateStats;
+
 		/// <summary>
 		/// Constructor
 		/// </summary>
@@ -67,12 +328,106 @@ namespace WebConfig
 		HTTPServer(Callback OnResponse)
 		{
 			this->OnResponse = OnResponse;
+			this->OnMessage = NULL;
+			this->CompressionLevel = 6;
+			this->CompressionThreshold = 512;
+			this->LogRequests = true;
+			this->MetricsUrl = "/metrics";
+			this->TraceUrl = "/trace";
+			this->UpdateStats = NULL;
+			this->metrics = new HTTPServerMetrics;
+			this->ownsMetrics = true;
 		}
 
-		void Start(int portNum);
+		~HTTPServer();
+
+		/// <summary>
+		/// Start listening. With no reactors the server runs in Update on the
+		/// calling thread. Otherwise each reactor is a thread with its own
+		/// listening socket on the port (SO_REUSEPORT, so the kernel spreads
+		/// connections between them) and OnResponse and OnMessage are called
+		/// on those threads; MaxConnections is shared out between them.
+		/// </summary>
+		/// <param name="portNum">Port on which to listen</param>
+		/// <param name="reactorCount">number of threads serving the port, or 0</param>
+		void Start(int portNum, int reactorCount = 0);
 		void Stop();
 		void Update();
 
+		/// <summary>
+		/// Get the number of threads serving the port; 0 when it is served by Update
+		/// </summary>
+		int GetReactorCount() const { return (int)reactors.size(); }
+
+		/// <summary>
+		/// Reactors copy CompressionLevel, CompressionThreshold, Limits and
+		/// LogRequests when they start; call this after changing any of them
+		/// later to queue the new values to their threads
+		/// </summary>
+		void ShareSettings();
+
+		/// <summary>
+		/// Get the number of open client connections
+		/// </summary>
+		int GetConnectionCount() const;
+
+		/// <summary>
+		/// Get the counters, summed over the reactors if there are any
+		/// </summary>
+		HTTPServerStats GetStats() const;
+
+		/// <summary>
+		/// Get the latency histograms and counters, which cover the reactors too.
+		/// Add routes to them before Start.
+		/// </summary>
+		HTTPServerMetrics& GetMetrics() { return *metrics; }
+
+		/// <summary>
+		/// Get the output bytes waiting to be sent, over every connection
+		/// </summary>
+		size_t GetQueuedBytes() const;
+
+		/// <summary>
+		/// Send a text message to every connected WebSocket. With reactors the
+		/// message is queued to their threads; this may be called from the
+		/// thread that started the server.
+		/// </summary>
+		void Broadcast(const std::string& message);
+
+		/// <summary>
+		/// Send data to every channel subscribed to topic. A channel that still
+		/// has earlier data waiting to go out is skipped, so slow clients drop
+		/// data rather than queue it. With reactors the data is queued to
+		/// their threads like Broadcast.
+		/// </summary>
+		/// <returns>number of channels the data was sent to, or given to the reactors for</returns>
+		int Publish(const std::string& topic, const std::string& data);
+
+		/// <summary>
+		/// Get the number of channels subscribed to topic
+		/// </summary>
+		int GetSubscriberCount(const std::string& topic) const;
+
+		/// <summary>
+		/// Answer the request parked with ticket; see HTTPResponse::Park. With
+		/// reactors the ticket is queued to their threads like Broadcast. A
+		/// ticket whose connection has closed is ignored.
+		/// </summary>
+		void Resume(long long ticket);
+
+		/// <summary>
+		/// Choose a content coding the client accepts
+		/// </summary>
+		/// <returns>"gzip", "deflate" or "" for none</returns>
+		static std::string GetAcceptedEncoding(const HTTPRequestParams& rq);
+
+		void AddWebSocket(Channel* channel) { webSockets.insert(channel); }
+		void RemoveWebSocket(Channel* channel) { webSockets.erase(channel); }
+		void AddSubscriber(const std::string& topic, Channel* channel) { subscribers[topic].insert(channel); }
+		void RemoveSubscriber(const std::string& topic, Channel* channel);
+		void AddParked(long long ticket, Channel* channel) { parked[ticket] = channel; }
+		void RemoveParked(long long ticket) { parked.erase(ticket); }
+
 		void handle_accept (void);
 	};
 }
@@ -0,0 +1,113 @@
+// WebConfig - Use a web browser to configure your application
+// Copyright (c) 2009 David McClurg <dpm@efn.org>
+// Under the MIT License, details: License.txt.
+
+#include "ImageStream.h"
+#include "HTTPServer.h"
+#include "AssetCache.h"
+#include "Support/Convert.h"
+
+using namespace std;
+
+namespace WebConfig
+{
+	// separates the frames of a stream
+	static const char* const FrameBoundary = "WebConfigFrame";
+
+	ImageStream::ImageStream(const string& url, CaptureSource* source)
+	{
+		this->url = AssetCache::NormalizeUrl(url);
+		this->frameUrl = this->url + ".jpg";
+		this->source = source;
+		FramesCaptured = 0;
+		FramesSkipped = 0;
+		FramesSent = 0;
+		FramesDropped = 0;
+		interval = 0.1;
+		nextCapture = 0;
+		width = 0;
+		height = 0;
+		capture.SetJpegQuality(60);
+	}
+
+	/// <summary>
+	/// Set the most frames per second to send
+	/// </summary>
+	void ImageStream::SetFrameRate(double fps)
+	{
+		interval = (fps > 0)? 1.0 / fps: 0;
+	}
+
+	/// <summary>
+	/// Set the size frames are scaled to before encoding
+	/// </summary>
+	void ImageStream::SetResolution(int width, int height)
+	{
+		this->width = width;
+		this->height = height;
+	}
+
+	/// <summary>
+	/// Capture, encode and send frames as they come due
+	/// </summary>
+	void ImageStream::Update(HTTPServer& server, AssetCache& assets, double now)
+	{
+		int viewers = server.GetSubscriberCount(url);
+
+		// send what the worker finished
+		if (capture.Publish(assets) > 0)
+		{
+			const AssetCache::Asset* asset = assets.Find(frameUrl);
+			if (asset != NULL)
+			{
+				part.assign("--");
+				part += FrameBoundary;
+				part += "\r\nContent-Type: image/jpeg\r\nContent-Length: ";
+				part += Convert::ToString((int)asset->Data.length());
+				part += "\r\n\r\n";
+				part += asset->Data;
+				part += "\r\n";
+
+				int sent = server.Publish(url, part);
+				FramesSent += sent;
+				FramesDropped += viewers - sent;
+			}
+		}
+
+		// nobody watching, nothing to do
+		if (viewers == 0 || source == NULL || now < nextCapture)
+			return;
+
+		// keep to the frame rate without bunching up after a stall
+		nextCapture = (now - nextCapture < interval)? nextCapture + interval: now + interval;
+
+		int w, h;
+		if (!source->GetSize(w, h) || w <= 0 || h <= 0)
+			return;
+
+		ScreenCapture::Frame* frame = capture.Acquire(w, h);
+		if (frame == NULL)
+		{
+			++FramesSkipped;
+			return;
+		}
+
+		if (source->Capture(*frame))
+		{
+			capture.Submit(frame, frameUrl, ScreenCapture::FORMAT_JPEG, width, height);
+			++FramesCaptured;
+		}
+		else
+		{
+			capture.Release(frame);
+		}
+	}
+
+	/// <summary>
+	/// Get the response Content-type for a stream
+	/// </summary>
+	string ImageStream::GetContentType()
+	{
+		return string("multipart/x-mixed-replace; boundary=") + FrameBoundary;
+	}
+}
@@ -0,0 +1,123 @@
+// WebConfig - Use a web browser to configure your application
+// Copyright (c) 2009 David McClurg <dpm@efn.org>
+// Under the MIT License, details: License.txt.
+
+#ifndef IMAGESTREAM_H
+#define IMAGESTREAM_H
+
+#include "ScreenCapture.h"
+
+#include <string>
+
+namespace WebConfig
+{
+	class HTTPServer;
+	class AssetCache;
+
+	/// <summary>
+	/// Supplies the pixels of an image stream; implemented by the application,
+	/// eg. to read back its viewport
+	/// </summary>
+	class CaptureSource
+	{
+	public:
+
+		virtual ~CaptureSource() {}
+
+		/// <summary>
+		/// Get the size of the next capture
+		/// </summary>
+		/// <returns>false if there is nothing to capture right now</returns>
+		virtual bool GetSize(int& width, int& height) = 0;
+
+		/// <summary>
+		/// Fill a frame of that size; set frame.Bgra for Win32 DIB byte order
+		/// </summary>
+		/// <returns>false to skip this capture</returns>
+		virtual bool Capture(ScreenCapture::Frame& frame) = 0;
+	};
+
+	/// <summary>
+	/// A live preview served as multipart/x-mixed-replace JPEG (MJPEG), which
+	/// browsers show in a plain img tag. Frames are only captured while someone
+	/// is watching, and never faster than the frame rate; encoding runs on a
+	/// worker. A viewer that hasn't finished receiving one frame skips the next,
+	/// and when the encoder falls behind the capture is skipped instead of queued.
+	/// The latest frame is also served as a still image at GetFrameUrl().
+	/// </summary>
+	class ImageStream
+	{
+	public:
+
+		/// <summary>
+		/// Constructor
+		/// </summary>
+		/// <param name="url">url of the stream</param>
+		/// <param name="source">pixels to send; not owned</param>
+		ImageStream(const std::string& url, CaptureSource* source);
+
+		/// <summary>
+		/// Set the most frames per second to send; the default is 10
+		/// </summary>
+		void SetFrameRate(double fps);
+
+		/// <summary>
+		/// Set the size frames are scaled to before encoding;
+		/// 0 sends them at the captured size, which is the default
+		/// </summary>
+		void SetResolution(int width, int height);
+
+		/// <summary>
+		/// Set the JPEG quality, 1 to 100; the default is 60
+		/// </summary>
+		void SetQuality(int quality) { capture.SetJpegQuality(quality); }
+
+		/// <summary>
+		/// Capture, encode and send frames as they come due; call every frame
+		/// </summary>
+		/// <param name="now">time in seconds</param>
+		void Update(HTTPServer& server, AssetCache& assets, double now);
+
+		/// <summary>
+		/// Wait for frames being encoded and stop the worker
+		/// </summary>
+		void Stop() { capture.Stop(); }
+
+		const std::string& GetUrl() const { return url; }
+		const std::string& GetFrameUrl() const { return frameUrl; }
+
+		/// <summary>
+		/// Get the most recent frame as one part of the stream; a new viewer
+		/// is sent this first so it doesn't wait for the next capture
+		/// </summary>
+		const std::string& GetLatestPart() const { return part; }
+
+		/// <summary>
+		/// Get the response Content-type for a stream
+		/// </summary>
+		static std::string GetContentType();
+
+		int FramesCaptured;		// submitted for encoding
+		int FramesSkipped;		// not captured because the encoder was behind
+		int FramesSent;			// summed over viewers
+		int FramesDropped;		// not sent to a viewer still busy with the last one
+
+	private:
+
+		std::string url;
+		std::string frameUrl;
+		CaptureSource* source;
+		ScreenCapture capture;
+		std::string part;		// reused for every frame
+
+		double interval;
+		double nextCapture;
+		int width;
+		int height;
+
+		ImageStream(const ImageStream&);
+		ImageStream& operator=(const ImageStream&);
+	};
+}
+
+#endif // #ifndef IMAGESTREAM_H
@@ -0,0 +1,242 @@
+// WebConfig - Use a web browser to configure your application
+// Copyright (c) 2009 David McClurg <dpm@efn.org>
+// Under the MIT License, details: License.txt.
+
+#include "ScreenCapture.h"
+#include "AssetCache.h"
+#include "Support/ImageEncoder.h"
+
+#include <stdio.h>
+#include <time.h>
+
+using namespace std;
+
+namespace WebConfig
+{
+	ScreenCapture::ScreenCapture()
+	{
+		quit = false;
+		poolSize = 2;
+		compressionLevel = 3;
+		jpegQuality = 75;
+		startTime = (unsigned int)time(NULL);
+		sequence = 0;
+	}
+
+	ScreenCapture::~ScreenCapture()
+	{
+		Stop();
+		for (unsigned int i = 0; i < frames.size(); i++)
+			delete frames[i];
+	}
+
+	/// <summary>
+	/// Get a free frame sized for width x height
+	/// </summary>
+	ScreenCapture::Frame* ScreenCapture::Acquire(int width, int height)
+	{
+		Frame* frame = NULL;
+		{
+			MutexLock hold(lock);
+			if (!idle.empty())
+			{
+				frame = idle.back();
+				idle.pop_back();
+			}
+			else if ((int)frames.size() < poolSize)
+			{
+				frame = new Frame;
+				frames.push_back(frame);
+			}
+		}
+
+		if (frame != NULL)
+		{
+			frame->Width = width;
+			frame->Height = height;
+			frame->Bgra = false;
+			frame->Pixels.resize((size_t)width * height * 4);
+		}
+		return frame;
+	}
+
+	/// <summary>
+	/// Queue a filled frame to be encoded and published at url
+	/// </summary>
+	void ScreenCapture::Submit(Frame* frame, const string& url, Format format, int width, int height)
+	{
+		frame->url = url;
+		frame->format = format;
+		frame->scaleWidth = (width > 0 && height > 0)? width: 0;
+		frame->scaleHeight = (width > 0 && height > 0)? height: 0;
+
+		if (!worker.IsRunning())
+		{
+			quit = false;
+			if (!worker.Start(&WorkerMain, this))
+			{
+				// no threads; encode here rather than lose the capture
+				Process(*frame, (format == FORMAT_JPEG)? jpegQuality: compressionLevel);
+				MutexLock hold(lock);
+				done.push_back(frame);
+				return;
+			}
+		}
+
+		{
+			MutexLock hold(lock);
+			queue.push_back(frame);
+		}
+		work.Post();
+	}
+
+	/// <summary>
+	/// Give back an acquired frame without submitting it
+	/// </summary>
+	void ScreenCapture::Release(Frame* frame)
+	{
+		MutexLock hold(lock);
+		idle.push_back(frame);
+	}
+
+	/// <summary>
+	/// Move finished images into the asset cache
+	/// </summary>
+	int ScreenCapture::Publish(AssetCache& assets)
+	{
+		vector<Frame*> finished;
+		{
+			MutexLock hold(lock);
+			if (done.empty())
+				return 0;
+			finished.swap(done);
+		}
+
+		for (unsigned int i = 0; i < finished.size(); i++)
+		{
+			Frame* frame = finished[i];
+
+			char etag[64];
+			sprintf(etag, "\"c%x-%x\"", startTime, ++sequence);
+
+			AssetCache::Asset asset;
+			asset.Data.swap(frame->encoded);
+			asset.ContentType = GetContentType(frame->format);
+			asset.ETag = etag;
+			asset.Pinned = true;
+			assets.Add(frame->url, asset);
+		}
+
+		MutexLock hold(lock);
+		idle.insert(idle.end(), finished.begin(), finished.end());
+		return (int)finished.size();
+	}
+
+	/// <summary>
+	/// Wait for queued frames to be encoded and stop the worker
+	/// </summary>
+	void ScreenCapture::Stop()
+	{
+		if (worker.IsRunning())
+		{
+			{
+				MutexLock hold(lock);
+				quit = true;
+			}
+			work.Post();
+			worker.Join();
+		}
+	}
+
+	void ScreenCapture::WorkerMain(void* arg)
+	{
+		((ScreenCapture*)arg)->Run();
+	}
+
+	/// <summary>
+	/// Encode queued frames until told to quit
+	/// </summary>
+	void ScreenCapture::Run()
+	{
+		while (true)
+		{
+			work.Wait();
+
+			Frame* frame = NULL;
+			int level;
+			{
+				MutexLock hold(lock);
+				if (queue.empty())
+				{
+					if (quit)
+						return;
+					continue;
+				}
+				frame = queue.front();
+				queue.pop_front();
+				level = (frame->format == FORMAT_JPEG)? jpegQuality: compressionLevel;
+			}
+
+			Process(*frame, level);
+
+			MutexLock hold(lock);
+			done.push_back(frame);
+		}
+	}
+
+	/// <summary>
+	/// Scale a submitted frame to its published size and encode it
+	/// </summary>
+	void ScreenCapture::Process(Frame& frame, int level)
+	{
+		if (frame.scaleWidth == 0 || (frame.scaleWidth == frame.Width && frame.scaleHeight == frame.Height))
+		{
+			Encode(frame, frame.format, level, frame.encoded);
+			return;
+		}
+
+		// the scaled copy keeps its buffer for the next capture
+		frame.scaled.resize((size_t)frame.scaleWidth * frame.scaleHeight * 4);
+		ImageEncoder::Scale(&frame.Pixels[0], frame.Width, frame.Height, frame.Width * 4,
+			&frame.scaled[0], frame.scaleWidth, frame.scaleHeight);
+		frame.Pixels.swap(frame.scaled);
+		int width = frame.Width, height = frame.Height;
+		frame.Width = frame.scaleWidth;
+		frame.Height = frame.scaleHeight;
+
+		Encode(frame, frame.format, level, frame.encoded);
+
+		frame.Pixels.swap(frame.scaled);
+		frame.Width = width;
+		frame.Height = height;
+	}
+
+	/// <summary>
+	/// Encode a frame on the calling thread
+	/// </summary>
+	void ScreenCapture::Encode(const Frame& frame, Format format, int level, string& out)
+	{
+		out.clear();
+		ImageEncoder::PixelOrder order = frame.Bgra? ImageEncoder::PIXEL_BGRA: ImageEncoder::PIXEL_RGBA;
+		const unsigned char* pixels = frame.Pixels.empty()? NULL: &frame.Pixels[0];
+		if (format == FORMAT_QOI)
+			ImageEncoder::EncodeQoi(pixels, frame.Width, frame.Height, frame.Width * 4, order, out);
+		else if (format == FORMAT_JPEG)
+			ImageEncoder::EncodeJpeg(pixels, frame.Width, frame.Height, frame.Width * 4, order, out, level);
+		else
+			ImageEncoder::EncodePng(pixels, frame.Width, frame.Height, frame.Width * 4, order, out, level);
+	}
+
+	/// <summary>
+	/// Get the mime type for an image format
+	/// </summary>
+	const char* ScreenCapture::GetContentType(Format format)
+	{
+		switch (format)
+		{
+		case FORMAT_QOI: return "image/qoi";
+		case FORMAT_JPEG: return "image/jpeg";
+		default: return "image/png";
+		}
+	}
+}
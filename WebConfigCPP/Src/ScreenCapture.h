@@ -0,0 +1,149 @@
+// WebConfig - Use a web browser to configure your application
+// Copyright (c) 2009 David McClurg <dpm@efn.org>
+// Under the MIT License, details: License.txt.
+
+#ifndef SCREENCAPTURE_H
+#define SCREENCAPTURE_H
+
+#include "Support/Thread.h"
+
+#include <string>
+#include <vector>
+#include <deque>
+
+namespace WebConfig
+{
+	class AssetCache;
+
+	/// <summary>
+	/// Takes screen shots without stalling the frame. The frame thread copies
+	/// pixels into a pooled Frame and submits it; a worker thread encodes it,
+	/// and Publish hands the image to the asset cache to be served from memory.
+	/// </summary>
+	class ScreenCapture
+	{
+	public:
+
+		enum Format
+		{
+			FORMAT_PNG,
+			FORMAT_QOI,
+			FORMAT_JPEG
+		};
+
+		/// <summary>
+		/// A pixel buffer from the pool
+		/// </summary>
+		class Frame
+		{
+			friend class ScreenCapture;
+
+			std::string url;
+			Format format;
+			int scaleWidth;		// size to publish at; 0 for the captured size
+			int scaleHeight;
+			std::vector<unsigned char> scaled;
+			std::string encoded;
+
+		public:
+
+			Frame() : format(FORMAT_PNG), scaleWidth(0), scaleHeight(0), Width(0), Height(0), Bgra(false) {}
+
+			int Width;
+			int Height;
+			bool Bgra;							// Win32 DIB byte order; otherwise RGBA
+			std::vector<unsigned char> Pixels;	// 4 bytes per pixel, top row first
+
+			/// <summary>
+			/// Start of a row
+			/// </summary>
+			unsigned char* Row(int y) { return &Pixels[(size_t)y * Width * 4]; }
+		};
+
+		ScreenCapture();
+		~ScreenCapture();
+
+		/// <summary>
+		/// Get a free frame sized for width x height; its buffer is reused
+		/// from earlier captures when it is big enough
+		/// </summary>
+		/// <returns>NULL while every frame in the pool is still being encoded</returns>
+		Frame* Acquire(int width, int height);
+
+		/// <summary>
+		/// Queue a filled frame to be encoded and published at url
+		/// </summary>
+		/// <param name="width">width of the published image; 0 keeps the captured size</param>
+		/// <param name="height">height of the published image</param>
+		void Submit(Frame* frame, const std::string& url, Format format = FORMAT_PNG, int width = 0, int height = 0);
+
+		/// <summary>
+		/// Give back an acquired frame without submitting it
+		/// </summary>
+		void Release(Frame* frame);
+
+		/// <summary>
+		/// Move finished images into the asset cache; call from the thread that owns it
+		/// </summary>
+		/// <returns>number of images published</returns>
+		int Publish(AssetCache& assets);
+
+		/// <summary>
+		/// Wait for queued frames to be encoded and stop the worker
+		/// </summary>
+		void Stop();
+
+		/// <summary>
+		/// Set how many frames may be in flight; the default is 2
+		/// </summary>
+		void SetPoolSize(int frames) { poolSize = frames; }
+
+		/// <summary>
+		/// Set the deflate level for PNG images, 1 fastest to 9 smallest
+		/// </summary>
+		void SetCompressionLevel(int level) { compressionLevel = level; }
+
+		/// <summary>
+		/// Set the quality of JPEG images, 1 to 100; the default is 75
+		/// </summary>
+		void SetJpegQuality(int quality) { jpegQuality = quality; }
+
+		/// <summary>
+		/// Encode a frame on the calling thread; level is the deflate level
+		/// for PNG or the quality for JPEG
+		/// </summary>
+		static void Encode(const Frame& frame, Format format, int level, std::string& out);
+
+		/// <summary>
+		/// Get the mime type for an image format
+		/// </summary>
+		static const char* GetContentType(Format format);
+
+	private:
+
+		Mutex lock;
+		Semaphore work;				// posted once per queued frame and once to quit
+		Thread worker;
+		bool quit;
+
+		std::vector<Frame*> frames;	// every frame; owned
+		std::vector<Frame*> idle;	// frames free to acquire
+		std::deque<Frame*> queue;	// submitted, waiting for the worker
+		std::vector<Frame*> done;	// encoded, waiting to be published
+
+		int poolSize;
+		int compressionLevel;
+		int jpegQuality;
+		unsigned int startTime;
+		unsigned int sequence;
+
+		static void WorkerMain(void* arg);
+		void Run();
+		void Process(Frame& frame, int level);
+
+		ScreenCapture(const ScreenCapture&);
+		ScreenCapture& operator=(const ScreenCapture&);
+	};
+}
+
+#endif // #ifndef SCREENCAPTURE_H
@@ -0,0 +1,48 @@
+#ifndef ATOMIC_H
+#define ATOMIC_H
+
+#ifdef _WIN32
+#	include <windows.h>
+#endif
+
+/// Lock-free operations on 64 bit counters shared between threads
+class Atomic
+{
+public:
+
+	/// Adds delta to value; returns the new value
+	static long long Add(volatile long long& value, long long delta)
+	{
+#ifdef _WIN32
+		return InterlockedExchangeAdd64(&value, delta) + delta;
+#else
+		return __sync_add_and_fetch(&value, delta);
+#endif
+	}
+
+	/// Sets value once everything written before it is visible to other threads;
+	/// a plain store where the hardware keeps stores in order
+	static void Store(volatile long long& value, long long newValue)
+	{
+#if defined(_WIN64)
+		_ReadWriteBarrier();
+		value = newValue;
+#elif defined(_WIN32)
+		InterlockedExchange64(&value, newValue);
+#else
+		__atomic_store_n(&value, newValue, __ATOMIC_RELEASE);
+#endif
+	}
+
+	/// Reads value whole, even where a 64 bit load takes two instructions
+	static long long Load(const volatile long long& value)
+	{
+#ifdef _WIN32
+		return InterlockedCompareExchange64((volatile long long*)&value, 0, 0);
+#else
+		return __sync_add_and_fetch((volatile long long*)&value, 0);
+#endif
+	}
+};
+
+#endif // #ifndef ATOMIC_H
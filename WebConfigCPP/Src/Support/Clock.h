@@ -0,0 +1,39 @@
+#ifndef CLOCK_H
+#define CLOCK_H
+
+#ifdef _WIN32
+#	include <windows.h>
+#else
+#	include <time.h>
+#endif
+
+/// Monotonic high resolution time; only differences are meaningful
+class Clock
+{
+public:
+
+	/// nanoseconds since an arbitrary start
+	static long long Nanoseconds()
+	{
+#ifdef _WIN32
+		static LARGE_INTEGER frequency = { 0 };
+		if (frequency.QuadPart == 0)
+			QueryPerformanceFrequency(&frequency);
+		LARGE_INTEGER count;
+		QueryPerformanceCounter(&count);
+		return (long long)((double)count.QuadPart * 1e9 / (double)frequency.QuadPart);
+#else
+		struct timespec ts;
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+#endif
+	}
+
+	/// seconds since an arbitrary start
+	static double Seconds()
+	{
+		return Nanoseconds() * 1e-9;
+	}
+};
+
+#endif // #ifndef CLOCK_H
@@ -31,6 +31,24 @@ public:
 		return x;
 	}
 
+	static long long ToInt64(const std::string& s)
+	{
+		std::istringstream i(s);
+		long long x;
+		if (!(i >> x))
+			throw BadConversion();
+		return x;
+	}
+
+	static double ToDouble(const std::string& s)
+	{
+		std::istringstream i(s);
+		double x;
+		if (!(i >> x))
+			throw BadConversion();
+		return x;
+	}
+
 	static float ToFloat(const std::string& s)
 	{
 		std::istringstream i(s);
@@ -47,6 +65,30 @@ public:
 			return true;
 		return false;
 	}
+
+	static std::string ToBase64String(const std::string& bytes)
+	{
+		static const char table[] =
+			"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+		std::string s;
+		s.reserve((bytes.length() + 2) / 3 * 4);
+
+		const unsigned char* p = (const unsigned char*)bytes.data();
+		size_t n = bytes.length();
+		for (size_t i = 0; i < n; i += 3)
+		{
+			unsigned int v = p[i] << 16;
+			if (i + 1 < n) v |= p[i+1] << 8;
+			if (i + 2 < n) v |= p[i+2];
+
+			s += table[(v >> 18) & 63];
+			s += table[(v >> 12) & 63];
+			s += (i + 1 < n)? table[(v >> 6) & 63]: '=';
+			s += (i + 2 < n)? table[v & 63]: '=';
+		}
+		return s;
+	}
 };
 
 #endif // #ifndef CONVERT_H
@@ -0,0 +1,391 @@
+#include "Deflate.h"
+
+#include <vector>
+
+using namespace std;
+
+namespace
+{
+	const int MinMatch = 3;
+	const int MaxMatch = 258;
+	const int MaxDistance = 32768;
+	const int MaxStored = 65535;
+
+	const unsigned short lengthBase[29] = {
+		3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+		35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+	const unsigned char lengthExtra[29] = {
+		0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+		3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+	const unsigned short distBase[30] = {
+		1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+		257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+	const unsigned char distExtra[30] = {
+		0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+		7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+	// search effort per level
+	const int maxChain[10] = { 0, 4, 8, 16, 32, 64, 128, 256, 1024, 4096 };
+	const int niceLength[10] = { 0, 8, 16, 32, 32, 64, 128, 258, 258, 258 };
+
+	unsigned int Reverse(unsigned int code, int bits)
+	{
+		unsigned int result = 0;
+		for (int i = 0; i < bits; i++, code >>= 1)
+			result = (result << 1) | (code & 1);
+		return result;
+	}
+
+	/// lookup tables built once at startup
+	struct Tables
+	{
+		unsigned short litCode[288];	// fixed codes, bit reversed for LSB first output
+		unsigned char litBits[288];
+		unsigned char distCode[30];
+		unsigned char lengthSymbol[MaxMatch + 1];	// length to index into lengthBase
+		unsigned char distSymbol[512];	// distance-1 to index into distBase; see DistSymbol()
+		unsigned long crc[256];
+
+		Tables()
+		{
+			for (int i = 0; i < 288; i++)
+			{
+				if (i < 144) { litCode[i] = (unsigned short)Reverse(0x30 + i, 8); litBits[i] = 8; }
+				else if (i < 256) { litCode[i] = (unsigned short)Reverse(0x190 + i - 144, 9); litBits[i] = 9; }
+				else if (i < 280) { litCode[i] = (unsigned short)Reverse(i - 256, 7); litBits[i] = 7; }
+				else { litCode[i] = (unsigned short)Reverse(0xC0 + i - 280, 8); litBits[i] = 8; }
+			}
+			for (int i = 0; i < 30; i++)
+				distCode[i] = (unsigned char)Reverse(i, 5);
+
+			for (int code = 0; code < 29; code++)
+			{
+				int end = (code == 28)? MaxMatch + 1: lengthBase[code + 1];
+				for (int n = lengthBase[code]; n < end; n++)
+					lengthSymbol[n] = (unsigned char)code;
+			}
+			for (int code = 0; code < 30; code++)
+			{
+				int end = (code == 29)? MaxDistance + 1: distBase[code + 1];
+				for (int d = distBase[code] - 1; d < end - 1; d++)
+				{
+					if (d < 256)
+						distSymbol[d] = (unsigned char)code;
+					else
+						distSymbol[256 + (d >> 7)] = (unsigned char)code;
+				}
+			}
+
+			for (unsigned long n = 0; n < 256; n++)
+			{
+				unsigned long c = n;
+				for (int k = 0; k < 8; k++)
+					c = (c & 1)? 0xEDB88320UL ^ (c >> 1): c >> 1;
+				crc[n] = c;
+			}
+		}
+
+		int DistSymbol(int dist) const
+		{
+			int d = dist - 1;
+			return (d < 256)? distSymbol[d]: distSymbol[256 + (d >> 7)];
+		}
+	};
+
+	const Tables tables;
+
+	/// packs bits least significant first, as deflate wants
+	class BitWriter
+	{
+		string& out;
+		unsigned int bits;
+		int count;
+
+	public:
+
+		BitWriter(string& output) : out(output), bits(0), count(0) {}
+
+		void Put(unsigned int value, int n)
+		{
+			bits |= value << count;
+			count += n;
+			while (count >= 8)
+			{
+				out += (char)(bits & 0xFF);
+				bits >>= 8;
+				count -= 8;
+			}
+		}
+
+		void Flush()
+		{
+			if (count > 0)
+				out += (char)(bits & 0xFF);
+			bits = 0;
+			count = 0;
+		}
+	};
+
+	/// LZ77 matcher over the whole input with a hash chain window
+	class Compressor
+	{
+		const unsigned char* data;
+		int length;
+		int hashShift;
+		int windowMask;
+		vector<int> head;
+		vector<int> prev;
+		int chain;
+		int nice;
+		BitWriter& bw;
+
+		unsigned int Hash(int pos) const
+		{
+			unsigned int v = (data[pos] << 16) | (data[pos + 1] << 8) | data[pos + 2];
+			return (v * 2654435761U) >> hashShift;
+		}
+
+		void Insert(int pos)
+		{
+			if (length - pos < MinMatch)
+				return;
+			unsigned int h = Hash(pos);
+			prev[pos & windowMask] = head[h];
+			head[h] = pos;
+		}
+
+		int FindMatch(int pos, int& dist) const
+		{
+			int limit = length - pos;
+			if (limit > MaxMatch)
+				limit = MaxMatch;
+			if (limit < MinMatch)
+				return 0;
+
+			int best = MinMatch - 1;
+			int cur = head[Hash(pos)];
+			for (int n = chain; cur >= 0 && pos - cur <= MaxDistance && n > 0; n--)
+			{
+				if (data[cur + best] == data[pos + best] && data[cur] == data[pos])
+				{
+					int len = 1;
+					while (len < limit && data[cur + len] == data[pos + len])
+						++len;
+					if (len > best)
+					{
+						best = len;
+						dist = pos - cur;
+						if (len >= nice || len == limit)
+							break;
+					}
+				}
+				int next = prev[cur & windowMask];
+				if (next >= cur)
+					break;	// slot reused by a newer position
+				cur = next;
+			}
+			return (best >= MinMatch)? best: 0;
+		}
+
+		void Literal(unsigned char c)
+		{
+			bw.Put(tables.litCode[c], tables.litBits[c]);
+		}
+
+		void Match(int len, int dist)
+		{
+			int code = tables.lengthSymbol[len];
+			bw.Put(tables.litCode[257 + code], tables.litBits[257 + code]);
+			if (lengthExtra[code] != 0)
+				bw.Put(len - lengthBase[code], lengthExtra[code]);
+
+			code = tables.DistSymbol(dist);
+			bw.Put(tables.distCode[code], 5);
+			if (distExtra[code] != 0)
+				bw.Put(dist - distBase[code], distExtra[code]);
+		}
+
+	public:
+
+		Compressor(const char* input, int inputLength, int level, BitWriter& writer)
+			: data((const unsigned char*)input), length(inputLength), bw(writer)
+		{
+			// size the tables to the input so small pages are cheap
+			int bits = 8;
+			while (bits < 15 && (1 << bits) < length)
+				++bits;
+			hashShift = 32 - bits;
+			windowMask = (1 << bits) - 1;
+			head.assign(1 << bits, -1);
+			prev.assign(1 << bits, -1);
+			chain = maxChain[level];
+			nice = niceLength[level];
+		}
+
+		void Run(bool lazy)
+		{
+			int pos = 0;
+			bool pending = false;	// a match starting at pos-1 waits for a better one at pos
+			int pendingLen = 0, pendingDist = 0;
+
+			while (pos < length)
+			{
+				int dist = 0;
+				int len = FindMatch(pos, dist);
+				Insert(pos);
+
+				if (pending)
+				{
+					if (len > pendingLen)
+					{
+						Literal(data[pos - 1]);
+						pendingLen = len;
+						pendingDist = dist;
+						++pos;
+						continue;
+					}
+					Match(pendingLen, pendingDist);
+					int end = pos - 1 + pendingLen;
+					for (++pos; pos < end; ++pos)
+						Insert(pos);
+					pending = false;
+					continue;
+				}
+
+				if (len == 0)
+				{
+					Literal(data[pos]);
+					++pos;
+				}
+				else if (lazy && len < nice)
+				{
+					pending = true;
+					pendingLen = len;
+					pendingDist = dist;
+					++pos;
+				}
+				else
+				{
+					Match(len, dist);
+					int end = pos + len;
+					for (++pos; pos < end; ++pos)
+						Insert(pos);
+				}
+			}
+			if (pending)
+				Match(pendingLen, pendingDist);
+		}
+	};
+
+	void Stored(const char* data, size_t length, string& out)
+	{
+		BitWriter bw(out);
+		size_t pos = 0;
+		do
+		{
+			size_t n = length - pos;
+			if (n > MaxStored)
+				n = MaxStored;
+			bw.Put((pos + n == length)? 1: 0, 1);
+			bw.Put(0, 2);
+			bw.Flush();
+			out += (char)(n & 0xFF);
+			out += (char)(n >> 8);
+			out += (char)(~n & 0xFF);
+			out += (char)((~n >> 8) & 0xFF);
+			out.append(data + pos, n);
+			pos += n;
+		}
+		while (pos < length);
+	}
+
+	void PutLE(string& out, unsigned long value)
+	{
+		for (int i = 0; i < 4; i++, value >>= 8)
+			out += (char)(value & 0xFF);
+	}
+
+	void PutBE(string& out, unsigned long value)
+	{
+		for (int i = 3; i >= 0; i--)
+			out += (char)((value >> (i * 8)) & 0xFF);
+	}
+}
+
+void Deflate::Compress(const char* data, size_t length, string& out, int level, Format format)
+{
+	if (level < 0)
+		level = 0;
+	if (level > 9)
+		level = 9;
+
+	if (format == FORMAT_GZIP)
+	{
+		static const char header[10] = { '\x1f', '\x8b', 8, 0, 0, 0, 0, 0, 0, '\xff' };
+		out.append(header, sizeof(header));
+	}
+	else if (format == FORMAT_ZLIB)
+	{
+		int flags = ((level < 2)? 0: (level < 6)? 1: (level == 6)? 2: 3) << 6;
+		flags += (31 - (0x7800 + flags) % 31) % 31;
+		out += (char)0x78;
+		out += (char)flags;
+	}
+
+	size_t start = out.length();
+	size_t storedLength = length + 5 * (length / MaxStored + 1);
+	if (level > 0 && length < 0x7FFFFFFF)
+	{
+		BitWriter bw(out);
+		bw.Put(1, 1);	// final block
+		bw.Put(1, 2);	// fixed Huffman codes
+		Compressor compressor(data, (int)length, level, bw);
+		compressor.Run(level >= 4);
+		bw.Put(tables.litCode[256], tables.litBits[256]);
+		bw.Flush();
+	}
+	if (level == 0 || out.length() - start > storedLength)
+	{
+		// incompressible
+		out.resize(start);
+		Stored(data, length, out);
+	}
+
+	if (format == FORMAT_GZIP)
+	{
+		PutLE(out, Crc32(0, data, length));
+		PutLE(out, (unsigned long)length);
+	}
+	else if (format == FORMAT_ZLIB)
+	{
+		PutBE(out, Adler32(1, data, length));
+	}
+}
+
+unsigned long Deflate::Crc32(unsigned long crc, const char* data, size_t length)
+{
+	crc = ~crc & 0xFFFFFFFFUL;
+	for (size_t i = 0; i < length; i++)
+		crc = tables.crc[(crc ^ (unsigned char)data[i]) & 0xFF] ^ (crc >> 8);
+	return ~crc & 0xFFFFFFFFUL;
+}
+
+unsigned long Deflate::Adler32(unsigned long adler, const char* data, size_t length)
+{
+	unsigned long a = adler & 0xFFFF;
+	unsigned long b = (adler >> 16) & 0xFFFF;
+	while (length > 0)
+	{
+		// largest run before b can overflow 32 bits
+		size_t n = (length < 5552)? length: 5552;
+		length -= n;
+		while (n-- > 0)
+		{
+			a += (unsigned char)*data++;
+			b += a;
+		}
+		a %= 65521;
+		b %= 65521;
+	}
+	return (b << 16) | a;
+}
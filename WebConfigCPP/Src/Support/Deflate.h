@@ -0,0 +1,35 @@
+#ifndef DEFLATE_H
+#define DEFLATE_H
+
+#include <string>
+
+/// Deflate compressor (RFC 1951) using LZ77 with fixed Huffman codes;
+/// small and dependency free rather than as tight as zlib
+class Deflate
+{
+public:
+
+	enum Format
+	{
+		FORMAT_RAW,		// bare deflate stream
+		FORMAT_ZLIB,	// RFC 1950; "Content-Encoding: deflate" and PNG
+		FORMAT_GZIP		// RFC 1952; "Content-Encoding: gzip" and .gz files
+	};
+
+	/// Appends the compressed data to out. Level 1 is fastest and 9 smallest;
+	/// level 0 stores the data uncompressed.
+	static void Compress(const char* data, size_t length, std::string& out, int level = 6, Format format = FORMAT_RAW);
+
+	static void Compress(const std::string& data, std::string& out, int level = 6, Format format = FORMAT_RAW)
+	{
+		Compress(data.data(), data.length(), out, level, format);
+	}
+
+	/// Updates a running CRC-32 as used by gzip and PNG; start with 0.
+	static unsigned long Crc32(unsigned long crc, const char* data, size_t length);
+
+	/// Updates a running Adler-32 as used by zlib; start with 1.
+	static unsigned long Adler32(unsigned long adler, const char* data, size_t length);
+};
+
+#endif // #ifndef DEFLATE_H
@@ -0,0 +1,73 @@
+#include "FrameStats.h"
+
+#include <algorithm>
+
+FrameStats::FrameStats() : Enabled(false), next(0), count(0)
+{
+	for (int i = 0; i < SECTION_COUNT; i++)
+		current[i] = 0;
+}
+
+#ifndef WEBCONFIG_NO_FRAME_STATS
+
+void FrameStats::EndFrame()
+{
+	MutexLock hold(lock);
+	for (int i = 0; i < SECTION_COUNT; i++)
+		frames[next][i] = current[i];
+	next = (next + 1) % FrameCount;
+	if (count < FrameCount)
+		++count;
+}
+
+#endif
+
+FrameStats::Summary FrameStats::GetSummary(Section section) const
+{
+	long long samples[FrameCount];
+	int n;
+	{
+		MutexLock hold(lock);
+		n = count;
+		for (int i = 0; i < n; i++)
+			samples[i] = frames[i][section];
+	}
+
+	Summary summary;
+	summary.Mean = 0;
+	summary.Max = 0;
+	summary.P99 = 0;
+	if (n == 0)
+		return summary;
+
+	long long total = 0;
+	for (int i = 0; i < n; i++)
+		total += samples[i];
+	std::sort(samples, samples + n);
+	summary.Mean = (double)total / n;
+	summary.Max = samples[n - 1];
+	summary.P99 = samples[(n * 99) / 100];
+	return summary;
+}
+
+int FrameStats::GetFrameCount() const
+{
+	MutexLock hold(lock);
+	return count;
+}
+
+void FrameStats::Reset()
+{
+	MutexLock hold(lock);
+	next = 0;
+	count = 0;
+}
+
+const char* FrameStats::GetSectionName(Section section)
+{
+	static const char* const names[SECTION_COUNT] =
+	{
+		"update", "poll", "parse", "render", "callbacks", "publish", "snapshot"
+	};
+	return names[section];
+}
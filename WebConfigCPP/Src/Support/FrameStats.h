@@ -0,0 +1,118 @@
+#ifndef FRAMESTATS_H
+#define FRAMESTATS_H
+
+#include "Clock.h"
+#include "Thread.h"
+
+/// Time spent in each section of a frame, kept for the last FrameCount
+/// frames. Sections are timed on the thread that runs the frames; the
+/// summaries may be read from any thread. Define WEBCONFIG_NO_FRAME_STATS
+/// to compile the timing out.
+class FrameStats
+{
+public:
+
+	enum Section
+	{
+		SECTION_UPDATE,		// the whole frame
+		SECTION_POLL,		// socket work, including parse and render when there are no reactors
+		SECTION_PARSE,		// request lines and headers
+		SECTION_RENDER,		// pages and api responses
+		SECTION_CALLBACKS,	// OnPost and the OnChange callbacks
+		SECTION_PUBLISH,	// assets, screen captures and live previews
+		SECTION_SNAPSHOT,	// the inputs copied for reactor threads
+		SECTION_COUNT
+	};
+
+	enum { FrameCount = 256 };
+
+	/// Nanoseconds over the frames kept
+	struct Summary
+	{
+		double Mean;
+		long long Max;
+		long long P99;
+	};
+
+	/// Sections are only timed while this is set.
+	bool Enabled;
+
+	FrameStats();
+
+#ifndef WEBCONFIG_NO_FRAME_STATS
+
+	/// Starts the sections of a new frame at zero.
+	void BeginFrame()
+	{
+		for (int i = 0; i < SECTION_COUNT; i++)
+			current[i] = 0;
+	}
+
+	/// Keeps the frame's sections, in place of the oldest frame.
+	void EndFrame();
+
+	/// Adds time to a section of the current frame.
+	void Add(Section section, long long nanoseconds) { current[section] += nanoseconds; }
+
+#else
+
+	void BeginFrame() {}
+	void EndFrame() {}
+	void Add(Section, long long) {}
+
+#endif
+
+	/// Summarizes a section over the frames kept.
+	Summary GetSummary(Section section) const;
+
+	/// Number of frames kept, up to FrameCount
+	int GetFrameCount() const;
+
+	/// Clears the frames kept.
+	void Reset();
+
+	static const char* GetSectionName(Section section);
+
+private:
+
+	long long current[SECTION_COUNT];
+	long long frames[FrameCount][SECTION_COUNT];
+	int next;		// where the next frame goes
+	int count;
+	mutable Mutex lock;	// guards frames, next and count
+
+	FrameStats(const FrameStats&);
+	FrameStats& operator=(const FrameStats&);
+};
+
+/// Adds the time until it goes out of scope to a section, if the stats are enabled
+class ScopedTimer
+{
+#ifndef WEBCONFIG_NO_FRAME_STATS
+	FrameStats& stats;
+	FrameStats::Section section;
+	long long start;
+
+public:
+
+	ScopedTimer(FrameStats& s, FrameStats::Section sec) :
+		stats(s), section(sec), start(s.Enabled? Clock::Nanoseconds(): 0) {}
+
+	~ScopedTimer()
+	{
+		if (start != 0)
+			stats.Add(section, Clock::Nanoseconds() - start);
+	}
+#else
+public:
+
+	ScopedTimer(FrameStats&, FrameStats::Section) {}
+#endif
+
+private:
+
+	ScopedTimer(const ScopedTimer&);
+	ScopedTimer& operator=(const ScopedTimer&);
+};
+
+#endif // #ifndef FRAMESTATS_H
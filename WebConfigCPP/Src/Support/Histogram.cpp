@@ -0,0 +1,119 @@
+#include "Histogram.h"
+#include "Atomic.h"
+
+// index of the highest bit set in a positive value
+static int HighestBit(unsigned long long value)
+{
+	int bit = 0;
+	for (int shift = 32; shift > 0; shift >>= 1)
+	{
+		if (value >> shift)
+		{
+			value >>= shift;
+			bit += shift;
+		}
+	}
+	return bit;
+}
+
+int Histogram::BucketOf(long long nanoseconds)
+{
+	if (nanoseconds < SubBuckets)
+		return (nanoseconds > 0)? (int)nanoseconds: 0;
+
+	int bit = HighestBit((unsigned long long)nanoseconds);
+	if (bit >= MaxBits)
+		return BucketCount - 1;
+
+	// the top SubBucketBits + 1 bits pick the bucket within the power of two
+	int exponent = bit - SubBucketBits;
+	int sub = (int)(nanoseconds >> exponent) - SubBuckets;
+	return (exponent + 1) * SubBuckets + sub;
+}
+
+long long Histogram::LowestIn(int bucket)
+{
+	if (bucket < SubBuckets)
+		return bucket;
+	int exponent = bucket / SubBuckets - 1;
+	return (long long)(SubBuckets + bucket % SubBuckets) << exponent;
+}
+
+long long Histogram::HighestIn(int bucket)
+{
+	if (bucket < SubBuckets)
+		return bucket;
+	int exponent = bucket / SubBuckets - 1;
+	return LowestIn(bucket) + (1LL << exponent) - 1;
+}
+
+void Histogram::Record(long long nanoseconds)
+{
+	Atomic::Add(counts[BucketOf(nanoseconds)], 1);
+	Atomic::Add(count, 1);
+	Atomic::Add(sum, (nanoseconds > 0)? nanoseconds: 0);
+}
+
+void Histogram::Reset()
+{
+	for (int i = 0; i < BucketCount; i++)
+		counts[i] = 0;
+	count = 0;
+	sum = 0;
+}
+
+long long Histogram::GetCount() const
+{
+	return Atomic::Load(count);
+}
+
+long long Histogram::GetSum() const
+{
+	return Atomic::Load(sum);
+}
+
+long long Histogram::CountAtOrBelow(long long nanoseconds) const
+{
+	long long total = 0;
+	for (int i = 0; i < BucketCount && HighestIn(i) <= nanoseconds; i++)
+		total += Atomic::Load(counts[i]);
+	return total;
+}
+
+long long Histogram::Percentile(double percent) const
+{
+	// the buckets rather than count, which a recorder may not have reached yet
+	long long loaded[BucketCount];
+	long long total = 0;
+	for (int i = 0; i < BucketCount; i++)
+	{
+		loaded[i] = Atomic::Load(counts[i]);
+		total += loaded[i];
+	}
+	if (total == 0)
+		return 0;
+
+	long long rank = (long long)(total * percent / 100 + 0.5);
+	if (rank < 1)
+		rank = 1;
+	long long seen = 0;
+	for (int i = 0; i < BucketCount; i++)
+	{
+		seen += loaded[i];
+		if (seen >= rank)
+			return HighestIn(i);
+	}
+	return HighestIn(BucketCount - 1);
+}
+
+void Histogram::Add(const Histogram& other)
+{
+	for (int i = 0; i < BucketCount; i++)
+	{
+		long long n = Atomic::Load(other.counts[i]);
+		if (n != 0)
+			Atomic::Add(counts[i], n);
+	}
+	Atomic::Add(count, other.GetCount());
+	Atomic::Add(sum, other.GetSum());
+}
@@ -0,0 +1,57 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+/// HDR-style histogram of durations in nanoseconds. Each power of two is
+/// split into 16 linear buckets, so a value is known to within 1/16 from
+/// 1 ns to 18 minutes in under 5 KB. Record is lock-free and may be called
+/// from any thread; readers see the counts as they stand.
+class Histogram
+{
+public:
+
+	enum
+	{
+		SubBucketBits = 4,
+		SubBuckets = 1 << SubBucketBits,
+		MaxBits = 40,	// largest value recorded is 2^40 - 1 ns
+		BucketCount = (MaxBits - SubBucketBits + 1) * SubBuckets
+	};
+
+	Histogram() { Reset(); }
+
+	/// Adds a duration; longer ones are counted as the largest.
+	void Record(long long nanoseconds);
+
+	/// Clears the counts; not safe while another thread records.
+	void Reset();
+
+	/// Number of durations recorded
+	long long GetCount() const;
+
+	/// Total of the durations recorded, in nanoseconds
+	long long GetSum() const;
+
+	/// Number of durations known to be at most nanoseconds
+	long long CountAtOrBelow(long long nanoseconds) const;
+
+	/// Duration that percent of those recorded are at or below; 0 if none are.
+	long long Percentile(double percent) const;
+
+	/// Adds another histogram's counts to this one.
+	void Add(const Histogram& other);
+
+	/// Bucket a duration falls in
+	static int BucketOf(long long nanoseconds);
+
+	/// Smallest and largest durations in a bucket
+	static long long LowestIn(int bucket);
+	static long long HighestIn(int bucket);
+
+private:
+
+	volatile long long counts[BucketCount];
+	volatile long long count;
+	volatile long long sum;
+};
+
+#endif // #ifndef HISTOGRAM_H
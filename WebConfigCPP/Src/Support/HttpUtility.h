@@ -2,6 +2,7 @@
 #define HTTPUTILITY_H
 
 #include <string>
+#include <string.h>
 
 class HttpUtility
 {
@@ -51,11 +52,11 @@ public:
 				(*s >= ':' && *s <= '?') ||
 				(*s >= '[' && *s <= '`' && *s != '_'))
 			{
-				char temp[3] = "00";
-				_itoa_s(*s, temp, sizeof(temp), 16);
-
+				static const char Hex[] = "0123456789abcdef";
+				unsigned char c = (unsigned char)*s;
 				result += '%';
-				result += temp;
+				result += Hex[c >> 4];
+				result += Hex[c & 15];
 			}
 			else
 			{
@@ -65,6 +66,18 @@ public:
 		return result;
 	}
 
+	/// true for text types that shrink when compressed; an empty type is taken as html
+	static bool IsCompressible(const std::string& contentType)
+	{
+		return contentType.empty() ||
+			contentType.compare(0, 5, "text/") == 0 ||
+			contentType.find("json") != std::string::npos ||
+			contentType.find("javascript") != std::string::npos ||
+			contentType.find("xml") != std::string::npos ||
+			contentType == "image/bmp" ||
+			contentType == "image/x-icon";
+	}
+
 	static std::string HtmlDecode(const std::string& str)
 	{
 		std::string s = "";
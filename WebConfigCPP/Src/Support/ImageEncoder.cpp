@@ -0,0 +1,609 @@
+#include "ImageEncoder.h"
+#include "Deflate.h"
+
+#include <vector>
+#include <string.h>
+
+using namespace std;
+
+namespace
+{
+	void PutBE(string& out, unsigned long value)
+	{
+		out += (char)((value >> 24) & 0xFF);
+		out += (char)((value >> 16) & 0xFF);
+		out += (char)((value >> 8) & 0xFF);
+		out += (char)(value & 0xFF);
+	}
+
+	/// copy one row of 32 bit pixels as RGB
+	void ToRgb(const unsigned char* src, int width, ImageEncoder::PixelOrder order, unsigned char* dst)
+	{
+		int r = (order == ImageEncoder::PIXEL_BGRA)? 2: 0;
+		int b = 2 - r;
+		for (int x = 0; x < width; x++, src += 4, dst += 3)
+		{
+			dst[0] = src[r];
+			dst[1] = src[1];
+			dst[2] = src[b];
+		}
+	}
+
+	void PutChunk(string& out, const char* type, const string& data)
+	{
+		PutBE(out, (unsigned long)data.length());
+		size_t start = out.length();
+		out.append(type, 4);
+		out += data;
+		PutBE(out, Deflate::Crc32(0, out.data() + start, out.length() - start));
+	}
+
+	int Paeth(int a, int b, int c)
+	{
+		int p = a + b - c;
+		int pa = (p > a)? p - a: a - p;
+		int pb = (p > b)? p - b: b - p;
+		int pc = (p > c)? p - c: c - p;
+		if (pa <= pb && pa <= pc)
+			return a;
+		return (pb <= pc)? b: c;
+	}
+
+	/// filter one row with the given PNG filter type; returns the sum of absolute values
+	/// which is the usual guess at how well it will compress
+	unsigned long Filter(int type, const unsigned char* cur, const unsigned char* prev, int length, unsigned char* out)
+	{
+		unsigned long sum = 0;
+		for (int i = 0; i < length; i++)
+		{
+			int a = (i >= 3)? cur[i - 3]: 0;
+			int b = prev[i];
+			int c = (i >= 3)? prev[i - 3]: 0;
+			int predict = 0;
+			switch (type)
+			{
+			case 1: predict = a; break;
+			case 2: predict = b; break;
+			case 3: predict = (a + b) / 2; break;
+			case 4: predict = Paeth(a, b, c); break;
+			}
+			unsigned char v = (unsigned char)(cur[i] - predict);
+			out[i] = v;
+			sum += (v < 128)? v: 256 - v;
+		}
+		return sum;
+	}
+
+	// ---------------------------------------------------------------------
+	// JPEG; baseline with the example tables from the standard (Annex K)
+	// ---------------------------------------------------------------------
+
+	/// position in zigzag order of each coefficient in natural order
+	const unsigned char zigzag[64] = {
+		0, 1, 5, 6, 14, 15, 27, 28, 2, 4, 7, 13, 16, 26, 29, 42,
+		3, 8, 12, 17, 25, 30, 41, 43, 9, 11, 18, 24, 31, 40, 44, 53,
+		10, 19, 23, 32, 39, 45, 52, 54, 20, 22, 33, 38, 46, 51, 55, 60,
+		21, 34, 37, 47, 50, 56, 59, 61, 35, 36, 48, 49, 57, 58, 62, 63 };
+
+	const unsigned char lumQuant[64] = {
+		16, 11, 10, 16, 24, 40, 51, 61, 12, 12, 14, 19, 26, 58, 60, 55,
+		14, 13, 16, 24, 40, 57, 69, 56, 14, 17, 22, 29, 51, 87, 80, 62,
+		18, 22, 37, 56, 68, 109, 103, 77, 24, 35, 55, 64, 81, 104, 113, 92,
+		49, 64, 78, 87, 103, 121, 120, 101, 72, 92, 95, 98, 112, 100, 103, 99 };
+
+	const unsigned char chromQuant[64] = {
+		17, 18, 24, 47, 99, 99, 99, 99, 18, 21, 26, 66, 99, 99, 99, 99,
+		24, 26, 56, 99, 99, 99, 99, 99, 47, 66, 99, 99, 99, 99, 99, 99,
+		99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99,
+		99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99 };
+
+	const unsigned char dcLumBits[16] = { 0, 1, 5, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0 };
+	const unsigned char dcChromBits[16] = { 0, 3, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0 };
+	const unsigned char dcValues[12] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11 };
+
+	const unsigned char acLumBits[16] = { 0, 2, 1, 3, 3, 2, 4, 3, 5, 5, 4, 4, 0, 0, 1, 0x7d };
+	const unsigned char acLumValues[162] = {
+		0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12, 0x21, 0x31, 0x41, 0x06, 0x13, 0x51, 0x61, 0x07,
+		0x22, 0x71, 0x14, 0x32, 0x81, 0x91, 0xa1, 0x08, 0x23, 0x42, 0xb1, 0xc1, 0x15, 0x52, 0xd1, 0xf0,
+		0x24, 0x33, 0x62, 0x72, 0x82, 0x09, 0x0a, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x25, 0x26, 0x27, 0x28,
+		0x29, 0x2a, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49,
+		0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69,
+		0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89,
+		0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7,
+		0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5,
+		0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda, 0xe1, 0xe2,
+		0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+		0xf9, 0xfa };
+
+	const unsigned char acChromBits[16] = { 0, 2, 1, 2, 4, 4, 3, 4, 7, 5, 4, 4, 0, 1, 2, 0x77 };
+	const unsigned char acChromValues[162] = {
+		0x00, 0x01, 0x02, 0x03, 0x11, 0x04, 0x05, 0x21, 0x31, 0x06, 0x12, 0x41, 0x51, 0x07, 0x61, 0x71,
+		0x13, 0x22, 0x32, 0x81, 0x08, 0x14, 0x42, 0x91, 0xa1, 0xb1, 0xc1, 0x09, 0x23, 0x33, 0x52, 0xf0,
+		0x15, 0x62, 0x72, 0xd1, 0x0a, 0x16, 0x24, 0x34, 0xe1, 0x25, 0xf1, 0x17, 0x18, 0x19, 0x1a, 0x26,
+		0x27, 0x28, 0x29, 0x2a, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48,
+		0x49, 0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68,
+		0x69, 0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87,
+		0x88, 0x89, 0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5,
+		0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3,
+		0xc4, 0xc5, 0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda,
+		0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+		0xf9, 0xfa };
+
+	/// code and length for each symbol
+	struct HuffmanTable
+	{
+		unsigned short code[256];
+		unsigned char length[256];
+
+		HuffmanTable(const unsigned char* bits, const unsigned char* values)
+		{
+			memset(length, 0, sizeof(length));
+			unsigned short c = 0;
+			int k = 0;
+			for (int n = 1; n <= 16; n++, c <<= 1)
+			{
+				for (int i = 0; i < bits[n - 1]; i++, k++, c++)
+				{
+					code[values[k]] = c;
+					length[values[k]] = (unsigned char)n;
+				}
+			}
+		}
+	};
+
+	const HuffmanTable dcLum(dcLumBits, dcValues);
+	const HuffmanTable dcChrom(dcChromBits, dcValues);
+	const HuffmanTable acLum(acLumBits, acLumValues);
+	const HuffmanTable acChrom(acChromBits, acChromValues);
+
+	/// entropy coded data; most significant bit first with 0xFF stuffing
+	class JpegBitWriter
+	{
+		string& out;
+		unsigned int bits;
+		int count;
+
+	public:
+
+		JpegBitWriter(string& output) : out(output), bits(0), count(0) {}
+
+		void Put(unsigned int code, int length)
+		{
+			bits = (bits << length) | code;
+			count += length;
+			while (count >= 8)
+			{
+				unsigned char c = (unsigned char)(bits >> (count - 8));
+				out += (char)c;
+				if (c == 0xFF)
+					out += '\0';
+				count -= 8;
+			}
+			bits &= (1 << count) - 1;
+		}
+
+		void Symbol(const HuffmanTable& table, int symbol)
+		{
+			Put(table.code[symbol], table.length[symbol]);
+		}
+
+		/// pad the last byte with ones
+		void Flush()
+		{
+			if (count > 0)
+				Put((1 << (8 - count)) - 1, 8 - count);
+		}
+	};
+
+	/// one dimensional scaled DCT (Arai, Agui and Nakajima); the scale is folded into quantization
+	void Dct(float* d, int stride)
+	{
+		float tmp0 = d[0] + d[7 * stride];
+		float tmp7 = d[0] - d[7 * stride];
+		float tmp1 = d[stride] + d[6 * stride];
+		float tmp6 = d[stride] - d[6 * stride];
+		float tmp2 = d[2 * stride] + d[5 * stride];
+		float tmp5 = d[2 * stride] - d[5 * stride];
+		float tmp3 = d[3 * stride] + d[4 * stride];
+		float tmp4 = d[3 * stride] - d[4 * stride];
+
+		// even part
+		float tmp10 = tmp0 + tmp3;
+		float tmp13 = tmp0 - tmp3;
+		float tmp11 = tmp1 + tmp2;
+		float tmp12 = tmp1 - tmp2;
+		d[0] = tmp10 + tmp11;
+		d[4 * stride] = tmp10 - tmp11;
+		float z1 = (tmp12 + tmp13) * 0.707106781f;
+		d[2 * stride] = tmp13 + z1;
+		d[6 * stride] = tmp13 - z1;
+
+		// odd part
+		tmp10 = tmp4 + tmp5;
+		tmp11 = tmp5 + tmp6;
+		tmp12 = tmp6 + tmp7;
+		float z5 = (tmp10 - tmp12) * 0.382683433f;
+		float z2 = tmp10 * 0.541196100f + z5;
+		float z4 = tmp12 * 1.306562965f + z5;
+		float z3 = tmp11 * 0.707106781f;
+		float z11 = tmp7 + z3;
+		float z13 = tmp7 - z3;
+		d[5 * stride] = z13 + z2;
+		d[3 * stride] = z13 - z2;
+		d[stride] = z11 + z4;
+		d[7 * stride] = z11 - z4;
+	}
+
+	/// bits needed for the magnitude of v
+	int Category(int v)
+	{
+		if (v < 0)
+			v = -v;
+		int n = 0;
+		for (; v != 0; v >>= 1)
+			++n;
+		return n;
+	}
+
+	/// transform, quantize and code one 8x8 block of level shifted samples
+	/// <returns>the quantized DC coefficient, which the next block is coded against</returns>
+	int EncodeBlock(JpegBitWriter& w, float* block, const float* scale, int dc,
+		const HuffmanTable& dcTable, const HuffmanTable& acTable)
+	{
+		for (int i = 0; i < 8; i++)
+			Dct(block + i * 8, 1);
+		for (int i = 0; i < 8; i++)
+			Dct(block + i, 8);
+
+		int coef[64];
+		for (int i = 0; i < 64; i++)
+		{
+			float v = block[i] * scale[i];
+			coef[zigzag[i]] = (int)((v < 0)? v - 0.5f: v + 0.5f);
+		}
+
+		int diff = coef[0] - dc;
+		int n = Category(diff);
+		w.Symbol(dcTable, n);
+		if (n > 0)
+			w.Put((diff < 0)? diff + (1 << n) - 1: diff, n);
+
+		int last = 63;
+		while (last > 0 && coef[last] == 0)
+			--last;
+
+		for (int i = 1; i <= last; i++)
+		{
+			int run = 0;
+			while (coef[i] == 0)
+			{
+				++i;
+				++run;
+			}
+			for (; run >= 16; run -= 16)
+				w.Symbol(acTable, 0xF0);	// sixteen zeros
+			n = Category(coef[i]);
+			w.Symbol(acTable, (run << 4) | n);
+			w.Put((coef[i] < 0)? coef[i] + (1 << n) - 1: coef[i], n);
+		}
+		if (last != 63)
+			w.Symbol(acTable, 0x00);	// end of block
+
+		return coef[0];
+	}
+
+	void PutMarker(string& out, int marker, int length)
+	{
+		out += (char)0xFF;
+		out += (char)marker;
+		if (length > 0)
+		{
+			out += (char)(length >> 8);
+			out += (char)(length & 0xFF);
+		}
+	}
+
+	void PutHuffmanTable(string& out, int id, const unsigned char* bits, const unsigned char* values, int count)
+	{
+		out += (char)id;
+		out.append((const char*)bits, 16);
+		out.append((const char*)values, count);
+	}
+}
+
+void ImageEncoder::EncodePng(const unsigned char* pixels, int width, int height, int stride,
+	PixelOrder order, string& out, int level)
+{
+	static const char signature[8] = { '\x89', 'P', 'N', 'G', '\r', '\n', '\x1a', '\n' };
+	out.append(signature, sizeof(signature));
+
+	string header;
+	PutBE(header, width);
+	PutBE(header, height);
+	header += (char)8;		// bits per channel
+	header += (char)2;		// RGB
+	header += (char)0;		// deflate
+	header += (char)0;		// adaptive filtering
+	header += (char)0;		// not interlaced
+	PutChunk(out, "IHDR", header);
+
+	// filtered rows, each led by its filter type
+	int rowLength = width * 3;
+	vector<unsigned char> prev(rowLength, 0), cur(rowLength), best(rowLength), trial(rowLength);
+	string raw;
+	raw.reserve((size_t)(rowLength + 1) * height);
+
+	for (int y = 0; y < height; y++)
+	{
+		ToRgb(pixels + (size_t)y * stride, width, order, &cur[0]);
+
+		int bestType = 0;
+		unsigned long bestSum = Filter(0, &cur[0], &prev[0], rowLength, &best[0]);
+		for (int type = 1; type <= 4; type++)
+		{
+			unsigned long sum = Filter(type, &cur[0], &prev[0], rowLength, &trial[0]);
+			if (sum < bestSum)
+			{
+				bestSum = sum;
+				bestType = type;
+				best.swap(trial);
+			}
+		}
+
+		raw += (char)bestType;
+		raw.append((const char*)&best[0], rowLength);
+		prev.swap(cur);
+	}
+
+	string data;
+	Deflate::Compress(raw, data, level, Deflate::FORMAT_ZLIB);
+	PutChunk(out, "IDAT", data);
+	PutChunk(out, "IEND", "");
+}
+
+void ImageEncoder::EncodeQoi(const unsigned char* pixels, int width, int height, int stride,
+	PixelOrder order, string& out)
+{
+	enum
+	{
+		QOI_OP_INDEX = 0x00,
+		QOI_OP_DIFF = 0x40,
+		QOI_OP_LUMA = 0x80,
+		QOI_OP_RUN = 0xc0,
+		QOI_OP_RGB = 0xfe
+	};
+
+	out += "qoif";
+	PutBE(out, width);
+	PutBE(out, height);
+	out += (char)3;		// RGB
+	out += (char)0;		// sRGB
+
+	// alpha is always 255, so it drops out of the hash and the diffs;
+	// the index holds packed RGB with -1 for slots not yet written
+	int index[64];
+	for (int i = 0; i < 64; i++)
+		index[i] = -1;
+	int pr = 0, pg = 0, pb = 0;
+	int run = 0;
+
+	int r = (order == PIXEL_BGRA)? 2: 0;
+	int b = 2 - r;
+	for (int y = 0; y < height; y++)
+	{
+		const unsigned char* p = pixels + (size_t)y * stride;
+		for (int x = 0; x < width; x++, p += 4)
+		{
+			int cr = p[r], cg = p[1], cb = p[b];
+			if (cr == pr && cg == pg && cb == pb)
+			{
+				if (++run == 62)
+				{
+					out += (char)(QOI_OP_RUN | (run - 1));
+					run = 0;
+				}
+				continue;
+			}
+			if (run > 0)
+			{
+				out += (char)(QOI_OP_RUN | (run - 1));
+				run = 0;
+			}
+
+			int hash = (cr * 3 + cg * 5 + cb * 7 + 255 * 11) % 64;
+			int packed = (cr << 16) | (cg << 8) | cb;
+			if (index[hash] == packed)
+			{
+				out += (char)(QOI_OP_INDEX | hash);
+			}
+			else
+			{
+				index[hash] = packed;
+
+				int dr = (signed char)(cr - pr);
+				int dg = (signed char)(cg - pg);
+				int db = (signed char)(cb - pb);
+				int drg = dr - dg;
+				int dbg = db - dg;
+				if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1)
+				{
+					out += (char)(QOI_OP_DIFF | ((dr + 2) << 4) | ((dg + 2) << 2) | (db + 2));
+				}
+				else if (dg >= -32 && dg <= 31 && drg >= -8 && drg <= 7 && dbg >= -8 && dbg <= 7)
+				{
+					out += (char)(QOI_OP_LUMA | (dg + 32));
+					out += (char)(((drg + 8) << 4) | (dbg + 8));
+				}
+				else
+				{
+					out += (char)QOI_OP_RGB;
+					out += (char)cr;
+					out += (char)cg;
+					out += (char)cb;
+				}
+			}
+			pr = cr;
+			pg = cg;
+			pb = cb;
+		}
+	}
+	if (run > 0)
+		out += (char)(QOI_OP_RUN | (run - 1));
+
+	static const char padding[8] = { 0, 0, 0, 0, 0, 0, 0, 1 };
+	out.append(padding, sizeof(padding));
+}
+
+void ImageEncoder::EncodeJpeg(const unsigned char* pixels, int width, int height, int stride,
+	PixelOrder order, string& out, int quality)
+{
+	if (quality < 1)
+		quality = 1;
+	if (quality > 100)
+		quality = 100;
+	int percent = (quality < 50)? 5000 / quality: 200 - quality * 2;
+
+	// quantization tables in zigzag order for the file, and their reciprocals
+	// with the DCT scale factors in natural order for the encoder
+	static const float aasf[8] = {
+		1.0f * 2.828427125f, 1.387039845f * 2.828427125f, 1.306562965f * 2.828427125f, 1.175875602f * 2.828427125f,
+		1.0f * 2.828427125f, 0.785694958f * 2.828427125f, 0.541196100f * 2.828427125f, 0.275899379f * 2.828427125f };
+	unsigned char lumTable[64], chromTable[64];
+	float lumScale[64], chromScale[64];
+	for (int i = 0; i < 64; i++)
+	{
+		int y = (lumQuant[i] * percent + 50) / 100;
+		int c = (chromQuant[i] * percent + 50) / 100;
+		y = (y < 1)? 1: (y > 255)? 255: y;
+		c = (c < 1)? 1: (c > 255)? 255: c;
+		lumTable[zigzag[i]] = (unsigned char)y;
+		chromTable[zigzag[i]] = (unsigned char)c;
+		lumScale[i] = 1.0f / (y * aasf[i / 8] * aasf[i % 8]);
+		chromScale[i] = 1.0f / (c * aasf[i / 8] * aasf[i % 8]);
+	}
+
+	PutMarker(out, 0xD8, 0);	// start of image
+
+	static const char jfif[14] = { 'J', 'F', 'I', 'F', 0, 1, 1, 0, 0, 1, 0, 1, 0, 0 };
+	PutMarker(out, 0xE0, 2 + sizeof(jfif));
+	out.append(jfif, sizeof(jfif));
+
+	PutMarker(out, 0xDB, 2 + 2 * 65);
+	out += (char)0;
+	out.append((const char*)lumTable, 64);
+	out += (char)1;
+	out.append((const char*)chromTable, 64);
+
+	// frame: Y sampled 2x2 against Cb and Cr (4:2:0)
+	PutMarker(out, 0xC0, 17);
+	out += (char)8;
+	out += (char)(height >> 8);
+	out += (char)(height & 0xFF);
+	out += (char)(width >> 8);
+	out += (char)(width & 0xFF);
+	static const char components[10] = { 3, 1, 0x22, 0, 2, 0x11, 1, 3, 0x11, 1 };
+	out.append(components, sizeof(components));
+
+	PutMarker(out, 0xC4, 2 + 2 * (17 + 12) + 2 * (17 + 162));
+	PutHuffmanTable(out, 0x00, dcLumBits, dcValues, 12);
+	PutHuffmanTable(out, 0x10, acLumBits, acLumValues, 162);
+	PutHuffmanTable(out, 0x01, dcChromBits, dcValues, 12);
+	PutHuffmanTable(out, 0x11, acChromBits, acChromValues, 162);
+
+	PutMarker(out, 0xDA, 12);
+	static const char scan[10] = { 3, 1, 0, 2, 0x11, 3, 0x11, 0, 0x3F, 0 };
+	out.append(scan, sizeof(scan));
+
+	int r = (order == PIXEL_BGRA)? 2: 0;
+	int b = 2 - r;
+	JpegBitWriter w(out);
+	int dcY = 0, dcCb = 0, dcCr = 0;
+	float Y[256], Cb[256], Cr[256], block[64];
+
+	for (int my = 0; my < height; my += 16)
+	{
+		for (int mx = 0; mx < width; mx += 16)
+		{
+			// convert a 16x16 macroblock, repeating the edge pixels past the border
+			for (int y = 0; y < 16; y++)
+			{
+				int sy = (my + y < height)? my + y: height - 1;
+				const unsigned char* row = pixels + (size_t)sy * stride;
+				for (int x = 0; x < 16; x++)
+				{
+					int sx = (mx + x < width)? mx + x: width - 1;
+					const unsigned char* p = row + sx * 4;
+					float R = p[r], G = p[1], B = p[b];
+					int k = y * 16 + x;
+					Y[k] = 0.299f * R + 0.587f * G + 0.114f * B - 128;
+					Cb[k] = -0.16874f * R - 0.33126f * G + 0.5f * B;
+					Cr[k] = 0.5f * R - 0.41869f * G - 0.08131f * B;
+				}
+			}
+
+			for (int i = 0; i < 4; i++)
+			{
+				const float* src = Y + (i / 2) * 128 + (i % 2) * 8;
+				for (int k = 0; k < 64; k++)
+					block[k] = src[(k / 8) * 16 + k % 8];
+				dcY = EncodeBlock(w, block, lumScale, dcY, dcLum, acLum);
+			}
+
+			for (int k = 0; k < 64; k++)
+			{
+				int i = (k / 8) * 32 + (k % 8) * 2;
+				block[k] = (Cb[i] + Cb[i + 1] + Cb[i + 16] + Cb[i + 17]) * 0.25f;
+			}
+			dcCb = EncodeBlock(w, block, chromScale, dcCb, dcChrom, acChrom);
+
+			for (int k = 0; k < 64; k++)
+			{
+				int i = (k / 8) * 32 + (k % 8) * 2;
+				block[k] = (Cr[i] + Cr[i + 1] + Cr[i + 16] + Cr[i + 17]) * 0.25f;
+			}
+			dcCr = EncodeBlock(w, block, chromScale, dcCr, dcChrom, acChrom);
+		}
+	}
+	w.Flush();
+
+	PutMarker(out, 0xD9, 0);	// end of image
+}
+
+void ImageEncoder::Scale(const unsigned char* src, int width, int height, int stride,
+	unsigned char* dst, int dstWidth, int dstHeight)
+{
+	// average the source pixels under each destination pixel; when enlarging
+	// this falls back to the nearest pixel
+	for (int y = 0; y < dstHeight; y++)
+	{
+		int y0 = (int)((long long)y * height / dstHeight);
+		int y1 = (int)((long long)(y + 1) * height / dstHeight);
+		if (y1 <= y0)
+			y1 = y0 + 1;
+
+		unsigned char* out = dst + (size_t)y * dstWidth * 4;
+		for (int x = 0; x < dstWidth; x++, out += 4)
+		{
+			int x0 = (int)((long long)x * width / dstWidth);
+			int x1 = (int)((long long)(x + 1) * width / dstWidth);
+			if (x1 <= x0)
+				x1 = x0 + 1;
+
+			unsigned int sum[4] = { 0, 0, 0, 0 };
+			for (int sy = y0; sy < y1; sy++)
+			{
+				const unsigned char* p = src + (size_t)sy * stride + x0 * 4;
+				for (int sx = x0; sx < x1; sx++, p += 4)
+				{
+					sum[0] += p[0];
+					sum[1] += p[1];
+					sum[2] += p[2];
+					sum[3] += p[3];
+				}
+			}
+			unsigned int n = (y1 - y0) * (x1 - x0);
+			for (int c = 0; c < 4; c++)
+				out[c] = (unsigned char)((sum[c] + n / 2) / n);
+		}
+	}
+}
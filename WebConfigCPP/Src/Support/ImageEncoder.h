@@ -0,0 +1,38 @@
+#ifndef IMAGEENCODER_H
+#define IMAGEENCODER_H
+
+#include <string>
+
+/// Encodes 32 bit pixels as PNG, QOI or JPEG images; alpha is dropped
+class ImageEncoder
+{
+public:
+
+	/// byte order of the 4 bytes of each source pixel
+	enum PixelOrder
+	{
+		PIXEL_RGBA,
+		PIXEL_BGRA		// Win32 DIB order
+	};
+
+	/// Appends a PNG image (RGB, 8 bits per channel) to out.
+	/// stride is the number of bytes from one row to the next; rows go top down.
+	/// level is the deflate level, 1 fastest to 9 smallest.
+	static void EncodePng(const unsigned char* pixels, int width, int height, int stride,
+		PixelOrder order, std::string& out, int level = 4);
+
+	/// Appends a QOI image (RGB) to out; see qoiformat.org.
+	/// Usually faster than PNG at a similar size for screen content.
+	static void EncodeQoi(const unsigned char* pixels, int width, int height, int stride,
+		PixelOrder order, std::string& out);
+
+	/// Appends a baseline JPEG image (YCbCr 4:2:0) to out; quality is 1 to 100.
+	static void EncodeJpeg(const unsigned char* pixels, int width, int height, int stride,
+		PixelOrder order, std::string& out, int quality = 75);
+
+	/// Resamples 32 bit pixels to another size; dst rows are packed.
+	static void Scale(const unsigned char* src, int width, int height, int stride,
+		unsigned char* dst, int dstWidth, int dstHeight);
+};
+
+#endif // #ifndef IMAGEENCODER_H
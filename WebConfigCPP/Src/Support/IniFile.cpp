@@ -1,11 +1,16 @@
 #include "IniFile.h"
 
-#include <windows.h>
+#ifdef _WIN32
+#	include <windows.h>
+#endif
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 using namespace std;
 
+#ifdef _WIN32
+
 int IniFile::ReadSectionKeys(const string& szSection, vector<string>& keyList)
 {
     DWORD buffSize = 1024;  // start at this size
@@ -122,4 +127,186 @@ void IniFile::WriteBoolean(const string& szSection, const string& szKey, bool bo
 void IniFile::WriteString(const string& szSection, const string& szKey, const string& szValue)
 {
 	WritePrivateProfileString(szSection.c_str(),  szKey.c_str(), szValue.c_str(), m_path.c_str());
-}
\ No newline at end of file
+}
+
+#else
+
+// Without the Win32 profile functions the file is read whole on each call,
+// like they do, and rewritten on each write. Sections and keys are matched
+// without regard to case.
+
+#include <strings.h>
+
+/// Reads the lines of a file; an unreadable file has none
+static void ReadLines(const string& path, vector<string>& lines)
+{
+	FILE* file = fopen(path.c_str(), "r");
+	if (file == NULL)
+		return;
+	char buffer[1024];
+	string line;
+	while (fgets(buffer, sizeof(buffer), file) != NULL)
+	{
+		line += buffer;
+		if (line[line.length() - 1] == '\n')
+		{
+			line.erase(line.length() - 1);
+			if (!line.empty() && line[line.length() - 1] == '\r')
+				line.erase(line.length() - 1);
+			lines.push_back(line);
+			line = "";
+		}
+	}
+	if (!line.empty())
+		lines.push_back(line);
+	fclose(file);
+}
+
+static void WriteLines(const string& path, const vector<string>& lines)
+{
+	FILE* file = fopen(path.c_str(), "w");
+	if (file == NULL)
+		return;
+	for (unsigned int i = 0; i < lines.size(); i++)
+		fprintf(file, "%s\n", lines[i].c_str());
+	fclose(file);
+}
+
+static string Trim(const string& s)
+{
+	size_t first = s.find_first_not_of(" \t");
+	if (first == string::npos)
+		return "";
+	size_t last = s.find_last_not_of(" \t");
+	return s.substr(first, last - first + 1);
+}
+
+/// Gets the line index of "[section]", or -1
+static int FindSection(const vector<string>& lines, const string& szSection)
+{
+	for (unsigned int i = 0; i < lines.size(); i++)
+	{
+		string line = Trim(lines[i]);
+		if (line.length() >= 2 && line[0] == '[' && line[line.length() - 1] == ']' &&
+			strcasecmp(Trim(line.substr(1, line.length() - 2)).c_str(), szSection.c_str()) == 0)
+			return i;
+	}
+	return -1;
+}
+
+/// Splits a "key=value" line; false for blank lines, comments and section headers
+static bool SplitLine(const string& line, string& key, string& value)
+{
+	string trimmed = Trim(line);
+	if (trimmed.empty() || trimmed[0] == ';' || trimmed[0] == '[')
+		return false;
+	size_t equals = trimmed.find('=');
+	if (equals == string::npos)
+		return false;
+	key = Trim(trimmed.substr(0, equals));
+	value = Trim(trimmed.substr(equals + 1));
+	if (value.length() >= 2 && (value[0] == '"' || value[0] == '\'') && value[value.length() - 1] == value[0])
+		value = value.substr(1, value.length() - 2);
+	return true;
+}
+
+/// Gets the line index of a key in the section starting at a line, or -1
+static int FindKey(const vector<string>& lines, int section, const string& szKey, string& value)
+{
+	for (unsigned int i = section + 1; i < lines.size() && Trim(lines[i]).compare(0, 1, "[") != 0; i++)
+	{
+		string key;
+		if (SplitLine(lines[i], key, value) && strcasecmp(key.c_str(), szKey.c_str()) == 0)
+			return i;
+	}
+	return -1;
+}
+
+int IniFile::ReadSectionKeys(const string& szSection, vector<string>& keyList)
+{
+	vector<string> lines;
+	ReadLines(m_path, lines);
+	int section = FindSection(lines, szSection);
+	if (section < 0)
+		return 0;
+	for (unsigned int i = section + 1; i < lines.size() && Trim(lines[i]).compare(0, 1, "[") != 0; i++)
+	{
+		string key, value;
+		if (SplitLine(lines[i], key, value))
+			keyList.push_back(key);
+	}
+	return keyList.size();
+}
+int IniFile::ReadInteger(const string& szSection, const string& szKey, int iDefaultValue)
+{
+	string value = ReadString(szSection, szKey, "");
+	return value.empty()? iDefaultValue: atoi(value.c_str());
+}
+float IniFile::ReadFloat(const string& szSection, const string& szKey, float fltDefaultValue)
+{
+	string value = ReadString(szSection, szKey, "");
+	return value.empty()? fltDefaultValue: (float)atof(value.c_str());
+}
+bool IniFile::ReadBoolean(const string& szSection, const string& szKey, bool bolDefaultValue)
+{
+	string value = ReadString(szSection, szKey, bolDefaultValue? "True" : "False");
+	return value == "True" || value == "true";
+}
+string IniFile::ReadString(const string& szSection, const string& szKey, const string& szDefaultValue)
+{
+	vector<string> lines;
+	ReadLines(m_path, lines);
+	int section = FindSection(lines, szSection);
+	string value;
+	if (section < 0 || FindKey(lines, section, szKey, value) < 0)
+		return szDefaultValue;
+	return value;
+}
+void IniFile::WriteInteger(const string& szSection, const string& szKey, int iValue)
+{
+	char szValue[256];
+	snprintf(szValue, sizeof(szValue), "%d", iValue);
+	WriteString(szSection, szKey, szValue);
+}
+void IniFile::WriteFloat(const string& szSection, const string& szKey, float fltValue)
+{
+	char szValue[256];
+	snprintf(szValue, sizeof(szValue), "%f", fltValue);
+	WriteString(szSection, szKey, szValue);
+}
+void IniFile::WriteBoolean(const string& szSection, const string& szKey, bool bolValue)
+{
+	WriteString(szSection, szKey, bolValue ? "True" : "False");
+}
+void IniFile::WriteString(const string& szSection, const string& szKey, const string& szValue)
+{
+	vector<string> lines;
+	ReadLines(m_path, lines);
+	string line = szKey + "=" + szValue;
+	int section = FindSection(lines, szSection);
+	string value;
+	int key;
+	if (section < 0)
+	{
+		lines.push_back("[" + szSection + "]");
+		lines.push_back(line);
+	}
+	else if ((key = FindKey(lines, section, szKey, value)) >= 0)
+	{
+		lines[key] = line;
+	}
+	else
+	{
+		// after the last line of the section that isn't blank
+		int last = section;
+		for (unsigned int i = section + 1; i < lines.size() && Trim(lines[i]).compare(0, 1, "[") != 0; i++)
+		{
+			if (!Trim(lines[i]).empty())
+				last = i;
+		}
+		lines.insert(lines.begin() + last + 1, line);
+	}
+	WriteLines(m_path, lines);
+}
+
+#endif
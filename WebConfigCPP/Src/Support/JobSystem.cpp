@@ -0,0 +1,161 @@
+#include "JobSystem.h"
+#include "Atomic.h"
+
+#ifndef _WIN32
+#	include <unistd.h>
+#endif
+
+JobSystem::JobSystem(int threadCount)
+{
+	remaining = 0;
+	steals = 0;
+	stopping = false;
+
+	if (threadCount <= 0)
+		threadCount = GetProcessorCount();
+	for (int i = 0; i < threadCount; i++)
+		queues.push_back(new Queue);
+
+	for (int i = 1; i < threadCount; i++)
+	{
+		Worker* worker = new Worker;
+		worker->System = this;
+		worker->Index = i;
+		workers.push_back(worker);
+		if (!worker->Runner.Start(&WorkerMain, worker))
+		{
+			// run with the threads we got; their chunks are stolen like any others
+			workers.pop_back();
+			delete worker;
+			break;
+		}
+	}
+}
+
+JobSystem::~JobSystem()
+{
+	stopping = true;
+	for (unsigned int i = 0; i < workers.size(); i++)
+		wake.Post();
+	for (unsigned int i = 0; i < workers.size(); i++)
+	{
+		workers[i]->Runner.Join();
+		delete workers[i];
+	}
+	for (unsigned int i = 0; i < queues.size(); i++)
+		delete queues[i];
+}
+
+void JobSystem::ParallelFor(int begin, int end, int grain, RangeFunction function, void* arg)
+{
+	if (end <= begin)
+		return;
+	if (grain < 1)
+		grain = 1;
+
+	int chunks = (end - begin + grain - 1) / grain;
+	int threads = (int)queues.size();
+	if (threads == 1 || chunks == 1)
+	{
+		function(arg, begin, end);
+		return;
+	}
+
+	// neighbouring chunks go to the same thread, which runs them front to back
+	Atomic::Store(remaining, chunks);
+	for (int t = 0; t < threads; t++)
+	{
+		int first = (int)((long long)chunks * t / threads);
+		int last = (int)((long long)chunks * (t + 1) / threads);
+		Queue& queue = *queues[t];
+		MutexLock hold(queue.Lock);
+		for (int c = last - 1; c >= first; c--)
+		{
+			Job job;
+			job.Function = function;
+			job.Arg = arg;
+			job.Begin = begin + c * grain;
+			job.End = (c == chunks - 1)? end: job.Begin + grain;
+			queue.Jobs.push_back(job);
+		}
+	}
+	for (unsigned int i = 0; i < workers.size(); i++)
+		wake.Post();
+
+	Job job;
+	while (Pop(0, job) || Steal(0, job))
+		Run(job);
+	done.Wait();
+}
+
+long long JobSystem::GetSteals() const
+{
+	return Atomic::Load(steals);
+}
+
+int JobSystem::GetProcessorCount()
+{
+#ifdef _WIN32
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	int count = (int)info.dwNumberOfProcessors;
+#else
+	int count = (int)sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+	return (count > 0)? count: 1;
+}
+
+void JobSystem::WorkerMain(void* arg)
+{
+	Worker* worker = (Worker*)arg;
+	JobSystem* system = worker->System;
+	for (;;)
+	{
+		system->wake.Wait();
+		if (system->stopping)
+			break;
+
+		// a wake left over from a ParallelFor that is already done finds nothing
+		Job job;
+		while (system->Pop(worker->Index, job) || system->Steal(worker->Index, job))
+			system->Run(job);
+	}
+}
+
+/// Takes the thread's own next chunk from the back of its deque
+bool JobSystem::Pop(int index, Job& job)
+{
+	Queue& queue = *queues[index];
+	MutexLock hold(queue.Lock);
+	if (queue.Jobs.empty())
+		return false;
+	job = queue.Jobs.back();
+	queue.Jobs.pop_back();
+	return true;
+}
+
+/// Takes the chunk furthest from where another thread is working
+bool JobSystem::Steal(int index, Job& job)
+{
+	int threads = (int)queues.size();
+	for (int i = 1; i < threads; i++)
+	{
+		Queue& queue = *queues[(index + i) % threads];
+		MutexLock hold(queue.Lock);
+		if (!queue.Jobs.empty())
+		{
+			job = queue.Jobs.front();
+			queue.Jobs.pop_front();
+			Atomic::Add(steals, 1);
+			return true;
+		}
+	}
+	return false;
+}
+
+void JobSystem::Run(const Job& job)
+{
+	job.Function(job.Arg, job.Begin, job.End);
+	if (Atomic::Add(remaining, -1) == 0)
+		done.Post();
+}
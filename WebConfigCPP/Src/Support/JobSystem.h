@@ -0,0 +1,85 @@
+#ifndef JOBSYSTEM_H
+#define JOBSYSTEM_H
+
+#include "Thread.h"
+
+#include <deque>
+#include <vector>
+
+/// Work-stealing scheduler for data parallel loops. ParallelFor cuts a
+/// range into chunks and deals them out in runs, one run to each thread's
+/// deque; a thread takes its own chunks from the back and, when it has
+/// none left, steals from the front of another's. The calling thread is
+/// one of the workers, so a system of one thread runs everything inline.
+class JobSystem
+{
+public:
+
+	/// Called with a chunk of the range; arg is what was given to ParallelFor
+	typedef void (*RangeFunction)(void* arg, int begin, int end);
+
+	/// Starts threadCount - 1 worker threads; 0 means one per processor
+	JobSystem(int threadCount = 0);
+
+	/// Waits for the workers to finish what they are running and stops them
+	~JobSystem();
+
+	/// Number of threads that run chunks, counting the caller of ParallelFor
+	int GetThreadCount() const { return (int)queues.size(); }
+
+	/// Runs function on chunks of begin to end and returns when every chunk
+	/// has run. Chunks start at begin plus a multiple of grain, so with an
+	/// aligned begin and grain no two threads write the same cache line.
+	/// Call from one thread at a time.
+	void ParallelFor(int begin, int end, int grain, RangeFunction function, void* arg);
+
+	/// Number of chunks taken from another thread's deque since the system started
+	long long GetSteals() const;
+
+	/// Number of processors the system can run threads on
+	static int GetProcessorCount();
+
+private:
+
+	struct Job
+	{
+		RangeFunction Function;
+		void* Arg;
+		int Begin;
+		int End;
+	};
+
+	/// One thread's chunks, on cache lines of its own
+	struct Queue
+	{
+		char before[64];
+		Mutex Lock;
+		std::deque<Job> Jobs;
+		char after[64];
+	};
+
+	struct Worker
+	{
+		JobSystem* System;
+		int Index;
+		Thread Runner;
+	};
+
+	std::vector<Queue*> queues;		// queues[0] is the caller's
+	std::vector<Worker*> workers;	// runs queues[1] and on
+	Semaphore wake;					// posted once per worker for each ParallelFor
+	Semaphore done;					// posted when the last chunk of a ParallelFor has run
+	volatile long long remaining;	// chunks of the current ParallelFor not yet run
+	volatile long long steals;
+	volatile bool stopping;
+
+	static void WorkerMain(void* arg);
+	bool Pop(int index, Job& job);
+	bool Steal(int index, Job& job);
+	void Run(const Job& job);
+
+	JobSystem(const JobSystem&);
+	JobSystem& operator=(const JobSystem&);
+};
+
+#endif // #ifndef JOBSYSTEM_H
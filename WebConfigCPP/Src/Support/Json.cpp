@@ -0,0 +1,406 @@
+#include "Json.h"
+
+#include <stdio.h>
+#include <string.h>
+
+using namespace std;
+
+// ===========================================================================
+// JsonWriter
+// ===========================================================================
+
+void JsonWriter::Separator()
+{
+	if (named)
+	{
+		named = false;
+		return;
+	}
+	if (!empty[depth])
+		out += ',';
+	empty[depth] = false;
+}
+
+void JsonWriter::Escape(const char* s, size_t length)
+{
+	static const char hex[] = "0123456789abcdef";
+
+	out += '"';
+	const char* run = s;	// start of bytes that need no escaping
+	for (size_t i = 0; i < length; i++)
+	{
+		unsigned char c = (unsigned char)s[i];
+		if (c >= 0x20 && c != '"' && c != '\\')
+			continue;
+
+		out.append(run, s + i - run);
+		run = s + i + 1;
+		switch (c)
+		{
+		case '"': out += "\\\""; break;
+		case '\\': out += "\\\\"; break;
+		case '\n': out += "\\n"; break;
+		case '\r': out += "\\r"; break;
+		case '\t': out += "\\t"; break;
+		default:
+			out += "\\u00";
+			out += hex[c >> 4];
+			out += hex[c & 15];
+			break;
+		}
+	}
+	out.append(run, s + length - run);
+	out += '"';
+}
+
+void JsonWriter::BeginObject()
+{
+	Separator();
+	out += '{';
+	if (depth + 1 < MaxDepth)
+		empty[++depth] = true;
+}
+
+void JsonWriter::EndObject()
+{
+	out += '}';
+	if (depth > 0)
+		--depth;
+}
+
+void JsonWriter::BeginArray()
+{
+	Separator();
+	out += '[';
+	if (depth + 1 < MaxDepth)
+		empty[++depth] = true;
+}
+
+void JsonWriter::EndArray()
+{
+	out += ']';
+	if (depth > 0)
+		--depth;
+}
+
+void JsonWriter::Name(const string& name)
+{
+	Separator();
+	Escape(name.data(), name.length());
+	out += ':';
+	named = true;
+}
+
+void JsonWriter::String(const string& value)
+{
+	Separator();
+	Escape(value.data(), value.length());
+}
+
+void JsonWriter::Int(long long value)
+{
+	char temp[32];
+	sprintf(temp, "%lld", value);
+	Separator();
+	out += temp;
+}
+
+void JsonWriter::Number(double value)
+{
+	// JSON has no NaN or infinity
+	if (value != value || value > 1.7976931348623157e308 || value < -1.7976931348623157e308)
+	{
+		Null();
+		return;
+	}
+	char temp[32];
+	sprintf(temp, "%.9g", value);
+	Separator();
+	out += temp;
+}
+
+void JsonWriter::Bool(bool value)
+{
+	Separator();
+	out += value? "true": "false";
+}
+
+void JsonWriter::Null()
+{
+	Separator();
+	out += "null";
+}
+
+// ===========================================================================
+// JsonReader
+// ===========================================================================
+
+JsonReader::JsonReader(const char* data, size_t length)
+	: p(data), end(data + length), token(TOKEN_NONE), depth(0), expectName(false), needComma(false)
+{
+}
+
+void JsonReader::SkipSpace()
+{
+	while (p < end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n'))
+		++p;
+}
+
+static int HexDigit(char c)
+{
+	if (c >= '0' && c <= '9') return c - '0';
+	if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+	return -1;
+}
+
+static void AppendUtf8(string& s, unsigned int cp)
+{
+	if (cp < 0x80)
+	{
+		s += (char)cp;
+	}
+	else if (cp < 0x800)
+	{
+		s += (char)(0xC0 | (cp >> 6));
+		s += (char)(0x80 | (cp & 0x3F));
+	}
+	else if (cp < 0x10000)
+	{
+		s += (char)(0xE0 | (cp >> 12));
+		s += (char)(0x80 | ((cp >> 6) & 0x3F));
+		s += (char)(0x80 | (cp & 0x3F));
+	}
+	else
+	{
+		s += (char)(0xF0 | (cp >> 18));
+		s += (char)(0x80 | ((cp >> 12) & 0x3F));
+		s += (char)(0x80 | ((cp >> 6) & 0x3F));
+		s += (char)(0x80 | (cp & 0x3F));
+	}
+}
+
+// p is on the opening quote
+bool JsonReader::ReadString()
+{
+	value.clear();
+	++p;
+	const char* run = p;
+	while (p < end)
+	{
+		char c = *p;
+		if (c == '"')
+		{
+			value.append(run, p - run);
+			++p;
+			return true;
+		}
+		if ((unsigned char)c < 0x20)
+			return false;
+		if (c != '\\')
+		{
+			++p;
+			continue;
+		}
+
+		value.append(run, p - run);
+		if (++p >= end)
+			return false;
+		switch (*p++)
+		{
+		case '"': value += '"'; break;
+		case '\\': value += '\\'; break;
+		case '/': value += '/'; break;
+		case 'b': value += '\b'; break;
+		case 'f': value += '\f'; break;
+		case 'n': value += '\n'; break;
+		case 'r': value += '\r'; break;
+		case 't': value += '\t'; break;
+		case 'u':
+			{
+				unsigned int cp = 0;
+				for (int i = 0; i < 4; i++)
+				{
+					int d = (p < end)? HexDigit(*p++): -1;
+					if (d < 0)
+						return false;
+					cp = (cp << 4) | d;
+				}
+				// surrogate pair
+				if (cp >= 0xD800 && cp < 0xDC00 && end - p >= 6 && p[0] == '\\' && p[1] == 'u')
+				{
+					unsigned int lo = 0;
+					for (int i = 2; i < 6; i++)
+					{
+						int d = HexDigit(p[i]);
+						if (d < 0)
+							return false;
+						lo = (lo << 4) | d;
+					}
+					if (lo >= 0xDC00 && lo < 0xE000)
+					{
+						cp = 0x10000 + ((cp - 0xD800) << 10) + (lo - 0xDC00);
+						p += 6;
+					}
+				}
+				AppendUtf8(value, cp);
+			}
+			break;
+		default:
+			return false;
+		}
+		run = p;
+	}
+	return false;
+}
+
+bool JsonReader::ReadNumber()
+{
+	const char* start = p;
+	if (p < end && *p == '-')
+		++p;
+	const char* digits = p;
+	while (p < end && ((*p >= '0' && *p <= '9') || *p == '.' || *p == 'e' || *p == 'E' || *p == '+' || *p == '-'))
+		++p;
+	if (p == digits)
+		return false;
+	value.assign(start, p - start);
+	return true;
+}
+
+bool JsonReader::ReadLiteral(const char* literal)
+{
+	size_t n = strlen(literal);
+	if ((size_t)(end - p) < n || strncmp(p, literal, n) != 0)
+		return false;
+	p += n;
+	return true;
+}
+
+JsonReader::Token JsonReader::Read()
+{
+	if (token == TOKEN_ERROR || token == TOKEN_END)
+		return token;
+
+	SkipSpace();
+	if (p >= end)
+	{
+		if (depth != 0 || token == TOKEN_NONE)
+			return Fail();
+		token = TOKEN_END;
+		return token;
+	}
+
+	// close the current container
+	if (depth > 0 && (*p == '}' || *p == ']'))
+	{
+		char open = stack[depth - 1];
+		if ((*p == '}' && open != '{') || (*p == ']' && open != '['))
+			return Fail();
+		if (open == '{' && !expectName && token == TOKEN_NAME)
+			return Fail();	// name without a value
+		++p;
+		--depth;
+		needComma = true;
+		expectName = (depth > 0 && stack[depth - 1] == '{');
+		token = (open == '{')? TOKEN_END_OBJECT: TOKEN_END_ARRAY;
+		return token;
+	}
+
+	if (depth == 0 && token != TOKEN_NONE)
+		return Fail();	// only one top level value
+
+	// separators between members
+	if (depth > 0 && needComma)
+	{
+		if (stack[depth - 1] == '{' && !expectName)
+		{
+			// value after a name
+			if (*p != ':')
+				return Fail();
+			++p;
+			SkipSpace();
+			needComma = false;
+		}
+		else
+		{
+			if (*p != ',')
+				return Fail();
+			++p;
+			SkipSpace();
+			needComma = false;
+		}
+	}
+
+	if (p >= end)
+		return Fail();
+
+	// member name
+	if (depth > 0 && stack[depth - 1] == '{' && expectName)
+	{
+		if (*p != '"' || !ReadString())
+			return Fail();
+		expectName = false;
+		needComma = true;	// next comes ':'
+		token = TOKEN_NAME;
+		return token;
+	}
+
+	// a value
+	switch (*p)
+	{
+	case '{':
+	case '[':
+		if (depth >= MaxDepth)
+			return Fail();
+		stack[depth++] = *p;
+		token = (*p == '{')? TOKEN_BEGIN_OBJECT: TOKEN_BEGIN_ARRAY;
+		++p;
+		expectName = (token == TOKEN_BEGIN_OBJECT);
+		needComma = false;
+		return token;
+	case '"':
+		if (!ReadString())
+			return Fail();
+		token = TOKEN_STRING;
+		break;
+	case 't':
+		if (!ReadLiteral("true"))
+			return Fail();
+		token = TOKEN_TRUE;
+		break;
+	case 'f':
+		if (!ReadLiteral("false"))
+			return Fail();
+		token = TOKEN_FALSE;
+		break;
+	case 'n':
+		if (!ReadLiteral("null"))
+			return Fail();
+		token = TOKEN_NULL;
+		break;
+	default:
+		if (!ReadNumber())
+			return Fail();
+		token = TOKEN_NUMBER;
+		break;
+	}
+
+	needComma = true;
+	expectName = (depth > 0 && stack[depth - 1] == '{');
+	return token;
+}
+
+bool JsonReader::Skip()
+{
+	if (token != TOKEN_BEGIN_OBJECT && token != TOKEN_BEGIN_ARRAY)
+		return token != TOKEN_ERROR;
+
+	int level = depth - 1;
+	while (depth > level)
+	{
+		if (Read() == TOKEN_ERROR)
+			return false;
+	}
+	return true;
+}
@@ -0,0 +1,103 @@
+#ifndef JSON_H
+#define JSON_H
+
+#include <string>
+
+/// Streaming JSON writer; appends straight into the caller's string
+class JsonWriter
+{
+	enum { MaxDepth = 32 };
+
+	std::string& out;
+	int depth;
+	bool empty[MaxDepth];	// nothing written yet at this level
+	bool named;				// a name was just written; the value needs no comma
+
+	void Separator();
+	void Escape(const char* s, size_t length);
+
+public:
+
+	JsonWriter(std::string& output) : out(output), depth(0), named(false) { empty[0] = true; }
+
+	void BeginObject();
+	void EndObject();
+	void BeginArray();
+	void EndArray();
+
+	/// Writes the name of the next object member.
+	void Name(const std::string& name);
+
+	void String(const std::string& value);
+	void Int(long long value);
+	void Number(double value);
+	void Bool(bool value);
+	void Null();
+
+	/// Writes a name-value member.
+	void Property(const std::string& name, const std::string& value) { Name(name); String(value); }
+	void Property(const std::string& name, const char* value) { Name(name); String(value); }
+	void Property(const std::string& name, int value) { Name(name); Int(value); }
+	void Property(const std::string& name, long long value) { Name(name); Int(value); }
+	void Property(const std::string& name, double value) { Name(name); Number(value); }
+	void Property(const std::string& name, bool value) { Name(name); Bool(value); }
+};
+
+/// Pull parser for JSON; reads one token at a time without building a tree
+class JsonReader
+{
+public:
+
+	enum Token
+	{
+		TOKEN_NONE,
+		TOKEN_BEGIN_OBJECT,
+		TOKEN_END_OBJECT,
+		TOKEN_BEGIN_ARRAY,
+		TOKEN_END_ARRAY,
+		TOKEN_NAME,
+		TOKEN_STRING,
+		TOKEN_NUMBER,
+		TOKEN_TRUE,
+		TOKEN_FALSE,
+		TOKEN_NULL,
+		TOKEN_END,		// end of input
+		TOKEN_ERROR
+	};
+
+	JsonReader(const char* data, size_t length);
+
+	/// Advances to the next token.
+	Token Read();
+
+	/// Text of the current name, string or number token; the buffer is reused by the next Read().
+	const std::string& Value() const { return value; }
+
+	/// Skips the value that starts with the current token, including any nested members.
+	bool Skip();
+
+	/// Current token
+	Token GetToken() const { return token; }
+
+private:
+
+	enum { MaxDepth = 32 };
+
+	const char* p;
+	const char* end;
+	Token token;
+	std::string value;
+
+	int depth;
+	char stack[MaxDepth];	// '{' or '['
+	bool expectName;		// inside an object, before the member name
+	bool needComma;			// a value at this level was already read
+
+	void SkipSpace();
+	bool ReadString();
+	bool ReadNumber();
+	bool ReadLiteral(const char* literal);
+	Token Fail() { token = TOKEN_ERROR; return token; }
+};
+
+#endif // #ifndef JSON_H
@@ -2,15 +2,24 @@
 
 #include <iostream>
 #include <fstream>
-#include <windows.h>
 
-#include <io.h>   // For access().
+#ifdef _WIN32
+#	include <windows.h>
+#	include <io.h>   // For access().
+#else
+#	include <unistd.h>	// For access().
+#	include <dirent.h>
+#endif
 #include <sys/types.h>  // For stat().
 #include <sys/stat.h>   // For stat().
 
 using namespace std;
 
+#ifdef _WIN32
 const char Path::DirectorySeparatorChar('\\');
+#else
+const char Path::DirectorySeparatorChar('/');
+#endif
 const char Path::AltDirectorySeparatorChar('/');
 const char Path::VolumeSeparatorChar(':');
 
@@ -127,6 +136,22 @@ bool Path::FileExists(const string& path)
 	return false;
 }
 
+/// Gets the attributes of a file or directory; returns false if it does not exist.
+bool Path::GetFileInfo(const string& path, FileInfo& info)
+{
+	struct stat status;
+	if ( stat( path.c_str(), &status ) != 0 )
+		return false;
+
+	info.IsDirectory = ( status.st_mode & S_IFDIR ) != 0;
+	info.Length = status.st_size;
+	info.LastWriteTime = status.st_mtime;
+	info.Inode = status.st_ino;
+	return true;
+}
+
+#ifdef _WIN32
+
 /// Gets the names of subdirectories in the specified directory.
 int Path::GetDirectories(const string& path, vector<string>& list)
 {
@@ -168,3 +193,44 @@ int Path::GetFiles(const string& path, vector<string>& list)
 
 	return list.size();
 }
+
+#else
+
+/// Gets the names of the entries in a directory that are, or are not, directories.
+static int GetEntries(const string& path, bool directories, vector<string>& list)
+{
+	DIR* dir = opendir(path.c_str());
+	if (dir == NULL)
+		return list.size();
+
+	string prefix = path;
+	if (!prefix.empty() && prefix[prefix.length() - 1] != Path::DirectorySeparatorChar)
+		prefix += Path::DirectorySeparatorChar;
+
+	struct dirent* entry;
+	while ((entry = readdir(dir)) != NULL)
+	{
+		string name = entry->d_name;
+		if (name == "." || name == "..")
+			continue;
+		if (Path::DirectoryExists(prefix + name) == directories)
+			list.push_back(prefix + name);
+	}
+	closedir(dir);
+
+	return list.size();
+}
+
+/// Gets the names of subdirectories in the specified directory.
+int Path::GetDirectories(const string& path, vector<string>& list)
+{
+	return GetEntries(path, true, list);
+}
+
+/// Returns the names of files in a specified directory.
+int Path::GetFiles(const string& path, vector<string>& list)
+{
+	return GetEntries(path, false, list);
+}
+
+#endif
@@ -39,6 +39,18 @@ public:
 	/// Determines whether the specified directory exists.
 	static bool DirectoryExists(const std::string& path);
 
+	/// Attributes of a file or directory
+	struct FileInfo
+	{
+		bool IsDirectory;
+		long long Length;			// size in bytes
+		long long LastWriteTime;	// seconds since 1970
+		long long Inode;			// file serial number; 0 where the file system has none
+	};
+
+	/// Gets the attributes of a file or directory; returns false if it does not exist.
+	static bool GetFileInfo(const std::string& path, FileInfo& info);
+
 	/// Gets the names of subdirectories in the specified directory.
 	static int GetDirectories(const std::string& path, std::vector<std::string>& list);
 
@@ -0,0 +1,90 @@
+#include "Sha1.h"
+
+using namespace std;
+
+typedef unsigned int uint32;
+
+static inline uint32 rol(uint32 value, int bits)
+{
+	return (value << bits) | (value >> (32 - bits));
+}
+
+// process one 64 byte block
+static void Transform(uint32 state[5], const unsigned char* block)
+{
+	uint32 w[80];
+	for (int i = 0; i < 16; i++)
+	{
+		w[i] = ((uint32)block[i*4] << 24) | ((uint32)block[i*4+1] << 16) |
+			((uint32)block[i*4+2] << 8) | (uint32)block[i*4+3];
+	}
+	for (int i = 16; i < 80; i++)
+	{
+		w[i] = rol(w[i-3] ^ w[i-8] ^ w[i-14] ^ w[i-16], 1);
+	}
+
+	uint32 a = state[0], b = state[1], c = state[2], d = state[3], e = state[4];
+	for (int i = 0; i < 80; i++)
+	{
+		uint32 f, k;
+		if (i < 20)      { f = (b & c) | (~b & d);           k = 0x5A827999; }
+		else if (i < 40) { f = b ^ c ^ d;                    k = 0x6ED9EBA1; }
+		else if (i < 60) { f = (b & c) | (b & d) | (c & d);  k = 0x8F1BBCDC; }
+		else             { f = b ^ c ^ d;                    k = 0xCA62C1D6; }
+
+		uint32 temp = rol(a, 5) + f + e + k + w[i];
+		e = d;
+		d = c;
+		c = rol(b, 30);
+		b = a;
+		a = temp;
+	}
+
+	state[0] += a;
+	state[1] += b;
+	state[2] += c;
+	state[3] += d;
+	state[4] += e;
+}
+
+/// Computes the 20 byte SHA-1 digest of the specified data.
+string Sha1::ComputeHash(const string& data)
+{
+	uint32 state[5] = { 0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0 };
+
+	const unsigned char* p = (const unsigned char*)data.data();
+	size_t length = data.length();
+
+	size_t offset = 0;
+	for (; offset + 64 <= length; offset += 64)
+	{
+		Transform(state, p + offset);
+	}
+
+	// pad the tail with 0x80, zeros and the bit length
+	unsigned char block[128] = { 0 };
+	size_t rest = length - offset;
+	for (size_t i = 0; i < rest; i++)
+	{
+		block[i] = p[offset + i];
+	}
+	block[rest] = 0x80;
+
+	size_t blocks = (rest + 9 > 64)? 2: 1;
+	unsigned long long bits = (unsigned long long)length * 8;
+	for (int i = 0; i < 8; i++)
+	{
+		block[blocks * 64 - 1 - i] = (unsigned char)(bits >> (i * 8));
+	}
+	for (size_t i = 0; i < blocks; i++)
+	{
+		Transform(state, block + i * 64);
+	}
+
+	string digest(HashSize, '\0');
+	for (int i = 0; i < HashSize; i++)
+	{
+		digest[i] = (char)(state[i >> 2] >> ((3 - (i & 3)) * 8));
+	}
+	return digest;
+}
@@ -0,0 +1,17 @@
+#ifndef SHA1_H
+#define SHA1_H
+
+#include <string>
+
+class Sha1
+{
+public:
+
+	/// size of a digest in bytes
+	static const int HashSize = 20;
+
+	/// Computes the 20 byte SHA-1 digest of the specified data.
+	static std::string ComputeHash(const std::string& data);
+};
+
+#endif // #ifndef SHA1_H
@@ -0,0 +1,179 @@
+#include "Thread.h"
+
+#ifdef _WIN32
+#	include <process.h>
+#else
+#	include <errno.h>
+#	include <time.h>
+#endif
+
+// ===========================================================================
+// Mutex
+// ===========================================================================
+
+#ifdef _WIN32
+
+Mutex::Mutex() { InitializeCriticalSection(&cs); }
+Mutex::~Mutex() { DeleteCriticalSection(&cs); }
+void Mutex::Lock() { EnterCriticalSection(&cs); }
+void Mutex::Unlock() { LeaveCriticalSection(&cs); }
+
+#else
+
+Mutex::Mutex() { pthread_mutex_init(&mutex, NULL); }
+Mutex::~Mutex() { pthread_mutex_destroy(&mutex); }
+void Mutex::Lock() { pthread_mutex_lock(&mutex); }
+void Mutex::Unlock() { pthread_mutex_unlock(&mutex); }
+
+#endif
+
+// ===========================================================================
+// Semaphore
+// ===========================================================================
+
+#ifdef _WIN32
+
+Semaphore::Semaphore(int count) { handle = CreateSemaphore(NULL, count, 0x7FFFFFFF, NULL); }
+Semaphore::~Semaphore() { CloseHandle(handle); }
+void Semaphore::Post() { ReleaseSemaphore(handle, 1, NULL); }
+void Semaphore::Wait() { WaitForSingleObject(handle, INFINITE); }
+bool Semaphore::Wait(int milliseconds) { return WaitForSingleObject(handle, milliseconds) == WAIT_OBJECT_0; }
+
+#else
+
+Semaphore::Semaphore(int count) { sem_init(&sem, 0, count); }
+Semaphore::~Semaphore() { sem_destroy(&sem); }
+void Semaphore::Post() { sem_post(&sem); }
+
+void Semaphore::Wait()
+{
+	while (sem_wait(&sem) != 0 && errno == EINTR)
+		;
+}
+
+bool Semaphore::Wait(int milliseconds)
+{
+	struct timespec until;
+	clock_gettime(CLOCK_REALTIME, &until);
+	until.tv_sec += milliseconds / 1000;
+	until.tv_nsec += (milliseconds % 1000) * 1000000L;
+	if (until.tv_nsec >= 1000000000L)
+	{
+		until.tv_sec++;
+		until.tv_nsec -= 1000000000L;
+	}
+	int result;
+	while ((result = sem_timedwait(&sem, &until)) != 0 && errno == EINTR)
+		;
+	return result == 0;
+}
+
+#endif
+
+// ===========================================================================
+// Thread
+// ===========================================================================
+
+namespace
+{
+	struct StartInfo
+	{
+		Thread::Function function;
+		void* arg;
+	};
+
+#ifdef _WIN32
+	unsigned __stdcall ThreadMain(void* p)
+#else
+	void* ThreadMain(void* p)
+#endif
+	{
+		StartInfo info = *(StartInfo*)p;
+		delete (StartInfo*)p;
+		info.function(info.arg);
+		return 0;
+	}
+}
+
+#ifdef _WIN32
+
+Thread::Thread() : handle(NULL) {}
+
+Thread::~Thread()
+{
+	Join();
+}
+
+bool Thread::Start(Function function, void* arg)
+{
+	if (handle != NULL)
+		return false;
+
+	StartInfo* info = new StartInfo;
+	info->function = function;
+	info->arg = arg;
+	handle = (HANDLE)_beginthreadex(NULL, 0, ThreadMain, info, 0, NULL);
+	if (handle == NULL)
+	{
+		delete info;
+		return false;
+	}
+	return true;
+}
+
+void Thread::Join()
+{
+	if (handle != NULL)
+	{
+		WaitForSingleObject(handle, INFINITE);
+		CloseHandle(handle);
+		handle = NULL;
+	}
+}
+
+bool Thread::IsRunning() const
+{
+	return handle != NULL;
+}
+
+#else
+
+Thread::Thread() : started(false) {}
+
+Thread::~Thread()
+{
+	Join();
+}
+
+bool Thread::Start(Function function, void* arg)
+{
+	if (started)
+		return false;
+
+	StartInfo* info = new StartInfo;
+	info->function = function;
+	info->arg = arg;
+	if (pthread_create(&thread, NULL, ThreadMain, info) != 0)
+	{
+		delete info;
+		return false;
+	}
+	started = true;
+	return true;
+}
+
+void Thread::Join()
+{
+	if (started)
+	{
+		pthread_join(thread, NULL);
+		started = false;
+	}
+}
+
+bool Thread::IsRunning() const
+{
+	return started;
+}
+
+#endif
@@ -0,0 +1,97 @@
+#ifndef THREAD_H
+#define THREAD_H
+
+#ifdef _WIN32
+#	include <windows.h>
+#else
+#	include <pthread.h>
+#	include <semaphore.h>
+#endif
+
+/// Mutual exclusion between threads
+class Mutex
+{
+#ifdef _WIN32
+	CRITICAL_SECTION cs;
+#else
+	pthread_mutex_t mutex;
+#endif
+
+	Mutex(const Mutex&);
+	Mutex& operator=(const Mutex&);
+
+public:
+
+	Mutex();
+	~Mutex();
+	void Lock();
+	void Unlock();
+};
+
+/// Holds a mutex for the life of a scope
+class MutexLock
+{
+	Mutex& mutex;
+
+	MutexLock(const MutexLock&);
+	MutexLock& operator=(const MutexLock&);
+
+public:
+
+	MutexLock(Mutex& m) : mutex(m) { mutex.Lock(); }
+	~MutexLock() { mutex.Unlock(); }
+};
+
+/// Counting semaphore; Wait blocks until the count is above zero
+class Semaphore
+{
+#ifdef _WIN32
+	HANDLE handle;
+#else
+	sem_t sem;
+#endif
+
+	Semaphore(const Semaphore&);
+	Semaphore& operator=(const Semaphore&);
+
+public:
+
+	Semaphore(int count = 0);
+	~Semaphore();
+	void Post();
+	void Wait();
+
+	/// Waits at most milliseconds; returns false if the count stayed at zero.
+	bool Wait(int milliseconds);
+};
+
+/// A thread running a plain function
+class Thread
+{
+#ifdef _WIN32
+	HANDLE handle;
+#else
+	pthread_t thread;
+	bool started;
+#endif
+
+	Thread(const Thread&);
+	Thread& operator=(const Thread&);
+
+public:
+
+	typedef void (*Function)(void* arg);
+
+	Thread();
+	~Thread();
+
+	/// Starts running function(arg); returns false if the thread could not be created.
+	bool Start(Function function, void* arg);
+
+	/// Waits for the function to return.
+	void Join();
+
+	bool IsRunning() const;
+};
+
+#endif // #ifndef THREAD_H
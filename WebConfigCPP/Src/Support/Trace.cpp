@@ -0,0 +1,192 @@
+#include "Trace.h"
+#include "Atomic.h"
+#include "Clock.h"
+#include "Thread.h"
+
+#include <vector>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef _WIN32
+#	define THREAD_LOCAL __declspec(thread)
+#else
+#	define THREAD_LOCAL __thread
+#endif
+
+using namespace std;
+
+static const int NameSize = 32;
+
+struct TraceEvent
+{
+	long long Time;		// nanoseconds
+	const char* Name;
+	char Phase;			// 'B' or 'E'
+	char Detail[Trace::DetailSize];
+};
+
+/// The events of one thread; only that thread writes them
+struct TraceRing
+{
+	TraceEvent Events[Trace::RingSize];
+	volatile long long Head;	// events ever recorded; the next goes at Head % RingSize
+	long long Cleared;			// Head when last cleared
+	int Id;
+	char Name[NameSize];
+	TraceRing* Next;
+};
+
+static Mutex ringLock;		// guards the list of rings, their names and Cleared
+static TraceRing* rings = NULL;
+static int ringCount = 0;
+
+static THREAD_LOCAL TraceRing* threadRing = NULL;
+static THREAD_LOCAL char threadName[NameSize];
+
+static void CopyString(char* to, const char* from, int size)
+{
+	int i = 0;
+	for (; from != NULL && from[i] != 0 && i < size - 1; i++)
+		to[i] = from[i];
+	to[i] = 0;
+}
+
+static TraceRing* NewRing()
+{
+	TraceRing* ring = new TraceRing;
+	ring->Head = 0;
+	ring->Cleared = 0;
+	ring->Next = NULL;
+
+	MutexLock hold(ringLock);
+	ring->Id = ++ringCount;
+	if (threadName[0] != 0)
+		CopyString(ring->Name, threadName, NameSize);
+	else
+		sprintf(ring->Name, "thread %d", ring->Id);
+	ring->Next = rings;
+	rings = ring;
+	return ring;
+}
+
+static void AppendString(string& out, const char* s)
+{
+	out += '"';
+	for (; *s != 0; s++)
+	{
+		if (*s == '"' || *s == '\\')
+		{
+			out += '\\';
+			out += *s;
+		}
+		else if ((unsigned char)*s < 0x20)
+		{
+			char temp[8];
+			sprintf(temp, "\\u%04x", *s);
+			out += temp;
+		}
+		else
+			out += *s;
+	}
+	out += '"';
+}
+
+volatile bool Trace::enabled = false;
+
+void Trace::Enable(bool on)
+{
+	enabled = on;
+}
+
+void Trace::Record(char phase, const char* name, const char* detail)
+{
+	TraceRing* ring = threadRing;
+	if (ring == NULL)
+		ring = threadRing = NewRing();
+
+	TraceEvent& event = ring->Events[ring->Head % RingSize];
+	event.Time = Clock::Nanoseconds();
+	event.Name = name;
+	event.Phase = phase;
+	CopyString(event.Detail, detail, DetailSize);
+
+	// publishes the event to Write
+	Atomic::Add(ring->Head, 1);
+}
+
+void Trace::SetThreadName(const char* name)
+{
+	CopyString(threadName, name, NameSize);
+	if (threadRing != NULL)
+	{
+		MutexLock hold(ringLock);
+		CopyString(threadRing->Name, name, NameSize);
+	}
+}
+
+void Trace::Write(string& out)
+{
+	MutexLock hold(ringLock);
+	out += "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+	bool first = true;
+	char temp[64];
+	vector<TraceEvent> events;
+	for (TraceRing* ring = rings; ring != NULL; ring = ring->Next)
+	{
+		// copy, then drop what the thread may have written over meanwhile
+		long long head = Atomic::Load(ring->Head);
+		long long start = head - RingSize;
+		if (start < ring->Cleared)
+			start = ring->Cleared;
+		if (start < 0)
+			start = 0;
+		events.clear();
+		for (long long i = start; i < head; i++)
+			events.push_back(ring->Events[i % RingSize]);
+		long long overwritten = Atomic::Load(ring->Head) - RingSize + 1;
+		size_t skip = (overwritten > start)? (size_t)(overwritten - start): 0;
+
+		if (!first)
+			out += ',';
+		first = false;
+		sprintf(temp, "{\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"name\":\"thread_name\",\"args\":{\"name\":", ring->Id);
+		out += temp;
+		AppendString(out, ring->Name);
+		out += "}}";
+
+		// an end whose begin was lost would close a span it doesn't belong to
+		int depth = 0;
+		for (size_t i = skip; i < events.size(); i++)
+		{
+			const TraceEvent& event = events[i];
+			if (event.Phase == 'E')
+			{
+				if (depth == 0)
+					continue;
+				--depth;
+			}
+			else
+				++depth;
+
+			sprintf(temp, ",{\"ph\":\"%c\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"name\":",
+				event.Phase, ring->Id, event.Time * 1e-3);
+			out += temp;
+			AppendString(out, event.Name);
+			if (event.Detail[0] != 0)
+			{
+				out += ",\"args\":{\"detail\":";
+				AppendString(out, event.Detail);
+				out += '}';
+			}
+			out += '}';
+		}
+	}
+	out += "]}";
+}
+
+void Trace::Clear()
+{
+	MutexLock hold(ringLock);
+	for (TraceRing* ring = rings; ring != NULL; ring = ring->Next)
+		ring->Cleared = Atomic::Load(ring->Head);
+}
@@ -0,0 +1,103 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <string>
+
+/// Begin and end events from any thread, written out as Chrome trace-event
+/// JSON for chrome://tracing or ui.perfetto.dev. Each thread records into
+/// its own ring of the last RingSize events without taking a lock; Write
+/// skips any events a thread overwrites while they are being copied. Rings
+/// are made the first time a thread records while tracing is enabled, and
+/// kept for the life of the process. Define WEBCONFIG_NO_TRACE to compile
+/// the events out.
+class Trace
+{
+public:
+
+	enum
+	{
+		RingSize = 4096,
+		DetailSize = 40		// longer details are cut short
+	};
+
+	/// Starts or stops recording; events already recorded are kept.
+	static void Enable(bool enabled);
+
+	static bool IsEnabled() { return enabled; }
+
+#ifndef WEBCONFIG_NO_TRACE
+
+	/// Starts a span on this thread. The name must outlive the trace, eg. a
+	/// literal; the detail is copied and shown as the span's argument.
+	static void Begin(const char* name, const char* detail = 0)
+	{
+		if (enabled)
+			Record('B', name, detail);
+	}
+
+	/// Ends the span begun last on this thread.
+	static void End(const char* name)
+	{
+		if (enabled)
+			Record('E', name, 0);
+	}
+
+#else
+
+	static void Begin(const char*, const char* = 0) {}
+	static void End(const char*) {}
+
+#endif
+
+	/// Names this thread in the trace; "thread <n>" otherwise.
+	static void SetThreadName(const char* name);
+
+	/// Appends the events of every thread as a JSON object.
+	static void Write(std::string& out);
+
+	/// Forgets the events recorded so far.
+	static void Clear();
+
+private:
+
+	friend class TraceScope;
+
+	static volatile bool enabled;
+
+	static void Record(char phase, const char* name, const char* detail);
+};
+
+/// Begins a span and ends it when it goes out of scope
+class TraceScope
+{
+#ifndef WEBCONFIG_NO_TRACE
+	const char* name;
+	bool begun;		// tracing may be turned on or off inside the span
+
+public:
+
+	TraceScope(const char* n, const char* detail = 0) : name(n), begun(Trace::IsEnabled())
+	{
+		if (begun)
+			Trace::Record('B', name, detail);
+	}
+
+	~TraceScope()
+	{
+		// even if tracing was turned off since, so the span is closed
+		if (begun)
+			Trace::Record('E', name, 0);
+	}
+#else
+public:
+
+	TraceScope(const char*, const char* = 0) {}
+#endif
+
+private:
+
+	TraceScope(const TraceScope&);
+	TraceScope& operator=(const TraceScope&);
+};
+
+#endif // #ifndef TRACE_H
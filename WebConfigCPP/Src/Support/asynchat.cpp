@@ -43,6 +43,15 @@ namespace async_sockets
 
 	const std::string async_chat::null_terminator = string("");
 
+	async_chat::~async_chat (void)
+	{
+		// producers never drained belong to us
+		while (producer_fifo.size()) {
+			delete producer_fifo.front();
+			producer_fifo.pop();
+		}
+	}
+
 	void async_chat::set_terminator (const string & t)
 	{
 		terminator = t;
@@ -72,54 +81,62 @@ namespace async_sockets
 		int result = recv (buffer, ac_in_buffer_size);
 
 		if (result > 0) {
+			bytes_received += result;
 			ac_in_buffer.append (buffer, result);
+			handle_input();
+		}
+	}
 
-			// Continue to search for self.terminator in self.ac_in_buffer,
-			// while calling self.collect_incoming_data.  The while loop is
-			// necessary because we might read several data+terminator combos
-			// with a single recv().
-
-			while (ac_in_buffer.length()) {
-				string terminator = get_terminator();
-
-				// special case where we're not using a terminator
-				if (terminator == null_terminator) {
-					collect_incoming_data (ac_in_buffer);
-					ac_in_buffer.clear(); //.remove ();
-					return;
-				}
+	void async_chat::handle_input (void)
+	{
+		// Continue to search for self.terminator in self.ac_in_buffer,
+		// while calling self.collect_incoming_data.  The while loop is
+		// necessary because we might read several data+terminator combos
+		// with a single recv().
+
+		while (ac_in_buffer.length()) {
+			string terminator = get_terminator();
+
+			// special case where we're not using a terminator
+			// (collect_incoming_data may hand back what it doesn't want
+			// after setting a new terminator)
+			if (terminator == null_terminator) {
+				string data;
+				data.swap (ac_in_buffer);
+				collect_incoming_data (data);
+				continue;
+			}
 
-				int terminator_len = terminator.length();
+			int terminator_len = terminator.length();
 
-				int index = ac_in_buffer.find (terminator);
+			int index = ac_in_buffer.find (terminator);
 
-				// 3 cases:
-				// 1) end of buffer matches terminator exactly:
-				//    collect data, transition
-				// 2) end of buffer matches some prefix:
-				//    collect data to the prefix
-				// 3) end of buffer does not match any prefix:
-				//    collect data
+			// 3 cases:
+			// 1) end of buffer matches terminator exactly:
+			//    collect data, transition
+			// 2) end of buffer matches some prefix:
+			//    collect data to the prefix
+			// 3) end of buffer does not match any prefix:
+			//    collect data
 
-				if (index != -1) {
-					// we found the terminator
-					collect_incoming_data (ac_in_buffer.substr (0, index));
-					ac_in_buffer = ac_in_buffer.substr(index + terminator_len); //.remove (0, index + terminator_len);
-					found_terminator();
+			if (index != -1) {
+				// we found the terminator
+				collect_incoming_data (ac_in_buffer.substr (0, index));
+				ac_in_buffer = ac_in_buffer.substr(index + terminator_len); //.remove (0, index + terminator_len);
+				found_terminator();
+			} else {
+				// check for a prefix of the terminator
+				int num = find_prefix_at_end (ac_in_buffer, terminator);
+				if (num) {
+					int bl = ac_in_buffer.length();
+					// we found a prefix, collect up to the prefix
+					collect_incoming_data (ac_in_buffer.substr (0, bl - num));
+					ac_in_buffer = ac_in_buffer.substr(bl - num); //.remove (0, bl - num);
+					break;
 				} else {
-					// check for a prefix of the terminator
-					int num = find_prefix_at_end (ac_in_buffer, terminator);
-					if (num) {
-						int bl = ac_in_buffer.length();
-						// we found a prefix, collect up to the prefix
-						collect_incoming_data (ac_in_buffer.substr (0, bl - num));
-						ac_in_buffer = ac_in_buffer.substr(bl - num); //.remove (0, bl - num);
-						break;
-					} else {
-						// no prefix, collect it all
-						collect_incoming_data (ac_in_buffer);
-						ac_in_buffer.clear(); //.remove();
-					}
+					// no prefix, collect it all
+					collect_incoming_data (ac_in_buffer);
+					ac_in_buffer.clear(); //.remove();
 				}
 			}
 		}
@@ -191,6 +208,7 @@ namespace async_sockets
 					cerr << "popping fifo" << endl;
 #endif
 					producer_fifo.pop();
+					delete p;
 					delete data;
 				}
 			} else {
@@ -211,7 +229,8 @@ namespace async_sockets
 			cerr << fileno << ":sending " << ac_out_buffer.length() << " bytes" << endl;
 #endif
 			int num_sent = dispatcher::send (ac_out_buffer.data(), ac_out_buffer.length());
-			if (num_sent) {
+			if (num_sent > 0) {
+				bytes_sent += num_sent;
 				ac_out_buffer = ac_out_buffer.substr(num_sent); //.remove (0, num_sent);
 			}
 		}
@@ -44,6 +44,7 @@ namespace async_sockets
 	class producer
 	{
 	public:
+		virtual ~producer (void) { }
 		virtual std::string* more (void) = 0;
 	};
 
@@ -93,10 +94,19 @@ namespace async_sockets
 
 		std::queue<producer*> producer_fifo;
 
+		// total bytes written to and read from the socket
+		unsigned long long bytes_sent;
+		unsigned long long bytes_received;
+
+		async_chat (void) : bytes_sent (0), bytes_received (0) { }
+		~async_chat (void);
+
 		virtual void	set_terminator			(const std::string & t);
 		virtual std::string& get_terminator	(void);
 
 		void			handle_read				(void);
+		// split what is in ac_in_buffer at terminators, as handle_read does after recv
+		void			handle_input			(void);
 		void			handle_write			(void);
 		int				read_after_terminator	(char * buffer, size_t size);
 
@@ -13,27 +13,217 @@
 // Maybe assert valid fileno, too?
 
 #include "asyncore.h"
+#include "uring.h"
+#include "Clock.h"
 
 #include <list>
 
+#ifdef __linux__
+#include <sys/epoll.h>
+#endif
+
 using namespace std;
 
 namespace async_sockets
 {
 
-	socket_map dispatcher::channels;
+	// ==================================================
+	// timers
+	// ==================================================
+
+	timer::timer (timer_wheel * w) :
+		home (w ? w : &reactor::get_main().timers),
+		next (0),
+		prev (0),
+		wheel (0),
+		expires (0)
+	{
+	}
+
+	void timer::arm (unsigned int milliseconds)
+	{
+		home->arm (this, timer_wheel::now() + milliseconds);
+	}
+
+	void timer::cancel (void)
+	{
+		if (wheel) {
+			wheel->cancel (this);
+		}
+	}
+
+	timer_wheel::timer_wheel () : current (now()), count (0)
+	{
+		for (int l = 0; l < levels; l++) {
+			for (int i = 0; i < slot_count; i++) {
+				slots[l][i] = 0;
+			}
+		}
+	}
+
+	unsigned long long timer_wheel::now (void)
+	{
+		return (unsigned long long) (Clock::Nanoseconds() / 1000000);
+	}
+
+	void timer_wheel::arm (timer * t, unsigned long long expires)
+	{
+		if (t->wheel) {
+			t->wheel->cancel (t);
+		}
+		// anything already due runs on the next tick
+		t->expires = (expires > current) ? expires : current + 1;
+		t->wheel = this;
+		insert (t);
+		count++;
+	}
+
+	void timer_wheel::cancel (timer * t)
+	{
+		if (t->wheel == this) {
+			unlink (t);
+			t->wheel = 0;
+			count--;
+		}
+	}
+
+	// file the timer in the slot for its expiry at the lowest level
+	// whose span reaches it
+	void timer_wheel::insert (timer * t)
+	{
+		unsigned long long delta = t->expires - current;
+		int level = 0;
+		while (level < levels - 1 && delta >= ((unsigned long long) 1 << (slot_bits * (level + 1)))) {
+			level++;
+		}
+		if (delta >= ((unsigned long long) 1 << (slot_bits * levels))) {
+			t->expires = current + ((unsigned long long) 1 << (slot_bits * levels)) - 1;
+		}
+
+		timer ** head = &slots[level][(t->expires >> (slot_bits * level)) & (slot_count - 1)];
+		t->prev = 0;
+		t->next = *head;
+		if (*head) {
+			(*head)->prev = t;
+		}
+		*head = t;
+	}
+
+	void timer_wheel::unlink (timer * t)
+	{
+		if (t->next) {
+			t->next->prev = t->prev;
+		}
+		if (t->prev) {
+			t->prev->next = t->next;
+		} else {
+			// first in its slot; find the slot from where insert put it
+			for (int l = 0; l < levels; l++) {
+				timer ** head = &slots[l][(t->expires >> (slot_bits * l)) & (slot_count - 1)];
+				if (*head == t) {
+					*head = t->next;
+					break;
+				}
+			}
+		}
+		t->next = t->prev = 0;
+	}
+
+	// refile the timers of the slot at this level that current has just reached
+	void timer_wheel::cascade (int level)
+	{
+		timer ** head = &slots[level][(current >> (slot_bits * level)) & (slot_count - 1)];
+		timer * t = *head;
+		*head = 0;
+		while (t) {
+			timer * next = t->next;
+			insert (t);
+			t = next;
+		}
+	}
+
+	void timer_wheel::advance (unsigned long long time)
+	{
+		if (!count) {
+			// nothing to walk past
+			if (time > current) {
+				current = time;
+			}
+			return;
+		}
+
+		while (current < time && count) {
+			// skip the empty slots between here and the next timer or cascade
+			long long wait = next_timeout (current);
+			if (wait > 1) {
+				unsigned long long skip = (unsigned long long) wait - 1;
+				current += (skip < time - current) ? skip : time - current;
+				if (current == time) {
+					break;
+				}
+			}
+
+			current++;
+			for (int l = 1; l < levels && !(current & (((unsigned long long) 1 << (slot_bits * l)) - 1)); l++) {
+				cascade (l);
+			}
+
+			// callbacks may arm and cancel timers, so take them one at a time
+			timer ** head = &slots[0][current & (slot_count - 1)];
+			while (*head) {
+				timer * t = *head;
+				cancel (t);
+				t->handle_timeout();
+			}
+		}
+		if (time > current) {
+			current = time;
+		}
+	}
+
+	long long timer_wheel::next_timeout (unsigned long long time) const
+	{
+		if (!count) {
+			return -1;
+		}
+
+		// the first non-empty slot at each level gives the time it runs or cascades
+		unsigned long long when = ~(unsigned long long) 0;
+		for (int l = 0; l < levels; l++) {
+			unsigned long long base = current >> (slot_bits * l);
+			for (unsigned long long i = 1; i <= slot_count; i++) {
+				if (slots[l][(base + i) & (slot_count - 1)]) {
+					unsigned long long t = (base + i) << (slot_bits * l);
+					if (t < when) {
+						when = t;
+					}
+					break;
+				}
+			}
+		}
+		return (when > time) ? (long long) (when - time) : 0;
+	}
+
+	dispatcher::~dispatcher ()
+	{
+#ifdef __linux__
+		if (ring) {
+			owner->ring->detach (this);
+		}
+#endif
+	}
 
 	void dispatcher::add_channel ()
 	{
-		channels[fileno] = this;
+		owner->channels[fileno] = this;
 	}
 
 	bool dispatcher::create_socket (int family, int type, int protocol)
 	{
 		int result = socket (family, type, protocol);
 		if (result != -1) {
-			set_blocking (0);
 			fileno = result;
+			set_blocking (0);
 			add_channel();
 		}
 		return (result != -1);
@@ -48,7 +238,6 @@ namespace async_sockets
 
 #ifndef _WIN32
 	// unix version
-#include <fcntl.h>
 
 	void dispatcher::set_blocking (bool blocking)
 	{
@@ -85,7 +274,25 @@ namespace async_sockets
 
 	int dispatcher::accept (struct sockaddr * addr, int * length_ptr)
 	{
+#ifdef __linux__
+		if (owner->ring) {
+			// the ring accepted it already and didn't keep the address
+			if (length_ptr) {
+				*length_ptr = 0;
+			}
+			return owner->ring->accept (this);
+		}
+#endif
+#ifdef _WIN32
 		return ::accept (fileno, addr, length_ptr);
+#else
+		socklen_t length = length_ptr ? *length_ptr : 0;
+		int result = ::accept (fileno, addr, length_ptr ? &length : 0);
+		if (length_ptr) {
+			*length_ptr = (int) length;
+		}
+		return result;
+#endif
 	}
 
 	int dispatcher::connect (struct sockaddr * addr, size_t length)
@@ -107,6 +314,11 @@ namespace async_sockets
 	int dispatcher::send (const char * buffer, size_t size, int flags)
 	{
 		int result;
+#ifdef __linux__
+		if (owner->ring) {
+			result = owner->ring->send (this, buffer, size);
+		} else
+#endif
 #ifndef _WIN32
 		if (!flags) {
 			// this allows us to use non-sockets with the library
@@ -143,6 +355,11 @@ namespace async_sockets
 	{
 		int result;
 
+#ifdef __linux__
+		if (owner->ring) {
+			result = owner->ring->recv (this, buffer, size);
+		} else
+#endif
 #ifndef _WIN32
 		if (!flags) {
 			// this allows us to use non-sockets with the library
@@ -157,8 +374,10 @@ namespace async_sockets
 		if (result > 0) {
 			return result;
 		} else if (result == 0) {
-			closed = 1;
+			// the peer hung up
 			this->handle_close();
+			close();
+			closed = 1;
 			return 0;
 		} else if (is_nonblocking_error (result)) {
 			return 0;
@@ -179,6 +398,11 @@ namespace async_sockets
 #ifdef _WIN32
 		::closesocket (fileno);
 #else
+#ifdef __linux__
+		if (owner->ring) {
+			owner->ring->close (this);
+		} else
+#endif
 		::close (fileno);
 #endif
 		// flag this socket as closed, so it will be removed
@@ -217,6 +441,162 @@ namespace async_sockets
 	// ==================================================
 
 	void dispatcher::dump_channels (void)
+	{
+		reactor::get_main().dump_channels();
+	}
+
+	void dispatcher::delete_closed_channels ()
+	{
+		reactor::get_main().delete_closed_channels();
+	}
+
+	void dispatcher::poll (struct timeval * timeout)
+	{
+		reactor::get_main().poll (timeout);
+	}
+
+	void dispatcher::loop (struct timeval * timeout)
+	{
+		reactor::get_main().loop (timeout);
+	}
+
+	// ==================================================
+	// reactor
+	// ==================================================
+
+	namespace
+	{
+#ifdef __linux__
+		reactor::backend_type default_backend = reactor::backend_epoll;
+#else
+		reactor::backend_type default_backend = reactor::backend_select;
+#endif
+	}
+
+	reactor & reactor::get_main (void)
+	{
+		static reactor main_reactor;
+		return main_reactor;
+	}
+
+	reactor::reactor () : backend (backend_select)
+	{
+		wake_fds[0] = wake_fds[1] = -1;
+#ifndef _WIN32
+		if (::pipe (wake_fds) == 0) {
+			for (int i = 0; i < 2; i++) {
+				::fcntl (wake_fds[i], F_SETFL, ::fcntl (wake_fds[i], F_GETFL, 0) | O_NONBLOCK);
+			}
+		}
+#endif
+#ifdef __linux__
+		ring = 0;
+		epoll_fd = ::epoll_create (256);
+		if (wake_fds[0] != -1) {
+			struct epoll_event e;
+			e.events = EPOLLIN;
+			e.data.fd = wake_fds[0];
+			::epoll_ctl (epoll_fd, EPOLL_CTL_ADD, wake_fds[0], &e);
+		}
+#endif
+		if (!set_backend (default_backend)) {
+			set_backend (backend_epoll);
+		}
+	}
+
+	reactor::~reactor ()
+	{
+#ifdef __linux__
+		if (ring) {
+			for (socket_map::iterator i = channels.begin(); i != channels.end(); i++) {
+				ring->detach ((*i).second);
+			}
+			delete ring;
+		}
+#endif
+#ifndef _WIN32
+		for (int i = 0; i < 2; i++) {
+			if (wake_fds[i] != -1) {
+				::close (wake_fds[i]);
+			}
+		}
+#endif
+#ifdef __linux__
+		::close (epoll_fd);
+#endif
+	}
+
+	bool reactor::set_backend (backend_type b)
+	{
+		if (channels.size()) {
+			return false;
+		}
+		if (b == backend) {
+			return true;
+		}
+#ifdef __linux__
+		if (b == backend_uring) {
+			uring * r = new uring;
+			if (!r->open()) {
+				delete r;
+				return false;
+			}
+			ring = r;
+		} else if (ring) {
+			delete ring;
+			ring = 0;
+		}
+#else
+		if (b != backend_select) {
+			return false;
+		}
+#endif
+		backend = b;
+		return true;
+	}
+
+	bool reactor::set_default_backend (backend_type b)
+	{
+#ifdef __linux__
+		if (b == backend_uring) {
+			// see that the kernel has what it needs
+			uring probe;
+			if (!probe.open()) {
+				return false;
+			}
+		}
+#else
+		if (b != backend_select) {
+			return false;
+		}
+#endif
+		default_backend = b;
+		return true;
+	}
+
+	void reactor::wake (void)
+	{
+#ifndef _WIN32
+		char c = 0;
+		if (wake_fds[1] != -1) {
+			// a full pipe is already a wakeup
+			int ignored = ::write (wake_fds[1], &c, 1);
+			(void) ignored;
+		}
+#endif
+	}
+
+	void reactor::drain_wake (void)
+	{
+#ifndef _WIN32
+		char buffer[64];
+		while (::read (wake_fds[0], buffer, sizeof (buffer)) > 0) {
+			// empty
+		}
+#endif
+	}
+
+	void reactor::dump_channels (void)
 	{
 		cerr << "[";
 		socket_map::const_iterator i;
@@ -229,7 +609,7 @@ namespace async_sockets
 		cerr << "]" << endl;
 	}
 
-	void dispatcher::delete_closed_channels ()
+	void reactor::delete_closed_channels ()
 	{
 
 		// I'd prefer to use remove_if.
@@ -248,8 +628,138 @@ namespace async_sockets
 
 	}
 
-	void dispatcher::poll (struct timeval * timeout)
+	void reactor::poll (struct timeval * timeout)
 	{
+#ifdef __linux__
+		if (backend == backend_uring) {
+			poll_uring (timeout);
+			return;
+		} else if (backend == backend_epoll) {
+			poll_epoll (timeout);
+			return;
+		}
+#endif
+		poll_select (timeout);
+	}
+
+#ifdef __linux__
+	void reactor::poll_epoll (struct timeval * timeout)
+	{
+		timers.advance (timer_wheel::now());
+
+		delete_closed_channels();
+
+		if (!channels.size()) {
+#ifdef DEBUG
+			cerr << "socket map is empty, should be shutting down" << endl;
+#endif
+			return;
+		}
+
+		// bring the interest list up to date with the predicates; a closed
+		// socket has already left it
+		for (socket_map::iterator i = channels.begin(); i != channels.end(); i++) {
+			dispatcher * d = (*i).second;
+			int events = (d->readable() ? EPOLLIN : 0) | (d->writable() ? EPOLLOUT : 0);
+			if (events == d->interest) {
+				continue;
+			}
+			struct epoll_event e;
+			e.events = events;
+			e.data.fd = (*i).first;
+			if (!events) {
+				::epoll_ctl (epoll_fd, EPOLL_CTL_DEL, (*i).first, &e);
+			} else if (!d->interest) {
+				if (::epoll_ctl (epoll_fd, EPOLL_CTL_ADD, (*i).first, &e) != 0 && errno == EEXIST) {
+					::epoll_ctl (epoll_fd, EPOLL_CTL_MOD, (*i).first, &e);
+				}
+			} else {
+				::epoll_ctl (epoll_fd, EPOLL_CTL_MOD, (*i).first, &e);
+			}
+			d->interest = events;
+		}
+
+		// don't sleep past the next timer
+		int wait = timeout ? (int) (timeout->tv_sec * 1000 + timeout->tv_usec / 1000) : -1;
+		long long next = timers.next_timeout (timer_wheel::now());
+		if (next >= 0 && (wait < 0 || next < wait)) {
+			wait = (int) next;
+		}
+
+		struct epoll_event events[256];
+		int n = ::epoll_wait (epoll_fd, events, 256, wait);
+
+		for (int k = 0; k < n; k++) {
+			int fd = events[k].data.fd;
+			if (fd == wake_fds[0]) {
+				drain_wake();
+				continue;
+			}
+			socket_map::iterator i = channels.find (fd);
+			if (i == channels.end() || (*i).second->closed) {
+				continue;
+			}
+			dispatcher * d = (*i).second;
+			// errors and hangups are found by the read or write they wake
+			if ((d->interest & EPOLLIN) && (events[k].events & (EPOLLIN | EPOLLHUP | EPOLLERR))) {
+				d->handle_read_event();
+			}
+			if (!d->closed && (d->interest & EPOLLOUT) && (events[k].events & (EPOLLOUT | EPOLLHUP | EPOLLERR))) {
+				d->handle_write_event();
+			}
+		}
+
+		timers.advance (timer_wheel::now());
+	}
+
+	void reactor::poll_uring (struct timeval * timeout)
+	{
+		timers.advance (timer_wheel::now());
+
+		delete_closed_channels();
+
+		if (!channels.size()) {
+#ifdef DEBUG
+			cerr << "socket map is empty, should be shutting down" << endl;
+#endif
+			return;
+		}
+
+		// hand over what arrived, start output and arm receives; a channel
+		// left holding data it could take means there's no time to sleep
+		bool busy = false;
+		for (socket_map::iterator i = channels.begin(); i != channels.end(); i++) {
+			if (!(*i).second->closed && ring->service ((*i).second)) {
+				busy = true;
+			}
+		}
+		ring->arm_wake (wake_fds[0]);
+
+		// don't sleep past the next timer
+		int wait = timeout ? (int) (timeout->tv_sec * 1000 + timeout->tv_usec / 1000) : -1;
+		long long next = timers.next_timeout (timer_wheel::now());
+		if (next >= 0 && (wait < 0 || next < wait)) {
+			wait = (int) next;
+		}
+
+		// one system call submits everything queued above and waits
+		ring->submit (busy ? 0 : wait);
+		if (ring->reap()) {
+			drain_wake();
+		}
+
+		// answer straight away, so responses go out with this poll
+		ring->dispatch();
+		ring->submit (0);
+
+		timers.advance (timer_wheel::now());
+	}
+#endif
+
+	void reactor::poll_select (struct timeval * timeout)
+	{
+		timers.advance (timer_wheel::now());
+
 		if (channels.size()) {
 			fd_set r,w;
 			socket_map::iterator i;
@@ -296,6 +806,10 @@ namespace async_sockets
 			cerr << endl << "calling select() with " << num << " FD's set" << endl;
 #endif
 
+			if (wake_fds[0] != -1) {
+				FD_SET (wake_fds[0], &r);
+			}
+
 			// It bothers me that select()'s first argument does not appear to
 			// work as advertised... [it hangs like this if called with
 			// anything less than FD_SETSIZE, which seems wasteful?]
@@ -305,6 +819,15 @@ namespace async_sockets
 			// thing I have ever seen it used for is to detect urgent data -
 			// which is an unportable feature anyway.
 
+			// don't sleep past the next timer
+			struct timeval until;
+			long long wait = timers.next_timeout (timer_wheel::now());
+			if (wait >= 0 && (!timeout || wait < (long long) timeout->tv_sec * 1000 + timeout->tv_usec / 1000)) {
+				until.tv_sec = (long) (wait / 1000);
+				until.tv_usec = (long) (wait % 1000) * 1000;
+				timeout = &until;
+			}
+
 			// int n = ::select (channels.size() + 1, &r, &w, 0, timeout);
 			int n = ::select (FD_SETSIZE, &r, &w, 0, timeout);
 
@@ -312,9 +835,14 @@ namespace async_sockets
 			cerr << "select :" << n << " channels.size() " << channels.size() << endl << flush;
 #endif
 
+			if (n > 0 && wake_fds[0] != -1 && FD_ISSET (wake_fds[0], &r)) {
+				drain_wake();
+				n--;
+			}
+
 			// [we're also trusting it to count down channels in order to quit iterating]
 
-			for (i = channels.begin(); (i != channels.end() && n); ++i) {
+			for (i = channels.begin(); (i != channels.end() && n > 0); ++i) {
 				int fd = (*i).first;
 				if (FD_ISSET (fd, &r)) {
 					((*i).second)->handle_read_event();
@@ -325,10 +853,12 @@ namespace async_sockets
 					n--;
 				}
 			}
+
+			timers.advance (timer_wheel::now());
 		}
 	}
 
-	void dispatcher::loop (struct timeval * timeout)
+	void reactor::loop (struct timeval * timeout)
 	{
 		while (channels.size()) {
 			poll (timeout);
@@ -37,6 +37,17 @@
 #	include <winsock.h>
 #	undef min
 #	undef max
+#else
+#	include <sys/types.h>
+#	include <sys/socket.h>
+#	include <sys/select.h>
+#	include <netinet/in.h>
+#	include <netinet/tcp.h>
+#	include <arpa/inet.h>
+#	include <unistd.h>
+#	include <fcntl.h>
+#	include <errno.h>
+#	include <string.h>
 #endif
 
 #include <algorithm>
@@ -50,6 +61,143 @@ namespace async_sockets
 
 	typedef std::map<int, dispatcher*, std::less<int> > socket_map;
 
+	// ===========================================================================
+	// timer and timer_wheel
+	// ===========================================================================
+
+	class timer_wheel;
+	class reactor;
+	class uring;
+	struct uring_channel;
+
+	// something to do at a time; run by the poll of the reactor whose
+	// wheel it is given, or of the main reactor
+	class timer {
+	public:
+		timer (timer_wheel * home = 0);
+		virtual ~timer () { cancel(); }
+
+		virtual void handle_timeout (void) = 0;
+
+		// (re)start the timer; it runs once, milliseconds from now
+		void arm (unsigned int milliseconds);
+		void cancel (void);
+		bool armed (void) const { return wheel != 0; }
+
+	private:
+		friend class timer_wheel;
+		timer_wheel * home;	// the wheel arm uses
+		timer * next;
+		timer * prev;
+		timer_wheel * wheel;	// the wheel it is armed on, if any
+		unsigned long long expires;
+
+		timer (const timer&);
+		timer& operator= (const timer&);
+	};
+
+	// a timer that calls a member function
+	template <class T> class member_timer : public timer {
+	public:
+		typedef void (T::*method_type) (void);
+
+		member_timer (T * o, method_type m, timer_wheel * home = 0) : timer (home), object (o), method (m) { }
+		void handle_timeout (void) { (object->*method)(); }
+
+	private:
+		T * object;
+		method_type method;
+	};
+
+	// hierarchical timing wheel with millisecond ticks: four levels of 256
+	// slots each cover 49 days.  arm and cancel are O(1); a timer is moved
+	// down a level at most three times before it runs.
+	class timer_wheel {
+	public:
+		enum { slot_bits = 8, slot_count = 1 << slot_bits, levels = 4 };
+
+		timer_wheel ();
+
+		void arm (timer * t, unsigned long long expires);
+		void cancel (timer * t);
+
+		// run every timer due by now
+		void advance (unsigned long long now);
+
+		// milliseconds from now until the wheel next needs advancing, or -1 if never
+		long long next_timeout (unsigned long long now) const;
+
+		int size (void) const { return count; }
+
+		// milliseconds on a monotonic clock
+		static unsigned long long now (void);
+
+	private:
+		timer * slots[levels][slot_count];
+		unsigned long long current;	// time the wheel has been advanced to
+		int count;
+
+		void insert (timer * t);
+		void unlink (timer * t);
+		void cascade (int level);
+	};
+
+	// ===========================================================================
+	// reactor
+	// ===========================================================================
+
+	// a socket map and the timers of the channels in it, polled by one
+	// thread.  waits in epoll on linux and select() elsewhere, or lets an
+	// io_uring do the socket calls.  a program with one thread only needs
+	// the main reactor, which the static dispatcher functions use.
+	class reactor {
+	public:
+		enum backend_type { backend_select, backend_epoll, backend_uring };
+
+		reactor ();
+		~reactor ();
+
+		socket_map channels;
+		timer_wheel timers;
+
+		void poll (struct timeval * timeout = 0);
+		void loop (struct timeval * timeout = 0);
+		void delete_closed_channels (void);
+		void dump_channels (void);
+
+		// make a waiting poll return; safe from any thread
+		void wake (void);
+
+		// what waits for sockets.  set it while there are no channels;
+		// false if the platform or kernel doesn't have it
+		bool set_backend (backend_type b);
+		backend_type get_backend (void) const { return backend; }
+
+		// the backend reactors made from now on start with
+		static bool set_default_backend (backend_type b);
+
+		static reactor & get_main (void);
+
+	private:
+		friend class dispatcher;
+		backend_type backend;
+		int wake_fds[2];	// pipe written by wake, read by poll
+#ifdef __linux__
+		int epoll_fd;
+		uring * ring;
+#endif
+
+		void poll_select (struct timeval * timeout);
+#ifdef __linux__
+		void poll_epoll (struct timeval * timeout);
+		void poll_uring (struct timeval * timeout);
+#endif
+		void drain_wake (void);
+
+		reactor (const reactor&);
+		reactor& operator= (const reactor&);
+	};
+
 	class dispatcher {
 
 	public:
@@ -64,14 +212,18 @@ namespace async_sockets
 			accepting		(0),
 			connected		(0),
 			closed			(0),
-			write_blocked	(0) {
+			write_blocked	(0),
+			owner			(&reactor::get_main()),
+			interest		(0),
+			ring			(0) {
 				/* empty */
 		}
 
+		virtual ~dispatcher ();
+
 		static bool is_nonblocking_error (int error);
 
-		// static functions [relevant to the active socket map]
-		static socket_map channels;
+		// static functions [relevant to the main reactor]
 		static void dump_channels (void);
 		static void poll (struct timeval * timeout = 0);
 		static void loop (struct timeval * timeout = 0);
@@ -80,6 +232,10 @@ namespace async_sockets
 
 		int get_fileno () { return fileno; }
 
+		// the reactor that polls this channel; set it before the channel has a socket
+		reactor * get_reactor () { return owner; }
+		void set_reactor (reactor * r) { owner = r; }
+
 		// select() eligibility predicates
 		virtual bool readable (void) { return (connected || accepting); }
 		virtual bool writable (void) { return (!connected || write_blocked); }
@@ -129,10 +285,16 @@ namespace async_sockets
 		}
 #else
 		virtual void handle_error (int error) {
-			cerr << fileno << ":unhandled error:" << error << " error: " << strerror(errno) << endl;
+			std::cerr << fileno << ":unhandled error:" << error << " error: " << strerror(errno) << std::endl;
 		}
 #endif
 
+	private:
+		friend class reactor;
+		friend class uring;
+		reactor * owner;
+		int interest;		// events registered with epoll; 0 when not registered
+		uring_channel * ring;	// what the io_uring backend knows of the socket
 	};
 
 #ifndef _WIN32
@@ -0,0 +1,739 @@
+// -*- Mode: C++; tab-width: 4 -*-
+
+// io_uring backend for the reactor.  Talks to the kernel directly rather
+// than through liburing:
+//
+//   - listening sockets get one multishot accept, which queues a socket
+//     per connection for dispatcher::accept to hand out
+//   - connected sockets get a receive that picks a buffer from a ring of
+//     provided buffers; it is only armed while the channel is readable,
+//     so a channel that stops reading still pushes back on its client
+//   - output is copied into the ring, one send in flight per socket
+//     (MSG_WAITALL, so it is all written or fails); a close that follows
+//     it is linked to it, so the socket is closed as soon as it is sent
+
+#include "uring.h"
+
+#ifdef __linux__
+
+#include "asyncore.h"
+
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/socket.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+using namespace std;
+
+namespace async_sockets
+{
+
+	namespace
+	{
+		enum {
+			op_wake = 1,
+			op_accept,
+			op_poll,
+			op_recv,
+			op_send,
+			op_close,
+			op_cancel,
+			op_mask = 7
+		};
+
+		const unsigned int ring_entries = 1024;
+		const unsigned int buffer_count = 1024;		// a power of two
+		const unsigned int buffer_size = 4096;
+		const unsigned short buffer_group = 0;
+
+		// output a channel may have in the ring before send() reports it blocked
+		const size_t send_window = 64 * 1024;
+
+		// channels are allocated with new, so the low bits are free for the op
+		inline unsigned long long tag (uring_channel * c, int op)
+		{
+			return (unsigned long long) (size_t) c | op;
+		}
+
+		inline int sys_setup (unsigned int entries, struct io_uring_params * p)
+		{
+			return (int) ::syscall (__NR_io_uring_setup, entries, p);
+		}
+
+		inline int sys_enter (int fd, unsigned int submit, unsigned int wait, unsigned int flags, void * arg, size_t size)
+		{
+			return (int) ::syscall (__NR_io_uring_enter, fd, submit, wait, flags, arg, size);
+		}
+
+		inline int sys_register (int fd, unsigned int opcode, void * arg, unsigned int count)
+		{
+			return (int) ::syscall (__NR_io_uring_register, fd, opcode, arg, count);
+		}
+	}
+
+	uring_channel::uring_channel (dispatcher * d) :
+		owner			(d),
+		fd				(d->get_fileno()),
+		refs			(0),
+		accept_armed	(false),
+		poll_armed		(false),
+		connect_ready	(false),
+		recv_armed		(false),
+		buffer			(-1),
+		offset			(0),
+		length			(0),
+		eof				(false),
+		error			(0),
+		send_armed		(false),
+		send_index		(0),
+		close_pending	(false),
+		close_linked	(false),
+		ready			(false)
+	{
+	}
+
+	uring::uring () :
+		ring_fd			(-1),
+		sq_ring			(MAP_FAILED),
+		sq_ring_size	(0),
+		cq_ring			(MAP_FAILED),
+		cq_ring_size	(0),
+		sqes			((io_uring_sqe *) MAP_FAILED),
+		sqes_size		(0),
+		tail			(0),
+		published		(0),
+		buffers			(0),
+		buffer_memory	(0),
+		buffer_tail		(0),
+		buffers_free	(0),
+		wake_armed		(false),
+		woken			(false)
+	{
+	}
+
+	uring::~uring ()
+	{
+		if (ring_fd >= 0) {
+			// let the closes already asked for run; give up on output
+			// that a client won't take after a second
+			unsigned long long give_up = timer_wheel::now() + 1000;
+			bool cancelled = false;
+			while (!closing.empty() && timer_wheel::now() < give_up + 1000) {
+				if (!cancelled && timer_wheel::now() >= give_up) {
+					for (set<uring_channel *>::iterator i = closing.begin(); i != closing.end(); ++i) {
+						if ((*i)->send_armed) {
+							cancel (tag (*i, op_send));
+						}
+					}
+					cancelled = true;
+				}
+				submit (100);
+				take_completions();
+			}
+			for (set<uring_channel *>::iterator i = closing.begin(); i != closing.end(); ++i) {
+				delete *i;
+			}
+			::close (ring_fd);
+		}
+		if (sqes != MAP_FAILED) {
+			::munmap (sqes, sqes_size);
+		}
+		if (cq_ring != MAP_FAILED && cq_ring != sq_ring) {
+			::munmap (cq_ring, cq_ring_size);
+		}
+		if (sq_ring != MAP_FAILED) {
+			::munmap (sq_ring, sq_ring_size);
+		}
+		free (buffers);
+		free (buffer_memory);
+	}
+
+	bool uring::open (void)
+	{
+		struct io_uring_params p;
+		memset (&p, 0, sizeof (p));
+		p.flags = IORING_SETUP_CQSIZE;
+		p.cq_entries = ring_entries * 4;
+		ring_fd = sys_setup (ring_entries, &p);
+		if (ring_fd < 0) {
+			return false;
+		}
+		// timed waits need EXT_ARG (5.11); multishot accept and buffer rings need 5.19
+		if (!(p.features & IORING_FEAT_EXT_ARG) || !(p.features & IORING_FEAT_NODROP)) {
+			return false;
+		}
+
+		sq_ring_size = p.sq_off.array + p.sq_entries * sizeof (unsigned int);
+		cq_ring_size = p.cq_off.cqes + p.cq_entries * sizeof (struct io_uring_cqe);
+		if (p.features & IORING_FEAT_SINGLE_MMAP) {
+			sq_ring_size = cq_ring_size = max (sq_ring_size, cq_ring_size);
+		}
+		sq_ring = ::mmap (0, sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+		if (sq_ring == MAP_FAILED) {
+			return false;
+		}
+		if (p.features & IORING_FEAT_SINGLE_MMAP) {
+			cq_ring = sq_ring;
+		} else {
+			cq_ring = ::mmap (0, cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_CQ_RING);
+			if (cq_ring == MAP_FAILED) {
+				return false;
+			}
+		}
+		sqes_size = p.sq_entries * sizeof (struct io_uring_sqe);
+		sqes = (io_uring_sqe *) ::mmap (0, sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES);
+		if (sqes == MAP_FAILED) {
+			return false;
+		}
+
+		char * sq = (char *) sq_ring;
+		sq_head = (unsigned int *) (sq + p.sq_off.head);
+		sq_tail = (unsigned int *) (sq + p.sq_off.tail);
+		sq_mask = *(unsigned int *) (sq + p.sq_off.ring_mask);
+		sq_entries = p.sq_entries;
+		sq_array = (unsigned int *) (sq + p.sq_off.array);
+		char * cq = (char *) cq_ring;
+		cq_head = (unsigned int *) (cq + p.cq_off.head);
+		cq_tail = (unsigned int *) (cq + p.cq_off.tail);
+		cq_mask = *(unsigned int *) (cq + p.cq_off.ring_mask);
+		cqes = (io_uring_cqe *) (cq + p.cq_off.cqes);
+
+		// sqes are used in ring order, so the index array never changes
+		for (unsigned int i = 0; i < sq_entries; i++) {
+			sq_array[i] = i;
+		}
+		tail = published = *sq_tail;
+
+		if (posix_memalign ((void **) &buffers, (size_t) ::sysconf (_SC_PAGESIZE), buffer_count * sizeof (struct io_uring_buf)) != 0) {
+			buffers = 0;
+			return false;
+		}
+		memset (buffers, 0, buffer_count * sizeof (struct io_uring_buf));
+		buffer_memory = (char *) malloc ((size_t) buffer_count * buffer_size);
+		if (!buffer_memory) {
+			return false;
+		}
+		struct io_uring_buf_reg reg;
+		memset (&reg, 0, sizeof (reg));
+		reg.ring_addr = (unsigned long long) (size_t) buffers;
+		reg.ring_entries = buffer_count;
+		reg.bgid = buffer_group;
+		if (sys_register (ring_fd, IORING_REGISTER_PBUF_RING, &reg, 1) != 0) {
+			return false;
+		}
+		for (unsigned int i = 0; i < buffer_count; i++) {
+			recycle (i);
+		}
+		return true;
+	}
+
+	// ==================================================
+	// submission and completion
+	// ==================================================
+
+	unsigned int uring::sq_space (void) const
+	{
+		return sq_entries - (tail - __atomic_load_n (sq_head, __ATOMIC_ACQUIRE));
+	}
+
+	io_uring_sqe * uring::get_sqe (void)
+	{
+		while (!sq_space()) {
+			submit (0);
+			if (!sq_space()) {
+				// the kernel wants its completions taken first
+				take_completions();
+			}
+		}
+		io_uring_sqe * sqe = &sqes[tail & sq_mask];
+		memset (sqe, 0, sizeof (*sqe));
+		tail++;
+		return sqe;
+	}
+
+	void uring::submit (int milliseconds)
+	{
+		unsigned int count = tail - published;
+		if (!count && !milliseconds) {
+			return;
+		}
+		__atomic_store_n (sq_tail, tail, __ATOMIC_RELEASE);
+		published = tail;
+
+		if (!milliseconds) {
+			sys_enter (ring_fd, count, 0, 0, 0, 0);
+			return;
+		}
+
+		struct __kernel_timespec ts;
+		struct io_uring_getevents_arg arg;
+		memset (&arg, 0, sizeof (arg));
+		arg.sigmask_sz = _NSIG / 8;
+		if (milliseconds > 0) {
+			ts.tv_sec = milliseconds / 1000;
+			ts.tv_nsec = (long long) (milliseconds % 1000) * 1000000;
+			arg.ts = (unsigned long long) (size_t) &ts;
+		}
+		// a timeout, interruption or full completion queue all just return
+		sys_enter (ring_fd, count, 1, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof (arg));
+	}
+
+	void uring::take_completions (void)
+	{
+		unsigned int head = *cq_head;
+		unsigned int end = __atomic_load_n (cq_tail, __ATOMIC_ACQUIRE);
+		while (head != end) {
+			complete (&cqes[head & cq_mask]);
+			head++;
+			__atomic_store_n (cq_head, head, __ATOMIC_RELEASE);
+			if (head == end) {
+				end = __atomic_load_n (cq_tail, __ATOMIC_ACQUIRE);
+			}
+		}
+	}
+
+	bool uring::reap (void)
+	{
+		take_completions();
+		bool was_woken = woken;
+		woken = false;
+		return was_woken;
+	}
+
+	void uring::recycle (int buffer)
+	{
+		// not buffers->bufs: C++ sees the header's flexible array 8 bytes in
+		struct io_uring_buf * b = (struct io_uring_buf *) buffers + (buffer_tail & (buffer_count - 1));
+		b->addr = (unsigned long long) (size_t) (buffer_memory + (size_t) buffer * buffer_size);
+		b->len = buffer_size;
+		b->bid = (unsigned short) buffer;
+		buffer_tail++;
+		__atomic_store_n (&buffers->tail, buffer_tail, __ATOMIC_RELEASE);
+		buffers_free++;
+	}
+
+	void uring::complete (io_uring_cqe * cqe)
+	{
+		uring_channel * c = (uring_channel *) (size_t) (cqe->user_data & ~(unsigned long long) op_mask);
+		int op = (int) (cqe->user_data & op_mask);
+		int res = cqe->res;
+
+		if (cqe->flags & IORING_CQE_F_BUFFER) {
+			buffers_free--;
+		}
+
+		switch (op) {
+		case op_wake:
+			wake_armed = false;
+			woken = true;
+			return;
+
+		case op_cancel:
+			return;
+
+		case op_accept:
+			if (res >= 0) {
+				if (c->owner) {
+					c->accepted.push_back (res);
+				} else {
+					::close (res);
+				}
+			}
+			if (!(cqe->flags & IORING_CQE_F_MORE)) {
+				// cancelled, or out of file descriptors: armed again by service
+				c->accept_armed = false;
+				mark_ready (c);
+				release (c);
+			} else {
+				mark_ready (c);
+			}
+			return;
+
+		case op_poll:
+			c->poll_armed = false;
+			c->connect_ready = true;
+			mark_ready (c);
+			release (c);
+			return;
+
+		case op_recv:
+			c->recv_armed = false;
+			if (cqe->flags & IORING_CQE_F_BUFFER) {
+				int buffer = (int) (cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+				if (res > 0 && c->owner) {
+					c->buffer = buffer;
+					c->offset = 0;
+					c->length = (unsigned int) res;
+				} else {
+					recycle (buffer);
+				}
+			}
+			if (res == 0) {
+				c->eof = true;
+			} else if (res < 0 && res != -ENOBUFS && res != -ECANCELED) {
+				// ENOBUFS: every buffer is held by a channel; armed again by service
+				c->error = -res;
+			}
+			mark_ready (c);
+			release (c);
+			return;
+
+		case op_send:
+			c->send_armed = false;
+			if (res < 0) {
+				// the output is lost; the channel finds out on its next send or receive
+				c->error = (res == -ECANCELED) ? EPIPE : -res;
+				c->sending.clear();
+				c->output.clear();
+				if (c->close_linked) {
+					// the close linked to it was cancelled too
+					c->close_linked = false;
+					close_fd (c, c->fd, false);
+				}
+			} else if (c->close_linked && (size_t) res < c->sending.length()) {
+				// a short send cancels the close linked to it, which only releases;
+				// the channel is closed, so the rest has nobody to go to
+				c->close_linked = false;
+				c->sending.clear();
+				c->output.clear();
+				close_fd (c, c->fd, false);
+			} else {
+				c->sending.erase (0, (size_t) res);
+				c->output.insert (0, c->sending);
+				c->sending.clear();
+			}
+			if (!c->output.empty() && !c->close_linked) {
+				start_send (c);
+			} else if (c->close_pending) {
+				c->close_pending = false;
+				close_fd (c, c->fd, false);
+			}
+			mark_ready (c);
+			release (c);
+			return;
+
+		case op_close:
+			// a linked close cancelled by its send is closed again by op_send
+			if (c) {
+				release (c);
+			}
+			return;
+		}
+	}
+
+	// ==================================================
+	// channels
+	// ==================================================
+
+	uring_channel * uring::attach (dispatcher * d)
+	{
+		if (!d->ring) {
+			d->ring = new uring_channel (d);
+		}
+		return d->ring;
+	}
+
+	void uring::release (uring_channel * c)
+	{
+		if (--c->refs == 0 && !c->owner) {
+			closing.erase (c);
+			delete c;
+		}
+	}
+
+	void uring::mark_ready (uring_channel * c)
+	{
+		if (c->owner && !c->ready) {
+			c->ready = true;
+			c->refs++;
+			ready.push_back (c);
+		}
+	}
+
+	void uring::arm_wake (int fd)
+	{
+		if (!wake_armed && fd != -1) {
+			io_uring_sqe * sqe = get_sqe();
+			sqe->opcode = IORING_OP_POLL_ADD;
+			sqe->fd = fd;
+			sqe->poll32_events = POLLIN;
+			sqe->user_data = op_wake;
+			wake_armed = true;
+		}
+	}
+
+	void uring::arm_accept (uring_channel * c)
+	{
+		io_uring_sqe * sqe = get_sqe();
+		sqe->opcode = IORING_OP_ACCEPT;
+		sqe->fd = c->fd;
+		sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+		sqe->user_data = tag (c, op_accept);
+		c->accept_armed = true;
+		c->refs++;
+	}
+
+	void uring::arm_recv (uring_channel * c)
+	{
+		io_uring_sqe * sqe = get_sqe();
+		sqe->opcode = IORING_OP_RECV;
+		sqe->fd = c->fd;
+		sqe->len = buffer_size;
+		sqe->flags = IOSQE_BUFFER_SELECT;
+		sqe->buf_group = buffer_group;
+		sqe->user_data = tag (c, op_recv);
+		c->recv_armed = true;
+		c->refs++;
+	}
+
+	void uring::arm_poll (uring_channel * c)
+	{
+		io_uring_sqe * sqe = get_sqe();
+		sqe->opcode = IORING_OP_POLL_ADD;
+		sqe->fd = c->fd;
+		sqe->poll32_events = POLLOUT;
+		sqe->user_data = tag (c, op_poll);
+		c->poll_armed = true;
+		c->refs++;
+	}
+
+	void uring::start_send (uring_channel * c)
+	{
+		c->sending.swap (c->output);
+		io_uring_sqe * sqe = get_sqe();
+		sqe->opcode = IORING_OP_SEND;
+		sqe->fd = c->fd;
+		sqe->addr = (unsigned long long) (size_t) c->sending.data();
+		sqe->len = (unsigned int) c->sending.length();
+		sqe->msg_flags = MSG_NOSIGNAL | MSG_WAITALL;
+		sqe->user_data = tag (c, op_send);
+		c->send_armed = true;
+		c->send_index = tail - 1;
+		c->refs++;
+		if (c->close_pending && sq_space()) {
+			c->close_pending = false;
+			close_fd (c, c->fd, true);
+		}
+	}
+
+	// close fd once the sqe before it (linked) or the ones already queued have run
+	void uring::close_fd (uring_channel * c, int fd, bool linked)
+	{
+		if (linked) {
+			sqes[(tail - 1) & sq_mask].flags |= IOSQE_IO_LINK;
+		}
+		io_uring_sqe * sqe = get_sqe();
+		sqe->opcode = IORING_OP_CLOSE;
+		sqe->fd = fd;
+		sqe->user_data = tag (c, op_close);
+		if (c) {
+			c->close_linked = linked;
+			c->refs++;
+		}
+	}
+
+	void uring::cancel (unsigned long long user_data)
+	{
+		io_uring_sqe * sqe = get_sqe();
+		sqe->opcode = IORING_OP_ASYNC_CANCEL;
+		sqe->fd = -1;
+		sqe->addr = user_data;
+		sqe->user_data = op_cancel;
+	}
+
+	bool uring::service (dispatcher * d)
+	{
+		uring_channel * c = attach (d);
+		c->refs++;		// d may close under us
+
+		if (d->accepting) {
+			// handle_accept takes one socket each time it is called
+			while (!c->accepted.empty() && !d->closed && d->readable()) {
+				size_t before = c->accepted.size();
+				d->handle_read_event();
+				if (c->accepted.size() == before) {
+					break;
+				}
+			}
+			if (!d->closed && !c->accept_armed && d->readable()) {
+				arm_accept (c);
+			}
+		} else if (!d->connected) {
+			if (c->connect_ready) {
+				c->connect_ready = false;
+				d->handle_write_event();
+			} else if (!c->poll_armed && d->writable()) {
+				arm_poll (c);
+			}
+		}
+
+		bool more = false;
+		if (d->connected && !d->accepting) {
+			// async_chat reads a little at a time; keep going while it takes some
+			while (!d->closed && (c->length || c->eof || c->error) && d->readable()) {
+				unsigned int before = c->length;
+				d->handle_read_event();
+				if (c->length == before) {
+					break;
+				}
+			}
+			if (!d->closed && d->writable() && c->queued() < send_window) {
+				d->handle_write_event();
+			}
+			if (!d->closed && !c->recv_armed && !c->length && !c->eof && !c->error
+				&& buffers_free > 0 && d->readable()) {
+				arm_recv (c);
+			}
+			more = !d->closed && c->length && d->readable();
+		}
+
+		release (c);
+		return more;
+	}
+
+	void uring::dispatch (void)
+	{
+		// services can make channels ready again; they wait for the next poll
+		batch.swap (ready);
+		for (size_t i = 0; i < batch.size(); i++) {
+			uring_channel * c = batch[i];
+			c->ready = false;
+			if (c->owner && !c->owner->closed) {
+				service (c->owner);
+			}
+			release (c);
+		}
+		batch.clear();
+	}
+
+	// ==================================================
+	// the dispatcher socket calls
+	// ==================================================
+
+	int uring::accept (dispatcher * d)
+	{
+		uring_channel * c = d->ring;
+		if (!c || c->accepted.empty()) {
+			errno = EAGAIN;
+			return -1;
+		}
+		int fd = c->accepted.front();
+		c->accepted.pop_front();
+		return fd;
+	}
+
+	int uring::recv (dispatcher * d, char * buffer, size_t size)
+	{
+		uring_channel * c = d->ring;
+		if (!c) {
+			errno = EAGAIN;
+			return -1;
+		}
+		if (c->length) {
+			size_t n = (size < c->length) ? size : c->length;
+			memcpy (buffer, buffer_memory + (size_t) c->buffer * buffer_size + c->offset, n);
+			c->offset += (unsigned int) n;
+			c->length -= (unsigned int) n;
+			if (!c->length) {
+				recycle (c->buffer);
+				c->buffer = -1;
+			}
+			return (int) n;
+		}
+		if (c->error) {
+			errno = c->error;
+			return -1;
+		}
+		if (c->eof) {
+			return 0;
+		}
+		errno = EAGAIN;
+		return -1;
+	}
+
+	int uring::send (dispatcher * d, const char * buffer, size_t size)
+	{
+		uring_channel * c = attach (d);
+		if (c->error) {
+			errno = c->error;
+			return -1;
+		}
+		size_t room = (c->queued() < send_window) ? send_window - c->queued() : 0;
+		if (!room) {
+			errno = EAGAIN;
+			return -1;
+		}
+		size_t n = (size < room) ? size : room;
+		c->output.append (buffer, n);
+		if (!c->send_armed) {
+			start_send (c);
+		}
+		return (int) n;
+	}
+
+	void uring::close (dispatcher * d)
+	{
+		uring_channel * c = d->ring;
+		if (!c) {
+			if (!d->closed) {
+				close_fd (0, d->get_fileno(), false);
+			}
+			return;
+		}
+
+		if (!c->send_armed) {
+			close_fd (c, c->fd, false);
+		} else if (c->output.empty() && c->send_index == tail - 1 && tail != published && sq_space()) {
+			// the usual case: the last of a response was sent just now
+			close_fd (c, c->fd, true);
+		} else {
+			c->close_pending = true;
+		}
+		detach (d);
+	}
+
+	void uring::detach (dispatcher * d)
+	{
+		uring_channel * c = d->ring;
+		if (!c) {
+			return;
+		}
+		d->ring = 0;
+		c->owner = 0;
+
+		// operations still armed would hold the socket open
+		if (c->accept_armed) {
+			cancel (tag (c, op_accept));
+		}
+		if (c->recv_armed) {
+			cancel (tag (c, op_recv));
+		}
+		if (c->poll_armed) {
+			cancel (tag (c, op_poll));
+		}
+		while (!c->accepted.empty()) {
+			::close (c->accepted.front());
+			c->accepted.pop_front();
+		}
+		if (c->buffer != -1) {
+			recycle (c->buffer);
+			c->buffer = -1;
+			c->length = 0;
+		}
+
+		if (c->refs) {
+			closing.insert (c);
+		} else {
+			delete c;
+		}
+	}
+
+} // namespace async_sockets
+
+#endif // __linux__
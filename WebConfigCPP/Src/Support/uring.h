@@ -0,0 +1,151 @@
+// -*- Mode: C++; tab-width: 4 -*-
+
+// io_uring backend for the reactor (linux only).  Channels keep their
+// callbacks: the ring does the accepts, receives, sends and closes, and
+// dispatcher::accept, recv, send and close trade in what it has done.
+
+#ifndef URING_H
+#define URING_H
+
+#ifdef __linux__
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <set>
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+struct io_uring_buf_ring;
+
+namespace async_sockets
+{
+
+	class dispatcher;
+
+	// what the ring knows of one socket.  it outlives a closed dispatcher
+	// until the operations on the socket have completed.
+	struct uring_channel {
+		uring_channel (dispatcher * d);
+
+		dispatcher * owner;		// 0 once closed
+		int fd;
+		int refs;				// operations in flight, and services under way
+
+		bool accept_armed;
+		std::deque<int> accepted;	// sockets accepted but not yet taken by accept()
+
+		bool poll_armed;		// waiting for a connect to finish
+		bool connect_ready;
+
+		bool recv_armed;
+		int buffer;				// provided buffer holding received data, or -1
+		unsigned int offset;
+		unsigned int length;
+		bool eof;
+		int error;				// errno of a failed receive or send
+
+		bool send_armed;
+		unsigned int send_index;	// sq index of the send, to link a close to it
+		std::string sending;	// the send in flight
+		std::string output;		// queued behind it
+
+		bool close_pending;		// close once the output is sent
+		bool close_linked;		// a close is linked to the send in flight
+
+		bool ready;				// on the ready list
+
+		size_t queued (void) const { return sending.length() + output.length(); }
+	};
+
+	class uring {
+	public:
+		uring ();
+		~uring ();
+
+		// set up the ring; false if the kernel lacks what we need
+		bool open (void);
+
+		// deliver what has arrived for d, start its output and arm its
+		// accept or receive.  true if d still has data it could take.
+		bool service (dispatcher * d);
+
+		// submit what is queued and wait up to milliseconds (-1 forever,
+		// 0 not at all) for something to complete
+		void submit (int milliseconds);
+
+		// take completions; true if the wake fd was signalled
+		bool reap (void);
+
+		// service the channels that completions were for
+		void dispatch (void);
+
+		// watch the read end of the reactor's wake pipe
+		void arm_wake (int fd);
+
+		// the dispatcher socket calls
+		int accept (dispatcher * d);
+		int recv (dispatcher * d, char * buffer, size_t size);
+		int send (dispatcher * d, const char * buffer, size_t size);
+		void close (dispatcher * d);
+		void detach (dispatcher * d);
+
+	private:
+		int ring_fd;
+		void * sq_ring;
+		size_t sq_ring_size;
+		void * cq_ring;
+		size_t cq_ring_size;
+		io_uring_sqe * sqes;
+		size_t sqes_size;
+
+		unsigned int * sq_head;
+		unsigned int * sq_tail;
+		unsigned int sq_mask;
+		unsigned int sq_entries;
+		unsigned int * sq_array;
+		unsigned int * cq_head;
+		unsigned int * cq_tail;
+		unsigned int cq_mask;
+		io_uring_cqe * cqes;
+
+		unsigned int tail;			// sq tail, published to the kernel by submit
+		unsigned int published;
+
+		io_uring_buf_ring * buffers;	// provided buffers for receives
+		char * buffer_memory;
+		unsigned short buffer_tail;
+		int buffers_free;
+
+		bool wake_armed;
+		bool woken;
+		std::vector<uring_channel *> ready;
+		std::vector<uring_channel *> batch;
+		std::set<uring_channel *> closing;	// closed, with operations still in flight
+
+		uring_channel * attach (dispatcher * d);
+		void release (uring_channel * c);
+		void mark_ready (uring_channel * c);
+		void complete (io_uring_cqe * cqe);
+		void take_completions (void);
+
+		io_uring_sqe * get_sqe (void);
+		unsigned int sq_space (void) const;
+		void recycle (int buffer);
+
+		void arm_accept (uring_channel * c);
+		void arm_recv (uring_channel * c);
+		void arm_poll (uring_channel * c);
+		void start_send (uring_channel * c);
+		void close_fd (uring_channel * c, int fd, bool linked);
+		void cancel (unsigned long long user_data);
+
+		uring (const uring&);
+		uring& operator= (const uring&);
+	};
+
+} // namespace async_sockets
+
+#endif // __linux__
+
+#endif // URING_H
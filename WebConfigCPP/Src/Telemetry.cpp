@@ -0,0 +1,213 @@
+// WebConfig - Use a web browser to configure your application
+// Copyright (c) 2009 David McClurg <dpm@efn.org>
+// Under the MIT License, details: License.txt.
+
+#include "Telemetry.h"
+#include "Support/Atomic.h"
+#include "Support/Clock.h"
+
+#include <math.h>
+
+using namespace std;
+
+namespace WebConfig
+{
+	Telemetry::Producer::Producer()
+	{
+		head = 0;
+		tail = 0;
+		knownTail = 0;
+		dropped = 0;
+	}
+
+	/// <summary>
+	/// Add a sample taken now
+	/// </summary>
+	bool Telemetry::Producer::Push(double value)
+	{
+		return Push(value, Clock::Seconds());
+	}
+
+	/// <summary>
+	/// Add a sample taken at a time
+	/// </summary>
+	bool Telemetry::Producer::Push(double value, double time)
+	{
+		long long n = head;
+		if (n - knownTail >= ProducerSize)
+		{
+			// looks full; see how far the aggregator has got
+			knownTail = Atomic::Load(tail);
+			if (n - knownTail >= ProducerSize)
+			{
+				Atomic::Add(dropped, 1);
+				return false;
+			}
+		}
+		Sample& sample = samples[n & (ProducerSize - 1)];
+		sample.Time = time;
+		sample.Value = value;
+		Atomic::Store(head, n + 1);
+		return true;
+	}
+
+	/// <summary>
+	/// Get the number of samples dropped
+	/// </summary>
+	long long Telemetry::Producer::GetDropped() const
+	{
+		return Atomic::Load(dropped);
+	}
+
+	/// <summary>
+	/// Constructor
+	/// </summary>
+	Telemetry::Telemetry(const string& name, double resolution)
+	{
+		this->name = name;
+		this->resolution = (resolution > 0)? resolution: 0.001;
+
+		Slot empty;
+		empty.Index = -1;
+		empty.Min = 0;
+		empty.Max = 0;
+		empty.Sum = 0;
+		empty.Count = 0;
+		double width = this->resolution;
+		for (int i = 0; i < LevelCount; i++)
+		{
+			levels[i].assign(LevelSize, empty);
+			newest[i] = -1;
+			widths[i] = width;
+			width *= LevelScale;
+		}
+	}
+
+	Telemetry::~Telemetry()
+	{
+		for (unsigned int i = 0; i < producers.size(); i++)
+			delete producers[i];
+	}
+
+	/// <summary>
+	/// Get a producer for the calling thread
+	/// </summary>
+	Telemetry::Producer* Telemetry::AddProducer()
+	{
+		Producer* producer = new Producer;
+		MutexLock hold(lock);
+		producers.push_back(producer);
+		return producer;
+	}
+
+	/// <summary>
+	/// Fold the samples pushed so far into the buckets
+	/// </summary>
+	int Telemetry::Drain()
+	{
+		MutexLock hold(lock);
+		int folded = 0;
+		for (unsigned int i = 0; i < producers.size(); i++)
+		{
+			Producer& producer = *producers[i];
+			long long end = Atomic::Load(producer.head);
+			for (long long n = producer.tail; n < end; n++)
+			{
+				const Producer::Sample& sample = producer.samples[n & (ProducerSize - 1)];
+				Add(sample.Time, sample.Value);
+			}
+			folded += (int)(end - producer.tail);
+
+			// the producer may reuse the slots from here on
+			Atomic::Store(producer.tail, end);
+		}
+		return folded;
+	}
+
+	/// <summary>
+	/// Add a sample to its bucket at every level
+	/// </summary>
+	void Telemetry::Add(double time, double value)
+	{
+		for (int i = 0; i < LevelCount; i++)
+		{
+			long long index = (long long)floor(time / widths[i]);
+
+			// older than anything this level still holds
+			if (index <= newest[i] - LevelSize)
+				continue;
+
+			Slot& slot = levels[i][(size_t)(index % LevelSize)];
+			if (slot.Index != index)
+			{
+				slot.Index = index;
+				slot.Min = value;
+				slot.Max = value;
+				slot.Sum = 0;
+				slot.Count = 0;
+			}
+			if (value < slot.Min)
+				slot.Min = value;
+			if (value > slot.Max)
+				slot.Max = value;
+			slot.Sum += value;
+			slot.Count++;
+			if (index > newest[i])
+				newest[i] = index;
+		}
+	}
+
+	/// <summary>
+	/// Get the buckets between two times
+	/// </summary>
+	double Telemetry::Query(double start, double end, int count, vector<Bucket>& buckets) const
+	{
+		if (count < 1)
+			count = 1;
+
+		MutexLock hold(lock);
+		int level = 0;
+		for (; level < LevelCount - 1; level++)
+		{
+			long long first = (long long)floor(start / widths[level]);
+			bool fits = (end - start) / widths[level] <= count;
+			bool holds = newest[level] < 0 || first > newest[level] - LevelSize;
+			if (fits && holds)
+				break;
+		}
+
+		double width = widths[level];
+		long long first = (long long)floor(start / width);
+		long long last = (long long)floor(end / width);
+		if (first <= newest[level] - LevelSize)
+			first = newest[level] - LevelSize + 1;
+		for (long long index = first; index <= last && index <= newest[level]; index++)
+		{
+			if (index < 0)
+				continue;
+			const Slot& slot = levels[level][(size_t)(index % LevelSize)];
+			if (slot.Index != index || slot.Count == 0)
+				continue;
+			Bucket bucket;
+			bucket.Time = index * width;
+			bucket.Min = slot.Min;
+			bucket.Max = slot.Max;
+			bucket.Mean = slot.Sum / slot.Count;
+			bucket.Count = slot.Count;
+			buckets.push_back(bucket);
+		}
+		return width;
+	}
+
+	/// <summary>
+	/// Get the number of samples dropped by all producers
+	/// </summary>
+	long long Telemetry::GetDropped() const
+	{
+		MutexLock hold(lock);
+		long long total = 0;
+		for (unsigned int i = 0; i < producers.size(); i++)
+			total += producers[i]->GetDropped();
+		return total;
+	}
+}
@@ -0,0 +1,151 @@
+// WebConfig - Use a web browser to configure your application
+// Copyright (c) 2009 David McClurg <dpm@efn.org>
+// Under the MIT License, details: License.txt.
+
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include "Support/Thread.h"
+
+#include <string>
+#include <vector>
+
+namespace WebConfig
+{
+	/// <summary>
+	/// A signal sampled faster than the frame rate, eg. physics substeps or
+	/// audio levels. Each producing thread pushes samples into a ring of its
+	/// own without locking; the aggregator thread folds them into min, max
+	/// and mean buckets at LevelCount resolutions, each LevelScale times
+	/// coarser than the last. Any window can then be drawn from the level
+	/// nearest to screen resolution, and memory stays the same however long
+	/// the session runs: old buckets fall off the fine levels first.
+	/// </summary>
+	class Telemetry
+	{
+	public:
+
+		enum
+		{
+			ProducerSize = 8192,	// samples a producer holds between drains; a power of two
+			LevelCount = 12,
+			LevelScale = 4,
+			LevelSize = 1024		// buckets kept at each level
+		};
+
+		/// <summary>
+		/// Samples in an interval; Time is its start in Clock::Seconds
+		/// </summary>
+		struct Bucket
+		{
+			double Time;
+			double Min;
+			double Max;
+			double Mean;
+			int Count;
+		};
+
+		/// <summary>
+		/// Where one thread pushes its samples
+		/// </summary>
+		class Producer
+		{
+			friend class Telemetry;
+
+			struct Sample
+			{
+				double Time;
+				double Value;
+			};
+
+			Sample samples[ProducerSize];
+			volatile long long head;	// samples ever pushed; written by the producer
+			volatile long long tail;	// samples ever drained; written by the aggregator
+			long long knownTail;		// the producer's last look at tail
+			volatile long long dropped;
+
+			Producer();
+
+		public:
+
+			/// <summary>
+			/// Add a sample taken now; call only from the thread that owns the producer
+			/// </summary>
+			/// <returns>false if the ring was full and the sample was dropped</returns>
+			bool Push(double value);
+
+			/// <summary>
+			/// Add a sample taken at a time in Clock::Seconds
+			/// </summary>
+			bool Push(double value, double time);
+
+			/// <summary>
+			/// Get the number of samples dropped because the aggregator fell behind
+			/// </summary>
+			long long GetDropped() const;
+		};
+
+		/// <summary>
+		/// Constructor
+		/// </summary>
+		/// <param name="name">name the signal is served under</param>
+		/// <param name="resolution">width of the finest buckets in seconds</param>
+		Telemetry(const std::string& name, double resolution);
+		~Telemetry();
+
+		/// <summary>
+		/// Get a producer for the calling thread; each thread that pushes
+		/// samples needs its own. It lives as long as the telemetry.
+		/// </summary>
+		Producer* AddProducer();
+
+		/// <summary>
+		/// Fold the samples pushed so far into the buckets; called by the aggregator
+		/// </summary>
+		/// <returns>number of samples folded</returns>
+		int Drain();
+
+		/// <summary>
+		/// Get the buckets between two times from the finest level that fits
+		/// them in count buckets and still holds start. Empty buckets are
+		/// left out.
+		/// </summary>
+		/// <returns>width of the buckets in seconds</returns>
+		double Query(double start, double end, int count, std::vector<Bucket>& buckets) const;
+
+		const std::string& GetName() const { return name; }
+		double GetResolution() const { return resolution; }
+
+		/// <summary>
+		/// Get the number of samples dropped by all producers
+		/// </summary>
+		long long GetDropped() const;
+
+	private:
+
+		struct Slot
+		{
+			long long Index;	// which interval of the level this slot holds
+			double Min;
+			double Max;
+			double Sum;
+			int Count;
+		};
+
+		std::string name;
+		double resolution;
+
+		mutable Mutex lock;					// guards producers and levels
+		std::vector<Producer*> producers;
+		std::vector<Slot> levels[LevelCount];	// LevelSize slots each, by Index % LevelSize
+		long long newest[LevelCount];		// highest Index seen at each level
+		double widths[LevelCount];
+
+		void Add(double time, double value);
+
+		Telemetry(const Telemetry&);
+		Telemetry& operator=(const Telemetry&);
+	};
+}
+
+#endif // #ifndef TELEMETRY_H
@@ -7,6 +7,7 @@
 #include "HTMLBuilder.h"
 #include "HTTPServer.h"
 #include "Support/Convert.h"
+#include "Support/Atomic.h"
 
 #include <vector>
 #include <iostream>
@@ -142,7 +143,7 @@ namespace WebConfig
 		string temp = GetExtraAttributes() + b.attr("type", "radio") + b.attr("name", UniqueID);
 		if (pForm->AutoSubmit)
 		{
-			temp += b.attr("onclick", "this.form.submit();");
+			temp += b.attr("onclick", "webconfigSend(this);");
 		}
 		string at[2];
 		at[1] = temp + b.attr("value", "True");
@@ -171,7 +172,7 @@ namespace WebConfig
 		string attr = b.attr("name", UniqueID) + b.attr("style", "width: 300px");
 		if (pForm->AutoSubmit)
 		{
-			attr += b.attr("onchange", "this.form.submit();");
+			attr += b.attr("onchange", "webconfigSend(this);");
 		}
 		b.open("select", attr);
 
@@ -228,16 +229,16 @@ namespace WebConfig
 			b.attr("name", UniqueID) +
 			b.attr("id", displayID) +
 			b.attr("type", "text") +
-			b.attr("from", Convert::ToString(minValue)) +
-			b.attr("to", Convert::ToString(maxValue)) +
-			b.attr("value", Convert::ToString(value)) +
+			b.attr("from", b.fmt("%.*f", decimals, minValue)) +
+			b.attr("to", b.fmt("%.*f", decimals, maxValue)) +
+			b.attr("value", b.fmt("%.*f", decimals, value)) +
 			b.attr("valuecount", Convert::ToString(valueCount)) +
 			b.attr("decimals", Convert::ToString(decimals)) +
 			b.attr("typelock", "off") + GetExtraAttributes();
 
 		if (pForm->AutoSubmit)
 		{
-			attr += b.attr("onchange", "this.form.submit();");
+			attr += b.attr("onchange", "webconfigSend(this);");
 		}
 		b.open("input", attr);
 
@@ -246,4 +247,103 @@ namespace WebConfig
 		b.close("div");
 		return b.ToString();
 	}
+
+	/// <summary>
+	/// Constructor
+	/// </summary>
+	/// <param name="path">path is "form-name/label-text"</param>
+	InputWatchBase::InputWatchBase(string path) : InputBase(path)
+	{
+		ReadOnly = true;
+		count = 0;
+		for (int i = 0; i < SampleCount; i++)
+			samples[i] = 0;
+
+		// Update samples the watches it knows about
+		WebConfig::Manager::Instance().AddWatch(this);
+	}
+
+	/// <summary>
+	/// Add a sample, replacing the oldest once the ring is full
+	/// </summary>
+	void InputWatchBase::Record(double value)
+	{
+		long long n = count;
+		samples[n & (SampleCount - 1)] = value;
+
+		// readers only look at samples below count
+		Atomic::Store(count, n + 1);
+	}
+
+	/// <summary>
+	/// Copy the samples taken since a cursor
+	/// </summary>
+	long long InputWatchBase::GetSamples(long long cursor, vector<double>& result) const
+	{
+		long long end = Atomic::Load(count);
+		long long start = end - SampleCount;
+		if (start < cursor)
+			start = cursor;
+		if (start > end || start < 0)
+			start = (end > SampleCount)? end - SampleCount: 0;
+
+		vector<double> copied;
+		for (long long i = start; i < end; i++)
+			copied.push_back(samples[i & (SampleCount - 1)]);
+
+		// drop any the sampler wrote over while they were copied
+		long long overwritten = Atomic::Load(count) - SampleCount + 1;
+		size_t skip = (overwritten > start)? (size_t)(overwritten - start): 0;
+		if (skip < copied.size())
+			result.insert(result.end(), copied.begin() + skip, copied.end());
+		return end;
+	}
+
+	/// <summary>
+	/// Get html representation
+	/// </summary>
+	/// <returns>html</returns>
+	string InputWatchBase::ToHtml()
+	{
+		HtmlBuilder b;
+		b.open("tr");
+		b.open("th"); b.append(b.text(Label + ":")); b.close("th");
+		b.open("td");
+
+		// slider.js draws the samples and keeps them coming
+		b.open("canvas", b.attr("class", "webconfig_watch") +
+			b.attr("id", UniqueID) +
+			b.attr("width", "300") +
+			b.attr("height", "40") +
+			(Title.empty()? "": b.attr("title", Title)));
+		b.close("canvas");
+		b.open("span", b.attr("id", UniqueID + "_value"));
+		b.close("span");
+		return b.ToString();
+	}
+
+	/// <summary>
+	/// Get html representation
+	/// </summary>
+	/// <returns>html</returns>
+	string InputTelemetry::ToHtml()
+	{
+		HtmlBuilder b;
+		b.open("tr");
+		b.open("th"); b.append(b.text(Label + ":")); b.close("th");
+		b.open("td");
+
+		// slider.js fetches and draws the buckets
+		b.open("canvas", b.attr("class", "webconfig_telemetry") +
+			b.attr("id", UniqueID) +
+			b.attr("telemetry", name) +
+			b.attr("window", Convert::ToString(window)) +
+			b.attr("width", "300") +
+			b.attr("height", "60") +
+			(Title.empty()? "": b.attr("title", Title)));
+		b.close("canvas");
+		b.open("span", b.attr("id", UniqueID + "_value"));
+		b.close("span");
+		return b.ToString();
+	}
 }
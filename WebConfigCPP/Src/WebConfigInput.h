@@ -20,12 +20,23 @@ namespace WebConfig
 		std::string Name;
         bool AutoSubmit;   // submit onchange or onclick
         bool AutoSave;     // save inputs to disk
+        unsigned int Version;  // changes whenever the generated page would
 
 		FormSettings(std::string name)
         {
             Name = name;
 			AutoSubmit = false;
 			AutoSave = false;
+			Version = 0;
+        }
+
+        /// <summary>
+        /// Mark the form as changed so browsers fetch it again; call this
+        /// after the application changes bound values itself
+        /// </summary>
+        void Invalidate()
+        {
+            ++Version;
         }
     };
 
@@ -68,6 +79,11 @@ namespace WebConfig
         /// <param name="setValue">lambda expression to set value</param>
         InputBase(std::string path);
 
+        /// <summary>
+        /// Destructor; inputs may be deleted through a base pointer
+        /// </summary>
+        virtual ~InputBase() {}
+
         /// <summary>
         /// set the input value
         /// </summary>
@@ -90,6 +106,15 @@ namespace WebConfig
 		{
 			OnChange = callback;
 		}
+
+        /// <summary>
+        /// true if every post should fire the callback, even
+        /// when the value is unchanged (eg. buttons)
+        /// </summary>
+		virtual bool AlwaysNotify()
+		{
+			return false;
+		}
 	};
 
 	/// <summary>
@@ -147,6 +172,14 @@ namespace WebConfig
 			SetCallback(onPress);
 		}
 
+		/// <summary>
+		/// a press has no value; every post is a press
+		/// </summary>
+		virtual bool AlwaysNotify()
+		{
+			return true;
+		}
+
 		/// <summary>
 		/// set the input value
 		/// </summary>
@@ -290,6 +323,14 @@ namespace WebConfig
 			options.push_back(option);
 		}
 
+		/// <summary>
+		/// Remove all the options
+		/// </summary>
+		void ClearOptions()
+		{
+			options.clear();
+		}
+
 		/// <summary>
 		/// set the input value
 		/// </summary>
@@ -400,6 +441,162 @@ namespace WebConfig
 			m_iValue = Convert::ToInt(value);
 			InputSlider::SetValue(Convert::ToString(m_iValue));
 		}
+
+		/// <summary>
+		/// get the input value; as a float it would lose digits past a million
+		/// </summary>
+		virtual std::string ToString()
+		{
+			return Convert::ToString(m_iValue);
+		}
+
+		/// <summary>
+		/// Get html representation of the bound int, which the application may have changed
+		/// </summary>
+		/// <returns>html</returns>
+		virtual std::string ToHtml()
+		{
+			m_fValue = (float)m_iValue;
+			return InputSlider::ToHtml();
+		}
+	};
+
+	/// <summary>
+	/// This class represents a read-only graph of a value over time. The
+	/// value is sampled each Update into a ring of the last SampleCount
+	/// samples; the form draws them as a sparkline and fetches only the
+	/// samples it hasn't seen from /api/watch.
+	/// </summary>
+	class InputWatchBase : public InputBase
+	{
+	public:
+		enum { SampleCount = 256 };	// a power of two
+
+		/// <summary>
+		/// Constructor
+		/// </summary>
+		/// <param name="path">path is "form-name/label-text"</param>
+		InputWatchBase(std::string path);
+
+		/// <summary>
+		/// Add the bound value to the ring; called by Update
+		/// </summary>
+		virtual void Sample() = 0;
+
+		/// <summary>
+		/// Copy the samples taken since a cursor; safe on any thread
+		/// </summary>
+		/// <param name="cursor">cursor returned by the last call, or 0</param>
+		/// <param name="samples">receives the samples, oldest first</param>
+		/// <returns>cursor for the next call</returns>
+		long long GetSamples(long long cursor, std::vector<double>& samples) const;
+
+		/// <summary>
+		/// a watch has no value to set
+		/// </summary>
+		virtual void SetValue(std::string value)
+		{
+		}
+
+		/// <summary>
+		/// the samples are read through GetSamples; a value here would
+		/// change every frame and the form with it
+		/// </summary>
+		virtual std::string ToString()
+		{
+			return "";
+		}
+
+		/// <summary>
+		/// Get html representation
+		/// </summary>
+		/// <returns>html</returns>
+		virtual std::string ToHtml();
+
+	protected:
+		/// <summary>
+		/// Add a sample, replacing the oldest once the ring is full
+		/// </summary>
+		void Record(double value);
+
+	private:
+		double samples[SampleCount];
+		volatile long long count;	// samples ever taken; only the sampling thread writes it
+	};
+
+	/// <summary>
+	/// Watch a variable of any type that converts to double
+	/// </summary>
+	template <class T>
+	class InputWatch : public InputWatchBase
+	{
+		const T& m_value;
+
+	public:
+
+		InputWatch(std::string path, const T& value) : InputWatchBase(path), m_value(value)
+		{
+		}
+
+		/// <summary>
+		/// Add the bound value to the ring
+		/// </summary>
+		virtual void Sample()
+		{
+			Record((double)m_value);
+		}
+	};
+
+	/// <summary>
+	/// This class represents a graph of a telemetry signal: the min to max
+	/// band and mean over the last few seconds, fetched at the width of the
+	/// graph from /api/telemetry
+	/// </summary>
+	class InputTelemetry : public InputBase
+	{
+		std::string name;
+		double window;
+
+	public:
+		/// <summary>
+		/// Constructor
+		/// </summary>
+		/// <param name="path">path is "form-name/label-text"</param>
+		/// <param name="telemetryName">name the signal was added under</param>
+		InputTelemetry(std::string path, std::string telemetryName) : InputBase(path), name(telemetryName)
+		{
+			ReadOnly = true;
+			window = 10;
+		}
+
+		/// <summary>
+		/// Set how many seconds back the graph shows
+		/// </summary>
+		void SetWindow(double seconds)
+		{
+			window = seconds;
+		}
+
+		/// <summary>
+		/// a graph has no value to set
+		/// </summary>
+		virtual void SetValue(std::string value)
+		{
+		}
+
+		/// <summary>
+		/// get the input value
+		/// </summary>
+		virtual std::string ToString()
+		{
+			return "";
+		}
+
+		/// <summary>
+		/// Get html representation
+		/// </summary>
+		/// <returns>html</returns>
+		virtual std::string ToHtml();
 	};
 }
 
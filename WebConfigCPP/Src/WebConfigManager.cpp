@@ -6,23 +6,54 @@
 #include "HTMLBuilder.h"
 #include "WebConfigInput.h"
 #include "WebConfigManager.h"
-#include "Support/HTTPUtility.h"
+#include "AssetCache.h"
+#include "ScreenCapture.h"
+#include "ImageStream.h"
+#include "Telemetry.h"
+#include "ChangeLog.h"
+#include "Support/HttpUtility.h"
 #include "Support/Convert.h"
 #include "Support/StringHelper.h"
 #include "Support/Path.h"
 #include "Support/IniFile.h"
+#include "Support/Json.h"
+#include "Support/Clock.h"
+#include "Support/Thread.h"
+#include "Support/Trace.h"
 
 #include <map>
 #include <vector>
 #include <set>
+#include <algorithm>
 
 #include <assert.h>
 #include <stdio.h>
+#include <time.h>
 
 using namespace std;
 
 namespace WebConfig
 {
+    /// <summary>
+    /// Form showing the frame stats, and how often it is refreshed in seconds
+    /// </summary>
+    static const char* const StatsForm = "webconfig stats";
+    static const double StatsInterval = 0.5;
+
+    /// <summary>
+    /// Milliseconds between folds of telemetry samples, and the window and
+    /// bucket count a telemetry query gets by default
+    /// </summary>
+    static const int TelemetryInterval = 20;
+    static const double TelemetryWindow = 10;
+    static const int TelemetryBuckets = 300;
+
+    /// <summary>
+    /// Form with the preset controls, and the file in the root folder presets are kept in
+    /// </summary>
+    static const char* const PresetForm = "webconfig presets";
+    static const char* const PresetFile = "/WebConfigPresets.json";
+
     /// <summary>
     /// This class is an http server and manages the list of inputs
     /// </summary>
@@ -41,6 +72,79 @@ namespace WebConfig
             SavedValue(string id, string v) { UniqueID = id; Value = v; }
         };
 
+        /// <summary>
+        /// Inputs and forms as they were at one moment. Pages and api responses
+        /// are built from one so reactor threads never touch the application's
+        /// variables; it is replaced, not changed, and freed by the last user.
+        /// </summary>
+        class Snapshot
+        {
+		public:
+            class Input
+            {
+			public:
+                string Form;
+                string Label;
+                string Value;
+                string Html;
+            };
+
+            class Form
+            {
+			public:
+                bool AutoSubmit;
+                bool AutoSave;
+                unsigned int Version;
+                int Inputs;
+            };
+
+            map<string, Input> Inputs;      // keyed by UniqueID
+            map<string, Form> Forms;        // keyed by Name
+            unsigned int MenuVersion;
+            int Refs;                       // guarded by snapshotLock
+        };
+
+        /// <summary>
+        /// Values posted on a reactor thread for Update to apply
+        /// </summary>
+        class PendingPost
+        {
+		public:
+            map<string, string> Values;
+            ChangeLog::Source From;
+            long long Ticket;       // the parked form post to answer once they are set, or 0
+        };
+
+        /// <summary>
+        /// Named values of a form's inputs, or of every input
+        /// </summary>
+        class Preset
+        {
+		public:
+            string Name;
+            string Form;                            // empty for every form
+            vector<pair<string, string> > Values;   // (UniqueID, value) in UniqueID order
+        };
+
+        /// <summary>
+        /// A preset change for Update to make at the frame boundary
+        /// </summary>
+        class PresetOp
+        {
+		public:
+            enum Kind
+            {
+                PRESET_SAVE,
+                PRESET_APPLY,
+                PRESET_DELETE,
+                PRESET_FLIP,
+                PRESET_AB
+            };
+            Kind What;
+            string Name;
+            string Other;   // form of PRESET_SAVE, B of PRESET_AB
+        };
+
         /// <summary>
         /// http server
         /// </summary>
@@ -61,16 +165,187 @@ namespace WebConfig
         /// </summary>
         vector<SavedValue> restoredInputs;
 
+        /// <summary>
+        /// inputs added since the last Update, to restore then; they are
+        /// added from the InputBase constructor, before they can take a value
+        /// </summary>
+        vector<InputBase*> addedInputs;
+
+        /// <summary>
+        /// OnChange callbacks to run during the next Update
+        /// </summary>
+        vector<InputBase::Callback> pendingCallbacks;
+
+        /// <summary>
+        /// Cache-Control header values keyed by url prefix; guarded by
+        /// cachePolicyLock, since reactor threads read them for every response
+        /// </summary>
+        map<string, string> cachePolicies;
+        Mutex cachePolicyLock;
+
+        /// <summary>
+        /// changes whenever the menu would; ie. inputs are added or removed
+        /// </summary>
+        unsigned int menuVersion;
+
+        /// <summary>
+        /// unique per run so entity tags from an earlier run never match
+        /// </summary>
+        string startupTag;
+
         /// <summary>
         /// root folder to serve content from
         /// </summary>
         string theFolder;
 
+        /// <summary>
+        /// static files from theFolder held in memory
+        /// </summary>
+        AssetCache assets;
+
+        /// <summary>
+        /// screen shots encoded off the frame thread and published to assets
+        /// </summary>
+        ScreenCapture capture;
+
+        /// <summary>
+        /// live previews; owned
+        /// </summary>
+        vector<ImageStream*> streams;
+
+        /// <summary>
+        /// high rate signals, owned, and the thread that aggregates them every
+        /// TelemetryInterval; telemetryLock guards the list, which reactor threads read
+        /// </summary>
+        vector<Telemetry*> telemetry;
+        Mutex telemetryLock;
+        Thread aggregator;
+        Semaphore stopAggregator;
+
+        /// <summary>
+        /// Update count, the change log and the frame it was opened on
+        /// </summary>
+        unsigned int frame;
+        ChangeLog changeLog;
+        unsigned int logFrame;
+
+        /// <summary>
+        /// changes being replayed, the next one due, and the frame replay began on
+        /// </summary>
+        vector<ChangeLog::Change> replay;
+        unsigned int replayNext;
+        unsigned int replayFrame;
+
+        /// <summary>
+        /// deflate level and size threshold for responses
+        /// </summary>
+        int compressionLevel;
+        size_t compressionThreshold;
+
+        /// <summary>
+        /// bounds on connections, queued output and request size
+        /// </summary>
+        HTTPServerLimits serverLimits;
+
+        /// <summary>
+        /// threads serving the port; 0 serves it from Update
+        /// </summary>
+        int reactorCount;
+
+        /// <summary>
+        /// print each request received
+        /// </summary>
+        bool logRequests;
+
+        /// <summary>
+        /// time spent in each part of Update, and the form showing it
+        /// </summary>
+        FrameStats frameStats;
+        vector<string> statsText;
+        vector<InputBase*> statsInputs;
+        double statsShown;
+
+        /// <summary>
+        /// what requests are answered from; replaced on the owner thread
+        /// </summary>
+        Snapshot* snapshot;
+        Mutex snapshotLock;
+
+        /// <summary>
+        /// values posted on reactor threads; the owner thread is their only writer
+        /// </summary>
+        vector<PendingPost> pendingPosts;
+        bool postsOpen;     // false once Shutdown begins, so no more are queued
+        long long lastTicket;
+        Mutex postLock;
+
+        /// <summary>
+        /// guards assets and the streams' latest frames, which reactor threads read
+        /// </summary>
+        Mutex assetLock;
+
+        /// <summary>
+        /// watches sampled each Update; changed on the owner thread under watchLock,
+        /// which reactor threads hold while reading samples
+        /// </summary>
+        vector<InputWatchBase*> watches;
+        Mutex watchLock;
+
+        /// <summary>
+        /// named presets, the one applied last and the two FlipPresets switches
+        /// between; changed on the owner thread under presetLock, which reactor
+        /// threads hold while reading them. Changes are queued in presetOps under
+        /// postLock and made at the start of the next Update.
+        /// </summary>
+        vector<Preset> presets;
+        string presetCurrent;
+        string presetA;
+        string presetB;
+        Mutex presetLock;
+        vector<PresetOp> presetOps;
+
+        /// <summary>
+        /// selects of the preset form and what its inputs are bound to
+        /// </summary>
+        InputSelect* presetChooser;
+        InputSelect* presetChooserA;
+        InputSelect* presetChooserB;
+        int presetChoice;
+        int presetChoiceA;
+        int presetChoiceB;
+        string presetName;
+        string presetFormName;
+
+        /// <summary>
+        /// the manager the preset form's callbacks act on
+        /// </summary>
+        static ManagerImpl* PresetOwner;
+
 		// private constructor
         ManagerImpl()
         {
 			theServer = NULL;
 			theFolder = "c:\\www\\";
+			menuVersion = 0;
+			compressionLevel = 6;
+			compressionThreshold = 512;
+			reactorCount = 0;
+			logRequests = true;
+			statsText.resize(FrameStats::SECTION_COUNT);
+			statsShown = 0;
+			frame = 0;
+			logFrame = 0;
+			replayNext = 0;
+			replayFrame = 0;
+			snapshot = NULL;
+			postsOpen = false;
+			lastTicket = 0;
+			presetChooser = NULL;
+			presetChooserA = NULL;
+			presetChooserB = NULL;
+			presetChoice = 0;
+			presetChoiceA = 0;
+			presetChoiceB = 0;
         }
 
         /// <summary>
@@ -99,7 +374,7 @@ namespace WebConfig
         /// Get menu with links to each form
         /// </summary>
         /// <returns>html</returns>
-        string GetMenuPage()
+        string GetMenuPage(const Snapshot& snap)
         {
             HtmlBuilder b;
             b.open("html");
@@ -113,9 +388,9 @@ namespace WebConfig
             b.open("table");
 
             set<string> uniqueNames;
-			for (map<string, InputBase*>::iterator i = inputs.begin(); i != inputs.end(); ++i)
+			for (map<string, Snapshot::Input>::const_iterator i = snap.Inputs.begin(); i != snap.Inputs.end(); ++i)
             {
-                string s = (*i).second->pForm->Name;
+                string s = (*i).second.Form;
                 if (uniqueNames.find(s) == uniqueNames.end())
                 {
                     uniqueNames.insert(s);
@@ -140,7 +415,7 @@ namespace WebConfig
         /// </summary>
         /// <param name="formName">name of form</param>
         /// <returns>html</returns>
-        string GetFormPage(string formName)
+        string GetFormPage(const Snapshot& snap, string formName)
         {
             HtmlBuilder b;
             b.open("html");
@@ -170,12 +445,11 @@ namespace WebConfig
                            b.attr("action", b.fmt("%s.cgi", formName.c_str())) +
                            b.attr("method", "post"));
             b.open("table");
-			for (map<string, InputBase*>::iterator i = inputs.begin(); i != inputs.end(); ++i)
+			for (map<string, Snapshot::Input>::const_iterator i = snap.Inputs.begin(); i != snap.Inputs.end(); ++i)
 			{
-                InputBase* input = (*i).second;
-                if (input->pForm->Name == formName)
+                if ((*i).second.Form == formName)
                 {
-                    b.append(input->ToHtml());
+                    b.append((*i).second.Html);
                 }
             }
             b.open("tr");
@@ -183,8 +457,8 @@ namespace WebConfig
             b.close("th");
             b.open("td");
 
-            FormSettings* form = GetFormSettings(formName);
-            if (!form->AutoSubmit)
+            map<string, Snapshot::Form>::const_iterator form = snap.Forms.find(formName);
+            if (form == snap.Forms.end() || !(*form).second.AutoSubmit)
             {
                 b.open("input", b.attr("type", "submit") + b.attr("value", "SUBMIT"));
                 b.close("input");
@@ -205,253 +479,1775 @@ namespace WebConfig
         }
 
         /// <summary>
-        /// Update the inputs from the client
+        /// Parse url encoded name-value pairs
         /// </summary>
+        /// <param name="data">form data like "a=1&b=2"</param>
         /// <param name="cgivars">name-value pairs</param>
-        void OnPost(map<string, string> cgivars)
+        void ParseFormData(const string& data, map<string, string>& cgivars)
         {
-			for (map<string, string>::iterator i = cgivars.begin(); i != cgivars.end(); ++i)
+            vector<string> settings;
+            StringHelper::Split(data, "&;", settings);
+            for (vector<string>::iterator i = settings.begin(); i != settings.end(); ++i)
             {
-				map<string, InputBase*>::iterator j = inputs.find((*i).first);
-                if (j != inputs.end())
+                const string& setting = (*i);
+                vector<string> nameValue;
+                StringHelper::Split(setting, "=", nameValue);
+                if (nameValue.size() == 2 && nameValue[1] != "")
                 {
-                    (*j).second->SetValue((*i).second);
-					if ((*j).second->OnChange != NULL)
-					{
-						(*(*j).second->OnChange)();
-					}
+                    string name = HttpUtility::UrlDecode(nameValue[0]);
+                    string value = HttpUtility::UrlDecode(nameValue[1]);
+                    cgivars[name] = value;
                 }
-			}
-		}
+            }
+        }
 
-		/// <summary>
-        /// Respond to HTTP requests
+        /// <summary>
+        /// Set the value of an input; if it changed the callback
+        /// is queued to run during the next Update
         /// </summary>
-        /// <param name="rq">request parameters</param>
-        /// <param name="rp">response parameters</param>
-        void OnResponse(const HTTPRequestParams& rq, HTTPResponse& rp)
+        /// <param name="input">form input</param>
+        /// <param name="value">new value as text</param>
+        /// <param name="from">where the value came from, for the change log</param>
+        /// <returns>true if the value changed</returns>
+        bool SetInputValue(InputBase* input, const string& value, ChangeLog::Source from)
         {
-            // Handle post
-            if (rq.Method == "POST")
+            string oldValue = input->ToString();
+            try
             {
-				map<string, string> cgivars;
-
-				string postStr = rq.BodyData; //Encoding.ASCII.GetString(rq.BodyData, 0, rq.BodySize);
-				vector<string> settings;
-				StringHelper::Split(postStr, "&;", settings);
-				for (vector<string>::iterator i = settings.begin(); i != settings.end(); ++i)
-                {
-					const string& setting = (*i);
-					vector<string> nameValue;
-					StringHelper::Split(setting, "=", nameValue);
-                    if (nameValue.size() == 2 && nameValue[1] != "")
-                    {
-						string name = HttpUtility::UrlDecode(nameValue[0]);
-                        string value = HttpUtility::UrlDecode(nameValue[1]);
-                        cgivars[name] = value;
-                    }
-                }
-
-                OnPost(cgivars);
-                // respond same as for GET
+                input->SetValue(value);
+            }
+            catch (Convert::BadConversion&)
+            {
+                return false;
             }
 
-            // handle top using frames
-            if (rq.URL == "/")
+            if (!input->AlwaysNotify() && input->ToString() == oldValue)
             {
-                string html = GetTopPage();
-                rp.BodyData = html; //Encoding.ASCII.GetBytes(html);
-                return;
+                return false;
             }
 
-            // handle generated menu and forms
-			if (Path::GetExtension(rq.URL) == ".cgi")
+            input->pForm->Invalidate();
+            QueueCallback(input->OnChange);
+            if (changeLog.IsOpen())
+                changeLog.Record(frame - logFrame, from, input->UniqueID, input->pForm->Name + "/" + input->Label, input->ToString());
+            return true;
+        }
+
+        /// <summary>
+        /// Queue a callback; it runs once per update no matter
+        /// how many inputs asked for it
+        /// </summary>
+        void QueueCallback(InputBase::Callback callback)
+        {
+            if (callback != NULL &&
+                find(pendingCallbacks.begin(), pendingCallbacks.end(), callback) == pendingCallbacks.end())
             {
-                if (rq.URL == "/menu.cgi")
-                {
-                    string html = GetMenuPage();
-                    rp.BodyData = html; //Encoding.ASCII.GetBytes(html);
-                }
-                else // contents
-                {
-					string formName = Path::GetFileNameWithoutExtension(rq.URL);
-                    string html = GetFormPage(formName);
-                    rp.BodyData = html; //Encoding.ASCII.GetBytes(html);
-                }
-                return;
+                pendingCallbacks.push_back(callback);
             }
+        }
 
-            string path = theFolder + rq.URL;
-			bool valid = (path.find("..") == string::npos); // make it secure
+        /// <summary>
+        /// Run the callbacks queued since the last update
+        /// </summary>
+        void DispatchCallbacks()
+        {
+            ScopedTimer timer(frameStats, FrameStats::SECTION_CALLBACKS);
 
-			if (valid && Path::DirectoryExists(path))
+            // callbacks may change more values
+            vector<InputBase::Callback> callbacks;
+            callbacks.swap(pendingCallbacks);
+            for (vector<InputBase::Callback>::iterator i = callbacks.begin(); i != callbacks.end(); ++i)
             {
-				if (Path::FileExists(path + "index.htm"))
-                    path += "\\index.htm";
-                else
-                {
-					vector<string> dirs, files;
-					Path::GetDirectories(path, dirs);
-					Path::GetFiles(path, files);
+                TraceScope trace("OnChange");
+                (*(*i))();
+            }
+        }
 
-                    HtmlBuilder b;
-                    b.open("html");
-                    b.open("head");
-                    b.close("head");
-                    b.open("body");
-                    b.open("h2");
-                    b.append(b.text("Folder listing for " + path.substr(theFolder.length() + 1)));
-                    b.close("h2");
-                    for (unsigned int i = 0; i < dirs.size(); i++)
-                    {
-						b.link(rq.URL + "/" + Path::GetFileName(dirs[i]),
-							"[" + Path::GetFileName(dirs[i]) + "]");
-                        b.br();
-                    }
-                    for (unsigned int i = 0; i < files.size(); i++)
+        /// <summary>
+        /// Update the inputs from the client
+        /// </summary>
+        /// <param name="cgivars">name-value pairs</param>
+        /// <param name="from">where the values came from</param>
+        void OnPost(const map<string, string>& cgivars, ChangeLog::Source from)
+        {
+            ScopedTimer timer(frameStats, FrameStats::SECTION_CALLBACKS);
+			for (map<string, string>::const_iterator i = cgivars.begin(); i != cgivars.end(); ++i)
+            {
+				map<string, InputBase*>::iterator j = inputs.find((*i).first);
+                if (j != inputs.end())
+                {
+                    InputBase* input = (*j).second;
+                    if (SetInputValue(input, (*i).second, from) && !input->AlwaysNotify())
                     {
-						b.link(rq.URL + "/" + Path::GetFileName(files[i]),
-							"[" + Path::GetFileName(files[i]) + "]");
-                        b.br();
+                        PushValue(input);
                     }
-                    rp.BodyData = b.ToString(); //Encoding.ASCII.GetBytes(b.ToString());
-                    return;
                 }
-            }
-
-			if (valid && Path::FileExists(path))
-            {
-#if 0
-                RegistryKey rk = Registry.ClassesRoot.OpenSubKey(Path.GetExtension(path), true);
-
-                // Get the data from a specified item in the key.
-                String s = (String)rk.GetValue("Content Type");
-#else
-				string fileExtension = StringHelper::tolower(Path::GetExtension(path));
+			}
+		}
 
-				string s = "";
-				if (fileExtension == ".css")
-					s = "text/css";
-				else if (fileExtension == ".js")
-					s = "text/javascript";
-				else if (fileExtension == ".htm" || fileExtension == ".html")
-					s = "text/html";
-				else
-					s = "";	// ??
-#endif
+        /// <summary>
+        /// Send the current value of an input to all WebSocket clients
+        /// </summary>
+        /// <param name="input">form input</param>
+        void PushValue(InputBase* input)
+        {
+            theServer->Broadcast(input->UniqueID + "=" + HttpUtility::UrlEncode(input->ToString()));
+        }
 
-				rp.fs.open(path.c_str(), ios::in|ios::binary);
-                if (s != "")
-                    rp.Headers["Content-type"] = s;
-            }
+        /// <summary>
+        /// Handle a WebSocket message; the same "id=value" pairs as a post
+        /// </summary>
+        /// <param name="message">url encoded name-value pairs</param>
+        void OnMessage(const string& message)
+        {
+            map<string, string> cgivars;
+            ParseFormData(message, cgivars);
+            if (reactorCount > 0)
+                QueuePost(cgivars, ChangeLog::SOURCE_POST, false);
             else
-            {
-				rp.Status = (int)RESPONSE_NOT_FOUND;
-
-                HtmlBuilder b;
-                b.open("html");
-                b.open("head");
-                b.close("head");
-                b.open("body");
-                b.append(b.text("File not found!!"));
-
-                rp.BodyData = b.ToString(); //Encoding.ASCII.GetBytes(b.ToString());
-            }
-
+                OnPost(cgivars, ChangeLog::SOURCE_POST);
         }
 
         /// <summary>
-        /// Get the root folder
+        /// Hand values posted on a reactor thread to the owner thread
         /// </summary>
-        string GetFolder()
+        /// <param name="values">input values by UniqueID</param>
+        /// <param name="from">where the values came from</param>
+        /// <param name="park">give the post a ticket to park its request with</param>
+        /// <returns>the ticket, or 0 if none was asked for or the post wasn't queued</returns>
+        long long QueuePost(const map<string, string>& values, ChangeLog::Source from, bool park)
         {
-            return theFolder;
+            MutexLock hold(postLock);
+            if (!postsOpen)
+                return 0;
+            pendingPosts.push_back(PendingPost());
+            pendingPosts.back().Values = values;
+            pendingPosts.back().From = from;
+            pendingPosts.back().Ticket = park? ++lastTicket: 0;
+            return pendingPosts.back().Ticket;
         }
 
         /// <summary>
-        /// Startup the server
+        /// Apply values posted on reactor threads, then answer their parked requests
         /// </summary>
-        void Startup(int thePort, string theFolder)
+        void ApplyPosts()
         {
-            assert(NULL == theServer);
-
-			static ManagerImpl* ProxyInstance = 0;
-			struct Proxy
-			{
-				static void OnResponse(const HTTPRequestParams& rq, HTTPResponse& rp)
-				{
-					ProxyInstance->OnResponse(rq, rp);
-				}
-			};
-
-			ProxyInstance = this;
+            vector<PendingPost> posts;
+            {
+                MutexLock hold(postLock);
+                posts.swap(pendingPosts);
+            }
+            if (posts.empty())
+                return;
 
-            this->theFolder = theFolder;
-			theServer = new HTTPServer(&Proxy::OnResponse);
-            theServer->Start(thePort);
+            for (unsigned int i = 0; i < posts.size(); i++)
+                OnPost(posts[i].Values, posts[i].From);
 
-            LoadInputs();
+            // the page sent back to a form poster shows the values
+            RefreshSnapshot();
+            for (unsigned int i = 0; i < posts.size(); i++)
+            {
+                if (posts[i].Ticket != 0)
+                    theServer->Resume(posts[i].Ticket);
+            }
         }
 
         /// <summary>
-        /// Shutdown the server
+        /// Check whether a snapshot still matches the inputs and forms
         /// </summary>
-        void Shutdown()
+        bool IsCurrent(const Snapshot& snap)
         {
-            assert(NULL != theServer);
+            if (snap.MenuVersion != menuVersion || snap.Inputs.size() != inputs.size() ||
+                snap.Forms.size() != forms.size())
+                return false;
+
+            for (map<string, FormSettings*>::iterator i = forms.begin(); i != forms.end(); ++i)
+            {
+                map<string, Snapshot::Form>::const_iterator f = snap.Forms.find((*i).first);
+                FormSettings* form = (*i).second;
+                if (f == snap.Forms.end() || (*f).second.Version != form->Version ||
+                    (*f).second.AutoSubmit != form->AutoSubmit || (*f).second.AutoSave != form->AutoSave)
+                    return false;
+            }
+
+            // the application may change bound variables without saying so
+            for (map<string, InputBase*>::iterator i = inputs.begin(); i != inputs.end(); ++i)
+            {
+                map<string, Snapshot::Input>::const_iterator j = snap.Inputs.find((*i).first);
+                if (j == snap.Inputs.end() || (*j).second.Value != (*i).second->ToString())
+                    return false;
+            }
+            return true;
+        }
+
+        /// <summary>
+        /// Replace the snapshot if the inputs or forms have changed since it was taken;
+        /// call on the owner thread only
+        /// </summary>
+        void RefreshSnapshot()
+        {
+            ScopedTimer timer(frameStats, FrameStats::SECTION_SNAPSHOT);
+            if (snapshot != NULL && IsCurrent(*snapshot))
+                return;
+
+            Snapshot* snap = new Snapshot;
+            snap->MenuVersion = menuVersion;
+            snap->Refs = 1;
+            for (map<string, FormSettings*>::iterator i = forms.begin(); i != forms.end(); ++i)
+            {
+                Snapshot::Form& form = snap->Forms[(*i).first];
+                form.AutoSubmit = (*i).second->AutoSubmit;
+                form.AutoSave = (*i).second->AutoSave;
+                form.Inputs = 0;
+            }
+            for (map<string, InputBase*>::iterator i = inputs.begin(); i != inputs.end(); ++i)
+            {
+                InputBase* input = (*i).second;
+                Snapshot::Input& state = snap->Inputs[(*i).first];
+                state.Form = input->pForm->Name;
+                state.Label = input->Label;
+                state.Value = input->ToString();
+                TraceScope trace("ToHtml", input->UniqueID.c_str());
+                state.Html = input->ToHtml();
+                snap->Forms[state.Form].Inputs++;
+
+                // a page that renders differently needs a new ETag, even when
+                // the application changed the value without calling Invalidate
+                if (snapshot != NULL)
+                {
+                    map<string, Snapshot::Input>::const_iterator was = snapshot->Inputs.find((*i).first);
+                    if (was == snapshot->Inputs.end() || (*was).second.Html != state.Html)
+                        input->pForm->Invalidate();
+                }
+            }
+            for (map<string, FormSettings*>::iterator i = forms.begin(); i != forms.end(); ++i)
+                snap->Forms[(*i).first].Version = (*i).second->Version;
+
+            Snapshot* old;
+            {
+                MutexLock hold(snapshotLock);
+                old = snapshot;
+                snapshot = snap;
+            }
+            ReleaseSnapshot(old);
+        }
+
+        /// <summary>
+        /// Get the latest snapshot; release it when done
+        /// </summary>
+        Snapshot* AcquireSnapshot()
+        {
+            // serving from Update, so this is the owner thread and may look for itself
+            if (reactorCount == 0)
+                RefreshSnapshot();
+
+            MutexLock hold(snapshotLock);
+            ++snapshot->Refs;
+            return snapshot;
+        }
+
+        void ReleaseSnapshot(Snapshot* snap)
+        {
+            if (snap == NULL)
+                return;
+            bool last;
+            {
+                MutexLock hold(snapshotLock);
+                last = (--snap->Refs == 0);
+            }
+            if (last)
+                delete snap;
+        }
+
+        /// <summary>
+        /// Holds a snapshot for the life of a scope
+        /// </summary>
+        class SnapshotRef
+        {
+            ManagerImpl& owner;
+            Snapshot* snap;
+
+            SnapshotRef(const SnapshotRef&);
+            SnapshotRef& operator=(const SnapshotRef&);
+
+		public:
+            SnapshotRef(ManagerImpl& m) : owner(m), snap(m.AcquireSnapshot()) {}
+            ~SnapshotRef() { owner.ReleaseSnapshot(snap); }
+            const Snapshot& operator*() const { return *snap; }
+        };
+
+        /// <summary>
+        /// Write a JSON object for one input
+        /// </summary>
+        void WriteInput(JsonWriter& w, const string& id, const Snapshot::Input& input)
+        {
+            w.BeginObject();
+            w.Property("id", id);
+            w.Property("form", input.Form);
+            w.Property("label", input.Label);
+            w.Property("value", input.Value);
+            w.EndObject();
+        }
+
+        /// <summary>
+        /// Convert a JSON scalar to the string form SetValue expects
+        /// </summary>
+        /// <returns>false if the token is not a scalar</returns>
+        bool GetJsonValue(JsonReader& r, string& value)
+        {
+            switch (r.GetToken())
+            {
+            case JsonReader::TOKEN_STRING:
+            case JsonReader::TOKEN_NUMBER:
+                value = r.Value();
+                return true;
+            case JsonReader::TOKEN_TRUE:
+                value = "True";
+                return true;
+            case JsonReader::TOKEN_FALSE:
+                value = "False";
+                return true;
+            default:
+                return false;
+            }
+        }
+
+        /// <summary>
+        /// Handle the JSON api
+        ///   GET /api/forms          all forms
+        ///   GET /api/forms/{name}   inputs of a form
+        ///   GET /api/inputs         values of all inputs, or of ?id=a,b,...
+        ///   POST /api/inputs        set many values {"id": value, ...} with one callback pass;
+        ///                           with reactors they are queued for Update and answered 202
+        ///   GET /api/watch          samples of every watch, or of ?{id}={cursor}&...
+        ///                           taken since each cursor, with the cursor to send next
+        ///   GET /api/telemetry      the high rate signals
+        ///   GET /api/telemetry/{name}?start=-10&end=0&count=300
+        ///                           min, max and mean of a signal in at most count buckets,
+        ///                           with times in seconds relative to now
+        ///   GET /api/presets        the presets, the one applied last and the A/B pair
+        ///   GET /api/presets/{name} values of a preset
+        ///   POST /api/presets/{name}/save[?form=], /apply, /delete
+        ///   POST /api/presets/flip, /api/presets/ab?a=&b=
+        ///                           queued for the next Update and answered 202
+        /// </summary>
+        /// <param name="rq">request parameters</param>
+        /// <param name="rp">response parameters</param>
+        void OnApi(const HTTPRequestParams& rq, HTTPResponse& rp)
+        {
+            string json;
+            JsonWriter w(json);
+            rp.Headers["Content-type"] = "application/json";
+
+            if (rq.URL == "/api/forms")
+            {
+                SnapshotRef snap(*this);
+                w.BeginObject();
+                w.Name("forms");
+                w.BeginArray();
+                for (map<string, Snapshot::Form>::const_iterator i = (*snap).Forms.begin(); i != (*snap).Forms.end(); ++i)
+                {
+                    const Snapshot::Form& form = (*i).second;
+                    w.BeginObject();
+                    w.Property("name", (*i).first);
+                    w.Property("autoSubmit", form.AutoSubmit);
+                    w.Property("autoSave", form.AutoSave);
+                    w.Property("inputs", form.Inputs);
+                    w.EndObject();
+                }
+                w.EndArray();
+                w.EndObject();
+            }
+            else if (rq.URL.compare(0, 11, "/api/forms/") == 0)
+            {
+                SnapshotRef snap(*this);
+                string formName = rq.URL.substr(11);
+                map<string, Snapshot::Form>::const_iterator f = (*snap).Forms.find(formName);
+                if (f == (*snap).Forms.end())
+                {
+                    rp.Status = (int)RESPONSE_NOT_FOUND;
+                    w.BeginObject();
+                    w.Property("error", "no such form");
+                    w.EndObject();
+                }
+                else
+                {
+                    const Snapshot::Form& form = (*f).second;
+                    w.BeginObject();
+                    w.Property("name", formName);
+                    w.Property("autoSubmit", form.AutoSubmit);
+                    w.Property("autoSave", form.AutoSave);
+                    w.Name("inputs");
+                    w.BeginArray();
+                    for (map<string, Snapshot::Input>::const_iterator i = (*snap).Inputs.begin(); i != (*snap).Inputs.end(); ++i)
+                    {
+                        if ((*i).second.Form == formName)
+                            WriteInput(w, (*i).first, (*i).second);
+                    }
+                    w.EndArray();
+                    w.EndObject();
+                }
+            }
+            else if (rq.URL == "/api/inputs")
+            {
+                vector<string> ids;
+                map<string, string> values;
+                if (rq.Method == "POST" || rq.Method == "PUT")
+                {
+                    JsonReader r(rq.BodyData.data(), rq.BodyData.length());
+                    bool valid = (r.Read() == JsonReader::TOKEN_BEGIN_OBJECT);
+                    while (valid && r.Read() == JsonReader::TOKEN_NAME)
+                    {
+                        string id = r.Value();
+                        r.Read();
+                        string value;
+                        if (GetJsonValue(r, value))
+                        {
+                            values[id] = value;
+                            ids.push_back(id);
+                        }
+                        else
+                        {
+                            valid = r.Skip();
+                        }
+                    }
+                    if (!valid || r.GetToken() != JsonReader::TOKEN_END_OBJECT || r.Read() != JsonReader::TOKEN_END)
+                    {
+                        rp.Status = (int)RESPONSE_BAD_REQUEST;
+                        w.BeginObject();
+                        w.Property("error", "expected an object of input values");
+                        w.EndObject();
+                        rp.BodyData = json;
+                        return;
+                    }
+                    if (reactorCount > 0)
+                    {
+                        QueuePost(values, ChangeLog::SOURCE_API, false);
+                        rp.Status = (int)RESPONSE_ACCEPTED;
+                    }
+                    else
+                    {
+                        OnPost(values, ChangeLog::SOURCE_API);
+                        values.clear();
+                    }
+                }
+                else
+                {
+                    Hashtable::const_iterator arg = rq.Args.find("id");
+                    if (arg != rq.Args.end())
+                        StringHelper::Split((*arg).second, ", ", ids);
+                }
+
+                // queued values are answered as posted, since they aren't set yet
+                SnapshotRef snap(*this);
+                w.BeginObject();
+                if (ids.empty() && rq.Method == "GET")
+                {
+                    for (map<string, Snapshot::Input>::const_iterator i = (*snap).Inputs.begin(); i != (*snap).Inputs.end(); ++i)
+                    {
+                        w.Property((*i).first, (*i).second.Value);
+                    }
+                }
+                else
+                {
+                    for (vector<string>::iterator i = ids.begin(); i != ids.end(); ++i)
+                    {
+                        map<string, Snapshot::Input>::const_iterator j = (*snap).Inputs.find(*i);
+                        w.Name(*i);
+                        if (j == (*snap).Inputs.end())
+                            w.Null();
+                        else if (values.find(*i) != values.end())
+                            w.String(values[*i]);
+                        else
+                            w.String((*j).second.Value);
+                    }
+                }
+                w.EndObject();
+            }
+            else if (rq.URL == "/api/watch")
+            {
+                // each argument is a watch id and the cursor its client last got
+                MutexLock hold(watchLock);
+                w.BeginObject();
+                for (unsigned int i = 0; i < watches.size(); i++)
+                {
+                    Hashtable::const_iterator arg = rq.Args.find(watches[i]->UniqueID);
+                    if (!rq.Args.empty() && arg == rq.Args.end())
+                        continue;
+                    long long cursor = 0;
+                    try
+                    {
+                        if (arg != rq.Args.end())
+                            cursor = Convert::ToInt64((*arg).second);
+                    }
+                    catch (Convert::BadConversion&)
+                    {
+                    }
+                    vector<double> samples;
+                    cursor = watches[i]->GetSamples(cursor, samples);
+                    w.Name(watches[i]->UniqueID);
+                    w.BeginObject();
+                    w.Property("cursor", cursor);
+                    w.Name("samples");
+                    w.BeginArray();
+                    for (unsigned int j = 0; j < samples.size(); j++)
+                        w.Number(samples[j]);
+                    w.EndArray();
+                    w.EndObject();
+                }
+                w.EndObject();
+            }
+            else if (rq.URL == "/api/telemetry")
+            {
+                MutexLock hold(telemetryLock);
+                w.BeginObject();
+                w.Name("telemetry");
+                w.BeginArray();
+                for (unsigned int i = 0; i < telemetry.size(); i++)
+                {
+                    w.BeginObject();
+                    w.Property("name", telemetry[i]->GetName());
+                    w.Property("resolution", telemetry[i]->GetResolution());
+                    w.Property("dropped", telemetry[i]->GetDropped());
+                    w.EndObject();
+                }
+                w.EndArray();
+                w.EndObject();
+            }
+            else if (rq.URL.compare(0, 15, "/api/telemetry/") == 0)
+            {
+                double start = -TelemetryWindow;
+                double end = 0;
+                int count = TelemetryBuckets;
+                try
+                {
+                    Hashtable::const_iterator arg;
+                    if ((arg = rq.Args.find("start")) != rq.Args.end())
+                        start = Convert::ToDouble((*arg).second);
+                    if ((arg = rq.Args.find("end")) != rq.Args.end())
+                        end = Convert::ToDouble((*arg).second);
+                    if ((arg = rq.Args.find("count")) != rq.Args.end())
+                        count = Convert::ToInt((*arg).second);
+                }
+                catch (Convert::BadConversion&)
+                {
+                }
+
+                MutexLock hold(telemetryLock);
+                Telemetry* signal = FindTelemetry(HttpUtility::UrlDecode(rq.URL.substr(15)));
+                if (signal == NULL)
+                {
+                    rp.Status = (int)RESPONSE_NOT_FOUND;
+                    w.BeginObject();
+                    w.Property("error", "no such telemetry");
+                    w.EndObject();
+                }
+                else
+                {
+                    double now = Clock::Seconds();
+                    vector<Telemetry::Bucket> buckets;
+                    double width = signal->Query(now + start, now + end, count, buckets);
+                    w.BeginObject();
+                    w.Property("name", signal->GetName());
+                    w.Property("width", width);
+                    w.Name("buckets");
+                    w.BeginArray();
+                    for (unsigned int i = 0; i < buckets.size(); i++)
+                    {
+                        // [time, min, max, mean]
+                        w.BeginArray();
+                        w.Number(buckets[i].Time - now);
+                        w.Number(buckets[i].Min);
+                        w.Number(buckets[i].Max);
+                        w.Number(buckets[i].Mean);
+                        w.EndArray();
+                    }
+                    w.EndArray();
+                    w.EndObject();
+                }
+            }
+            else if (rq.URL == "/api/presets")
+            {
+                MutexLock hold(presetLock);
+                w.BeginObject();
+                w.Property("current", presetCurrent);
+                w.Property("a", presetA);
+                w.Property("b", presetB);
+                w.Name("presets");
+                w.BeginArray();
+                for (unsigned int i = 0; i < presets.size(); i++)
+                {
+                    w.BeginObject();
+                    w.Property("name", presets[i].Name);
+                    w.Property("form", presets[i].Form);
+                    w.Property("inputs", (int)presets[i].Values.size());
+                    w.EndObject();
+                }
+                w.EndArray();
+                w.EndObject();
+            }
+            else if (rq.URL.compare(0, 13, "/api/presets/") == 0)
+            {
+                string rest = rq.URL.substr(13);
+                if (rq.Method == "POST")
+                {
+                    string action = rest;
+                    string name;
+                    size_t slash = rest.rfind('/');
+                    if (slash != string::npos)
+                    {
+                        name = rest.substr(0, slash);
+                        action = rest.substr(slash + 1);
+                    }
+
+                    Hashtable::const_iterator a = rq.Args.find("a");
+                    Hashtable::const_iterator b = rq.Args.find("b");
+                    Hashtable::const_iterator form = rq.Args.find("form");
+                    bool queued = true;
+                    if (slash == string::npos && action == "flip")
+                        QueuePreset(PresetOp::PRESET_FLIP, "", "");
+                    else if (slash == string::npos && action == "ab")
+                        QueuePreset(PresetOp::PRESET_AB, (a != rq.Args.end())? (*a).second: "",
+                            (b != rq.Args.end())? (*b).second: "");
+                    else if (!name.empty() && action == "save")
+                        QueuePreset(PresetOp::PRESET_SAVE, name, (form != rq.Args.end())? (*form).second: "");
+                    else if (!name.empty() && action == "apply")
+                        QueuePreset(PresetOp::PRESET_APPLY, name, "");
+                    else if (!name.empty() && action == "delete")
+                        QueuePreset(PresetOp::PRESET_DELETE, name, "");
+                    else
+                        queued = false;
+
+                    w.BeginObject();
+                    if (queued)
+                    {
+                        rp.Status = (int)RESPONSE_ACCEPTED;
+                        w.Property("action", action);
+                        w.Property("name", name);
+                    }
+                    else
+                    {
+                        rp.Status = (int)RESPONSE_NOT_FOUND;
+                        w.Property("error", "unknown preset action");
+                    }
+                    w.EndObject();
+                }
+                else
+                {
+                    MutexLock hold(presetLock);
+                    int index = FindPreset(rest);
+                    w.BeginObject();
+                    if (index < 0)
+                    {
+                        rp.Status = (int)RESPONSE_NOT_FOUND;
+                        w.Property("error", "no such preset");
+                    }
+                    else
+                    {
+                        const Preset& preset = presets[index];
+                        w.Property("name", preset.Name);
+                        w.Property("form", preset.Form);
+                        w.Name("values");
+                        w.BeginObject();
+                        for (unsigned int i = 0; i < preset.Values.size(); i++)
+                            w.Property(preset.Values[i].first, preset.Values[i].second);
+                        w.EndObject();
+                    }
+                    w.EndObject();
+                }
+            }
+            else if (rq.URL == "/api/stats")
+            {
+                w.BeginObject();
+                w.Property("enabled", frameStats.Enabled);
+                w.Property("frames", frameStats.GetFrameCount());
+                for (int i = 0; i < FrameStats::SECTION_COUNT; i++)
+                {
+                    FrameStats::Summary summary = frameStats.GetSummary((FrameStats::Section)i);
+                    w.Name(FrameStats::GetSectionName((FrameStats::Section)i));
+                    w.BeginObject();
+                    w.Property("mean", summary.Mean * 1e-3);
+                    w.Property("p99", summary.P99 * 1e-3);
+                    w.Property("max", summary.Max * 1e-3);
+                    w.EndObject();
+                }
+                w.EndObject();
+            }
+            else if (rq.URL == "/api/server")
+            {
+                HTTPServerStats stats = theServer->GetStats();
+                w.BeginObject();
+                w.Property("reactors", theServer->GetReactorCount());
+                w.Property("connections", theServer->GetConnectionCount());
+                w.Property("queuedBytes", (long long)theServer->GetQueuedBytes());
+                w.Property("accepted", (long long)stats.Accepted);
+                w.Property("rejected", (long long)stats.Rejected);
+                w.Property("evicted", (long long)stats.Evicted);
+                w.Property("readsSuspended", (long long)stats.ReadsSuspended);
+                w.Property("headersTooLarge", (long long)stats.HeadersTooLarge);
+                w.Property("bodiesTooLarge", (long long)stats.BodiesTooLarge);
+                w.Property("requestsTimedOut", (long long)stats.RequestsTimedOut);
+                w.Property("idleClosed", (long long)stats.IdleClosed);
+                w.EndObject();
+            }
+            else
+            {
+                rp.Status = (int)RESPONSE_NOT_FOUND;
+                w.BeginObject();
+                w.Property("error", "unknown api");
+                w.EndObject();
+            }
+
+            rp.BodyData = json;
+        }
+
+        /// <summary>
+        /// Make a strong entity tag from a kind prefix and a version
+        /// </summary>
+        string MakeETag(const char* kind, unsigned int version)
+        {
+            char temp[64];
+            sprintf(temp, "\"%s%s-%x\"", kind, startupTag.c_str(), version);
+            return temp;
+        }
+
+        /// <summary>
+        /// Make a strong entity tag for a file from its serial number, time and size
+        /// </summary>
+        string MakeETag(const Path::FileInfo& info)
+        {
+            char temp[80];
+            sprintf(temp, "\"%llx-%llx-%llx\"", info.Inode, info.LastWriteTime, info.Length);
+            return temp;
+        }
+
+        /// <summary>
+        /// Check If-None-Match against the entity tag of the current representation
+        /// </summary>
+        /// <returns>true if the client's copy is current</returns>
+        bool IsNotModified(const HTTPRequestParams& rq, const string& etag)
+        {
+            if (rq.Method != "GET" && rq.Method != "HEAD")
+                return false;
+
+            HeaderTable::const_iterator i = rq.Headers.find("If-None-Match");
+            if (i == rq.Headers.end())
+                return false;
+
+            vector<string> tags;
+            StringHelper::Split((*i).second, ", ", tags);
+            for (vector<string>::iterator t = tags.begin(); t != tags.end(); ++t)
+            {
+                // weak comparison
+                string tag = ((*t).compare(0, 2, "W/") == 0)? (*t).substr(2): (*t);
+                if (tag == "*" || tag == etag)
+                    return true;
+            }
+            return false;
+        }
+
+        /// <summary>
+        /// Set the validator and caching headers; answers 304 when the client is current
+        /// </summary>
+        /// <returns>true if the response is complete</returns>
+        bool CheckCache(const HTTPRequestParams& rq, HTTPResponse& rp, const string& etag)
+        {
+            rp.Headers["ETag"] = etag;
+            rp.Headers["Cache-Control"] = GetCachePolicy(rq.URL);
+            if (IsNotModified(rq, etag))
+            {
+                rp.Status = (int)RESPONSE_NOT_MODIFIED;
+                return true;
+            }
+            return false;
+        }
+
+        /// <summary>
+        /// Get the Cache-Control value for the longest matching url prefix
+        /// </summary>
+        string GetCachePolicy(const string& url)
+        {
+            string policy = "no-cache";
+            size_t longest = 0;
+            MutexLock hold(cachePolicyLock);
+            for (map<string, string>::iterator i = cachePolicies.begin(); i != cachePolicies.end(); ++i)
+            {
+                const string& prefix = (*i).first;
+                if (prefix.length() >= longest && url.compare(0, prefix.length(), prefix) == 0)
+                {
+                    longest = prefix.length();
+                    policy = (*i).second;
+                }
+            }
+            return policy;
+        }
+
+        /// <summary>
+        /// Set the deflate level and size threshold for responses
+        /// </summary>
+        void SetCompression(int level, size_t threshold)
+        {
+            compressionLevel = level;
+            compressionThreshold = threshold;
+            MutexLock hold(assetLock);
+            assets.SetCompressionLevel(level);
+            assets.Clear();
+            if (theServer != NULL)
+            {
+                theServer->CompressionLevel = level;
+                theServer->CompressionThreshold = threshold;
+                theServer->ShareSettings();
+            }
+        }
+
+        /// <summary>
+        /// Set the bounds on connections, queued output and request size
+        /// </summary>
+        void SetServerLimits(const HTTPServerLimits& limits)
+        {
+            serverLimits = limits;
+            if (theServer != NULL)
+            {
+                theServer->Limits = limits;
+                theServer->ShareSettings();
+            }
+        }
+
+        /// <summary>
+        /// Set the Cache-Control value for urls starting with a prefix
+        /// </summary>
+        void SetCachePolicy(const string& urlPrefix, const string& cacheControl)
+        {
+            MutexLock hold(cachePolicyLock);
+            cachePolicies[urlPrefix] = cacheControl;
+        }
+
+		/// <summary>
+        /// Respond to HTTP requests
+        /// </summary>
+        /// <param name="rq">request parameters</param>
+        /// <param name="rp">response parameters</param>
+        void OnResponse(const HTTPRequestParams& rq, HTTPResponse& rp)
+        {
+            // machine readable interface
+            if (rq.URL.compare(0, 5, "/api/") == 0)
+            {
+                rp.Route = "api";
+                OnApi(rq, rp);
+                return;
+            }
+
+            // posts are timed apart from the pages sent back for them
+            bool posted = (rq.Method == "POST");
+
+            // Handle post
+            if (posted)
+            {
+				map<string, string> cgivars;
+
+				string postStr = rq.BodyData; //Encoding.ASCII.GetString(rq.BodyData, 0, rq.BodySize);
+				ParseFormData(postStr, cgivars);
+
+                // the page sent back should show the change; rather than stall
+                // its other connections until the next Update, a reactor parks
+                // the request and answers it once Update has set the values
+                if (reactorCount > 0)
+                {
+                    if (!rq.Resumed)
+                    {
+                        rp.Park = QueuePost(cgivars, ChangeLog::SOURCE_POST, true);
+                        if (rp.Park != 0)
+                            return;
+                    }
+                }
+                else
+                    OnPost(cgivars, ChangeLog::SOURCE_POST);
+                // respond same as for GET
+            }
+
+            // handle top using frames
+            if (rq.URL == "/")
+            {
+                rp.Route = posted? "post": "top";
+                if (CheckCache(rq, rp, MakeETag("t", 0)))
+                    return;
+                string html = GetTopPage();
+                rp.BodyData = html; //Encoding.ASCII.GetBytes(html);
+                return;
+            }
+
+            // handle generated menu and forms
+			if (Path::GetExtension(rq.URL) == ".cgi")
+            {
+                SnapshotRef snap(*this);
+                if (rq.URL == "/menu.cgi")
+                {
+                    rp.Route = posted? "post": "menu";
+                    if (CheckCache(rq, rp, MakeETag("m", (*snap).MenuVersion)))
+                        return;
+                    string html = GetMenuPage(*snap);
+                    rp.BodyData = html; //Encoding.ASCII.GetBytes(html);
+                }
+                else // contents
+                {
+                    rp.Route = posted? "post": "form";
+					string formName = Path::GetFileNameWithoutExtension(rq.URL);
+                    map<string, Snapshot::Form>::const_iterator form = (*snap).Forms.find(formName);
+                    if (CheckCache(rq, rp, MakeETag("f", (form != (*snap).Forms.end())? (*form).second.Version: 0)))
+                        return;
+                    string html = GetFormPage(*snap, formName);
+                    rp.BodyData = html; //Encoding.ASCII.GetBytes(html);
+                }
+                return;
+            }
+
+            // live previews hold the connection open for frames
+            {
+                MutexLock hold(assetLock);
+                ImageStream* stream = FindImageStream(rq.URL);
+                if (stream != NULL)
+                {
+                    rp.Route = "stream";
+                    rp.Headers["Content-type"] = ImageStream::GetContentType();
+                    rp.Headers["Cache-Control"] = "no-cache";
+                    rp.BodyData = stream->GetLatestPart();
+                    rp.Subscribe = stream->GetUrl();
+                    return;
+                }
+            }
+
+            rp.Route = posted? "post": "static";
+            string path = theFolder + rq.URL;
+			bool valid = (path.find("..") == string::npos); // make it secure
+            string url = AssetCache::NormalizeUrl(rq.URL);
+
+            // cached files need no disk access
+            if (valid)
+            {
+                MutexLock hold(assetLock);
+                if (SendAsset(rq, rp, assets.Find(url)))
+                    return;
+            }
+
+			if (valid && Path::DirectoryExists(path))
+            {
+                string index = path + "/index.htm";
+				if (Path::FileExists(index))
+                {
+                    path = index;
+                    url = AssetCache::NormalizeUrl(url + "/index.htm");
+                    MutexLock hold(assetLock);
+                    if (SendAsset(rq, rp, assets.Find(url)))
+                        return;
+                }
+                else
+                {
+					vector<string> dirs, files;
+					Path::GetDirectories(path, dirs);
+					Path::GetFiles(path, files);
+
+                    HtmlBuilder b;
+                    b.open("html");
+                    b.open("head");
+                    b.close("head");
+                    b.open("body");
+                    b.open("h2");
+                    b.append(b.text("Folder listing for " + path.substr(theFolder.length() + 1)));
+                    b.close("h2");
+                    for (unsigned int i = 0; i < dirs.size(); i++)
+                    {
+						b.link(rq.URL + "/" + Path::GetFileName(dirs[i]),
+							"[" + Path::GetFileName(dirs[i]) + "]");
+                        b.br();
+                    }
+                    for (unsigned int i = 0; i < files.size(); i++)
+                    {
+						b.link(rq.URL + "/" + Path::GetFileName(files[i]),
+							"[" + Path::GetFileName(files[i]) + "]");
+                        b.br();
+                    }
+                    rp.BodyData = b.ToString(); //Encoding.ASCII.GetBytes(b.ToString());
+                    return;
+                }
+            }
+
+            Path::FileInfo info;
+			if (valid && Path::GetFileInfo(path, info) && !info.IsDirectory)
+            {
+                string etag = MakeETag(info);
+                if (CheckCache(rq, rp, etag))
+                    return;
+
+                // files too big to cache are streamed
+                {
+                    MutexLock hold(assetLock);
+                    if (SendAsset(rq, rp, assets.Load(url, path, etag)))
+                        return;
+                }
+
+				string s = AssetCache::GetContentType(path);
+				rp.FilePath = path;
+                if (s != "")
+                    rp.Headers["Content-type"] = s;
+            }
+            else
+            {
+				rp.Status = (int)RESPONSE_NOT_FOUND;
+
+                HtmlBuilder b;
+                b.open("html");
+                b.open("head");
+                b.close("head");
+                b.open("body");
+                b.append(b.text("File not found!!"));
+
+                rp.BodyData = b.ToString(); //Encoding.ASCII.GetBytes(b.ToString());
+            }
+
+        }
+
+        /// <summary>
+        /// Respond with a cached file; hold assetLock
+        /// </summary>
+        /// <returns>false if asset is NULL</returns>
+        bool SendAsset(const HTTPRequestParams& rq, HTTPResponse& rp, const AssetCache::Asset* asset)
+        {
+            if (asset == NULL)
+                return false;
+
+            if (!CheckCache(rq, rp, asset->ETag))
+            {
+                if (!asset->ContentType.empty())
+                    rp.Headers["Content-type"] = asset->ContentType;
+
+                if (asset->Gzip.empty())
+                    rp.BodyData = asset->Data;
+                else if (HTTPServer::GetAcceptedEncoding(rq) == "gzip" && rq.Headers.find("Range") == rq.Headers.end())
+                {
+                    rp.BodyData = asset->Gzip;
+                    rp.Headers["Content-Encoding"] = "gzip";
+                    rp.Headers["Vary"] = "Accept-Encoding";
+                }
+                else
+                {
+                    rp.BodyData = asset->Data;
+                    rp.Headers["Vary"] = "Accept-Encoding";
+                }
+            }
+            return true;
+        }
+
+        /// <summary>
+        /// Add a live preview served at url
+        /// </summary>
+        ImageStream* AddImageStream(const string& url, CaptureSource* source)
+        {
+            ImageStream* stream = new ImageStream(url, source);
+            streams.push_back(stream);
+            return stream;
+        }
+
+        /// <summary>
+        /// Add a high rate signal, or get the one already added under name
+        /// </summary>
+        Telemetry* AddTelemetry(const string& name, double resolution)
+        {
+            MutexLock hold(telemetryLock);
+            for (unsigned int i = 0; i < telemetry.size(); i++)
+            {
+                if (telemetry[i]->GetName() == name)
+                    return telemetry[i];
+            }
+            telemetry.push_back(new Telemetry(name, resolution));
+            if (!aggregator.IsRunning())
+                aggregator.Start(&AggregatorMain, this);
+            return telemetry.back();
+        }
+
+        /// <summary>
+        /// Get the signal added under name; call with telemetryLock held
+        /// </summary>
+        /// <returns>NULL if there is none</returns>
+        Telemetry* FindTelemetry(const string& name)
+        {
+            for (unsigned int i = 0; i < telemetry.size(); i++)
+            {
+                if (telemetry[i]->GetName() == name)
+                    return telemetry[i];
+            }
+            return NULL;
+        }
+
+        static void AggregatorMain(void* arg)
+        {
+            ((ManagerImpl*)arg)->Aggregate();
+        }
+
+        /// <summary>
+        /// Fold pushed samples into the signals' buckets until Shutdown
+        /// </summary>
+        void Aggregate()
+        {
+            Trace::SetThreadName("webconfig telemetry");
+            while (!stopAggregator.Wait(TelemetryInterval))
+            {
+                TraceScope trace("Aggregate");
+                MutexLock hold(telemetryLock);
+                for (unsigned int i = 0; i < telemetry.size(); i++)
+                    telemetry[i]->Drain();
+            }
+        }
+
+        /// <summary>
+        /// Get the live preview served at url
+        /// </summary>
+        /// <returns>NULL if there is none</returns>
+        ImageStream* FindImageStream(const string& url)
+        {
+            string normalized = AssetCache::NormalizeUrl(url);
+            for (unsigned int i = 0; i < streams.size(); i++)
+            {
+                if (streams[i]->GetUrl() == normalized)
+                    return streams[i];
+            }
+            return NULL;
+        }
+
+        /// <summary>
+        /// Get the root folder
+        /// </summary>
+        string GetFolder()
+        {
+            return theFolder;
+        }
+
+        /// <summary>
+        /// Startup the server
+        /// </summary>
+        void Startup(int thePort, string theFolder)
+        {
+            assert(NULL == theServer);
+
+			static ManagerImpl* ProxyInstance = 0;
+			struct Proxy
+			{
+				static void OnResponse(const HTTPRequestParams& rq, HTTPResponse& rp)
+				{
+					ProxyInstance->OnResponse(rq, rp);
+				}
+				static void OnMessage(const string& message)
+				{
+					ProxyInstance->OnMessage(message);
+				}
+			};
+
+			ProxyInstance = this;
+
+            this->theFolder = theFolder;
+            startupTag = Convert::ToString((unsigned int)time(NULL));
+			theServer = new HTTPServer(&Proxy::OnResponse);
+			theServer->OnMessage = &Proxy::OnMessage;
+			theServer->CompressionLevel = compressionLevel;
+			theServer->CompressionThreshold = compressionThreshold;
+			theServer->Limits = serverLimits;
+			theServer->LogRequests = logRequests;
+			theServer->UpdateStats = frameStats.Enabled? &frameStats: NULL;
+
+            // what OnResponse times responses under; served at /metrics
+            static const char* const Routes[] = { "top", "menu", "form", "post", "static", "stream", "api" };
+            for (unsigned int i = 0; i < sizeof(Routes) / sizeof(Routes[0]); i++)
+                theServer->GetMetrics().AddRoute(Routes[i]);
+            assets.Open(theFolder);
+
+            LoadInputs();
+            LoadPresets();
+            ShowPresets();
+
+            // requests may come in on reactor threads from here on
+            RefreshSnapshot();
+            postsOpen = true;
+            theServer->Start(thePort, reactorCount);
+        }
+
+        /// <summary>
+        /// Shutdown the server
+        /// </summary>
+        void Shutdown()
+        {
+            assert(NULL != theServer);
+
+            // queue no more posts; the ones already queued are set, though
+            // the reactors stop before answering any parked requests
+            {
+                MutexLock hold(postLock);
+                postsOpen = false;
+            }
+            ApplyPosts();
 
             theServer->Stop();
 			delete theServer;
 			theServer = NULL;
+            capture.Stop();
+            changeLog.Close();
+            for (unsigned int i = 0; i < streams.size(); i++)
+                delete streams[i];
+            streams.clear();
+            if (aggregator.IsRunning())
+            {
+                stopAggregator.Post();
+                aggregator.Join();
+            }
+            for (unsigned int i = 0; i < telemetry.size(); i++)
+                delete telemetry[i];
+            telemetry.clear();
+            assets.Close();
+            ReleaseSnapshot(snapshot);
+            snapshot = NULL;
+
+            SaveInputs();
+
+            inputs.clear();
+            addedInputs.clear();
+            forms.clear();
+        }
+
+        /// <summary>
+        /// Load input values to restore
+        /// </summary>
+        void LoadInputs()
+        {
+            restoredInputs.clear();
+
+			IniFile ini(theFolder + "/WebConfig.ini");
+			vector<string> keys;
+			if (ini.ReadSectionKeys("Inputs", keys) > 0)
+			{
+				for (vector<string>::iterator i = keys.begin(); i != keys.end(); ++i)
+				{
+					string key = (*i);
+					string value = ini.ReadString("Inputs", key, "");
+					restoredInputs.push_back(SavedValue(key, value));
+				}
+			}
+        }
+
+        /// <summary>
+        /// Restore the saved values of the inputs added since the last Update
+        /// </summary>
+        void RestoreInputs()
+        {
+            for (unsigned int i = 0; i < addedInputs.size(); i++)
+            {
+                InputBase* input = addedInputs[i];
+				for (vector<SavedValue>::iterator j = restoredInputs.begin(); j != restoredInputs.end(); ++j)
+				{
+					if ((*j).UniqueID == input->UniqueID)
+					{
+						SetInputValue(input, (*j).Value, ChangeLog::SOURCE_RESTORE);
+						break;
+					}
+				}
+            }
+            addedInputs.clear();
+        }
+
+        /// <summary>
+        /// Save input values for forms with AutoSave
+        /// </summary>
+        void SaveInputs()
+        {
+			IniFile ini(theFolder + "/WebConfig.ini");
+			for (map<string,InputBase*>::iterator i = inputs.begin(); i != inputs.end(); ++i)
+            {
+				InputBase* input = (*i).second;
+                if (input->pForm->AutoSave && !input->ToString().empty())
+				{
+					ini.WriteString("Inputs", (*i).first, input->ToString());
+				}
+            }
+        }
+
+        /// <summary>
+        /// Update the manager; should be called periodically
+        /// </summary>
+        void Update()
+        {
+            TraceScope trace("Update");
+            frameStats.BeginFrame();
+            {
+                ScopedTimer timer(frameStats, FrameStats::SECTION_UPDATE);
+                ++frame;
+                RestoreInputs();
+                for (unsigned int i = 0; i < watches.size(); i++)
+                    watches[i]->Sample();
+                ApplyPosts();
+                ApplyReplay();
+                ApplyPresetOps();
+                {
+                    ScopedTimer timer(frameStats, FrameStats::SECTION_PUBLISH);
+                    MutexLock hold(assetLock);
+                    assets.Update();
+                    capture.Publish(assets);
+                    double now = Clock::Seconds();
+                    for (unsigned int i = 0; i < streams.size(); i++)
+                        streams[i]->Update(*theServer, assets, now);
+                }
+                {
+                    ScopedTimer timer(frameStats, FrameStats::SECTION_POLL);
+                    theServer->Update();
+                }
+                DispatchCallbacks();
+                if (reactorCount > 0)
+                    RefreshSnapshot();
+            }
+            if (frameStats.Enabled)
+            {
+                frameStats.EndFrame();
+                ShowFrameStats();
+            }
+        }
+
+        /// <summary>
+        /// Start logging value changes to a file; an empty path stops
+        /// </summary>
+        bool SetChangeLog(const string& path)
+        {
+            changeLog.Close();
+            if (path.empty())
+                return true;
+            logFrame = frame;
+            return changeLog.Open(path);
+        }
+
+        /// <summary>
+        /// Re-apply the changes in a log from the next Update on
+        /// </summary>
+        bool Replay(const string& path)
+        {
+            vector<ChangeLog::Change> changes;
+            if (!ChangeLog::Read(path, changes))
+                return false;
+            replay.swap(changes);
+            replayNext = 0;
+            replayFrame = frame;
+            return true;
+        }
+
+        /// <summary>
+        /// Apply the replayed changes due by this frame, as one post per frame
+        /// </summary>
+        void ApplyReplay()
+        {
+            if (replayNext >= replay.size())
+                return;
+
+            map<string, string> values;
+            for (; replayNext < replay.size() && replay[replayNext].Frame <= frame - replayFrame; replayNext++)
+                values[replay[replayNext].Id] = replay[replayNext].Value;
+            if (!values.empty())
+                OnPost(values, ChangeLog::SOURCE_REPLAY);
+        }
+
+        /// <summary>
+        /// Get the index of a preset
+        /// </summary>
+        /// <returns>-1 if there is none</returns>
+        int FindPreset(const string& name)
+        {
+            for (unsigned int i = 0; i < presets.size(); i++)
+            {
+                if (presets[i].Name == name)
+                    return (int)i;
+            }
+            return -1;
+        }
+
+        /// <summary>
+        /// Queue a preset change for the next Update; any thread
+        /// </summary>
+        void QueuePreset(PresetOp::Kind what, const string& name, const string& other)
+        {
+            MutexLock hold(postLock);
+            presetOps.push_back(PresetOp());
+            presetOps.back().What = what;
+            presetOps.back().Name = name;
+            presetOps.back().Other = other;
+        }
+
+        /// <summary>
+        /// Make the preset changes queued since the last Update, so a switch
+        /// lands between frames and its callbacks run together in this one
+        /// </summary>
+        void ApplyPresetOps()
+        {
+            vector<PresetOp> ops;
+            {
+                MutexLock hold(postLock);
+                ops.swap(presetOps);
+            }
+            if (ops.empty())
+                return;
 
-            SaveInputs();
+            bool changed = false;   // what is saved to disk
+            for (unsigned int i = 0; i < ops.size(); i++)
+            {
+                const PresetOp& op = ops[i];
+                switch (op.What)
+                {
+                case PresetOp::PRESET_SAVE:
+                    changed |= SavePreset(op.Name, op.Other);
+                    break;
+                case PresetOp::PRESET_APPLY:
+                    ApplyPreset(op.Name);
+                    break;
+                case PresetOp::PRESET_DELETE:
+                    changed |= DeletePreset(op.Name);
+                    break;
+                case PresetOp::PRESET_FLIP:
+                    ApplyPreset((presetCurrent == presetA)? presetB: presetA);
+                    break;
+                case PresetOp::PRESET_AB:
+                    {
+                        MutexLock hold(presetLock);
+                        presetA = op.Name;
+                        presetB = op.Other;
+                    }
+                    changed = true;
+                    break;
+                }
+            }
+            if (changed)
+                SavePresets();
+            ShowPresets();
+        }
 
-            inputs.clear();
-            forms.clear();
+        /// <summary>
+        /// Save the values of a form's inputs, or of every input, under a name.
+        /// Values the client can't set and the manager's own forms are left out.
+        /// </summary>
+        bool SavePreset(const string& name, const string& formName)
+        {
+            if (name.empty())
+                return false;
+
+            Preset preset;
+            preset.Name = name;
+            preset.Form = formName;
+            for (map<string, InputBase*>::iterator i = inputs.begin(); i != inputs.end(); ++i)
+            {
+                InputBase* input = (*i).second;
+                const string& form = input->pForm->Name;
+                if (input->ReadOnly || input->AlwaysNotify() || form == PresetForm || form == StatsForm ||
+                    (!formName.empty() && form != formName))
+                    continue;
+                preset.Values.push_back(make_pair((*i).first, input->ToString()));
+            }
+
+            MutexLock hold(presetLock);
+            int index = FindPreset(name);
+            if (index < 0)
+                presets.push_back(preset);
+            else
+                presets[index] = preset;
+            presetCurrent = name;
+            return true;
         }
 
         /// <summary>
-        /// Load input values to restore
+        /// Set the inputs whose values differ from a preset's; the rest are not touched
         /// </summary>
-        void LoadInputs()
+        void ApplyPreset(const string& name)
         {
-            restoredInputs.clear();
+            int index = FindPreset(name);
+            if (index < 0)
+                return;
 
-			IniFile ini(theFolder + "/WebConfig.ini");
-			vector<string> keys;
-			if (ini.ReadSectionKeys("Inputs", keys) > 0)
-			{
-				for (vector<string>::iterator i = keys.begin(); i != keys.end(); ++i)
-				{
-					string key = (*i);
-					string value = ini.ReadString("Inputs", key, "");
-					restoredInputs.push_back(SavedValue(key, value));
-				}
-			}
+            TraceScope trace("ApplyPreset", name.c_str());
+            const Preset& preset = presets[index];
+            for (unsigned int i = 0; i < preset.Values.size(); i++)
+            {
+                map<string, InputBase*>::iterator j = inputs.find(preset.Values[i].first);
+                if (j == inputs.end())
+                    continue;
+                InputBase* input = (*j).second;
+                if (input->ToString() != preset.Values[i].second &&
+                    SetInputValue(input, preset.Values[i].second, ChangeLog::SOURCE_PRESET))
+                {
+                    PushValue(input);
+                }
+            }
+
+            MutexLock hold(presetLock);
+            presetCurrent = name;
         }
 
         /// <summary>
-        /// Save input values for forms with AutoSave
+        /// Delete a preset, and forget it as the current one or as A or B
         /// </summary>
-        void SaveInputs()
+        /// <returns>false if there is none</returns>
+        bool DeletePreset(const string& name)
         {
-			IniFile ini(theFolder + "/WebConfig.ini");
-			for (map<string,InputBase*>::iterator i = inputs.begin(); i != inputs.end(); ++i)
+            MutexLock hold(presetLock);
+            int index = FindPreset(name);
+            if (index < 0)
+                return false;
+            presets.erase(presets.begin() + index);
+            if (presetCurrent == name)
+                presetCurrent = "";
+            if (presetA == name)
+                presetA = "";
+            if (presetB == name)
+                presetB = "";
+            return true;
+        }
+
+        /// <summary>
+        /// Write the presets to PresetFile as JSON
+        /// </summary>
+        void SavePresets()
+        {
+            string json;
+            JsonWriter w(json);
+            w.BeginObject();
+            w.Property("a", presetA);
+            w.Property("b", presetB);
+            w.Name("presets");
+            w.BeginArray();
+            for (unsigned int i = 0; i < presets.size(); i++)
             {
-				InputBase* input = (*i).second;
-                if (input->pForm->AutoSave && !input->ToString().empty())
-				{
-					ini.WriteString("Inputs", (*i).first, input->ToString());
-				}
+                w.BeginObject();
+                w.Property("name", presets[i].Name);
+                w.Property("form", presets[i].Form);
+                w.Name("values");
+                w.BeginObject();
+                for (unsigned int j = 0; j < presets[i].Values.size(); j++)
+                    w.Property(presets[i].Values[j].first, presets[i].Values[j].second);
+                w.EndObject();
+                w.EndObject();
             }
+            w.EndArray();
+            w.EndObject();
+
+            FILE* file = fopen((theFolder + PresetFile).c_str(), "wb");
+            if (file == NULL)
+                return;
+            fwrite(json.data(), 1, json.length(), file);
+            fclose(file);
         }
 
         /// <summary>
-        /// Update the manager; should be called periodically
+        /// Read the presets saved by an earlier run
         /// </summary>
-        void Update()
+        void LoadPresets()
+        {
+            FILE* file = fopen((theFolder + PresetFile).c_str(), "rb");
+            if (file == NULL)
+                return;
+            string data;
+            char buffer[4096];
+            size_t n;
+            while ((n = fread(buffer, 1, sizeof(buffer), file)) > 0)
+                data.append(buffer, n);
+            fclose(file);
+
+            MutexLock hold(presetLock);
+            JsonReader r(data.data(), data.length());
+            if (r.Read() != JsonReader::TOKEN_BEGIN_OBJECT)
+                return;
+            while (r.Read() == JsonReader::TOKEN_NAME)
+            {
+                string name = r.Value();
+                r.Read();
+                if (name == "a" && r.GetToken() == JsonReader::TOKEN_STRING)
+                    presetA = r.Value();
+                else if (name == "b" && r.GetToken() == JsonReader::TOKEN_STRING)
+                    presetB = r.Value();
+                else if (name == "presets" && r.GetToken() == JsonReader::TOKEN_BEGIN_ARRAY)
+                {
+                    while (r.Read() == JsonReader::TOKEN_BEGIN_OBJECT)
+                    {
+                        Preset preset;
+                        while (r.Read() == JsonReader::TOKEN_NAME)
+                        {
+                            string member = r.Value();
+                            r.Read();
+                            if (member == "name" && r.GetToken() == JsonReader::TOKEN_STRING)
+                                preset.Name = r.Value();
+                            else if (member == "form" && r.GetToken() == JsonReader::TOKEN_STRING)
+                                preset.Form = r.Value();
+                            else if (member == "values" && r.GetToken() == JsonReader::TOKEN_BEGIN_OBJECT)
+                            {
+                                while (r.Read() == JsonReader::TOKEN_NAME)
+                                {
+                                    string id = r.Value();
+                                    r.Read();
+                                    string value;
+                                    if (GetJsonValue(r, value))
+                                        preset.Values.push_back(make_pair(id, value));
+                                    else if (!r.Skip())
+                                        return;
+                                }
+                            }
+                            else if (!r.Skip())
+                                return;
+                        }
+                        if (!preset.Name.empty() && FindPreset(preset.Name) < 0)
+                            presets.push_back(preset);
+                    }
+                }
+                else if (!r.Skip())
+                    return;
+            }
+        }
+
+        /// <summary>
+        /// Get the name of the preset a select of the preset form chose
+        /// </summary>
+        string GetPresetChoice(int choice)
+        {
+            return (choice > 0 && choice <= (int)presets.size())? presets[choice - 1].Name: "";
+        }
+
+        /// <summary>
+        /// Get the option of the preset form's selects that shows a preset
+        /// </summary>
+        int GetPresetOption(const string& name)
+        {
+            return FindPreset(name) + 1;
+        }
+
+        /// <summary>
+        /// Show the presets in the preset form's selects
+        /// </summary>
+        void ShowPresets()
+        {
+            if (presetChooser == NULL)
+                return;
+
+            InputSelect* selects[] = { presetChooser, presetChooserA, presetChooserB };
+            for (int i = 0; i < 3; i++)
+            {
+                selects[i]->ClearOptions();
+                selects[i]->AddOption("-");
+                for (unsigned int j = 0; j < presets.size(); j++)
+                    selects[i]->AddOption(presets[j].Name);
+            }
+            presetChoice = GetPresetOption(presetCurrent);
+            presetChoiceA = GetPresetOption(presetA);
+            presetChoiceB = GetPresetOption(presetB);
+            GetFormSettings(PresetForm)->Invalidate();
+        }
+
+        /// <summary>
+        /// Add the form that saves, applies and flips presets
+        /// </summary>
+        void AddPresetForm()
+        {
+            if (presetChooser != NULL)
+                return;
+
+            struct Callbacks
+            {
+                static void OnChoose()
+                {
+                    PresetOwner->QueuePreset(PresetOp::PRESET_APPLY, PresetOwner->GetPresetChoice(PresetOwner->presetChoice), "");
+                }
+                static void OnSave()
+                {
+                    PresetOwner->QueuePreset(PresetOp::PRESET_SAVE, PresetOwner->presetName, PresetOwner->presetFormName);
+                }
+                static void OnDelete()
+                {
+                    PresetOwner->QueuePreset(PresetOp::PRESET_DELETE, PresetOwner->presetName, "");
+                }
+                static void OnChooseAB()
+                {
+                    PresetOwner->QueuePreset(PresetOp::PRESET_AB, PresetOwner->GetPresetChoice(PresetOwner->presetChoiceA),
+                        PresetOwner->GetPresetChoice(PresetOwner->presetChoiceB));
+                }
+                static void OnFlip()
+                {
+                    PresetOwner->QueuePreset(PresetOp::PRESET_FLIP, "", "");
+                }
+            };
+
+            PresetOwner = this;
+            string form = PresetForm;
+            GetFormSettings(form)->AutoSubmit = true;
+            presetChooser = new InputSelect(form + "/apply", presetChoice);
+            presetChooser->SetCallback(&Callbacks::OnChoose);
+            new InputText(form + "/name", presetName);
+            InputText* formName = new InputText(form + "/form", presetFormName);
+            formName->Title = "form to save, or empty for every form";
+            new InputButton(form + "/save", &Callbacks::OnSave);
+            new InputButton(form + "/delete", &Callbacks::OnDelete);
+            presetChooserA = new InputSelect(form + "/A", presetChoiceA);
+            presetChooserA->SetCallback(&Callbacks::OnChooseAB);
+            presetChooserB = new InputSelect(form + "/B", presetChoiceB);
+            presetChooserB->SetCallback(&Callbacks::OnChooseAB);
+            new InputButton(form + "/flip A-B", &Callbacks::OnFlip);
+            ShowPresets();
+        }
+
+        /// <summary>
+        /// Turn the frame timing on or off, with the form that shows it
+        /// </summary>
+        void SetFrameStats(bool enabled)
+        {
+            frameStats.Enabled = enabled;
+            frameStats.Reset();
+            if (theServer != NULL)
+                theServer->UpdateStats = enabled? &frameStats: NULL;
+
+            if (enabled && statsInputs.empty())
+            {
+                for (int i = 0; i < FrameStats::SECTION_COUNT; i++)
+                {
+                    InputText* input = new InputText(string(StatsForm) + "/" +
+                        FrameStats::GetSectionName((FrameStats::Section)i), statsText[i]);
+                    input->ReadOnly = true;
+                    statsInputs.push_back(input);
+                }
+            }
+            else if (!enabled)
+            {
+                for (unsigned int i = 0; i < statsInputs.size(); i++)
+                {
+                    RemoveInput(statsInputs[i]);
+                    delete statsInputs[i];
+                }
+                statsInputs.clear();
+
+                // leave no empty form in the menu
+                map<string, FormSettings*>::iterator form = forms.find(StatsForm);
+                if (form != forms.end())
+                {
+                    delete (*form).second;
+                    forms.erase(form);
+                    ++menuVersion;
+                }
+            }
+        }
+
+        /// <summary>
+        /// Refresh the stats form every StatsInterval
+        /// </summary>
+        void ShowFrameStats()
         {
-            theServer->Update();
+            double now = Clock::Seconds();
+            if (statsInputs.empty() || now < statsShown + StatsInterval)
+                return;
+            statsShown = now;
+
+            for (int i = 0; i < FrameStats::SECTION_COUNT; i++)
+            {
+                FrameStats::Summary summary = frameStats.GetSummary((FrameStats::Section)i);
+                char temp[128];
+                sprintf(temp, "mean %.1f us, p99 %.1f us, max %.1f us",
+                    summary.Mean * 1e-3, summary.P99 * 1e-3, summary.Max * 1e-3);
+                statsText[i] = temp;
+            }
+            GetFormSettings(StatsForm)->Invalidate();
         }
 
         /// <summary>
@@ -482,36 +2278,55 @@ namespace WebConfig
 			map<string, InputBase*>::iterator i = inputs.find(input->UniqueID);
             if (i == inputs.end())
             {
-				for (vector<SavedValue>::iterator j = restoredInputs.begin(); j != restoredInputs.end(); ++j)
-				{
-					if ((*j).UniqueID == input->UniqueID)
-					{
-						// restore value
-						input->SetValue((*j).Value);
-						if (input->OnChange != NULL)
-						{
-							(*input->OnChange)();
-						}
-						break;
-					}
-				}
+                addedInputs.push_back(input);
                 inputs[input->UniqueID] = input;
+                input->pForm->Invalidate();
+                ++menuVersion;
             }
         }
 
+        /// <summary>
+        /// Sample a watch each Update
+        /// </summary>
+        void AddWatch(InputWatchBase* watch)
+        {
+            MutexLock hold(watchLock);
+            watches.push_back(watch);
+        }
+
         /// <summary>
         /// Remove an input from the dictionary
         /// </summary>
         void RemoveInput(InputBase* input)
         {
+            {
+                MutexLock hold(watchLock);
+                for (unsigned int i = 0; i < watches.size(); i++)
+                {
+                    if (watches[i] == input)
+                    {
+                        watches.erase(watches.begin() + i);
+                        break;
+                    }
+                }
+            }
+
+            vector<InputBase*>::iterator added = find(addedInputs.begin(), addedInputs.end(), input);
+            if (added != addedInputs.end())
+                addedInputs.erase(added);
+
 			map<string, InputBase*>::iterator i = inputs.find(input->UniqueID);
             if (i != inputs.end())
             {
                 inputs.erase(i);
+                input->pForm->Invalidate();
+                ++menuVersion;
             }
         }
     };
 
+    ManagerImpl* ManagerImpl::PresetOwner = NULL;
+
 	/// <summary>
 	/// Constructor
 	/// </summary>
@@ -560,6 +2375,14 @@ namespace WebConfig
 		pImpl->AddInput(input);
 	}
 
+	/// <summary>
+	/// Sample a watch each Update
+	/// </summary>
+	void Manager::AddWatch(InputWatchBase* watch)
+	{
+		pImpl->AddWatch(watch);
+	}
+
 	/// <summary>
 	/// Remove an input from the dictionary
 	/// </summary>
@@ -568,6 +2391,172 @@ namespace WebConfig
 		pImpl->RemoveInput(input);
 	}
 
+	/// <summary>
+	/// Set the Cache-Control header sent for urls starting with a prefix
+	/// </summary>
+	void Manager::SetCachePolicy(std::string urlPrefix, std::string cacheControl)
+	{
+		pImpl->SetCachePolicy(urlPrefix, cacheControl);
+	}
+
+	/// <summary>
+	/// Get the screen capture queue
+	/// </summary>
+	ScreenCapture& Manager::GetScreenCapture()
+	{
+		return pImpl->capture;
+	}
+
+	/// <summary>
+	/// Add a live preview served at url
+	/// </summary>
+	ImageStream* Manager::AddImageStream(std::string url, CaptureSource* source)
+	{
+		return pImpl->AddImageStream(url, source);
+	}
+
+	/// <summary>
+	/// Log value changes
+	/// </summary>
+	bool Manager::SetChangeLog(std::string path)
+	{
+		return pImpl->SetChangeLog(path);
+	}
+
+	/// <summary>
+	/// Re-apply a change log
+	/// </summary>
+	bool Manager::Replay(std::string path)
+	{
+		return pImpl->Replay(path);
+	}
+
+	/// <summary>
+	/// Check for changes still to replay
+	/// </summary>
+	bool Manager::IsReplaying()
+	{
+		return pImpl->replayNext < pImpl->replay.size();
+	}
+
+	/// <summary>
+	/// Save a preset at the next Update
+	/// </summary>
+	void Manager::SavePreset(std::string name, std::string formName)
+	{
+		pImpl->QueuePreset(ManagerImpl::PresetOp::PRESET_SAVE, name, formName);
+	}
+
+	/// <summary>
+	/// Apply a preset at the next Update
+	/// </summary>
+	void Manager::ApplyPreset(std::string name)
+	{
+		pImpl->QueuePreset(ManagerImpl::PresetOp::PRESET_APPLY, name, "");
+	}
+
+	/// <summary>
+	/// Delete a preset at the next Update
+	/// </summary>
+	void Manager::DeletePreset(std::string name)
+	{
+		pImpl->QueuePreset(ManagerImpl::PresetOp::PRESET_DELETE, name, "");
+	}
+
+	/// <summary>
+	/// Set the presets FlipPresets switches between
+	/// </summary>
+	void Manager::SetPresetsAB(std::string a, std::string b)
+	{
+		pImpl->QueuePreset(ManagerImpl::PresetOp::PRESET_AB, a, b);
+	}
+
+	/// <summary>
+	/// Switch between presets A and B at the next Update
+	/// </summary>
+	void Manager::FlipPresets()
+	{
+		pImpl->QueuePreset(ManagerImpl::PresetOp::PRESET_FLIP, "", "");
+	}
+
+	/// <summary>
+	/// Add the form that saves, applies and flips presets
+	/// </summary>
+	void Manager::AddPresetForm()
+	{
+		pImpl->AddPresetForm();
+	}
+
+	/// <summary>
+	/// Add a high rate signal
+	/// </summary>
+	Telemetry* Manager::AddTelemetry(std::string name, double resolution)
+	{
+		return pImpl->AddTelemetry(name, resolution);
+	}
+
+	/// <summary>
+	/// Set the bounds on connections, queued output and request size
+	/// </summary>
+	void Manager::SetServerLimits(const HTTPServerLimits& limits)
+	{
+		pImpl->SetServerLimits(limits);
+	}
+
+	/// <summary>
+	/// Set how responses are compressed
+	/// </summary>
+	void Manager::SetCompression(int level, size_t threshold)
+	{
+		pImpl->SetCompression(level, threshold);
+	}
+
+	/// <summary>
+	/// Set the memory cap for static files held in memory
+	/// </summary>
+	void Manager::SetAssetCacheSize(size_t bytes)
+	{
+		MutexLock hold(pImpl->assetLock);
+		pImpl->assets.SetCapacity(bytes);
+	}
+
+	/// <summary>
+	/// Serve the port from threads instead of Update
+	/// </summary>
+	void Manager::SetReactors(int count)
+	{
+		pImpl->reactorCount = count;
+	}
+
+	/// <summary>
+	/// Print each request received
+	/// </summary>
+	void Manager::SetLogRequests(bool log)
+	{
+		pImpl->logRequests = log;
+		if (pImpl->theServer != NULL)
+		{
+			pImpl->theServer->LogRequests = log;
+			pImpl->theServer->ShareSettings();
+		}
+	}
+
+	/// <summary>
+	/// Time each part of Update
+	/// </summary>
+	void Manager::SetFrameStats(bool enabled)
+	{
+		pImpl->SetFrameStats(enabled);
+	}
+
+	/// <summary>
+	/// Record trace events
+	/// </summary>
+	void Manager::SetTrace(bool enabled)
+	{
+		Trace::Enable(enabled);
+	}
+
 	/// <summary>
 	/// Get the root folder
 	/// </summary>
@@ -11,8 +11,14 @@
 namespace WebConfig
 {
 	class InputBase;
+	class InputWatchBase;
 	class ManagerImpl;
 	class FormSettings;
+	class ScreenCapture;
+	class ImageStream;
+	class CaptureSource;
+	class Telemetry;
+	struct HTTPServerLimits;
 
 	class Manager
 	{
@@ -56,7 +62,9 @@ namespace WebConfig
 		void Shutdown();
 
 		/// <summary>
-		/// Update the manager; should be called periodically
+		/// Update the manager; should be called periodically.
+		/// OnChange callbacks for values changed since the last
+		/// update run here, once each, after requests are handled.
 		/// </summary>
 		void Update();
 
@@ -70,15 +78,180 @@ namespace WebConfig
 		/// </summary>
 		void AddInput(InputBase* input);
 
+		/// <summary>
+		/// Sample a watch each Update; InputWatch does this itself
+		/// </summary>
+		void AddWatch(InputWatchBase* watch);
+
 		/// <summary>
 		/// Remove an input from the dictionary
 		/// </summary>
 		void RemoveInput(InputBase* input);
 
+		/// <summary>
+		/// Set the Cache-Control header sent for urls starting with a prefix,
+		/// eg. SetCachePolicy("/scripts/", "max-age=3600"); the default is
+		/// "no-cache" which makes browsers revalidate with If-None-Match
+		/// </summary>
+		void SetCachePolicy(std::string urlPrefix, std::string cacheControl);
+
+		/// <summary>
+		/// Set the memory cap for static files held in memory; files are
+		/// dropped least recently used first and when they change on disk.
+		/// The default is 16MB and 0 turns the cache off.
+		/// </summary>
+		void SetAssetCacheSize(size_t bytes);
+
+		/// <summary>
+		/// Set how responses are compressed for clients that send Accept-Encoding.
+		/// Pages of at least threshold bytes are deflated at level 1 (fastest) to
+		/// 9 (smallest); level 0 turns compression off. Static text files are
+		/// compressed once when cached, or taken from a ".gz" file beside them.
+		/// The default is level 6 and 512 bytes.
+		/// </summary>
+		void SetCompression(int level, size_t threshold);
+
+		/// <summary>
+		/// Set the bounds on what clients may cost: the most connections, the
+		/// output queued for one client before its requests stop being read,
+		/// how long a client may leave output unread before it is dropped,
+		/// and the largest request headers and body. Counters for each are
+		/// served at /api/server.
+		/// </summary>
+		void SetServerLimits(const HTTPServerLimits& limits);
+
+		/// <summary>
+		/// Serve the port from count threads of its own instead of from Update;
+		/// call before Startup. For heavy api traffic on Linux. Requests are
+		/// answered from a snapshot of the inputs that Update takes when they
+		/// change. Posted values are queued for Update to set, so the
+		/// application's variables are only touched on its own thread: api
+		/// posts are answered 202 at once, and form posts once the next Update
+		/// has set them, without holding up the reactor's other connections.
+		/// 0, the default, serves the port from Update.
+		/// </summary>
+		void SetReactors(int count);
+
+		/// <summary>
+		/// Print each request received to stderr; on by default. Turn it off
+		/// when requests are too many to read, eg. under load.
+		/// </summary>
+		void SetLogRequests(bool log);
+
+		/// <summary>
+		/// Time each part of Update: socket polling, request parsing, page
+		/// rendering, the application's callbacks and publishing assets. The
+		/// mean, p99 and max over recent frames are served at /api/stats and
+		/// shown in the "webconfig stats" form while enabled. Call it after
+		/// creating the application's inputs so their ids do not change.
+		/// </summary>
+		void SetFrameStats(bool enabled);
+
+		/// <summary>
+		/// Record begin and end events for accepting, reading, parsing and
+		/// sending on each connection, OnResponse, each input's ToHtml and
+		/// the OnChange callbacks. The last events of each thread are served
+		/// at /trace as Chrome trace-event JSON, for chrome://tracing or
+		/// ui.perfetto.dev. The application can add its own spans, eg. its
+		/// frames, with Trace::Begin and Trace::End from Support/Trace.h.
+		/// </summary>
+		void SetTrace(bool enabled);
+
+		/// <summary>
+		/// Get the screen capture queue. Frames submitted to it are encoded
+		/// on a worker thread and served from memory at their url once
+		/// Update publishes them.
+		/// </summary>
+		ScreenCapture& GetScreenCapture();
+
+		/// <summary>
+		/// Add a live preview at url, eg. of the viewport. Browsers show it
+		/// in an img tag as MJPEG; frames are captured from source only while
+		/// it is being watched. The manager owns the stream but not the source.
+		/// </summary>
+		/// <returns>the stream, to set its frame rate, resolution and quality</returns>
+		ImageStream* AddImageStream(std::string url, CaptureSource* source);
+
+		/// <summary>
+		/// Add a signal sampled faster than Update runs, eg. physics substeps
+		/// or audio levels, or get the one already added under name. Each
+		/// thread pushing samples takes a producer from it. Samples are folded
+		/// into min, max and mean buckets on a background thread and served
+		/// at /api/telemetry/{name}; InputTelemetry graphs them on a form. The
+		/// manager owns the signal until Shutdown.
+		/// </summary>
+		/// <param name="resolution">width of the finest buckets in seconds</param>
+		Telemetry* AddTelemetry(std::string name, double resolution = 0.001);
+
+		/// <summary>
+		/// Append every value change to a binary log: form and WebSocket
+		/// posts, api posts, values restored by AutoSave and replayed ones,
+		/// each with its frame and time. Changes are queued on the calling
+		/// thread and written in batches by a writer thread. Set it before
+		/// creating inputs to log the restored values too; an empty path
+		/// stops logging.
+		/// </summary>
+		/// <returns>false if the file can't be opened</returns>
+		bool SetChangeLog(std::string path);
+
+		/// <summary>
+		/// Re-apply the changes in a log at the frames they were made,
+		/// counting from the next Update, with their callbacks as usual.
+		/// Create the inputs the same way as the logged run so their ids
+		/// match; nothing needs a browser, so a headless run can replay a
+		/// tuning session.
+		/// </summary>
+		/// <returns>false if the file can't be read</returns>
+		bool Replay(std::string path);
+
+		/// <summary>
+		/// Check whether logged changes are still waiting to be replayed
+		/// </summary>
+		bool IsReplaying();
+
+		/// <summary>
+		/// Save the values of a form's inputs, or of every input when formName
+		/// is empty, as a named preset, replacing any of the same name. Inputs
+		/// the client can't set are left out. Presets are kept in
+		/// WebConfigPresets.json in the root folder. Like the other preset
+		/// calls it is safe from any thread and takes effect at the start of
+		/// the next Update.
+		/// </summary>
+		void SavePreset(std::string name, std::string formName = "");
+
+		/// <summary>
+		/// Switch to a preset between frames: only the inputs whose values
+		/// differ are set, and each OnChange callback runs once in that Update
+		/// however many of its inputs changed
+		/// </summary>
+		void ApplyPreset(std::string name);
+
+		/// <summary>
+		/// Delete a preset
+		/// </summary>
+		void DeletePreset(std::string name);
+
+		/// <summary>
+		/// Set the two presets FlipPresets switches between
+		/// </summary>
+		void SetPresetsAB(std::string a, std::string b);
+
+		/// <summary>
+		/// Apply preset B if A was the one applied last, otherwise A; eg. on
+		/// a hotkey, to compare two tunings
+		/// </summary>
+		void FlipPresets();
+
+		/// <summary>
+		/// Add the "webconfig presets" form to apply, save and delete presets
+		/// from a browser, and to pick and flip between A and B
+		/// </summary>
+		void AddPresetForm();
+
 		/// <summary>
 		/// Get the root folder
 		/// </summary>
-		std::string Manager::GetFolder();
+		std::string GetFolder();
 	};
 }
 
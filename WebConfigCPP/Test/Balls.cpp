@@ -0,0 +1,226 @@
+// WebConfig - Use a web browser to configure your application
+// Copyright (c) 2009 David McClurg <dpm@efn.org>
+// Under the MIT License, details: License.txt.
+
+#include "Balls.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#	define BALLS_SSE
+#	include <xmmintrin.h>
+#endif
+
+// gcc builds the avx kernel whatever the target and checks the cpu when
+// it runs; other compilers build it when the target has avx
+#if defined(BALLS_SSE) && defined(__GNUC__)
+#	define BALLS_AVX __attribute__((target("avx")))
+#	include <immintrin.h>
+#elif defined(__AVX__)
+#	define BALLS_AVX
+#	include <immintrin.h>
+#endif
+
+#ifdef _WIN32
+#	include <malloc.h>
+#endif
+
+namespace SampleApp
+{
+	static float* AllocateFloats(int count)
+	{
+#ifdef _WIN32
+		return (float*)_aligned_malloc(count * sizeof(float), Balls::Alignment);
+#else
+		void* p = NULL;
+		return (posix_memalign(&p, Balls::Alignment, count * sizeof(float)) == 0)? (float*)p: NULL;
+#endif
+	}
+
+	static void FreeFloats(float* p)
+	{
+#ifdef _WIN32
+		_aligned_free(p);
+#else
+		free(p);
+#endif
+	}
+
+	Balls::Balls()
+	{
+		X = Y = VX = VY = NULL;
+		count = 0;
+		capacity = 0;
+	}
+
+	Balls::~Balls()
+	{
+		FreeFloats(X);
+		FreeFloats(Y);
+		FreeFloats(VX);
+		FreeFloats(VY);
+	}
+
+	/// <summary>
+	/// Set the number of balls
+	/// </summary>
+	void Balls::Resize(int newCount)
+	{
+		int padded = (newCount + Padding - 1) / Padding * Padding;
+		if (padded > capacity)
+		{
+			float** arrays[] = { &X, &Y, &VX, &VY };
+			for (int i = 0; i < 4; i++)
+			{
+				float* p = AllocateFloats(padded);
+				if (count > 0)
+					memcpy(p, *arrays[i], count * sizeof(float));
+				FreeFloats(*arrays[i]);
+				*arrays[i] = p;
+			}
+			capacity = padded;
+		}
+
+		// new balls and the padding are still at the origin, even where
+		// the padding held balls before the count went down
+		int first = (newCount < count)? newCount: count;
+		if (padded > first)
+		{
+			int n = (padded - first) * sizeof(float);
+			memset(X + first, 0, n);
+			memset(Y + first, 0, n);
+			memset(VX + first, 0, n);
+			memset(VY + first, 0, n);
+		}
+		count = newCount;
+	}
+
+	static void MoveScalar(float* pos, float* vel, int begin, int end, float speed, float max)
+	{
+		for (int i = begin; i < end; i++)
+		{
+			float p = pos[i] + vel[i] * speed;
+			pos[i] = p;
+			if (p <= 0 || p >= max)
+				vel[i] = -vel[i];
+		}
+	}
+
+#ifdef BALLS_SSE
+	static void MoveSSE(float* pos, float* vel, int begin, int end, float speed, float max)
+	{
+		const __m128 s = _mm_set1_ps(speed);
+		const __m128 zero = _mm_setzero_ps();
+		const __m128 limit = _mm_set1_ps(max);
+		const __m128 sign = _mm_set1_ps(-0.0f);
+		for (int i = begin; i < end; i += 4)
+		{
+			__m128 v = _mm_load_ps(vel + i);
+			__m128 p = _mm_add_ps(_mm_load_ps(pos + i), _mm_mul_ps(v, s));
+			__m128 bounce = _mm_or_ps(_mm_cmple_ps(p, zero), _mm_cmpge_ps(p, limit));
+			_mm_store_ps(pos + i, p);
+			_mm_store_ps(vel + i, _mm_xor_ps(v, _mm_and_ps(bounce, sign)));
+		}
+	}
+#endif
+
+#ifdef BALLS_AVX
+	BALLS_AVX static void MoveAVX(float* pos, float* vel, int begin, int end, float speed, float max)
+	{
+		const __m256 s = _mm256_set1_ps(speed);
+		const __m256 zero = _mm256_setzero_ps();
+		const __m256 limit = _mm256_set1_ps(max);
+		const __m256 sign = _mm256_set1_ps(-0.0f);
+		for (int i = begin; i < end; i += 8)
+		{
+			__m256 v = _mm256_load_ps(vel + i);
+			__m256 p = _mm256_add_ps(_mm256_load_ps(pos + i), _mm256_mul_ps(v, s));
+			__m256 bounce = _mm256_or_ps(_mm256_cmp_ps(p, zero, _CMP_LE_OQ), _mm256_cmp_ps(p, limit, _CMP_GE_OQ));
+			_mm256_store_ps(pos + i, p);
+			_mm256_store_ps(vel + i, _mm256_xor_ps(v, _mm256_and_ps(bounce, sign)));
+		}
+	}
+#endif
+
+	/// <summary>
+	/// Move balls begin to end and bounce them off the walls
+	/// </summary>
+	void Balls::Move(int begin, int end, float speed, float maxX, float maxY, Kernel kernel)
+	{
+		if (kernel == KERNEL_BEST)
+			kernel = GetBestKernel();
+
+		// the axes are independent; each pass streams one position and one velocity array
+		switch (kernel)
+		{
+#ifdef BALLS_AVX
+		case KERNEL_AVX:
+			MoveAVX(X, VX, begin, end, speed, maxX);
+			MoveAVX(Y, VY, begin, end, speed, maxY);
+			break;
+#endif
+#ifdef BALLS_SSE
+		case KERNEL_SSE:
+			MoveSSE(X, VX, begin, end, speed, maxX);
+			MoveSSE(Y, VY, begin, end, speed, maxY);
+			break;
+#endif
+		default:
+			MoveScalar(X, VX, begin, end, speed, maxX);
+			MoveScalar(Y, VY, begin, end, speed, maxY);
+			break;
+		}
+	}
+
+	/// <summary>
+	/// Check whether this build and machine can run a kernel
+	/// </summary>
+	bool Balls::HasKernel(Kernel kernel)
+	{
+		switch (kernel)
+		{
+		case KERNEL_SCALAR:
+		case KERNEL_BEST:
+			return true;
+#ifdef BALLS_SSE
+		case KERNEL_SSE:
+			return true;
+#endif
+#ifdef BALLS_AVX
+		case KERNEL_AVX:
+#	ifdef __GNUC__
+			return __builtin_cpu_supports("avx") != 0;
+#	else
+			return true;
+#	endif
+#endif
+		default:
+			return false;
+		}
+	}
+
+	/// <summary>
+	/// Get the kernel KERNEL_BEST stands for
+	/// </summary>
+	Balls::Kernel Balls::GetBestKernel()
+	{
+		static const Kernel best =
+			HasKernel(KERNEL_AVX)? KERNEL_AVX: HasKernel(KERNEL_SSE)? KERNEL_SSE: KERNEL_SCALAR;
+		return best;
+	}
+
+	/// <summary>
+	/// Get the name of a kernel
+	/// </summary>
+	const char* Balls::GetKernelName(Kernel kernel)
+	{
+		switch (kernel)
+		{
+		case KERNEL_SCALAR: return "scalar";
+		case KERNEL_SSE: return "sse";
+		case KERNEL_AVX: return "avx";
+		default: return GetKernelName(GetBestKernel());
+		}
+	}
+}
@@ -0,0 +1,94 @@
+// WebConfig - Use a web browser to configure your application
+// Copyright (c) 2009 David McClurg <dpm@efn.org>
+// Under the MIT License, details: License.txt.
+
+#ifndef BALLS_H
+#define BALLS_H
+
+namespace SampleApp
+{
+	/// <summary>
+	/// Positions and velocities of the balls as a structure of arrays, so
+	/// moving them streams through four dense arrays of floats that SIMD
+	/// kernels load whole registers from. Each array starts on a cache line
+	/// and is padded with still balls to a whole number of cache lines, so
+	/// kernels need no remainder loop and threads can split the balls on
+	/// cache line boundaries.
+	/// </summary>
+	class Balls
+	{
+	public:
+
+		enum
+		{
+			Alignment = 64,						// bytes; a cache line
+			Padding = Alignment / sizeof(float)	// balls per cache line of each array
+		};
+
+		/// <summary>
+		/// Ways of moving the balls; each gives the same result
+		/// </summary>
+		enum Kernel
+		{
+			KERNEL_SCALAR,
+			KERNEL_SSE,		// 4 balls at a time
+			KERNEL_AVX,		// 8 balls at a time
+			KERNEL_BEST		// the fastest this machine has
+		};
+
+		float* X;
+		float* Y;
+		float* VX;
+		float* VY;
+
+		Balls();
+		~Balls();
+
+		/// <summary>
+		/// Get the number of balls
+		/// </summary>
+		int Count() const { return count; }
+
+		/// <summary>
+		/// Get the number of balls rounded up to a whole number of cache lines
+		/// </summary>
+		int PaddedCount() const { return (count + Padding - 1) / Padding * Padding; }
+
+		/// <summary>
+		/// Set the number of balls; balls kept keep their values and new ones are still at 0,0
+		/// </summary>
+		void Resize(int count);
+
+		/// <summary>
+		/// Move balls begin to end by their velocity times speed and bounce
+		/// them off the walls at 0 and at maxX and maxY. begin and end are
+		/// multiples of Padding, or end is PaddedCount().
+		/// </summary>
+		void Move(int begin, int end, float speed, float maxX, float maxY, Kernel kernel = KERNEL_BEST);
+
+		/// <summary>
+		/// Check whether this build and machine can run a kernel
+		/// </summary>
+		static bool HasKernel(Kernel kernel);
+
+		/// <summary>
+		/// Get the kernel KERNEL_BEST stands for
+		/// </summary>
+		static Kernel GetBestKernel();
+
+		/// <summary>
+		/// Get the name of a kernel, eg. "avx"
+		/// </summary>
+		static const char* GetKernelName(Kernel kernel);
+
+	private:
+
+		int count;
+		int capacity;
+
+		Balls(const Balls&);
+		Balls& operator=(const Balls&);
+	};
+}
+
+#endif // #ifndef BALLS_H
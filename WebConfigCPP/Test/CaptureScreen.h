@@ -4,6 +4,21 @@
 #include <windows.h>
 #include <string>
 
-void CaptureScreen(HWND hDesktopWnd, std::string bmpFilename);
+#include "ImageStream.h"
+
+/// grabs the client area of a window straight into a capture frame
+class WindowSource : public WebConfig::CaptureSource
+{
+	HWND hWnd;
+
+public:
+
+	WindowSource(HWND hWnd) : hWnd(hWnd) {}
+	bool GetSize(int& width, int& height);
+	bool Capture(WebConfig::ScreenCapture::Frame& frame);
+};
+
+/// grab the client area of a window and publish it as a PNG at url
+void CaptureScreen(HWND hDesktopWnd, std::string url);
 
 #endif // #ifndef CAPTURESCREEN_H
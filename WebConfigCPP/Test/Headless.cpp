@@ -0,0 +1,124 @@
+// WebConfig - Use a web browser to configure your application
+// Copyright (c) 2009 David McClurg <dpm@efn.org>
+// Under the MIT License, details: License.txt.
+
+// Runs the sample simulation without a window, so the server, the saved
+// inputs and the simulation can be profiled where there is no display.
+// Drawing goes to NullGraphics. Once a second it prints the frame rate
+// and the mean time spent in Manager::Update, Simulation::Update and
+// Simulation::Draw.
+//
+// usage: SampleHeadless [port] [folder] [seconds] [fps]
+//
+// The folder defaults to the current one, so run it from WebConfigCPP.
+// Seconds 0, the default, runs until interrupted; fps 0 runs flat out.
+
+#include "Simulation.h"
+#include "WebConfigManager.h"
+#include "WebConfigInput.h"
+#include "Support/Clock.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <time.h>
+#include <string>
+
+#ifdef _WIN32
+#	include <windows.h>
+#else
+#	include <unistd.h>
+#endif
+
+using namespace std;
+using namespace SampleApp;
+
+static volatile bool quit = false;
+
+static void OnSignal(int)
+{
+	quit = true;
+}
+
+static void SleepSeconds(double seconds)
+{
+#ifdef _WIN32
+	::Sleep((DWORD)(seconds * 1000));
+#else
+	usleep((useconds_t)(seconds * 1e6));
+#endif
+}
+
+int main(int argc, char* argv[])
+{
+	int port = (argc > 1)? atoi(argv[1]): 8080;
+	string folder = (argc > 2)? argv[2]: ".";
+	double seconds = (argc > 3)? atof(argv[3]): 0;
+	int fps = (argc > 4)? atoi(argv[4]): 60;
+
+	signal(SIGINT, OnSignal);
+	signal(SIGTERM, OnSignal);
+#ifndef _WIN32
+	// a client hanging up mustn't kill the server
+	signal(SIGPIPE, SIG_IGN);
+#endif
+
+	WebConfig::Manager& manager = WebConfig::Manager::Instance();
+	manager.SetLogRequests(false);
+	manager.Startup(port, folder);
+
+	srand((unsigned int)time(NULL));
+	Simulation::Instance().Init();
+
+	// graphs of values that change every frame, as in the sample application
+	double frameTime = 0;
+	int ballCount = 0;
+	new WebConfig::InputWatch<double>("debug/frame time (ms)", frameTime);
+	new WebConfig::InputWatch<int>("debug/balls", ballCount);
+	manager.AddPresetForm();
+
+	printf("serving %s on port %d\n", folder.c_str(), port);
+
+	double start = Clock::Seconds();
+	double reported = start;
+	double managerTime = 0, simulationTime = 0, drawTime = 0;
+	int frames = 0;
+	while (!quit && (seconds <= 0 || Clock::Seconds() < start + seconds))
+	{
+		double frameStart = Clock::Seconds();
+		manager.Update();
+		double t1 = Clock::Seconds();
+		Simulation::Instance().Update();
+		double t2 = Clock::Seconds();
+		Simulation::Instance().Draw();
+		double frameEnd = Clock::Seconds();
+
+		managerTime += t1 - frameStart;
+		simulationTime += t2 - t1;
+		drawTime += frameEnd - t2;
+		++frames;
+		frameTime = (frameEnd - frameStart) * 1e3;
+		ballCount = (int)Simulation::Instance().balls.Count();
+
+		if (frameEnd >= reported + 1)
+		{
+			printf("%d fps, %d balls; per frame: manager %.3f ms, simulation %.3f ms, draw %.3f ms\n",
+				(int)(frames / (frameEnd - reported) + 0.5), ballCount,
+				managerTime / frames * 1e3, simulationTime / frames * 1e3, drawTime / frames * 1e3);
+			fflush(stdout);
+			reported = frameEnd;
+			managerTime = simulationTime = drawTime = 0;
+			frames = 0;
+		}
+
+		if (fps > 0)
+		{
+			// cap the frame rate, but yield to the OS when too slow
+			double wait = 1.0 / fps - (Clock::Seconds() - frameStart);
+			SleepSeconds((wait > 0.001)? wait: 0.001);
+		}
+	}
+
+	manager.Shutdown();
+	return 0;
+}
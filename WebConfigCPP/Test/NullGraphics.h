@@ -0,0 +1,34 @@
+// WebConfig - Use a web browser to configure your application
+// Copyright (c) 2009 David McClurg <dpm@efn.org>
+// Under the MIT License, details: License.txt.
+
+#ifndef NULLGRAPHICS_H
+#define NULLGRAPHICS_H
+
+/// <summary>
+/// The part of winbgi the simulation draws with, drawing nothing, for
+/// running it where there is no window. The screen is 640x480 like the
+/// sample application's.
+/// </summary>
+namespace WinBGI
+{
+	enum colors
+	{
+		BLACK, BLUE, GREEN, CYAN, RED, MAGENT, BROWN, LIGHTGRAY, DARKGRAY,
+		LIGHTBLUE, LIGHTGREEN, LIGHTCYAN, LIGHTRED, LIGHTMAGENTA, YELLOW, WHITE
+	};
+
+	enum fill_patterns
+	{
+		EMPTY_FILL, SOLID_FILL
+	};
+
+	inline int getmaxx() { return 639; }
+	inline int getmaxy() { return 479; }
+	inline void setcolor(int) {}
+	inline void setfillstyle(int, int) {}
+	inline void fillellipse(int, int, int, int) {}
+	inline void outtextxy(int, int, char const*) {}
+}
+
+#endif // #ifndef NULLGRAPHICS_H
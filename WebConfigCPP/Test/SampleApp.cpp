@@ -47,8 +47,7 @@ namespace SampleApp
 
 	void CaptureScreen()
 	{
-		string path = WebConfig::Manager::Instance().GetFolder() + "\\Screen.BMP";
-		CaptureScreen(WinBGI::gethandle(), path);
+		CaptureScreen(WinBGI::gethandle(), "/Screen.png");
 	}
 
 	void Run()
@@ -84,7 +83,23 @@ namespace SampleApp
 		new WebConfig::InputSliderInt("debug/fun", fun);
 
 		new WebConfig::InputButton("debug/Capture Screen", CaptureScreen);
-		new WebConfig::InputLink("debug/View Screen", "Screen.BMP");
+		new WebConfig::InputLink("debug/View Screen", "Screen.png");
+
+		// live view of the window at half size
+		WindowSource window(WinBGI::gethandle());
+		WebConfig::ImageStream* liveView = WebConfig::Manager::Instance().AddImageStream("/live.mjpg", &window);
+		liveView->SetFrameRate(15);
+		liveView->SetResolution(320, 240);
+		new WebConfig::InputLink("debug/Live View", "live.mjpg");
+
+		// graphs of values that change every frame
+		long frameTime = 0;
+		int ballCount = 0;
+		new WebConfig::InputWatch<long>("debug/frame time (ms)", frameTime);
+		new WebConfig::InputWatch<int>("debug/balls", ballCount);
+
+		// presets of the tuning; 'f' flips between the A and B picked on the form
+		WebConfig::Manager::Instance().AddPresetForm();
 
 		//Main Loop
 		while (!WinBGI::quitgraph())
@@ -100,6 +115,9 @@ namespace SampleApp
 					WinBGI::closegraph();
 					break;
 				}
+				else if (KeyPressed == 'f') {
+					WebConfig::Manager::Instance().FlipPresets();
+				}
 			}
 
 			WebConfig::Manager::Instance().Update();
@@ -113,6 +131,8 @@ namespace SampleApp
 
 			long timeEnd = timeGetTime();
 			long deltaTime = timeEnd - timeStart;
+			frameTime = deltaTime;
+			ballCount = (int)Simulation::Instance().balls.Count();
 			if (deltaTime < (1000/FPS))
 			{
 				// cap frame frate
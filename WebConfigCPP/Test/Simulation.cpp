@@ -9,8 +9,14 @@
 #include <vector>
 #include <string>
 #include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
 
+#ifdef _WIN32
 #include "winbgi2.h"
+#else
+#include "NullGraphics.h"
+#endif
 
 using namespace std;
 
@@ -66,70 +72,6 @@ namespace SampleApp
 		}
 	};
 
-	/// <summary>
-	/// The ball class
-	/// </summary>
-	class Ball
-	{
-		Vec3 pos;
-		Vec3 vel;
-
-	public:
-
-		Ball()
-		{
-			const Simulation& sim = Simulation::Instance();
-
-			pos.x = (float)WinBGI::getmaxx() / 2 + Random::Next(WinBGI::getmaxx() / 3);
-			pos.y = (float)WinBGI::getmaxy() / 2 + Random::Next(WinBGI::getmaxy() / 3);
-
-			float speed = (float)Random::Next(5, 11); // 5 to 10
-			float angle = (float)Random::Next(0, 360) * PI / 180;
-			vel.x = Math::Cos(angle) * speed;
-			vel.y = Math::Sin(angle) * speed;
-		}
-
-		void Draw()
-		{
-			const Simulation& sim = Simulation::Instance();
-
-			WinBGI::setcolor(sim.BallColor);
-			WinBGI::setfillstyle(WinBGI::SOLID_FILL, sim.BallColor);
-			WinBGI::fillellipse( (int)pos.x, (int)pos.y, 20, 20);
-
-			if (sim.showPos)
-			{
-				char buffer[80];
-				sprintf(buffer, "(%.2f,%.2f)", pos.x, pos.y);
-
-				int off = sim.BallRadius;
-				WinBGI::outtextxy((int)(pos.x + off), (int)(pos.y + off), buffer);
-			}
-		}
-
-		void Move()
-		{
-			const Simulation& sim = Simulation::Instance();
-
-			pos = pos + vel * sim.BallSpeed;
-
-			int w = WinBGI::getmaxx() + 1;
-			int h = WinBGI::getmaxy() + 1;
-
-			// Collide with left and right walls
-			if (pos.x <= 0 || pos.x >= w - sim.BallRadius)
-			{
-				vel.x = -vel.x;
-			}
-
-			// Collide with top and bottom walls
-			if (pos.y <= 0 || pos.y >= h - sim.BallRadius)
-			{
-				vel.y = -vel.y;
-			}
-		}
-	};
-
 	Simulation::Simulation()
 	{
 		numRequested = 10;
@@ -139,35 +81,93 @@ namespace SampleApp
 		BallRadius = 10;
 		BallSpeed = 1;
 		BallColor = WinBGI::RED;
+
+		numThreads = JobSystem::GetProcessorCount();
+		jobs = NULL;
+	}
+
+	Simulation::~Simulation()
+	{
+		delete jobs;
+	}
+
+	/// <summary>
+	/// What every chunk of balls moves by in a frame
+	/// </summary>
+	struct MoveJob
+	{
+		Balls* balls;
+		float speed;
+		float maxX;
+		float maxY;
+	};
+
+	static void MoveChunk(void* arg, int begin, int end)
+	{
+		MoveJob* job = (MoveJob*)arg;
+		job->balls->Move(begin, end, job->speed, job->maxX, job->maxY);
 	}
 
 	void Simulation::Update()
 	{
-		for (int i=0; i<balls.size(); ++i)
+		// the threads are changed here, between frames, where no chunk is running
+		if (numThreads < 1)
+			numThreads = 1;
+		if (jobs == NULL || jobs->GetThreadCount() != numThreads)
 		{
-			balls[i]->Move();
+			delete jobs;
+			jobs = new JobSystem(numThreads);
 		}
+
+		// the walls are the same for every ball
+		int w = WinBGI::getmaxx() + 1;
+		int h = WinBGI::getmaxy() + 1;
+		MoveJob job;
+		job.balls = &balls;
+		job.speed = BallSpeed;
+		job.maxX = (float)(w - BallRadius);
+		job.maxY = (float)(h - BallRadius);
+		jobs->ParallelFor(0, balls.PaddedCount(), ChunkBalls, MoveChunk, &job);
 	}
 
 	void Simulation::Draw()
 	{
-		for (int i=0; i<balls.size(); ++i)
+		WinBGI::setcolor(BallColor);
+		WinBGI::setfillstyle(WinBGI::SOLID_FILL, BallColor);
+		for (int i = 0; i < balls.Count(); ++i)
 		{
-			balls[i]->Draw();
+			WinBGI::fillellipse((int)balls.X[i], (int)balls.Y[i], 20, 20);
+		}
+
+		if (showPos)
+		{
+			for (int i = 0; i < balls.Count(); ++i)
+			{
+				char buffer[80];
+				sprintf(buffer, "(%.2f,%.2f)", balls.X[i], balls.Y[i]);
+
+				int off = BallRadius;
+				WinBGI::outtextxy((int)(balls.X[i] + off), (int)(balls.Y[i] + off), buffer);
+			}
 		}
 	}
 
 	void Simulation::Reset()
 	{
-		for (int i=0; i<balls.size(); ++i)
-		{
-			delete balls[i];
-		}
-		balls.clear();
+		int count = (numRequested > 0)? numRequested: 0;
+		balls.Resize(count);
 
-		for (int i = 0; i < numRequested; i++)
+		int w = WinBGI::getmaxx();
+		int h = WinBGI::getmaxy();
+		for (int i = 0; i < count; i++)
 		{
-			balls.push_back(new Ball());
+			balls.X[i] = (float)w / 2 + Random::Next(w / 3);
+			balls.Y[i] = (float)h / 2 + Random::Next(h / 3);
+
+			float speed = (float)Random::Next(5, 11); // 5 to 10
+			float angle = (float)Random::Next(0, 360) * PI / 180;
+			balls.VX[i] = Math::Cos(angle) * speed;
+			balls.VY[i] = Math::Sin(angle) * speed;
 		}
 	}
 
@@ -184,7 +184,10 @@ namespace SampleApp
 
 		new WebConfig::InputButton("game/Reset", StartAnimation);
 
-		(new WebConfig::InputSliderInt("game/Number of Balls", numRequested))->SetCallback(StartAnimation);
+		WebConfig::InputSliderInt* number = new WebConfig::InputSliderInt("game/Number of Balls", numRequested);
+		number->SetRange(0, 2000000, 0);
+		number->SetCallback(StartAnimation);
+		(new WebConfig::InputSliderInt("game/Threads", numThreads))->SetRange(1, (float)(JobSystem::GetProcessorCount() * 2), 0);
 		(new WebConfig::InputSliderInt("game/Ball Radius", BallRadius))->SetRange(0, 20, 0);
 		(new WebConfig::InputSlider("game/Speed Factor", BallSpeed))->SetRange(0.1f, 2, 1);
 
@@ -2,7 +2,9 @@
 // Copyright (c) 2009 David McClurg <dpm@efn.org>
 // Under the MIT License, details: License.txt.
 
-#include <vector>
+#include "Balls.h"
+#include "Support/JobSystem.h"
+
 #include <assert.h>
 
 namespace SampleApp
@@ -16,6 +18,7 @@ namespace SampleApp
 		/// private constructor
 		/// </summary>
 		Simulation();
+		~Simulation();
 
 		Simulation(const Simulation&)
 		{
@@ -44,11 +47,22 @@ namespace SampleApp
         int BallRadius;
         float BallSpeed;
         int BallColor;
-		std::vector<class Ball*> balls;
+		int numThreads;
+		Balls balls;
+
+		/// <summary>
+		/// balls moved by one job; a multiple of Balls::Padding so threads
+		/// never share a cache line
+		/// </summary>
+		enum { ChunkBalls = 16 * 1024 };
 
         void Update();
         void Draw();
         void Reset();
         void Init();
+
+	private:
+
+		JobSystem* jobs;
     };
 }
@@ -1,15 +1,46 @@
 // -*- Mode: C++; tab-width: 4 -*-
 
+// an echo server for async_chat, and a microbenchmark of the reactor
+// built on it.  the benchmark runs the server on a reactor thread of its
+// own and drives it over loopback from client threads, so changes to
+// asyncore.cpp and asynchat.cpp can be measured apart from the http
+// server and the html it generates.
+//
+// usage: echo_server [port]
+//          echo each message ending in "\r\n\r\n" back to its sender
+//
+//        echo_server bench [port] [seconds] [select|epoll|uring]
+//          for each terminator mode, message size and connection count,
+//          report messages per second, throughput and round trip latency.
+//          every connection has one message in flight at a time.  the
+//          modes are "\r\n\r\n", "\n", and null_terminator, where the
+//          server echoes data as it arrives without looking for an end.
+
 #include "Support/asynchat.h"
+#include "Support/Clock.h"
+#include "Support/Thread.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <set>
+#include <algorithm>
+
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <signal.h>
+#define closesocket close
+#endif
 
 using namespace std;
 #include <iostream>
 
-class echo_server : public async_sockets::dispatcher
-{
-  void handle_accept (void);
-};
-
 class echo_channel : public async_sockets::async_chat
 {
   string input_buffer;
@@ -19,15 +50,72 @@ class echo_channel : public async_sockets::async_chat
   void handle_close (void);
 };
 
+class echo_server : public async_sockets::dispatcher
+{
+public:
+  string terminator;			// given to each channel accepted
+  set<echo_channel *> channels;
+
+  echo_server (void) : terminator ("\r\n\r\n") { }
+  ~echo_server (void) { stop(); }
+
+  // delete the channels that have closed
+  void reap (void);
+  // close the listener and every channel
+  void stop (void);
+
+private:
+  void handle_accept (void);
+  void handle_close (void) { }
+};
+
 void
 echo_server::handle_accept (void)
 {
   struct sockaddr addr;
   int addr_len = sizeof(sockaddr);
   int fd = async_sockets::dispatcher::accept (&addr, &addr_len);
+  if (fd < 0) {
+	return;
+  }
+#ifndef _WIN32
+  // an echo is one small write; don't let nagle hold it back
+  int on = 1;
+  setsockopt (fd, IPPROTO_TCP, TCP_NODELAY, (const char *) &on, sizeof (on));
+#endif
   echo_channel * jc = new echo_channel;
+  jc->set_reactor (get_reactor());
   jc->set_fileno (fd);
-  jc->set_terminator ("\r\n\r\n");
+  jc->set_terminator (terminator);
+  channels.insert (jc);
+}
+
+void
+echo_server::reap (void)
+{
+  get_reactor()->delete_closed_channels();
+  for (set<echo_channel *>::iterator i = channels.begin(); i != channels.end(); ) {
+	if ((*i)->closed) {
+	  delete *i;
+	  channels.erase (i++);
+	} else {
+	  ++i;
+	}
+  }
+}
+
+void
+echo_server::stop (void)
+{
+  for (set<echo_channel *>::iterator i = channels.begin(); i != channels.end(); ++i) {
+	if (!(*i)->closed) {
+	  (*i)->close();
+	}
+  }
+  if (accepting && !closed) {
+	close();
+  }
+  reap();
 }
 
 void
@@ -39,6 +127,11 @@ echo_channel::handle_close (void)
 void
 echo_channel::collect_incoming_data (const string& data)
 {
+  // streaming: there is no end to wait for
+  if (get_terminator() == null_terminator) {
+	send (data);
+	return;
+  }
   input_buffer.append (data);
 }
 
@@ -46,11 +139,266 @@ void
 echo_channel::found_terminator (void)
 {
   if (input_buffer.length()) {
-	send (input_buffer + "\r\n\r\n");
+	send (input_buffer + get_terminator());
 	input_buffer.clear(); //.remove();
   }
 }
 
+// ===========================================================================
+// benchmark
+// ===========================================================================
+
+// an echo server polled by a thread of its own
+class bench_server
+{
+public:
+  async_sockets::reactor reactor;
+  echo_server server;
+
+  bench_server (void) : stopping (false) { }
+
+  bool start (int port, const string& terminator)
+  {
+	server.terminator = terminator;
+	server.set_reactor (&reactor);
+	if (!server.create_socket (AF_INET, SOCK_STREAM)) {
+	  return false;
+	}
+
+	struct sockaddr_in addr;
+	memset (&addr, 0, sizeof (addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons (port);
+	addr.sin_addr.s_addr = htonl (INADDR_LOOPBACK);
+	if (server.bind ((struct sockaddr *) &addr, sizeof (addr)) != 0 || server.listen (128) != 0) {
+	  server.close();
+	  return false;
+	}
+	return thread.Start (&bench_server::run, this);
+  }
+
+  void stop (void)
+  {
+	{
+	  MutexLock hold (lock);
+	  stopping = true;
+	}
+	reactor.wake();
+	thread.Join();
+  }
+
+private:
+  Thread thread;
+  Mutex lock;
+  bool stopping;
+
+  static void run (void * arg)
+  {
+	bench_server * self = (bench_server *) arg;
+	for (;;) {
+	  {
+		MutexLock hold (self->lock);
+		if (self->stopping) {
+		  break;
+		}
+	  }
+	  self->reactor.poll();
+	  self->server.reap();
+	}
+	self->server.stop();
+  }
+};
+
+// a thread of blocking clients, each on its own connection
+class bench_client
+{
+public:
+  int port;
+  int connections;
+  string message;
+  size_t reply_length;
+  double until;
+
+  long long messages;
+  int errors;
+  vector<double> latencies;
+  Thread thread;
+
+  bench_client (void) : port (0), connections (0), reply_length (0), until (0), messages (0), errors (0) { }
+
+  static void run (void * arg)
+  {
+	((bench_client *) arg)->loop();
+  }
+
+private:
+  static int connect_to (int port)
+  {
+	int fd = (int) socket (AF_INET, SOCK_STREAM, 0);
+	if (fd < 0) {
+	  return -1;
+	}
+	int on = 1;
+	setsockopt (fd, IPPROTO_TCP, TCP_NODELAY, (const char *) &on, sizeof (on));
+
+	struct sockaddr_in addr;
+	memset (&addr, 0, sizeof (addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons (port);
+	addr.sin_addr.s_addr = inet_addr ("127.0.0.1");
+	if (connect (fd, (struct sockaddr *) &addr, sizeof (addr)) != 0) {
+	  closesocket (fd);
+	  return -1;
+	}
+	return fd;
+  }
+
+  // read until the whole echo is in
+  bool read_reply (int fd)
+  {
+	char buffer[65536];
+	size_t received = 0;
+	while (received < reply_length) {
+	  size_t want = min (reply_length - received, sizeof (buffer));
+	  int n = (int) ::recv (fd, buffer, (int) want, 0);
+	  if (n <= 0) {
+		return false;
+	  }
+	  received += n;
+	}
+	return true;
+  }
+
+  void loop (void)
+  {
+	vector<int> fds;
+	for (int i = 0; i < connections; i++) {
+	  int fd = connect_to (port);
+	  if (fd < 0) {
+		++errors;
+	  } else {
+		fds.push_back (fd);
+	  }
+	}
+
+	vector<double> sent (fds.size());
+	while (Clock::Seconds() < until && !fds.empty()) {
+	  for (unsigned int i = 0; i < fds.size(); i++) {
+		sent[i] = Clock::Seconds();
+		::send (fds[i], message.data(), (int) message.length(), 0);
+	  }
+	  for (unsigned int i = 0; i < fds.size(); i++) {
+		if (!read_reply (fds[i])) {
+		  ++errors;
+		  closesocket (fds[i]);
+		  fds.erase (fds.begin() + i);
+		  sent.erase (sent.begin() + i);
+		  --i;
+		  continue;
+		}
+		latencies.push_back (Clock::Seconds() - sent[i]);
+		++messages;
+	  }
+	}
+
+	for (unsigned int i = 0; i < fds.size(); i++) {
+	  closesocket (fds[i]);
+	}
+  }
+};
+
+static double percentile (vector<double>& samples, int percent)
+{
+  if (samples.empty()) {
+	return 0;
+  }
+  return samples[(samples.size() * percent) / 100];
+}
+
+// serve one mode, size and connection count for a while and print a line
+static void measure (int port, double seconds, const char * mode, const string& terminator,
+					 int size, int connections)
+{
+  bench_server server;
+  if (!server.start (port, terminator)) {
+	printf ("%8s %8d %6d   can't listen on port %d\n", mode, size, connections, port);
+	return;
+  }
+
+  // the payload mustn't contain the terminator
+  string message (size, 'x');
+  message += terminator;
+
+  int threads = min (connections, 4);
+  vector<bench_client *> clients;
+  double start = Clock::Seconds();
+  for (int i = 0; i < threads; i++) {
+	bench_client * client = new bench_client;
+	client->port = port;
+	client->connections = connections / threads + ((i < connections % threads) ? 1 : 0);
+	client->message = message;
+	client->reply_length = message.length();
+	client->until = start + seconds;
+	client->thread.Start (&bench_client::run, client);
+	clients.push_back (client);
+  }
+
+  long long messages = 0;
+  int errors = 0;
+  vector<double> latencies;
+  for (unsigned int i = 0; i < clients.size(); i++) {
+	clients[i]->thread.Join();
+	messages += clients[i]->messages;
+	errors += clients[i]->errors;
+	latencies.insert (latencies.end(), clients[i]->latencies.begin(), clients[i]->latencies.end());
+	delete clients[i];
+  }
+  double elapsed = Clock::Seconds() - start;
+  server.stop();
+
+  sort (latencies.begin(), latencies.end());
+  double rate = messages / elapsed;
+  printf ("%8s %8d %6d %12.0f %9.1f %9.1f %9.1f %7d\n", mode, size, connections, rate,
+		  rate * message.length() * 2 / (1024 * 1024),
+		  percentile (latencies, 50) * 1e6, percentile (latencies, 99) * 1e6, errors);
+}
+
+static int bench (int argc, char * argv[])
+{
+  int port = (argc > 2) ? atoi (argv[2]) : 8889;
+  double seconds = (argc > 3) ? atof (argv[3]) : 1;
+
+  if (argc > 4) {
+	string name = argv[4];
+	async_sockets::reactor::backend_type backend = async_sockets::reactor::backend_select;
+	if (name == "epoll") {
+	  backend = async_sockets::reactor::backend_epoll;
+	} else if (name == "uring") {
+	  backend = async_sockets::reactor::backend_uring;
+	}
+	if (!async_sockets::reactor::set_default_backend (backend)) {
+	  cerr << name << " is not available" << endl;
+	  return 1;
+	}
+  }
+
+  static const char * const mode_names[] = { "crlfcrlf", "newline", "stream" };
+  const string terminators[] = { "\r\n\r\n", "\n", async_sockets::async_chat::null_terminator };
+  static const int sizes[] = { 64, 1024, 16384, 65536 };
+  static const int connection_counts[] = { 1, 16, 64 };
+
+  printf ("%.1f s per run\n\n", seconds);
+  printf ("    mode     size  conns   messages/s      MB/s    p50 us    p99 us  errors\n");
+  for (int m = 0; m < 3; m++) {
+	for (int s = 0; s < 4; s++) {
+	  for (int c = 0; c < 3; c++) {
+		measure (port++, seconds, mode_names[m], terminators[m], sizes[s], connection_counts[c]);
+	  }
+	}
+  }
+  return 0;
+}
+
 #ifdef _WIN32
 void init_winsock (void)
 {
@@ -62,13 +410,20 @@ void init_winsock (void)
 int
 main (int argc, char * argv[])
 {
-  echo_server es;
-  int port = 8888;
-
 #ifdef _WIN32
   init_winsock();
+#else
+  // a client hanging up mustn't kill the server
+  signal (SIGPIPE, SIG_IGN);
 #endif
 
+  if (argc > 1 && string (argv[1]) == "bench") {
+	return bench (argc, argv);
+  }
+
+  echo_server es;
+  int port = 8888;
+
   if (argc < 2) {
 	port = 8888;
   } else {
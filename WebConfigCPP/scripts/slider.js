@@ -103,7 +103,10 @@ function moveSlider(evnt)
 			Math.round(carpedisplay.valuecount * sliderVal / carpeslider.distance);
 		var v = Math.round((sliderPos * carpeslider.scale + carpeslider.from) * // calculate display value
 			Math.pow(10, carpedisplay.decimals)) / Math.pow(10, carpedisplay.decimals);
+		var changed = (carpedisplay.value != v);
 		carpedisplay.value = v; // put the new value in the slider display element
+		if (changed && carpedisplay.onchange && webconfigConnected())
+			webconfigSend(carpedisplay); // live update while dragging
 		return false;
 	}
 	return
@@ -201,4 +204,224 @@ function carpeInit() // Set up the sliders and the displays.
 		carpedisplays[i].onfocus = focusDisplay; // Attach event listener.
 	}
 }
-carpeAddLoadEvent(carpeInit);
\ No newline at end of file
+carpeAddLoadEvent(carpeInit);
+
+//---------------------------------+
+//  WebConfig live updates         |
+//---------------------------------+
+
+// Auto-submit inputs send just their own "id=value" over a WebSocket
+// instead of posting the whole form. The server pushes values back in
+// the same format whenever an input changes.
+var webconfigSocket = null;
+
+// webconfigConnected: True when values can go over the WebSocket.
+function webconfigConnected()
+{
+	return (webconfigSocket != null) && (webconfigSocket.readyState == 1);
+}
+// webconfigSend: Sends one changed input; falls back to a form post.
+function webconfigSend(input)
+{
+	if (webconfigConnected()) {
+		webconfigSocket.send(encodeURIComponent(input.name) + '=' + encodeURIComponent(input.value));
+	}
+	else if (input.form) {
+		input.form.submit();
+	}
+}
+// webconfigSetSlider: Moves the slider associated with a display element.
+function webconfigSetSlider(display, value)
+{
+	var slider = document.getElementById(display.name);
+	if (!slider) return;
+	var dist = parseInt(slider.getAttribute('distance'));
+	dist = dist ? dist : carpeDefaultSliderLength;
+	var from = parseFloat(display.getAttribute('from'));
+	var to = parseFloat(display.getAttribute('to'));
+	if (isNaN(from) || isNaN(to) || to == from) return;
+	var pos = Math.round((parseFloat(value) - from) * dist / (to - from));
+	pos = (pos < 0) ? 0 : ((pos > dist) ? dist : pos);
+	carpeLeft(display.name, pos);
+}
+// webconfigReceive: Applies values pushed by the server.
+function webconfigReceive(data)
+{
+	var pairs = data.split('&');
+	for (var i = 0; i < pairs.length; i++) {
+		var nameValue = pairs[i].split('=');
+		if (nameValue.length != 2) continue;
+		var name = decodeURIComponent(nameValue[0]);
+		var value = decodeURIComponent(nameValue[1].replace(/\+/g, ' '));
+		var els = document.getElementsByName(name);
+		for (var j = 0; j < els.length; j++) {
+			var el = els[j];
+			if (el.type == 'radio') {
+				var on = (value.charAt(0) == '1' || value.charAt(0) == 't' || value.charAt(0) == 'T');
+				el.checked = ((el.value == 'True') == on);
+			}
+			else if (el.type == 'button' || el.type == 'hidden') {
+				// buttons have no value to show
+			}
+			else if (el.className.indexOf(carpeSliderDisplayClassName) >= 0) {
+				if (carpemouseover && carpedisplay == el) continue; // being dragged here
+				el.value = value;
+				webconfigSetSlider(el, value);
+			}
+			else if (el != document.activeElement) {
+				el.value = value;
+			}
+		}
+	}
+}
+// webconfigConnect: Opens the WebSocket back to the page's server.
+function webconfigConnect()
+{
+	if (!window.WebSocket) return;
+	webconfigSocket = new WebSocket('ws://' + window.location.host + '/ws');
+	webconfigSocket.onmessage = function(evnt) { webconfigReceive(evnt.data); };
+	webconfigSocket.onclose = function() { webconfigSocket = null; };
+}
+carpeAddLoadEvent(webconfigConnect);
+//---------------------------------+
+//  WebConfig watches              |
+//---------------------------------+
+
+// Watches are canvases of class webconfig_watch. Their samples are
+// fetched from /api/watch a few times a second; each request sends the
+// cursor of the last reply so only new samples come back.
+var webconfigWatchClassName = 'webconfig_watch';
+var webconfigWatchInterval  = 250; // milliseconds between fetches
+var webconfigWatches        = [];
+
+// webconfigDrawWatch: Draws the samples of a watch as a sparkline.
+function webconfigDrawWatch(watch)
+{
+	var canvas = watch.canvas;
+	var samples = watch.samples;
+	var context = canvas.getContext('2d');
+	context.clearRect(0, 0, canvas.width, canvas.height);
+	if (samples.length == 0) return;
+
+	var low = samples[0], high = samples[0];
+	for (var i = 1; i < samples.length; i++) {
+		low = Math.min(low, samples[i]);
+		high = Math.max(high, samples[i]);
+	}
+	var range = (high > low) ? (high - low) : 1;
+	var step = canvas.width / Math.max(samples.length - 1, 1);
+	context.beginPath();
+	for (var i = 0; i < samples.length; i++) {
+		var y = canvas.height - 1 - (samples[i] - low) * (canvas.height - 2) / range;
+		if (i == 0) context.moveTo(0, y);
+		else context.lineTo(i * step, y);
+	}
+	context.strokeStyle = '#36c';
+	context.stroke();
+
+	var label = document.getElementById(canvas.id + '_value');
+	if (label) label.innerHTML = samples[samples.length - 1] + ' (' + low + ' .. ' + high + ')';
+}
+// webconfigFetchWatches: Asks for the samples taken since each cursor.
+function webconfigFetchWatches()
+{
+	var query = [];
+	for (var i = 0; i < webconfigWatches.length; i++)
+		query.push(encodeURIComponent(webconfigWatches[i].canvas.id) + '=' + webconfigWatches[i].cursor);
+	var request = new XMLHttpRequest();
+	request.open('GET', '/api/watch?' + query.join('&'), true);
+	request.onreadystatechange = function() {
+		if (request.readyState != 4) return;
+		if (request.status == 200) {
+			var reply = JSON.parse(request.responseText);
+			for (var i = 0; i < webconfigWatches.length; i++) {
+				var watch = webconfigWatches[i];
+				var update = reply[watch.canvas.id];
+				if (!update) continue;
+				watch.cursor = update.cursor;
+				watch.samples = watch.samples.concat(update.samples);
+				if (watch.samples.length > watch.canvas.width)
+					watch.samples = watch.samples.slice(watch.samples.length - watch.canvas.width);
+				webconfigDrawWatch(watch);
+			}
+		}
+		setTimeout(webconfigFetchWatches, webconfigWatchInterval);
+	};
+	request.send(null);
+}
+// webconfigInitWatches: Starts fetching if the page has any watches.
+function webconfigInitWatches()
+{
+	var canvases = carpeGetElementsByClass(webconfigWatchClassName);
+	for (var i = 0; i < canvases.length; i++) {
+		if (!canvases[i].getContext) continue; // no canvas support
+		webconfigWatches.push({ canvas: canvases[i], cursor: 0, samples: [] });
+	}
+	if (webconfigWatches.length > 0 && window.XMLHttpRequest && window.JSON)
+		webconfigFetchWatches();
+}
+carpeAddLoadEvent(webconfigInitWatches);
+
+// Telemetry graphs are canvases of class webconfig_telemetry. Each fetch
+// asks for the last 'window' seconds in as many buckets as the canvas is
+// wide, and draws the min to max band with the mean through it.
+var webconfigTelemetryClassName = 'webconfig_telemetry';
+
+// webconfigDrawTelemetry: Draws [time, min, max, mean] buckets.
+function webconfigDrawTelemetry(canvas, window, buckets)
+{
+	var context = canvas.getContext('2d');
+	context.clearRect(0, 0, canvas.width, canvas.height);
+	if (buckets.length == 0) return;
+
+	var low = buckets[0][1], high = buckets[0][2];
+	for (var i = 1; i < buckets.length; i++) {
+		low = Math.min(low, buckets[i][1]);
+		high = Math.max(high, buckets[i][2]);
+	}
+	var range = (high > low) ? (high - low) : 1;
+	function x(time) { return (time + window) * canvas.width / window; }
+	function y(value) { return canvas.height - 1 - (value - low) * (canvas.height - 2) / range; }
+
+	context.fillStyle = '#bcd';
+	for (var i = 0; i < buckets.length; i++) {
+		var top = y(buckets[i][2]);
+		context.fillRect(x(buckets[i][0]), top, 1, Math.max(y(buckets[i][1]) - top, 1));
+	}
+	context.beginPath();
+	for (var i = 0; i < buckets.length; i++) {
+		if (i == 0) context.moveTo(x(buckets[i][0]), y(buckets[i][3]));
+		else context.lineTo(x(buckets[i][0]), y(buckets[i][3]));
+	}
+	context.strokeStyle = '#36c';
+	context.stroke();
+
+	var label = document.getElementById(canvas.id + '_value');
+	if (label) label.innerHTML = buckets[buckets.length - 1][3].toPrecision(4) + ' (' + low + ' .. ' + high + ')';
+}
+// webconfigFetchTelemetry: Keeps one graph fetching.
+function webconfigFetchTelemetry(canvas)
+{
+	var window = parseFloat(canvas.getAttribute('window')) || 10;
+	var request = new XMLHttpRequest();
+	request.open('GET', '/api/telemetry/' + encodeURIComponent(canvas.getAttribute('telemetry')) +
+		'?start=' + (-window) + '&end=0&count=' + canvas.width, true);
+	request.onreadystatechange = function() {
+		if (request.readyState != 4) return;
+		if (request.status == 200)
+			webconfigDrawTelemetry(canvas, window, JSON.parse(request.responseText).buckets);
+		setTimeout(function() { webconfigFetchTelemetry(canvas); }, webconfigWatchInterval);
+	};
+	request.send(null);
+}
+// webconfigInitTelemetry: Starts each graph on the page.
+function webconfigInitTelemetry()
+{
+	if (!window.XMLHttpRequest || !window.JSON) return;
+	var canvases = carpeGetElementsByClass(webconfigTelemetryClassName);
+	for (var i = 0; i < canvases.length; i++) {
+		if (canvases[i].getContext)
+			webconfigFetchTelemetry(canvases[i]);
+	}
+}
+carpeAddLoadEvent(webconfigInitTelemetry);